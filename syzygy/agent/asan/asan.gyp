@@ -26,9 +26,13 @@
         'allocators_impl.h',
         'block.cc',
         'block.h',
+        'block_checksum.cc',
+        'block_checksum.h',
         'block_impl.h',
         'block_utils.cc',
         'block_utils.h',
+        'check_access_sampler.cc',
+        'check_access_sampler.h',
         'circular_queue.h',
         'circular_queue_impl.h',
         'constants.cc',
@@ -77,6 +81,8 @@
         'quarantine.h',
         'quarantines/sharded_quarantine.h',
         'quarantines/sharded_quarantine_impl.h',
+        'quarantines/size_class_quarantine.h',
+        'quarantines/size_class_quarantine_impl.h',
         'quarantines/size_limited_quarantine.h',
         'quarantines/size_limited_quarantine_impl.h',
         'reporters/breakpad_reporter.cc',
@@ -102,6 +108,8 @@
         'shadow_impl.h',
         'shadow_marker.cc',
         'shadow_marker.h',
+        'shadow_simd.cc',
+        'shadow_simd.h',
         'stack_capture_cache.cc',
         'stack_capture_cache.h',
         'system_interceptors.cc',
@@ -112,6 +120,7 @@
         'windows_heap_adapter.h',
       ],
       'dependencies': [
+        '<(src)/syzygy/agent/common/common.gyp:agent_common_lib',
         '<(src)/syzygy/crashdata/crashdata.gyp:crashdata_lib',
         '<(src)/syzygy/common/common.gyp:common_lib',
         '<(src)/syzygy/trace/client/client.gyp:rpc_client_lib',
@@ -171,8 +180,10 @@
       'sources': [
         'allocators_unittest.cc',
         'crt_interceptors_unittest.cc',
+        'block_checksum_unittest.cc',
         'block_unittest.cc',
         'block_utils_unittest.cc',
+        'check_access_sampler_unittest.cc',
         'circular_queue_unittest.cc',
         'error_info_unittest.cc',
         'heap_checker_unittest.cc',
@@ -189,6 +200,7 @@
         'runtime_unittest.cc',
         'scoped_page_protections_unittest.cc',
         'shadow_marker_unittest.cc',
+        'shadow_simd_unittest.cc',
         'shadow_unittest.cc',
         'stack_capture_cache_unittest.cc',
         'system_interceptors_unittest.cc',
@@ -203,6 +215,7 @@
         'heap_managers/deferred_free_thread_unittest.cc',
         'memory_notifiers/shadow_memory_notifier_unittest.cc',
         'quarantines/sharded_quarantine_unittest.cc',
+        'quarantines/size_class_quarantine_unittest.cc',
         'quarantines/size_limited_quarantine_unittest.cc',
         'reporters/breakpad_reporter_unittest.cc',
         'reporters/crashpad_reporter_unittest.cc',
@@ -16,8 +16,8 @@
 
 #include <algorithm>
 
-#include "base/hash.h"
 #include "base/logging.h"
+#include "syzygy/agent/asan/block_checksum.h"
 #include "syzygy/agent/asan/runtime.h"
 #include "syzygy/agent/asan/shadow.h"
 #include "syzygy/agent/asan/stack_capture_cache.h"
@@ -431,21 +431,28 @@ void BlockSetChecksum(const BlockInfo& block_info) {
     case ALLOCATED_BLOCK:
     case QUARANTINED_FLOODED_BLOCK: {
       // Only checksum the header and trailer regions.
-      checksum = base::SuperFastHash(
-          reinterpret_cast<const char*>(block_info.header),
-          block_info.TotalHeaderSize());
-      checksum ^= base::SuperFastHash(
-          reinterpret_cast<const char*>(block_info.trailer_padding),
-          block_info.TotalTrailerSize());
+      checksum = BlockChecksumRange(block_info.header,
+                                    block_info.TotalHeaderSize());
+      checksum ^= BlockChecksumRange(block_info.trailer_padding,
+                                     block_info.TotalTrailerSize());
       break;
     }
 
     // The checksum is the calculated in the same way in these two cases.
     case QUARANTINED_BLOCK:
     case FREED_BLOCK: {
-      checksum = base::SuperFastHash(
-          reinterpret_cast<const char*>(block_info.header),
-          block_info.block_size);
+      if (BlockChecksumSamplesBody(block_info.body_size)) {
+        // Large bodies are only partially covered, but the header and the
+        // trailer are always checksummed in their entirety.
+        checksum = BlockChecksumRange(block_info.header,
+                                      block_info.TotalHeaderSize());
+        checksum ^= BlockChecksumRange(block_info.trailer_padding,
+                                       block_info.TotalTrailerSize());
+        checksum ^= BlockChecksumSampledBody(block_info.body,
+                                             block_info.body_size);
+        break;
+      }
+      checksum = BlockChecksumRange(block_info.header, block_info.block_size);
       break;
     }
   }
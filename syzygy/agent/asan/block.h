@@ -429,7 +429,8 @@ uint32_t BlockCalculateChecksum(const BlockInfo& block_info);
 // @note The pages containing the block must be writable and readable.
 bool BlockChecksumIsValid(const BlockInfo& block_info);
 
-// Calculates and sets the block checksum in place.
+// Calculates and sets the block checksum in place. The hashing algorithm and
+// the body sampling are configured via SetBlockChecksumOptions.
 // @param block_info The block to be checksummed.
 // @note The pages containing the block must be writable and readable.
 void BlockSetChecksum(const BlockInfo& block_info);
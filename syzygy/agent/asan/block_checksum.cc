@@ -0,0 +1,201 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/block_checksum.h"
+
+#if defined(_M_IX86) || defined(_M_X64)
+#define BLOCK_CHECKSUM_USE_SSE42
+#include <intrin.h>
+#include <nmmintrin.h>
+#endif
+
+#include <algorithm>
+
+#include "base/hash.h"
+#include "base/logging.h"
+#include "base/macros.h"
+
+namespace agent {
+namespace asan {
+
+namespace {
+
+// The reflected CRC32C (Castagnoli) polynomial.
+const uint32_t kCrc32cPolynomial = 0x82F63B78;
+
+// The lookup table used by the software CRC32C implementation. This is
+// lazily initialized.
+uint32_t crc32c_table[256] = {};
+bool crc32c_table_initialized = false;
+
+// The current configuration. These are only modified at runtime setup, before
+// any block is checksummed.
+BlockChecksumAlgorithm block_checksum_algorithm = kSuperFastHashBlockChecksum;
+uint32_t block_checksum_body_sample_size = 0;
+bool use_hardware_crc32c = false;
+
+void InitializeCrc32cTable() {
+  if (crc32c_table_initialized)
+    return;
+  for (uint32_t i = 0; i < arraysize(crc32c_table); ++i) {
+    uint32_t crc = i;
+    for (size_t j = 0; j < 8; ++j)
+      crc = (crc >> 1) ^ ((crc & 1) ? kCrc32cPolynomial : 0);
+    crc32c_table[i] = crc;
+  }
+  crc32c_table_initialized = true;
+}
+
+inline uint32_t RotateLeft(uint32_t value, uint32_t bits) {
+  return (value << bits) | (value >> (32 - bits));
+}
+
+}  // namespace
+
+bool SetBlockChecksumOptions(uint32_t algorithm, uint32_t body_sample_size) {
+  bool valid = true;
+  if (algorithm >= kBlockChecksumAlgorithmMax) {
+    LOG(ERROR) << "Invalid block checksum algorithm: " << algorithm << ".";
+    algorithm = kSuperFastHashBlockChecksum;
+    valid = false;
+  }
+
+  block_checksum_algorithm = static_cast<BlockChecksumAlgorithm>(algorithm);
+  block_checksum_body_sample_size = body_sample_size;
+  use_hardware_crc32c = internal::CpuSupportsCrc32c();
+  if (block_checksum_algorithm == kCrc32cBlockChecksum && !use_hardware_crc32c)
+    InitializeCrc32cTable();
+
+  return valid;
+}
+
+BlockChecksumAlgorithm GetBlockChecksumAlgorithm() {
+  return block_checksum_algorithm;
+}
+
+uint32_t GetBlockChecksumBodySampleSize() {
+  return block_checksum_body_sample_size;
+}
+
+uint32_t BlockChecksumRange(const void* data, uint32_t length) {
+  DCHECK(data != nullptr || length == 0);
+
+  if (block_checksum_algorithm == kCrc32cBlockChecksum) {
+    if (use_hardware_crc32c)
+      return internal::Crc32cHardware(0, data, length);
+    return internal::Crc32cSoftware(0, data, length);
+  }
+
+  return base::SuperFastHash(reinterpret_cast<const char*>(data),
+                             static_cast<int>(length));
+}
+
+bool BlockChecksumSamplesBody(uint32_t body_size) {
+  if (block_checksum_body_sample_size == 0)
+    return false;
+  uint32_t threshold = std::max(block_checksum_body_sample_size,
+                                2 * kBlockChecksumSampleWindowSize);
+  return body_size > threshold;
+}
+
+uint32_t BlockChecksumSampledBody(const void* body, uint32_t body_size) {
+  DCHECK_NE(static_cast<const void*>(nullptr), body);
+  DCHECK(BlockChecksumSamplesBody(body_size));
+
+  // The windows are evenly spaced, with the first one at the start of the body
+  // and the last one at its end. As the body is strictly larger than the total
+  // size of the windows they never overlap.
+  uint32_t window_count = std::max(
+      2u, block_checksum_body_sample_size / kBlockChecksumSampleWindowSize);
+  uint32_t last_offset = body_size - kBlockChecksumSampleWindowSize;
+  uint32_t stride = last_offset / (window_count - 1);
+  DCHECK_LE(kBlockChecksumSampleWindowSize, stride);
+
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(body);
+  uint32_t checksum = 0;
+  for (uint32_t i = 0; i < window_count; ++i) {
+    uint32_t offset = i + 1 == window_count ? last_offset : i * stride;
+    checksum = RotateLeft(checksum, 5) ^
+        BlockChecksumRange(bytes + offset, kBlockChecksumSampleWindowSize);
+  }
+
+  return checksum;
+}
+
+namespace internal {
+
+bool CpuSupportsCrc32c() {
+#ifdef BLOCK_CHECKSUM_USE_SSE42
+  // The SSE4.2 support is indicated by bit 20 of ECX for CPUID function 1.
+  int cpu_info[4] = {};
+  __cpuid(cpu_info, 1);
+  return (cpu_info[2] & (1 << 20)) != 0;
+#else
+  return false;
+#endif
+}
+
+uint32_t Crc32cSoftware(uint32_t crc, const void* data, uint32_t length) {
+  InitializeCrc32cTable();
+
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+  crc = ~crc;
+  for (uint32_t i = 0; i < length; ++i)
+    crc = crc32c_table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+}
+
+uint32_t Crc32cHardware(uint32_t crc, const void* data, uint32_t length) {
+#ifdef BLOCK_CHECKSUM_USE_SSE42
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+  const uint8_t* end = bytes + length;
+  crc = ~crc;
+
+  // Process the unaligned head a byte at a time.
+  while (bytes < end && (reinterpret_cast<uintptr_t>(bytes) & 7) != 0) {
+    crc = _mm_crc32_u8(crc, *bytes);
+    ++bytes;
+  }
+
+  // Process the aligned middle a machine word at a time.
+#ifdef _M_X64
+  uint64_t crc64 = crc;
+  while (end - bytes >= 8) {
+    crc64 = _mm_crc32_u64(crc64, *reinterpret_cast<const uint64_t*>(bytes));
+    bytes += 8;
+  }
+  crc = static_cast<uint32_t>(crc64);
+#else
+  while (end - bytes >= 4) {
+    crc = _mm_crc32_u32(crc, *reinterpret_cast<const uint32_t*>(bytes));
+    bytes += 4;
+  }
+#endif
+
+  // Process the tail.
+  while (bytes < end) {
+    crc = _mm_crc32_u8(crc, *bytes);
+    ++bytes;
+  }
+
+  return ~crc;
+#else
+  return Crc32cSoftware(crc, data, length);
+#endif
+}
+
+}  // namespace internal
+
+}  // namespace asan
+}  // namespace agent
@@ -0,0 +1,103 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the hashing engine used to compute block checksums. The algorithm
+// is selected once at runtime setup via the AsanParameters, and the bodies of
+// large quarantined blocks may optionally be sampled rather than hashed in
+// their entirety, trading some detection of use-after-free writes for a
+// cheaper free path.
+
+#ifndef SYZYGY_AGENT_ASAN_BLOCK_CHECKSUM_H_
+#define SYZYGY_AGENT_ASAN_BLOCK_CHECKSUM_H_
+
+#include <stdint.h>
+
+namespace agent {
+namespace asan {
+
+// The algorithms that can be used to compute block checksums. These values
+// are persisted in AsanParameters::block_checksum_algorithm, so they must not
+// be renumbered.
+enum BlockChecksumAlgorithm : uint32_t {
+  // base::SuperFastHash. This is the historical algorithm.
+  kSuperFastHashBlockChecksum = 0,
+  // CRC32C. This uses the SSE4.2 CRC32 instruction when the CPU supports it,
+  // and a table driven implementation otherwise.
+  kCrc32cBlockChecksum = 1,
+
+  kBlockChecksumAlgorithmMax,
+};
+
+// The size of each of the windows that are hashed when sampling the body of
+// a block.
+static constexpr uint32_t kBlockChecksumSampleWindowSize = 256;
+
+// Configures the block checksum engine. This must be called before any block
+// checksum is calculated, as changing the configuration invalidates all of the
+// existing checksums.
+// @param algorithm The algorithm to use. An invalid value causes the default
+//     algorithm to be used.
+// @param body_sample_size The number of bytes to sample from the body of
+//     quarantined blocks, or 0 to always hash the full body.
+// @returns true on success, false if @p algorithm was invalid.
+bool SetBlockChecksumOptions(uint32_t algorithm, uint32_t body_sample_size);
+
+// @returns the currently configured block checksum algorithm.
+BlockChecksumAlgorithm GetBlockChecksumAlgorithm();
+
+// @returns the currently configured body sample size.
+uint32_t GetBlockChecksumBodySampleSize();
+
+// Hashes a range of memory using the configured algorithm.
+// @param data The range to hash.
+// @param length The length of the range.
+// @returns the hash value.
+uint32_t BlockChecksumRange(const void* data, uint32_t length);
+
+// Determines if the body of a block of the given size is sampled, as opposed
+// to fully hashed.
+// @param body_size The size of the body of the block.
+// @returns true if the body will be sampled.
+bool BlockChecksumSamplesBody(uint32_t body_size);
+
+// Hashes evenly spaced windows of a block body using the configured algorithm.
+// The first and the last bytes of the body are always covered. This should
+// only be called if BlockChecksumSamplesBody returns true for @p body_size.
+// @param body The body to hash.
+// @param body_size The size of the body.
+// @returns the hash value.
+uint32_t BlockChecksumSampledBody(const void* body, uint32_t body_size);
+
+namespace internal {
+
+// @returns true if the CPU supports the SSE4.2 CRC32 instruction.
+bool CpuSupportsCrc32c();
+
+// Computes or extends a CRC32C. These can be chained, such that
+// Crc32c(Crc32c(0, a), b) is the CRC32C of the concatenation of a and b.
+// @param crc The CRC32C of the preceding data, or 0.
+// @param data The data to process.
+// @param length The length of the data.
+// @returns the updated CRC32C.
+// @{
+uint32_t Crc32cSoftware(uint32_t crc, const void* data, uint32_t length);
+uint32_t Crc32cHardware(uint32_t crc, const void* data, uint32_t length);
+// @}
+
+}  // namespace internal
+
+}  // namespace asan
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_ASAN_BLOCK_CHECKSUM_H_
@@ -0,0 +1,146 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/block_checksum.h"
+
+#include <string.h>
+#include <vector>
+
+#include "base/hash.h"
+#include "gtest/gtest.h"
+
+namespace agent {
+namespace asan {
+
+namespace {
+
+class BlockChecksumTest : public testing::Test {
+ public:
+  void TearDown() override {
+    // Restore the default configuration for the other tests.
+    EXPECT_TRUE(SetBlockChecksumOptions(kSuperFastHashBlockChecksum, 0));
+    testing::Test::TearDown();
+  }
+};
+
+}  // namespace
+
+TEST_F(BlockChecksumTest, Crc32cKnownValues) {
+  static const char kCheck[] = "123456789";
+  EXPECT_EQ(0xE3069283u, internal::Crc32cSoftware(0, kCheck, 9));
+  EXPECT_EQ(0u, internal::Crc32cSoftware(0, kCheck, 0));
+
+  // These come from the iSCSI specification (RFC 3720, B.4).
+  uint8_t buffer[32] = {};
+  EXPECT_EQ(0x8A9136AAu,
+            internal::Crc32cSoftware(0, buffer, sizeof(buffer)));
+  ::memset(buffer, 0xFF, sizeof(buffer));
+  EXPECT_EQ(0x62A8AB43u,
+            internal::Crc32cSoftware(0, buffer, sizeof(buffer)));
+}
+
+TEST_F(BlockChecksumTest, Crc32cChains) {
+  static const char kCheck[] = "123456789";
+  uint32_t crc = internal::Crc32cSoftware(0, kCheck, 4);
+  EXPECT_EQ(0xE3069283u, internal::Crc32cSoftware(crc, kCheck + 4, 5));
+}
+
+TEST_F(BlockChecksumTest, Crc32cHardwareMatchesSoftware) {
+  if (!internal::CpuSupportsCrc32c())
+    return;
+
+  std::vector<uint8_t> buffer(1024);
+  for (size_t i = 0; i < buffer.size(); ++i)
+    buffer[i] = static_cast<uint8_t>(i * 37 + 11);
+
+  // Test every head alignment with a variety of lengths.
+  for (uint32_t offset = 0; offset < 16; ++offset) {
+    for (uint32_t length = 0; length < 64; ++length) {
+      EXPECT_EQ(internal::Crc32cSoftware(0, buffer.data() + offset, length),
+                internal::Crc32cHardware(0, buffer.data() + offset, length));
+    }
+    uint32_t length = static_cast<uint32_t>(buffer.size()) - offset;
+    EXPECT_EQ(internal::Crc32cSoftware(0, buffer.data() + offset, length),
+              internal::Crc32cHardware(0, buffer.data() + offset, length));
+  }
+}
+
+TEST_F(BlockChecksumTest, SetBlockChecksumOptions) {
+  EXPECT_EQ(kSuperFastHashBlockChecksum, GetBlockChecksumAlgorithm());
+  EXPECT_EQ(0u, GetBlockChecksumBodySampleSize());
+
+  EXPECT_TRUE(SetBlockChecksumOptions(kCrc32cBlockChecksum, 4096));
+  EXPECT_EQ(kCrc32cBlockChecksum, GetBlockChecksumAlgorithm());
+  EXPECT_EQ(4096u, GetBlockChecksumBodySampleSize());
+
+  // An invalid algorithm falls back to the default one.
+  EXPECT_FALSE(SetBlockChecksumOptions(kBlockChecksumAlgorithmMax, 0));
+  EXPECT_EQ(kSuperFastHashBlockChecksum, GetBlockChecksumAlgorithm());
+}
+
+TEST_F(BlockChecksumTest, BlockChecksumRange) {
+  static const char kData[] = "The quick brown fox jumps over the lazy dog";
+  const uint32_t kLength = sizeof(kData) - 1;
+
+  EXPECT_EQ(static_cast<uint32_t>(base::SuperFastHash(kData, kLength)),
+            BlockChecksumRange(kData, kLength));
+
+  EXPECT_TRUE(SetBlockChecksumOptions(kCrc32cBlockChecksum, 0));
+  EXPECT_EQ(internal::Crc32cSoftware(0, kData, kLength),
+            BlockChecksumRange(kData, kLength));
+}
+
+TEST_F(BlockChecksumTest, BlockChecksumSamplesBody) {
+  EXPECT_FALSE(BlockChecksumSamplesBody(1024 * 1024));
+
+  EXPECT_TRUE(SetBlockChecksumOptions(kSuperFastHashBlockChecksum, 4096));
+  EXPECT_FALSE(BlockChecksumSamplesBody(4096));
+  EXPECT_TRUE(BlockChecksumSamplesBody(4097));
+
+  // The body must always be larger than two windows to be sampled.
+  EXPECT_TRUE(SetBlockChecksumOptions(kSuperFastHashBlockChecksum, 1));
+  EXPECT_FALSE(BlockChecksumSamplesBody(2 * kBlockChecksumSampleWindowSize));
+  EXPECT_TRUE(
+      BlockChecksumSamplesBody(2 * kBlockChecksumSampleWindowSize + 1));
+}
+
+TEST_F(BlockChecksumTest, BlockChecksumSampledBody) {
+  const uint32_t kSampleSize = 4 * kBlockChecksumSampleWindowSize;
+  const uint32_t kBodySize = 64 * 1024;
+
+  for (uint32_t algorithm = 0; algorithm < kBlockChecksumAlgorithmMax;
+       ++algorithm) {
+    EXPECT_TRUE(SetBlockChecksumOptions(algorithm, kSampleSize));
+    ASSERT_TRUE(BlockChecksumSamplesBody(kBodySize));
+
+    std::vector<uint8_t> body(kBodySize, 0xAB);
+    uint32_t checksum = BlockChecksumSampledBody(body.data(), kBodySize);
+
+    // Modifications to the first and the last bytes are always detected.
+    body.front() ^= 1;
+    EXPECT_NE(checksum, BlockChecksumSampledBody(body.data(), kBodySize));
+    body.front() ^= 1;
+    body.back() ^= 1;
+    EXPECT_NE(checksum, BlockChecksumSampledBody(body.data(), kBodySize));
+    body.back() ^= 1;
+    EXPECT_EQ(checksum, BlockChecksumSampledBody(body.data(), kBodySize));
+
+    // The body is not covered in between the windows.
+    body[kBlockChecksumSampleWindowSize] ^= 1;
+    EXPECT_EQ(checksum, BlockChecksumSampledBody(body.data(), kBodySize));
+  }
+}
+
+}  // namespace asan
+}  // namespace agent
@@ -14,16 +14,20 @@
 
 #include "syzygy/agent/asan/block.h"
 
+#include <algorithm>
 #include <memory>
 #include <set>
 #include <vector>
 
 #include "windows.h"
 
+#include "base/strings/stringprintf.h"
 #include "gtest/gtest.h"
+#include "syzygy/agent/asan/block_checksum.h"
 #include "syzygy/agent/asan/page_protection_helpers.h"
 #include "syzygy/agent/asan/runtime.h"
 #include "syzygy/agent/asan/unittest_util.h"
+#include "syzygy/testing/metrics.h"
 
 namespace agent {
 namespace asan {
@@ -713,6 +717,92 @@ TEST_F(BlockTest, ChecksumDetectsTampering) {
   ASSERT_NO_FATAL_FAILURE(runtime.TearDown());
 }
 
+TEST_F(BlockTest, SampledChecksumDetectsTampering) {
+  ASSERT_TRUE(SetBlockChecksumOptions(kCrc32cBlockChecksum, 4096));
+
+  BlockLayout layout = {};
+  EXPECT_TRUE(BlockPlanLayout(kShadowRatio, kShadowRatio, 64 * 1024, 0, 0,
+                              &layout));
+  std::unique_ptr<uint8_t[]> data(new uint8_t[layout.block_size]);
+  BlockInfo info = {};
+  BlockInitialize(layout, data.get(), &info);
+  info.header->state = QUARANTINED_BLOCK;
+  BlockSetChecksum(info);
+  EXPECT_TRUE(BlockChecksumIsValid(info));
+
+  // The header, the trailer and the ends of the body are always covered.
+  uint8_t* bytes[] = {
+      info.RawHeader(),
+      info.RawBody(),
+      info.RawBody() + info.body_size - 1,
+      info.RawTrailer() + 3,
+  };
+  for (size_t i = 0; i < arraysize(bytes); ++i) {
+    *bytes[i] ^= 0x10;
+    EXPECT_FALSE(BlockChecksumIsValid(info));
+    *bytes[i] ^= 0x10;
+    EXPECT_TRUE(BlockChecksumIsValid(info));
+  }
+
+  // Allocated blocks don't cover their body, so they are unaffected.
+  info.header->state = ALLOCATED_BLOCK;
+  BlockSetChecksum(info);
+  info.RawBody(info.body_size / 2) ^= 0x10;
+  EXPECT_TRUE(BlockChecksumIsValid(info));
+
+  ASSERT_TRUE(SetBlockChecksumOptions(kSuperFastHashBlockChecksum, 0));
+}
+
+TEST_F(BlockTest, ChecksumPerfTest) {
+  struct ChecksumConfig {
+    const char* name;
+    uint32_t algorithm;
+    uint32_t body_sample_size;
+  };
+  const ChecksumConfig kConfigs[] = {
+      { "SuperFastHash", kSuperFastHashBlockChecksum, 0 },
+      { "Crc32c", kCrc32cBlockChecksum, 0 },
+      { "Crc32cSampled", kCrc32cBlockChecksum, 4096 },
+  };
+  const uint32_t kMaxSize = 4 * 1024 * 1024;
+
+  std::unique_ptr<uint8_t[]> data(new uint8_t[2 * kMaxSize]);
+  ::memset(data.get(), 0xAB, 2 * kMaxSize);
+
+  // Emits the average number of cycles spent checksumming a block as it is
+  // freed, for body sizes from 16 bytes to 4 MB.
+  for (size_t i = 0; i < arraysize(kConfigs); ++i) {
+    ASSERT_TRUE(SetBlockChecksumOptions(kConfigs[i].algorithm,
+                                        kConfigs[i].body_sample_size));
+    for (uint32_t size = 16; size <= kMaxSize; size *= 4) {
+      BlockLayout layout = {};
+      EXPECT_TRUE(BlockPlanLayout(kShadowRatio, kShadowRatio, size, 0, 0,
+                                  &layout));
+      ASSERT_GE(2 * kMaxSize, layout.block_size);
+      BlockInfo info = {};
+      BlockInitialize(layout, data.get(), &info);
+      info.header->state = QUARANTINED_BLOCK;
+
+      const uint32_t kIterations =
+          std::min(10000u, std::max(4u, kMaxSize / size));
+      uint64_t total = 0;
+      for (uint32_t j = 0; j < kIterations; ++j) {
+        uint64_t t0 = ::__rdtsc();
+        BlockSetChecksum(info);
+        uint64_t t1 = ::__rdtsc();
+        total += t1 - t0;
+      }
+
+      testing::EmitMetric(
+          base::StringPrintf("Syzygy.Asan.Block.SetChecksum.%s.%u",
+                             kConfigs[i].name, size),
+          total / kIterations);
+    }
+  }
+
+  ASSERT_TRUE(SetBlockChecksumOptions(kSuperFastHashBlockChecksum, 0));
+}
+
 TEST_F(BlockTest, BlockBodyIsFloodFilled) {
   static char dummy_body[3] = { 0x00, 0x00, 0x00 };
   BlockInfo dummy_info = {};
@@ -0,0 +1,262 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/check_access_sampler.h"
+
+#include <algorithm>
+
+#include "base/atomicops.h"
+#include "base/bind.h"
+#include "base/logging.h"
+#include "base/time/time.h"
+#include "base/win/pe_image.h"
+#include "syzygy/common/process_utils.h"
+
+namespace agent {
+namespace asan {
+
+namespace {
+
+// Accessors for the fields of the sampling table entries, which are
+// concurrently updated by the instrumented code.
+volatile base::subtle::Atomic32* AsAtomic(int32_t* field) {
+  return reinterpret_cast<volatile base::subtle::Atomic32*>(field);
+}
+
+volatile base::subtle::Atomic32* AsAtomic(uint32_t* field) {
+  return reinterpret_cast<volatile base::subtle::Atomic32*>(field);
+}
+
+}  // namespace
+
+CheckAccessSampler::CheckAccessSampler(float sampling_rate)
+    : base_period_(kMaxSamplingPeriod),
+      stop_event_(false, false),
+      thread_running_(false) {
+  if (sampling_rate > 0.0f) {
+    float period = 1.0f / sampling_rate + 0.5f;
+    if (period < static_cast<float>(kMaxSamplingPeriod))
+      base_period_ = std::max(1U, static_cast<uint32_t>(period));
+  }
+}
+
+CheckAccessSampler::~CheckAccessSampler() {
+  DCHECK(!thread_running_);
+}
+
+bool CheckAccessSampler::Start() {
+  DCHECK(!thread_running_);
+
+  // Register for the load notifications before enumerating the modules, so
+  // that none of them is missed. A module that is seen twice is only
+  // registered once. This fails on systems that don't support these
+  // notifications, in which case only the modules that are already loaded
+  // are sampled.
+  if (!dll_watcher_.Init(base::Bind(&CheckAccessSampler::OnDllEvent,
+                                    base::Unretained(this)))) {
+    LOG(WARNING) << "Unable to watch the loaded modules, the modules loaded "
+                 << "later won't be sampled.";
+  }
+
+  ::common::ModuleVector modules;
+  if (!::common::GetCurrentProcessModules(&modules)) {
+    dll_watcher_.Reset();
+    return false;
+  }
+  for (size_t i = 0; i < modules.size(); ++i)
+    AddModule(modules[i]);
+
+  if (!base::PlatformThread::CreateWithPriority(
+          0, this, &thread_, base::ThreadPriority::BACKGROUND)) {
+    LOG(ERROR) << "Unable to start the access check sampling thread.";
+    dll_watcher_.Reset();
+    return false;
+  }
+  thread_running_ = true;
+  return true;
+}
+
+void CheckAccessSampler::Stop() {
+  DCHECK(thread_running_);
+
+  // There won't be any notification after this returns.
+  dll_watcher_.Reset();
+
+  stop_event_.Signal();
+  base::PlatformThread::Join(thread_);
+  thread_running_ = false;
+}
+
+void CheckAccessSampler::SignalStop() {
+  DCHECK(thread_running_);
+
+  dll_watcher_.Reset();
+  stop_event_.Signal();
+}
+
+void CheckAccessSampler::AddModule(HMODULE module) {
+  DCHECK_NE(static_cast<HMODULE>(nullptr), module);
+
+  base::win::PEImage pe_image(module);
+  PIMAGE_SECTION_HEADER section = pe_image.GetImageSectionHeaderByName(
+      ::common::kAsanSamplingTableSectionName);
+  if (section == nullptr)
+    return;
+
+  Entry* entries = reinterpret_cast<Entry*>(
+      reinterpret_cast<uint8_t*>(module) + section->VirtualAddress);
+  size_t entry_count = section->Misc.VirtualSize / sizeof(Entry);
+
+  base::AutoLock lock(lock_);
+  AddTableUnlocked(module, pe_image.GetNTHeaders()->OptionalHeader.SizeOfImage,
+                   entries, entry_count);
+}
+
+void CheckAccessSampler::RemoveModule(HMODULE module) {
+  base::AutoLock lock(lock_);
+  for (size_t i = 0; i < tables_.size(); ++i) {
+    if (tables_[i].module == module) {
+      tables_.erase(tables_.begin() + i);
+      return;
+    }
+  }
+}
+
+void CheckAccessSampler::OnError(const void* pc) {
+  const uint8_t* address = reinterpret_cast<const uint8_t*>(pc);
+
+  base::AutoLock lock(lock_);
+  for (size_t i = 0; i < tables_.size(); ++i) {
+    Table& table = tables_[i];
+    const uint8_t* module = reinterpret_cast<const uint8_t*>(table.module);
+    if (address < module || address >= module + table.module_size)
+      continue;
+
+    // Check every execution of the sites of this module, starting with the
+    // next one.
+    table.boost_update_count = kErrorBoostUpdateCount;
+    for (size_t j = 0; j < table.entry_count; ++j) {
+      Entry* entry = &table.entries[j];
+      base::subtle::NoBarrier_Store(AsAtomic(&entry->reload), 0);
+      base::subtle::NoBarrier_Store(AsAtomic(&entry->countdown), 0);
+    }
+    return;
+  }
+}
+
+void CheckAccessSampler::Update() {
+  base::AutoLock lock(lock_);
+  for (size_t i = 0; i < tables_.size(); ++i)
+    UpdateTableUnlocked(&tables_[i]);
+}
+
+uint32_t CheckAccessSampler::ComputeSamplingPeriod(uint32_t base_period,
+                                                   uint32_t execution_count) {
+  // Every execution is checked when sampling isn't requested, or when the
+  // site is cold.
+  if (base_period <= 1 || execution_count < kHotSiteExecutionCount)
+    return 1;
+
+  // The period grows with the hotness of the site, so that the number of
+  // checks it runs per update stays roughly constant.
+  uint64_t period = static_cast<uint64_t>(base_period) * execution_count /
+      kHotSiteExecutionCount;
+  if (period < base_period)
+    return base_period;
+  if (period > kMaxSamplingPeriod)
+    return kMaxSamplingPeriod;
+  return static_cast<uint32_t>(period);
+}
+
+void CheckAccessSampler::AddTableUnlocked(HMODULE module,
+                                          size_t module_size,
+                                          Entry* entries,
+                                          size_t entry_count) {
+  lock_.AssertAcquired();
+  DCHECK_NE(static_cast<HMODULE>(nullptr), module);
+  DCHECK_NE(static_cast<Entry*>(nullptr), entries);
+
+  for (size_t i = 0; i < tables_.size(); ++i) {
+    if (tables_[i].module == module)
+      return;
+  }
+
+  Table table = { module, module_size, entries, entry_count, 0 };
+  tables_.push_back(table);
+}
+
+void CheckAccessSampler::UpdateTableUnlocked(Table* table) {
+  lock_.AssertAcquired();
+  DCHECK_NE(static_cast<Table*>(nullptr), table);
+
+  // Keep checking every execution for a while after an error.
+  bool boosted = table->boost_update_count != 0;
+  if (boosted)
+    --table->boost_update_count;
+
+  for (size_t i = 0; i < table->entry_count; ++i) {
+    Entry* entry = &table->entries[i];
+
+    // Estimate the number of executions of the site since the last update.
+    uint32_t check_count = static_cast<uint32_t>(
+        base::subtle::NoBarrier_AtomicExchange(AsAtomic(&entry->check_count),
+                                               0));
+    if (boosted)
+      continue;
+    uint32_t period = static_cast<uint32_t>(
+        base::subtle::NoBarrier_Load(AsAtomic(&entry->reload))) + 1;
+    uint64_t execution_count = static_cast<uint64_t>(check_count) * period;
+    if (execution_count > UINT32_MAX)
+      execution_count = UINT32_MAX;
+
+    uint32_t new_period = ComputeSamplingPeriod(
+        base_period_, static_cast<uint32_t>(execution_count));
+    if (new_period == period)
+      continue;
+    base::subtle::NoBarrier_Store(AsAtomic(&entry->reload), new_period - 1);
+
+    // Apply a shorter period right away, rather than after the current
+    // countdown.
+    if (new_period < period) {
+      int32_t countdown = static_cast<int32_t>(new_period - 1);
+      if (base::subtle::NoBarrier_Load(AsAtomic(&entry->countdown)) >
+              countdown) {
+        base::subtle::NoBarrier_Store(AsAtomic(&entry->countdown), countdown);
+      }
+    }
+  }
+}
+
+void CheckAccessSampler::OnDllEvent(
+    agent::common::DllNotificationWatcher::EventType type,
+    HMODULE module,
+    size_t module_size,
+    const base::StringPiece16& dll_path,
+    const base::StringPiece16& dll_base_name) {
+  if (type == agent::common::DllNotificationWatcher::kDllLoaded)
+    AddModule(module);
+  else
+    RemoveModule(module);
+}
+
+void CheckAccessSampler::ThreadMain() {
+  base::PlatformThread::SetName("SyzyASAN Check Access Sampler Thread");
+  const base::TimeDelta update_period =
+      base::TimeDelta::FromMilliseconds(kUpdatePeriodMs);
+  while (!stop_event_.TimedWait(update_period))
+    Update();
+}
+
+}  // namespace asan
+}  // namespace agent
@@ -0,0 +1,182 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares a class that adapts the sampling rates of the sampled access
+// checks of the instrumented images at runtime.
+
+#ifndef SYZYGY_AGENT_ASAN_CHECK_ACCESS_SAMPLER_H_
+#define SYZYGY_AGENT_ASAN_CHECK_ACCESS_SAMPLER_H_
+
+#include <windows.h>
+
+#include <vector>
+
+#include "base/synchronization/lock.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/platform_thread.h"
+#include "syzygy/agent/common/dll_notifications.h"
+#include "syzygy/common/asan_parameters.h"
+
+namespace agent {
+namespace asan {
+
+// Periodically adjusts the entries of the sampling tables of the instrumented
+// images, so that each sampled access check runs at a rate adapted to how
+// often it is executed:
+//   - The sites that are rarely executed are checked on every execution, as
+//     they are cheap to check and are where the untested code lives.
+//   - The hot sites are checked once every |base period| executions, where
+//     the base period is derived from the sampling rate, and the period grows
+//     with their hotness so that each of them runs a bounded number of checks
+//     per update.
+//   - After an error is reported in an image, all of its sites are checked on
+//     every execution for a while.
+// The number of executions of a site is estimated from the number of checks
+// it ran since the previous update, and its current period.
+//
+// The images loaded after Start are picked up through DLL load notifications.
+class CheckAccessSampler : public base::PlatformThread::Delegate {
+ public:
+  typedef ::common::AsanSamplingTableEntry Entry;
+
+  // The time between two updates of the sampling tables, in milliseconds.
+  static const uint32_t kUpdatePeriodMs = 1000;
+
+  // The number of executions per update above which a site is considered hot.
+  static const uint32_t kHotSiteExecutionCount = 1024;
+
+  // The maximum sampling period of a site.
+  static const uint32_t kMaxSamplingPeriod = 1 << 16;
+
+  // The number of updates during which all the sites of an image are checked
+  // on every execution, after an error is reported in this image.
+  static const uint32_t kErrorBoostUpdateCount = 60;
+
+  // @param sampling_rate The base fraction of the executions of the hot sites
+  //     that are checked, in the range 0.0 to 1.0.
+  explicit CheckAccessSampler(float sampling_rate);
+  ~CheckAccessSampler() override;
+
+  // Registers the sampling tables of the images that are already loaded, and
+  // starts the background thread that updates them. Must not be called if
+  // the sampler has already been started.
+  // @returns true on success, false otherwise.
+  bool Start();
+
+  // Stops the background thread and waits for it to exit. Must be called
+  // before the destruction of this object if it was started. This must not be
+  // called while holding the loader lock, as the thread needs it to exit.
+  void Stop();
+
+  // Asks the background thread to stop, without waiting for it. This is meant
+  // to be used when unloading the runtime, where the thread can't be joined.
+  // As the thread may still be running when this returns, this object must
+  // then be leaked rather than destroyed.
+  void SignalStop();
+
+  // Registers the sampling table of an image, if it has one.
+  // @param module The image to register.
+  void AddModule(HMODULE module);
+
+  // Unregisters the sampling table of an image, if it has one.
+  // @param module The image to unregister.
+  void RemoveModule(HMODULE module);
+
+  // Raises the coverage of the image containing the instruction that caused
+  // an error, if it has a sampling table.
+  // @param pc The address of the instruction that caused the error.
+  void OnError(const void* pc);
+
+  // Updates all of the registered sampling tables. This is called
+  // periodically by the background thread.
+  void Update();
+
+  // Computes the sampling period of a site.
+  // @param base_period The sampling period of the hot sites.
+  // @param execution_count The estimated number of executions of the site
+  //     since the previous update.
+  // @returns the number of executions between two checks of the site.
+  static uint32_t ComputeSamplingPeriod(uint32_t base_period,
+                                        uint32_t execution_count);
+
+  // @returns the sampling period of the hot sites.
+  uint32_t base_period() const { return base_period_; }
+
+ protected:
+  // A registered sampling table.
+  struct Table {
+    // The image containing the table, and its size in memory.
+    HMODULE module;
+    size_t module_size;
+    // The entries of the table.
+    Entry* entries;
+    size_t entry_count;
+    // The number of updates during which all the sites of the table are
+    // still checked on every execution, following an error.
+    uint32_t boost_update_count;
+  };
+
+  // Registers a sampling table. The caller must hold lock_.
+  // @param module The image containing the table.
+  // @param module_size The size of @p module in memory.
+  // @param entries The entries of the table.
+  // @param entry_count The number of entries of the table.
+  void AddTableUnlocked(HMODULE module,
+                        size_t module_size,
+                        Entry* entries,
+                        size_t entry_count);
+
+  // Updates the entries of a single sampling table. The caller must hold
+  // lock_.
+  // @param table The table to update.
+  void UpdateTableUnlocked(Table* table);
+
+  // Sink for DLL load/unload event notifications.
+  void OnDllEvent(agent::common::DllNotificationWatcher::EventType type,
+                  HMODULE module,
+                  size_t module_size,
+                  const base::StringPiece16& dll_path,
+                  const base::StringPiece16& dll_base_name);
+
+  // Implementation of base::PlatformThread::Delegate. This is the body of the
+  // background thread.
+  void ThreadMain() override;
+
+  // The sampling period of the hot sites.
+  uint32_t base_period_;
+
+  // Protects tables_.
+  base::Lock lock_;
+
+  // The registered sampling tables.
+  std::vector<Table> tables_;  // Under lock_.
+
+  // Used to get the load and unload notifications of the images.
+  agent::common::DllNotificationWatcher dll_watcher_;
+
+  // Signaled to stop the background thread.
+  base::WaitableEvent stop_event_;
+
+  // The background thread, and whether it is running.
+  base::PlatformThreadHandle thread_;
+  bool thread_running_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(CheckAccessSampler);
+};
+
+}  // namespace asan
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_ASAN_CHECK_ACCESS_SAMPLER_H_
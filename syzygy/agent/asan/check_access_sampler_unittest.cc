@@ -0,0 +1,162 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/check_access_sampler.h"
+
+#include "gtest/gtest.h"
+
+namespace agent {
+namespace asan {
+
+namespace {
+
+// A fake module, used to register a sampling table that isn't backed by an
+// image.
+uint8_t dummy_module[64] = {};
+
+class TestCheckAccessSampler : public CheckAccessSampler {
+ public:
+  using CheckAccessSampler::Table;
+  using CheckAccessSampler::tables_;
+
+  explicit TestCheckAccessSampler(float sampling_rate)
+      : CheckAccessSampler(sampling_rate) {
+  }
+
+  void AddTable(Entry* entries, size_t entry_count) {
+    base::AutoLock lock(lock_);
+    AddTableUnlocked(reinterpret_cast<HMODULE>(dummy_module),
+                     sizeof(dummy_module), entries, entry_count);
+  }
+};
+
+typedef CheckAccessSampler::Entry Entry;
+
+}  // namespace
+
+TEST(CheckAccessSamplerTest, BasePeriod) {
+  EXPECT_EQ(1U, TestCheckAccessSampler(1.0f).base_period());
+  EXPECT_EQ(2U, TestCheckAccessSampler(0.5f).base_period());
+  EXPECT_EQ(10U, TestCheckAccessSampler(0.1f).base_period());
+  EXPECT_EQ(CheckAccessSampler::kMaxSamplingPeriod,
+            TestCheckAccessSampler(0.0f).base_period());
+}
+
+TEST(CheckAccessSamplerTest, ComputeSamplingPeriod) {
+  const uint32_t kHot = CheckAccessSampler::kHotSiteExecutionCount;
+
+  // Without sampling every execution is checked.
+  EXPECT_EQ(1U, CheckAccessSampler::ComputeSamplingPeriod(1, 0));
+  EXPECT_EQ(1U, CheckAccessSampler::ComputeSamplingPeriod(1, 100 * kHot));
+
+  // The cold sites are always checked.
+  EXPECT_EQ(1U, CheckAccessSampler::ComputeSamplingPeriod(10, 0));
+  EXPECT_EQ(1U, CheckAccessSampler::ComputeSamplingPeriod(10, kHot - 1));
+
+  // The period of the hot sites grows with their hotness.
+  EXPECT_EQ(10U, CheckAccessSampler::ComputeSamplingPeriod(10, kHot));
+  EXPECT_EQ(40U, CheckAccessSampler::ComputeSamplingPeriod(10, 4 * kHot));
+  EXPECT_EQ(CheckAccessSampler::kMaxSamplingPeriod,
+            CheckAccessSampler::ComputeSamplingPeriod(10, UINT32_MAX));
+}
+
+TEST(CheckAccessSamplerTest, AddModuleWithoutTable) {
+  TestCheckAccessSampler sampler(0.5f);
+  sampler.AddModule(::GetModuleHandle(nullptr));
+  EXPECT_TRUE(sampler.tables_.empty());
+}
+
+TEST(CheckAccessSamplerTest, AddAndRemoveTable) {
+  TestCheckAccessSampler sampler(0.5f);
+  Entry entries[2] = {};
+  sampler.AddTable(entries, arraysize(entries));
+  sampler.AddTable(entries, arraysize(entries));
+  EXPECT_EQ(1U, sampler.tables_.size());
+
+  sampler.RemoveModule(reinterpret_cast<HMODULE>(dummy_module));
+  EXPECT_TRUE(sampler.tables_.empty());
+}
+
+TEST(CheckAccessSamplerTest, Update) {
+  const uint32_t kHot = CheckAccessSampler::kHotSiteExecutionCount;
+  TestCheckAccessSampler sampler(0.1f);
+  Entry entries[3] = {};
+  sampler.AddTable(entries, arraysize(entries));
+
+  // A cold site, a hot site and a very hot site, all checked on every
+  // execution so far.
+  entries[0].check_count = kHot / 2;
+  entries[1].check_count = kHot;
+  entries[2].check_count = 4 * kHot;
+  sampler.Update();
+
+  EXPECT_EQ(0U, entries[0].reload);
+  EXPECT_EQ(9U, entries[1].reload);
+  EXPECT_EQ(39U, entries[2].reload);
+  for (size_t i = 0; i < arraysize(entries); ++i)
+    EXPECT_EQ(0U, entries[i].check_count);
+
+  // The very hot site cools down. Its estimated execution count is now
+  // 40 * 4 = 160, so it goes back to being checked on every execution, and
+  // its countdown is brought down right away.
+  entries[2].countdown = 30;
+  entries[2].check_count = 4;
+  sampler.Update();
+  EXPECT_EQ(0U, entries[2].reload);
+  EXPECT_EQ(0, entries[2].countdown);
+
+  // A site that isn't executed anymore is checked on its next execution.
+  EXPECT_EQ(0U, entries[1].reload);
+}
+
+TEST(CheckAccessSamplerTest, OnError) {
+  const uint32_t kHot = CheckAccessSampler::kHotSiteExecutionCount;
+  TestCheckAccessSampler sampler(0.1f);
+  Entry entries[2] = {};
+  sampler.AddTable(entries, arraysize(entries));
+
+  entries[0].check_count = 4 * kHot;
+  entries[1].check_count = 4 * kHot;
+  sampler.Update();
+  EXPECT_EQ(39U, entries[0].reload);
+  entries[0].countdown = 20;
+
+  // An error outside of the module doesn't change anything.
+  sampler.OnError(&entries[0]);
+  EXPECT_EQ(39U, entries[0].reload);
+  EXPECT_EQ(20, entries[0].countdown);
+
+  // An error in the module checks all of its sites on every execution.
+  sampler.OnError(dummy_module + 4);
+  for (size_t i = 0; i < arraysize(entries); ++i) {
+    EXPECT_EQ(0U, entries[i].reload);
+    EXPECT_EQ(0, entries[i].countdown);
+  }
+
+  // This lasts for a while, no matter how hot the sites are.
+  for (size_t i = 0; i < CheckAccessSampler::kErrorBoostUpdateCount; ++i) {
+    entries[0].check_count = 4 * kHot;
+    sampler.Update();
+    EXPECT_EQ(0U, entries[0].reload);
+    EXPECT_EQ(0U, entries[0].check_count);
+  }
+
+  // Then the sampling resumes.
+  entries[0].check_count = 4 * kHot;
+  sampler.Update();
+  EXPECT_EQ(39U, entries[0].reload);
+}
+
+}  // namespace asan
+}  // namespace agent
@@ -34,6 +34,11 @@ static const size_t kUsualAllocationGranularity = 64 * 1024;
 // access for random removal and insertion of elements into the quarantine.
 static const size_t kQuarantineDefaultShardingFactor = 128;
 
+// The sharding factor of each size class of the shared quarantine. Across all
+// of the size classes this gives the same number of lists as the default
+// sharding factor.
+static const size_t kQuarantineSizeClassShardingFactor = 16;
+
 // @returns the size of a page on the OS (usually 4KB).
 // @note Declaring this as a constant might result in an initialization order
 //     fiasco.
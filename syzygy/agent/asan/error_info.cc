@@ -661,7 +661,7 @@ void PopulateAsanParameters(const AsanErrorInfo& error_info,
 
   // Any new parameter added to the parameters structure should also be added
   // here.
-  static_assert(15 == ::common::kAsanParametersVersion,
+  static_assert(19 == ::common::kAsanParametersVersion,
                 "Pointers in the params must be linked up here.");
   crashdata::Dictionary* param_dict = crashdata::DictAddDict("asan-parameters",
                                                              dict);
@@ -701,6 +701,21 @@ void PopulateAsanParameters(const AsanErrorInfo& error_info,
   crashdata::LeafSetReal(
       error_info.asan_parameters.quarantine_flood_fill_rate,
       crashdata::DictAddLeaf("quarantine-flood-fill-rate", param_dict));
+  crashdata::LeafSetReal(
+      error_info.asan_parameters.check_access_sampling_rate,
+      crashdata::DictAddLeaf("check-access-sampling-rate", param_dict));
+  crashdata::LeafSetUInt(error_info.asan_parameters.block_checksum_algorithm,
+                         crashdata::DictAddLeaf("block-checksum-algorithm",
+                                                param_dict));
+  crashdata::LeafSetUInt(
+      error_info.asan_parameters.block_checksum_body_sample_size,
+      crashdata::DictAddLeaf("block-checksum-body-sample-size", param_dict));
+  crashdata::LeafSetUInt(error_info.asan_parameters.enable_fast_stack_capture,
+                         crashdata::DictAddLeaf("enable-fast-stack-capture",
+                                                param_dict));
+  crashdata::LeafSetUInt(error_info.asan_parameters.enable_async_logging,
+                         crashdata::DictAddLeaf("enable-async-logging",
+                                                param_dict));
 }
 
 }  // namespace
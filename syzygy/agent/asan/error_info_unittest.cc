@@ -749,7 +749,12 @@ TEST_F(AsanErrorInfoTest, PopulateErrorInfo) {
       "    \"zebra-block-heap-size\": 16777216,\n"
       "    \"zebra-block-heap-quarantine-ratio\": 2.5000000000000000E-01,\n"
       "    \"large-allocation-threshold\": 20480,\n"
-      "    \"quarantine-flood-fill-rate\": 5.0000000000000000E-01\n"
+      "    \"quarantine-flood-fill-rate\": 5.0000000000000000E-01,\n"
+      "    \"check-access-sampling-rate\": 1.0000000000000000E+00,\n"
+      "    \"block-checksum-algorithm\": 0,\n"
+      "    \"block-checksum-body-sample-size\": 0,\n"
+      "    \"enable-fast-stack-capture\": 0,\n"
+      "    \"enable-async-logging\": 0\n"
       "  }\n"
       "}";
   AsanErrorShadowMemory shadow_memory = {};
@@ -898,7 +903,12 @@ TEST_F(AsanErrorInfoTest, PopulateErrorInfoWithMemoryRanges) {
       "    \"zebra-block-heap-size\": 16777216,\n"
       "    \"zebra-block-heap-quarantine-ratio\": 2.5000000000000000E-01,\n"
       "    \"large-allocation-threshold\": 20480,\n"
-      "    \"quarantine-flood-fill-rate\": 5.0000000000000000E-01\n"
+      "    \"quarantine-flood-fill-rate\": 5.0000000000000000E-01,\n"
+      "    \"check-access-sampling-rate\": 1.0000000000000000E+00,\n"
+      "    \"block-checksum-algorithm\": 0,\n"
+      "    \"block-checksum-body-sample-size\": 0,\n"
+      "    \"enable-fast-stack-capture\": 0,\n"
+      "    \"enable-async-logging\": 0\n"
       "  }\n"
       "}";
   AsanErrorShadowMemory shadow_memory = {};
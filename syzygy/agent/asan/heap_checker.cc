@@ -14,16 +14,231 @@
 
 #include "syzygy/agent/asan/heap_checker.h"
 
+#include "base/atomicops.h"
+#include "base/sys_info.h"
+#include "base/memory/ref_counted.h"
+#include "base/threading/platform_thread.h"
+#include "syzygy/agent/asan/block_utils.h"
+#include "syzygy/agent/asan/constants.h"
 #include "syzygy/agent/asan/page_protection_helpers.h"
 #include "syzygy/agent/asan/runtime.h"
 #include "syzygy/agent/asan/shadow.h"
+#include "syzygy/common/align.h"
 
 namespace agent {
 namespace asan {
 
+namespace {
+
+// A run of consecutive blocks encountered while walking a partition of
+// memory. Each corrupt block gets its own run, while consecutive valid blocks
+// are coalesced into a single one.
+struct BlockRun {
+  // The header of the first and of the last block in this run.
+  const uint8_t* first_header;
+  const uint8_t* last_header;
+  // The end of the last block in this run.
+  const uint8_t* end;
+  // Indicates if this is a corrupt block.
+  bool corrupt;
+};
+typedef std::vector<BlockRun> BlockRunVector;
+
+// Walks the blocks whose header lies in a partition of memory, and summarizes
+// them as runs.
+// @param shadow The shadow memory to query.
+// @param lower_bound The lower bound of the partition (inclusive).
+// @param upper_bound The upper bound of the partition (exclusive). An
+//     overflowed value of 0 indicates the end of all memory.
+// @param runs Will receive the runs of blocks in this partition.
+// @note block_protect_lock must be held, either by the calling thread or on
+//     its behalf.
+void WalkPartition(Shadow* shadow,
+                   const uint8_t* lower_bound,
+                   const uint8_t* upper_bound,
+                   BlockRunVector* runs) {
+  DCHECK_NE(static_cast<Shadow*>(nullptr), shadow);
+  DCHECK_NE(static_cast<const uint8_t*>(nullptr), lower_bound);
+  DCHECK(upper_bound == nullptr || lower_bound <= upper_bound);
+  DCHECK_NE(static_cast<BlockRunVector*>(nullptr), runs);
+
+  // An overflowed |upper_bound| is handled correctly by the ShadowWalker.
+  ShadowWalker shadow_walker(shadow, lower_bound, upper_bound);
+
+  BlockInfo block_info = {};
+  while (shadow_walker.Next(&block_info)) {
+    // Remove the protections on this block so its checksum can be safely
+    // validated. We leave the protections permanently removed so that the
+    // minidump generation has free access to block contents.
+    BlockProtectNoneUnlocked(block_info, shadow);
+
+    bool corrupt = IsBlockCorrupt(block_info);
+    const uint8_t* header = block_info.RawHeader();
+    const uint8_t* end = header + block_info.block_size;
+
+    // Extend the current run of valid blocks if possible.
+    if (!corrupt && !runs->empty() && !runs->back().corrupt) {
+      runs->back().last_header = header;
+      runs->back().end = end;
+      continue;
+    }
+
+    BlockRun run = { header, header, end, corrupt };
+    runs->push_back(run);
+  }
+}
+
+// Appends the runs of a partition to a vector of corrupt ranges. This is
+// called on the partitions in address order.
+// @param runs The runs of the partition.
+// @param covered_until The end of the last block that was appended so far.
+//     Blocks starting before this are nested in a previous block that
+//     straddles the partition boundary, and are ignored like a sequential walk
+//     would. This is updated.
+// @param range_open Indicates if the last range of @p corrupt_ranges may
+//     still be extended. This is updated.
+// @param corrupt_ranges The vector that receives the corrupt ranges.
+void AppendRuns(const BlockRunVector& runs,
+                const uint8_t** covered_until,
+                bool* range_open,
+                HeapChecker::CorruptRangesVector* corrupt_ranges) {
+  DCHECK_NE(static_cast<const uint8_t**>(nullptr), covered_until);
+  DCHECK_NE(static_cast<bool*>(nullptr), range_open);
+  DCHECK_NE(static_cast<HeapChecker::CorruptRangesVector*>(nullptr),
+            corrupt_ranges);
+
+  for (const auto& run : runs) {
+    if (run.last_header < *covered_until)
+      continue;
+    *covered_until = run.end;
+
+    if (!run.corrupt) {
+      *range_open = false;
+      continue;
+    }
+
+    // This block is at the beginning of a corrupt range.
+    if (!*range_open) {
+      AsanCorruptBlockRange corrupt_range;
+      corrupt_range.address = run.first_header;
+      corrupt_range.length = 0;
+      corrupt_range.block_count = 0;
+      corrupt_range.block_info = nullptr;
+      corrupt_range.block_info_count = 0;
+      corrupt_ranges->push_back(corrupt_range);
+      *range_open = true;
+    }
+
+    // Update the size of the current range.
+    AsanCorruptBlockRange* current_corrupt_range = &corrupt_ranges->back();
+    current_corrupt_range->block_count++;
+    current_corrupt_range->length =
+        run.end -
+        reinterpret_cast<const uint8_t*>(current_corrupt_range->address);
+  }
+}
+
+// The state of a heap check that is spread across multiple threads. This is
+// reference counted so that a worker thread that only gets to run after the
+// check has completed can safely find that there's nothing left to do.
+class ParallelHeapCheck : public base::RefCountedThreadSafe<ParallelHeapCheck> {
+ public:
+  // @param shadow The shadow memory to query.
+  // @param bounds The bounds of the partitions, in increasing order. There
+  //     is one more bound than there are partitions.
+  ParallelHeapCheck(Shadow* shadow, const std::vector<const uint8_t*>& bounds)
+      : shadow_(shadow),
+        bounds_(bounds),
+        runs_(bounds.size() - 1),
+        next_partition_(0),
+        completed_partitions_(0) {
+    DCHECK_NE(static_cast<Shadow*>(nullptr), shadow);
+    DCHECK_LT(1u, bounds.size());
+  }
+
+  // Claims and checks partitions until none are left.
+  void Run() {
+    base::subtle::Atomic32 partition_count =
+        static_cast<base::subtle::Atomic32>(runs_.size());
+    while (true) {
+      base::subtle::Atomic32 partition =
+          base::subtle::Barrier_AtomicIncrement(&next_partition_, 1) - 1;
+      if (partition >= partition_count)
+        return;
+      WalkPartition(shadow_, bounds_[partition], bounds_[partition + 1],
+                    &runs_[partition]);
+      base::subtle::Barrier_AtomicIncrement(&completed_partitions_, 1);
+    }
+  }
+
+  // Waits until all of the partitions have been checked. The calling thread
+  // must have called Run beforehand, so that no partition is left unclaimed.
+  void WaitForCompletion() {
+    base::subtle::Atomic32 partition_count =
+        static_cast<base::subtle::Atomic32>(runs_.size());
+    while (base::subtle::Acquire_Load(&completed_partitions_) <
+           partition_count) {
+      base::PlatformThread::YieldCurrentThread();
+    }
+  }
+
+  // @returns the runs of blocks of the given partition. Only valid after
+  //     WaitForCompletion has returned.
+  const BlockRunVector& runs(size_t partition) const {
+    return runs_[partition];
+  }
+
+ private:
+  friend class base::RefCountedThreadSafe<ParallelHeapCheck>;
+  ~ParallelHeapCheck() {}
+
+  Shadow* shadow_;
+  std::vector<const uint8_t*> bounds_;
+  std::vector<BlockRunVector> runs_;
+
+  // The index of the next partition to be claimed.
+  base::subtle::Atomic32 next_partition_;
+  // The number of partitions that have been checked.
+  base::subtle::Atomic32 completed_partitions_;
+
+  DISALLOW_COPY_AND_ASSIGN(ParallelHeapCheck);
+};
+
+// A worker thread participating in a parallel heap check. This deletes itself
+// once done.
+class HeapCheckWorker : public base::PlatformThread::Delegate {
+ public:
+  explicit HeapCheckWorker(ParallelHeapCheck* check) : check_(check) {}
+
+  // Implementation of PlatformThread::Delegate:
+  void ThreadMain() override {
+    base::PlatformThread::SetName("SyzyASAN Heap Checker Thread");
+    // The thread that dispatched the check holds block_protect_lock on our
+    // behalf.
+    check_->Run();
+    delete this;
+  }
+
+ private:
+  scoped_refptr<ParallelHeapCheck> check_;
+
+  DISALLOW_COPY_AND_ASSIGN(HeapCheckWorker);
+};
+
+}  // namespace
+
 HeapChecker::HeapChecker(Shadow* shadow)
-    : shadow_(shadow) {
+    : shadow_(shadow),
+      worker_count_(1),
+      lower_bound_(
+          reinterpret_cast<const uint8_t*>(Shadow::kAddressLowerBound)),
+      // Allow memory_size to overflow to 0 for 4GB 32-bit processes.
+      upper_bound_(reinterpret_cast<const uint8_t*>(shadow->memory_size())),
+      slice_cursor_(lower_bound_),
+      slice_covered_until_(lower_bound_) {
   DCHECK_NE(static_cast<Shadow*>(nullptr), shadow);
+  set_worker_count(
+      static_cast<size_t>(std::max(1, base::SysInfo::NumberOfProcessors())));
 }
 
 bool HeapChecker::IsHeapCorrupt(CorruptRangesVector* corrupt_ranges) {
@@ -33,71 +248,85 @@ bool HeapChecker::IsHeapCorrupt(CorruptRangesVector* corrupt_ranges) {
 
   // Grab the page protection lock. This prevents multiple heap checkers from
   // running simultaneously, and also prevents page protections from being
-  // modified from underneath us.
+  // modified from underneath us. The worker threads rely on this lock being
+  // held on their behalf.
   ::common::AutoRecursiveLock scoped_lock(block_protect_lock);
 
-  // Walk over all of the addressable memory to find the corrupt blocks.
-  // Allow memory_size to overflow to 0 for 4GB 32-bit processes.
+  // Split the memory into evenly sized partitions. This arithmetic wraps
+  // around correctly when |upper_bound_| has overflowed to 0.
   // TODO(sebmarchand): Iterates over the heap slabs once we have switched to
   //     a new memory allocator.
-  GetCorruptRangesInSlab(
-      reinterpret_cast<const uint8_t*>(Shadow::kAddressLowerBound),
-      reinterpret_cast<const uint8_t*>(shadow_->memory_size()),
-      corrupt_ranges);
+  size_t partition_count = worker_count_ == 1 ?
+      1 : worker_count_ * kPartitionsPerWorker;
+  uintptr_t lower = reinterpret_cast<uintptr_t>(lower_bound_);
+  uintptr_t size = reinterpret_cast<uintptr_t>(upper_bound_) - lower;
+  uintptr_t partition_size = std::max<uintptr_t>(
+      kShadowRatio, ::common::AlignUp(size / partition_count, kShadowRatio));
+  std::vector<const uint8_t*> bounds;
+  for (size_t i = 0; i < partition_count; ++i) {
+    uintptr_t offset = i * partition_size;
+    if (i > 0 && offset >= size)
+      break;
+    bounds.push_back(reinterpret_cast<const uint8_t*>(lower + offset));
+  }
+  bounds.push_back(upper_bound_);
+
+  scoped_refptr<ParallelHeapCheck> check(
+      new ParallelHeapCheck(shadow_, bounds));
+
+  // Start the worker threads. The calling thread does its share of the work,
+  // so a failure to start the workers, or workers that are slow to start, only
+  // affect the speed of the check.
+  for (size_t i = 1; i < worker_count_; ++i) {
+    HeapCheckWorker* worker = new HeapCheckWorker(check.get());
+    if (!base::PlatformThread::CreateNonJoinable(0, worker)) {
+      delete worker;
+      break;
+    }
+  }
+  check->Run();
+  check->WaitForCompletion();
+
+  // Stitch the results of the partitions back together.
+  const uint8_t* covered_until = lower_bound_;
+  bool range_open = false;
+  for (size_t i = 0; i + 1 < bounds.size(); ++i)
+    AppendRuns(check->runs(i), &covered_until, &range_open, corrupt_ranges);
 
   return !corrupt_ranges->empty();
 }
 
-void HeapChecker::GetCorruptRangesInSlab(const uint8_t* lower_bound,
-                                         const uint8_t* upper_bound,
-                                         CorruptRangesVector* corrupt_ranges) {
-  DCHECK_NE(static_cast<const uint8_t*>(nullptr), lower_bound);
-  DCHECK(upper_bound == nullptr || lower_bound <= upper_bound);
+bool HeapChecker::IsNextSliceCorrupt(size_t slice_size,
+                                     CorruptRangesVector* corrupt_ranges) {
+  DCHECK_LT(0u, slice_size);
   DCHECK_NE(static_cast<CorruptRangesVector*>(nullptr), corrupt_ranges);
 
-  // An overflowed |upper_bound| is handled correctly by the ShadowWalker.
-  ShadowWalker shadow_walker(shadow_, lower_bound, upper_bound);
+  corrupt_ranges->clear();
 
-  AsanCorruptBlockRange* current_corrupt_range = nullptr;
+  ::common::AutoRecursiveLock scoped_lock(block_protect_lock);
 
-  // Iterates over the blocks.
-  BlockInfo block_info = {};
-  while (shadow_walker.Next(&block_info)) {
-    // Remove the protections on this block so its checksum can be safely
-    // validated. We leave the protections permanently removed so that the
-    // minidump generation has free access to block contents.
-    BlockProtectNone(block_info, shadow_);
+  // Determine the end of this slice. As in IsHeapCorrupt this handles an
+  // overflowed |upper_bound_|.
+  uintptr_t cursor = reinterpret_cast<uintptr_t>(slice_cursor_);
+  uintptr_t remaining = reinterpret_cast<uintptr_t>(upper_bound_) - cursor;
+  uintptr_t size = std::min<uintptr_t>(
+      ::common::AlignUp(slice_size, GetPageSize()), remaining);
+  const uint8_t* slice_end = reinterpret_cast<const uint8_t*>(cursor + size);
 
-    bool current_block_is_corrupt = IsBlockCorrupt(block_info);
-    // If the current block is corrupt and |current_corrupt_range| is nullptr
-    // then this means that the current block is at the beginning of a corrupt
-    // range.
-    if (current_block_is_corrupt && current_corrupt_range == nullptr) {
-      AsanCorruptBlockRange corrupt_range;
-      corrupt_range.address = block_info.header;
-      corrupt_range.length = 0;
-      corrupt_range.block_count = 0;
-      corrupt_range.block_info = nullptr;
-      corrupt_range.block_info_count = 0;
-      corrupt_ranges->push_back(corrupt_range);
-      current_corrupt_range = &corrupt_ranges->back();
-    } else if (!current_block_is_corrupt && current_corrupt_range != nullptr) {
-      current_corrupt_range = nullptr;
-    }
+  BlockRunVector runs;
+  WalkPartition(shadow_, slice_cursor_, slice_end, &runs);
+  bool range_open = false;
+  AppendRuns(runs, &slice_covered_until_, &range_open, corrupt_ranges);
 
-    if (current_block_is_corrupt) {
-      // If the current block is corrupt then we need to update the size of the
-      // current range.
-      DCHECK_NE(reinterpret_cast<AsanCorruptBlockRange*>(nullptr),
-                current_corrupt_range);
-      current_corrupt_range->block_count++;
-      const uint8_t* current_block_end =
-          block_info.RawHeader() + block_info.block_size;
-      current_corrupt_range->length =
-          current_block_end -
-          reinterpret_cast<const uint8_t*>(current_corrupt_range->address);
-    }
+  // Wrap around at the end of memory.
+  if (slice_end == upper_bound_) {
+    slice_cursor_ = lower_bound_;
+    slice_covered_until_ = lower_bound_;
+  } else {
+    slice_cursor_ = slice_end;
   }
+
+  return !corrupt_ranges->empty();
 }
 
 }  // namespace asan
@@ -17,6 +17,7 @@
 #ifndef SYZYGY_AGENT_ASAN_HEAP_CHECKER_H_
 #define SYZYGY_AGENT_ASAN_HEAP_CHECKER_H_
 
+#include <algorithm>
 #include <vector>
 
 #include "base/logging.h"
@@ -31,10 +32,23 @@ class AsanRuntime;
 class Shadow;
 
 // A class to analyze the heap and to check if it's corrupt.
+//
+// The memory is split into partitions that are checked concurrently by a set
+// of worker threads, with the calling thread participating as well. Blocks are
+// attributed to the partition containing their header, so the results are the
+// same as those of a sequential walk.
 class HeapChecker {
  public:
   typedef std::vector<AsanCorruptBlockRange> CorruptRangesVector;
 
+  // The maximum number of threads that are used to check the heap, including
+  // the calling thread.
+  static const size_t kMaxWorkerCount = 8;
+
+  // The number of partitions that are used per worker thread. Using more than
+  // one balances the work when the heap is unevenly distributed.
+  static const size_t kPartitionsPerWorker = 4;
+
   // Constructor.
   // @param shadow The shadow memory to query.
   explicit HeapChecker(Shadow* shadow);
@@ -45,26 +59,66 @@ class HeapChecker {
   // @param corrupt_ranges Will receive the information about the corrupt
   //     ranges.
   // @returns true if the heap is corrupt, false otherwise.
+  // @note The caller must prevent the blocks from changing state while this
+  //     runs, typically by holding the heap manager lock.
   bool IsHeapCorrupt(CorruptRangesVector* corrupt_ranges);
 
-  // TODO(sebmarchand): Add a testing seam that controls the range of memory
-  //     that is walked by HeapChecker to keep unittest times to something
-  //     reasonable.
+  // Incrementally checks the heap. Each call checks the next slice of memory,
+  // picking up where the previous call left off and wrapping around at the
+  // end of memory. This is meant to be called periodically from an idle
+  // thread, so that corruption is found before it causes a crash. Like
+  // IsHeapCorrupt this permanently removes the page protections of the blocks
+  // that it checks.
+  // @param slice_size The size of the memory slice to check. This is rounded
+  //     up to a multiple of the page size.
+  // @param corrupt_ranges Will receive the information about the corrupt
+  //     ranges in this slice.
+  // @returns true if corrupt blocks were found in this slice, false
+  //     otherwise.
+  // @note The same locking requirements as IsHeapCorrupt apply.
+  bool IsNextSliceCorrupt(size_t slice_size,
+                          CorruptRangesVector* corrupt_ranges);
 
- private:
-  // Get the information about the corrupt ranges in a heap slab.
-  // @param lower_bound The lower bound for this slab (inclusive).
-  // @param upper_bound The upper bound for this slab (exclusive). An
-  //     overflowed value of 0 indicates the end of all memory.
-  // @param corrupt_ranges Will receive the information about the corrupt ranges
-  //     in this slab.
-  void GetCorruptRangesInSlab(const uint8_t* lower_bound,
-                              const uint8_t* upper_bound,
-                              CorruptRangesVector* corrupt_ranges);
+  // @name Accessors.
+  // @{
+  size_t worker_count() const { return worker_count_; }
+  void set_worker_count(size_t worker_count) {
+    DCHECK_LT(0u, worker_count);
+    worker_count_ = std::min(worker_count, kMaxWorkerCount);
+  }
+  // @}
 
+  // Restricts the range of memory that is walked, to keep the unittest times
+  // to something reasonable.
+  // @param lower_bound The lower bound of the range (inclusive).
+  // @param upper_bound The upper bound of the range (exclusive).
+  void set_bounds_for_testing(const void* lower_bound,
+                              const void* upper_bound) {
+    lower_bound_ = reinterpret_cast<const uint8_t*>(lower_bound);
+    upper_bound_ = reinterpret_cast<const uint8_t*>(upper_bound);
+    slice_cursor_ = lower_bound_;
+    slice_covered_until_ = lower_bound_;
+  }
+
+ private:
   // The shadow memory that will be analyzed.
   Shadow* shadow_;
 
+  // The number of threads that are used to check the heap.
+  size_t worker_count_;
+
+  // The range of memory that is checked. An overflowed |upper_bound_| of 0
+  // indicates the end of all memory.
+  const uint8_t* lower_bound_;
+  const uint8_t* upper_bound_;
+
+  // The state of the incremental check. |slice_cursor_| is the beginning of
+  // the next slice, and |slice_covered_until_| is the end of the last block
+  // that has been checked. This is beyond the cursor when a block straddles
+  // two slices.
+  const uint8_t* slice_cursor_;
+  const uint8_t* slice_covered_until_;
+
   DISALLOW_COPY_AND_ASSIGN(HeapChecker);
 };
 
@@ -204,5 +204,114 @@ TEST_F(HeapCheckerTest, IsHeapCorrupt) {
   ::free(global_alloc);
 }
 
+namespace {
+
+// Lays out a number of contiguous blocks, some of which are corrupt.
+class CorruptHeapFixture {
+ public:
+  static const size_t kNumberOfBlocks = 64;
+
+  explicit CorruptHeapFixture(Shadow* shadow) : shadow_(shadow) {
+    EXPECT_TRUE(BlockPlanLayout(kShadowRatio, kShadowRatio, 100, 0, 0,
+                                &block_layout_));
+    total_alloc_size_ = block_layout_.block_size * kNumberOfBlocks;
+    global_alloc_ = reinterpret_cast<uint8_t*>(::malloc(total_alloc_size_));
+
+    for (size_t i = 0; i < kNumberOfBlocks; ++i) {
+      BlockInfo block_info = {};
+      BlockInitialize(block_layout_,
+                      global_alloc_ + i * block_layout_.block_size,
+                      &block_info);
+      shadow_->PoisonAllocatedBlock(block_info);
+      BlockSetChecksum(block_info);
+      block_headers_[i] = block_info.header;
+    }
+  }
+
+  ~CorruptHeapFixture() {
+    for (size_t i = 0; i < kNumberOfBlocks; ++i)
+      block_headers_[i]->magic = kBlockHeaderMagic;
+    shadow_->Unpoison(global_alloc_, total_alloc_size_);
+    ::free(global_alloc_);
+  }
+
+  void Corrupt(size_t index) { block_headers_[index]->magic++; }
+
+  uint8_t* begin() const { return global_alloc_; }
+  uint8_t* end() const { return global_alloc_ + total_alloc_size_; }
+  size_t total_alloc_size() const { return total_alloc_size_; }
+
+ private:
+  Shadow* shadow_;
+  BlockLayout block_layout_;
+  size_t total_alloc_size_;
+  uint8_t* global_alloc_;
+  BlockHeader* block_headers_[kNumberOfBlocks];
+};
+
+const size_t kCorruptBlocks[] = { 0, 1, 5, 17, 18, 19, 40, 63 };
+
+}  // namespace
+
+TEST_F(HeapCheckerTest, ParallelCheckMatchesSequentialCheck) {
+  CorruptHeapFixture fixture(runtime_->shadow());
+  for (size_t i = 0; i < arraysize(kCorruptBlocks); ++i)
+    fixture.Corrupt(kCorruptBlocks[i]);
+
+  HeapChecker sequential_checker(runtime_->shadow());
+  sequential_checker.set_worker_count(1);
+  sequential_checker.set_bounds_for_testing(fixture.begin(), fixture.end());
+  HeapChecker::CorruptRangesVector expected_ranges;
+  EXPECT_TRUE(sequential_checker.IsHeapCorrupt(&expected_ranges));
+  ASSERT_EQ(5u, expected_ranges.size());
+  EXPECT_EQ(fixture.begin(), expected_ranges[0].address);
+  EXPECT_EQ(2u, expected_ranges[0].block_count);
+  EXPECT_EQ(3u, expected_ranges[2].block_count);
+
+  // The partition boundaries fall in the middle of blocks, which must be
+  // attributed to a single partition.
+  for (size_t worker_count = 2; worker_count <= HeapChecker::kMaxWorkerCount;
+       worker_count *= 2) {
+    HeapChecker parallel_checker(runtime_->shadow());
+    parallel_checker.set_worker_count(worker_count);
+    parallel_checker.set_bounds_for_testing(fixture.begin(), fixture.end());
+    HeapChecker::CorruptRangesVector corrupt_ranges;
+    EXPECT_TRUE(parallel_checker.IsHeapCorrupt(&corrupt_ranges));
+    ASSERT_EQ(expected_ranges.size(), corrupt_ranges.size());
+    for (size_t i = 0; i < expected_ranges.size(); ++i) {
+      EXPECT_EQ(expected_ranges[i].address, corrupt_ranges[i].address);
+      EXPECT_EQ(expected_ranges[i].length, corrupt_ranges[i].length);
+      EXPECT_EQ(expected_ranges[i].block_count, corrupt_ranges[i].block_count);
+    }
+  }
+}
+
+TEST_F(HeapCheckerTest, IsNextSliceCorrupt) {
+  CorruptHeapFixture fixture(runtime_->shadow());
+
+  HeapChecker heap_checker(runtime_->shadow());
+  heap_checker.set_bounds_for_testing(fixture.begin(), fixture.end());
+  HeapChecker::CorruptRangesVector corrupt_ranges;
+  size_t slice_count =
+      (fixture.total_alloc_size() + GetPageSize() - 1) / GetPageSize();
+  for (size_t i = 0; i < slice_count; ++i)
+    EXPECT_FALSE(heap_checker.IsNextSliceCorrupt(1, &corrupt_ranges));
+
+  for (size_t i = 0; i < arraysize(kCorruptBlocks); ++i)
+    fixture.Corrupt(kCorruptBlocks[i]);
+
+  // Each corrupt block is found exactly once per pass over the memory, even
+  // though blocks straddle the slices.
+  for (size_t pass = 0; pass < 2; ++pass) {
+    size_t corrupt_block_count = 0;
+    for (size_t i = 0; i < slice_count; ++i) {
+      heap_checker.IsNextSliceCorrupt(1, &corrupt_ranges);
+      for (const auto& range : corrupt_ranges)
+        corrupt_block_count += range.block_count;
+    }
+    EXPECT_EQ(arraysize(kCorruptBlocks), corrupt_block_count);
+  }
+}
+
 }  // namespace asan
 }  // namespace agent
@@ -45,6 +45,11 @@ using heaps::ZebraBlockHeap;
 // TODO(georgesak): allow this to be changed through the parameters.
 enum : uint32_t { kOverbudgetSizePercentage = 20 };
 
+// The maximum number of blocks that the deferred free thread pops from the
+// shared quarantine at once. Bigger batches amortize the locking of the
+// quarantine, smaller ones reduce the time spent holding its locks.
+enum : size_t { kDeferredFreeBatchSize = 64 };
+
 // Return the position of the most significant bit in a 32 bit unsigned value.
 size_t GetMSBIndex(size_t n) {
   // Algorithm taken from
@@ -694,7 +699,7 @@ bool BlockHeapManager::DestroyHeapContents(
   // We'll keep the blocks that don't belong to this heap in a temporary list.
   // While this isn't optimal in terms of performance, destroying a heap isn't a
   // common operation.
-  // TODO(sebmarchand): Add a version of the ShardedBlockQuarantine::Empty
+  // TODO(sebmarchand): Add a version of the SizeClassBlockQuarantine::Empty
   //     method that accepts a functor to filter the blocks to remove.
   BlockQuarantineInterface::ObjectVector blocks_to_reinsert;
   quarantine->Empty(&blocks_vec);
@@ -1042,8 +1047,24 @@ void BlockHeapManager::DeferredFreeDoWork() {
   DCHECK_EQ(GetDeferredFreeThreadId(), base::PlatformThread::CurrentId());
   // As of now, only the shared quarantine gets trimmed asynchronously. This
   // will bring it back in the GREEN color.
-  BlockQuarantineInterface* shared_quarantine = &shared_quarantine_;
-  TrimQuarantine(TrimColor::GREEN, shared_quarantine);
+  if (parameters_.quarantine_size == 0) {
+    TrimQuarantine(TrimColor::GREEN, &shared_quarantine_);
+    return;
+  }
+
+  // The blocks are popped in batches, which only requires locking a single
+  // list of the quarantine per batch.
+  BlockQuarantineInterface::ObjectVector blocks_to_free;
+  blocks_to_free.reserve(kDeferredFreeBatchSize);
+  while (true) {
+    blocks_to_free.clear();
+    PopResult result =
+        shared_quarantine_.PopBatch(kDeferredFreeBatchSize, &blocks_to_free);
+    for (const auto& block : blocks_to_free)
+      FreeBlock(block);
+    if (!result.pop_successful || result.trim_color <= TrimColor::GREEN)
+      break;
+  }
 }
 
 base::PlatformThreadId BlockHeapManager::GetDeferredFreeThreadId() {
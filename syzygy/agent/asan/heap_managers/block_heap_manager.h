@@ -33,7 +33,7 @@
 #include "syzygy/agent/asan/stack_capture_cache.h"
 #include "syzygy/agent/asan/heap_managers/deferred_free_thread.h"
 #include "syzygy/agent/asan/memory_notifiers/shadow_memory_notifier.h"
-#include "syzygy/agent/asan/quarantines/sharded_quarantine.h"
+#include "syzygy/agent/asan/quarantines/size_class_quarantine.h"
 #include "syzygy/agent/common/stack_capture.h"
 #include "syzygy/common/asan_parameters.h"
 
@@ -152,11 +152,11 @@ class BlockHeapManager : public HeapManagerInterface {
   // @}
 
   // The type of quarantine that we use internally.
-  using ShardedBlockQuarantine =
-      quarantines::ShardedQuarantine<CompactBlockInfo,
-                                     GetTotalBlockSizeFunctor,
-                                     GetBlockHashFunctor,
-                                     kQuarantineDefaultShardingFactor>;
+  using SizeClassBlockQuarantine =
+      quarantines::SizeClassQuarantine<CompactBlockInfo,
+                                       GetTotalBlockSizeFunctor,
+                                       GetBlockHashFunctor,
+                                       kQuarantineSizeClassShardingFactor>;
 
   // A map associating a block heap with its underlying heap.
   using UnderlyingHeapMap =
@@ -387,7 +387,7 @@ class BlockHeapManager : public HeapManagerInterface {
 
   // The quarantine shared by the heaps created by this manager. This is also
   // used by the LargeBlockHeap.
-  ShardedBlockQuarantine shared_quarantine_;
+  SizeClassBlockQuarantine shared_quarantine_;
 
   // Map the block heaps to their underlying heap.
   UnderlyingHeapMap underlying_heaps_map_;  // Under lock_.
@@ -224,7 +224,7 @@ class TestBlockHeapManager : public BlockHeapManager {
   using BlockHeapManager::HeapQuarantineMap;
   using BlockHeapManager::IsValidHeapIdUnlocked;
   using BlockHeapManager::SetHeapErrorCallback;
-  using BlockHeapManager::ShardedBlockQuarantine;
+  using BlockHeapManager::SizeClassBlockQuarantine;
   using BlockHeapManager::TrimQuarantine;
 
   using BlockHeapManager::allocation_filter_flag_tls_;
@@ -240,16 +240,17 @@ class TestBlockHeapManager : public BlockHeapManager {
   using BlockHeapManager::zebra_block_heap_id_;
 
   // A derived class to expose protected members for unit-testing. This has to
-  // be nested into this one because ShardedBlockQuarantine accesses some
+  // be nested into this one because SizeClassBlockQuarantine accesses some
   // protected fields of BlockHeapManager.
   //
   // This class should only expose some members or expose new functions, no new
   // member should be added.
-  class TestQuarantine : public ShardedBlockQuarantine {
+  class TestQuarantine : public SizeClassBlockQuarantine {
    public:
-    using ShardedBlockQuarantine::Node;
-    using ShardedBlockQuarantine::kShardingFactor;
-    using ShardedBlockQuarantine::heads_;
+    using SizeClassBlockQuarantine::Node;
+    using SizeClassBlockQuarantine::kShardingFactor;
+    using SizeClassBlockQuarantine::kSizeClassCount;
+    using SizeClassBlockQuarantine::heads_;
   };
 
   // Constructor.
@@ -371,30 +372,33 @@ class ScopedHeap {
   // Determines if the address @p mem corresponds to a block in the quarantine
   // of this heap.
   bool InQuarantine(const void* mem) {
-    // As we'll cast an AsanShardedQuarantine directly into a TestQuarantine
+    // As we'll cast the quarantine directly into a TestQuarantine
     // there shouldn't be any new field defined by this class, this should only
     // act as an interface allowing to access some private fields.
     static_assert(sizeof(TestQuarantine) ==
-                      sizeof(TestBlockHeapManager::ShardedBlockQuarantine),
+                      sizeof(TestBlockHeapManager::SizeClassBlockQuarantine),
                   "TestQuarantine isn't an interface.");
     TestQuarantine* test_quarantine =
         reinterpret_cast<TestQuarantine*>(GetQuarantine());
     EXPECT_NE(static_cast<TestQuarantine*>(nullptr), test_quarantine);
-    // Search through all of the shards.
-    for (size_t i = 0; i < test_quarantine->kShardingFactor; ++i) {
-      // Search through all blocks in each shard.
-      TestQuarantine::Node* current_node = test_quarantine->heads_[i];
-      while (current_node != nullptr) {
-        const uint8_t* body =
-            reinterpret_cast<const uint8_t*>(current_node->object.header) +
-            current_node->object.header_size;
-        if (body == mem) {
-          EXPECT_TRUE(
-              current_node->object.header->state == QUARANTINED_BLOCK ||
-              current_node->object.header->state == QUARANTINED_FLOODED_BLOCK);
-          return true;
+    // Search through all of the shards of all of the size classes.
+    for (size_t i = 0; i < test_quarantine->kSizeClassCount; ++i) {
+      for (size_t j = 0; j < test_quarantine->kShardingFactor; ++j) {
+        // Search through all blocks in each shard.
+        TestQuarantine::Node* current_node = test_quarantine->heads_[i][j];
+        while (current_node != nullptr) {
+          const uint8_t* body =
+              reinterpret_cast<const uint8_t*>(current_node->object.header) +
+              current_node->object.header_size;
+          if (body == mem) {
+            EXPECT_TRUE(current_node->object.header->state ==
+                            QUARANTINED_BLOCK ||
+                        current_node->object.header->state ==
+                            QUARANTINED_FLOODED_BLOCK);
+            return true;
+          }
+          current_node = current_node->next;
         }
-        current_node = current_node->next;
       }
     }
 
@@ -420,7 +424,8 @@ class ScopedHeap {
 // A value-parameterized test class for testing the BlockHeapManager class.
 class BlockHeapManagerTest : public testing::TestWithAsanRuntime {
  public:
-  typedef TestBlockHeapManager::ShardedBlockQuarantine ShardedBlockQuarantine;
+  typedef TestBlockHeapManager::SizeClassBlockQuarantine
+      SizeClassBlockQuarantine;
   typedef testing::TestWithAsanRuntime Super;
 
   BlockHeapManagerTest()
@@ -23,6 +23,7 @@
 #include "base/process/launch.h"
 #include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/time/time.h"
 #include "syzygy/common/rpc/helpers.h"
 #include "syzygy/trace/rpc/logger_rpc.h"
 
@@ -35,6 +36,16 @@ using ::common::rpc::GetInstanceString;
 
 AsanLogger* logger_instance = NULL;
 
+// The maximum number of bytes of text sent to the logger in a single batch.
+// A batch always contains at least one message, so this can be exceeded by a
+// single long message.
+const size_t kMaxBatchTextSize = 64 * 1024;
+
+// The time to wait for the background thread to leave ThreadMain when the
+// runtime is unloaded, in milliseconds. The thread only has to finish the
+// batch it is sending, if any.
+const int64_t kUnloadStopTimeoutMs = 5000;
+
 void InitExecutionContext(const CONTEXT& rtl_context,
                           ExecutionContext* exc_context) {
   DCHECK(exc_context != NULL);
@@ -67,7 +78,38 @@ void InitExecutionContext(const CONTEXT& rtl_context,
 
 }  // namespace
 
-AsanLogger::AsanLogger() : log_as_text_(true), minidump_on_failure_(false) {
+AsanLogger::AsanLogger()
+    : log_as_text_(true),
+      minidump_on_failure_(false),
+      ring_tail_(0),
+      ring_head_(0),
+      dropped_count_(0),
+      work_event_(false, false),
+      work_signaled_(0),
+      async_thread_running_(0),
+      async_thread_stopping_(0),
+      async_thread_exited_(true, false) {
+  static_assert((kRingBufferSize & (kRingBufferSize - 1)) == 0,
+                "The ring buffer size must be a power of two.");
+  for (size_t i = 0; i < kRingBufferSize; ++i) {
+    ring_[i].sequence = static_cast<base::subtle::Atomic32>(i);
+    ring_[i].message = nullptr;
+  }
+}
+
+AsanLogger::~AsanLogger() {
+  // This can run under the loader lock, so the background thread can't be
+  // joined here.
+  if (async_writes_enabled())
+    ignore_result(StopAsyncWritesForUnload());
+
+  // Discard the messages that couldn't be sent. This doesn't block, as the
+  // lock could be held by a thread that has been terminated at process exit.
+  if (flush_lock_.Try()) {
+    while (PendingMessage* message = PopMessage())
+      delete message;
+    flush_lock_.Release();
+  }
 }
 
 void AsanLogger::Init() {
@@ -94,14 +136,79 @@ void AsanLogger::Init() {
 }
 
 void AsanLogger::Stop() {
+  if (async_writes_enabled())
+    StopAsyncWrites();
   if (rpc_binding_.Get() != NULL) {
     ::common::rpc::InvokeRpc(&LoggerClient_Stop, rpc_binding_.Get());
   }
 }
 
+bool AsanLogger::StopAsyncWritesForUnload() {
+  if (!async_writes_enabled())
+    return true;
+
+  base::subtle::NoBarrier_Store(&async_thread_stopping_, 1);
+  base::subtle::MemoryBarrier();
+  work_event_.Signal();
+
+  // The producers send their messages synchronously from now on. See
+  // PushMessage.
+  base::subtle::NoBarrier_Store(&async_thread_running_, 0);
+  base::subtle::MemoryBarrier();
+
+  // A thread that has been terminated at process exit has a signaled handle,
+  // and will never signal |async_thread_exited_|. A live thread only needs
+  // to finish its current batch, which doesn't need the loader lock.
+  bool thread_done = ::WaitForSingleObject(async_thread_.platform_handle(),
+                                           0) == WAIT_OBJECT_0 ||
+      async_thread_exited_.TimedWait(
+          base::TimeDelta::FromMilliseconds(kUnloadStopTimeoutMs));
+  if (!thread_done)
+    LOG(ERROR) << "The asynchronous logging thread didn't stop.";
+
+  // Don't block here, the lock could be held by a thread that has been
+  // terminated at process exit.
+  if (thread_done && flush_lock_.Try()) {
+    FlushImpl();
+    flush_lock_.Release();
+  }
+
+  // The thread handle is leaked, as it can't be joined.
+  return thread_done;
+}
+
+bool AsanLogger::EnableAsyncWrites() {
+  DCHECK(!async_writes_enabled());
+
+  // There's nothing to do if we're not bound to a logging endpoint.
+  if (rpc_binding_.Get() == NULL)
+    return true;
+
+  base::subtle::NoBarrier_Store(&async_thread_stopping_, 0);
+  async_thread_exited_.Reset();
+  if (!base::PlatformThread::CreateWithPriority(
+          0, this, &async_thread_, base::ThreadPriority::BACKGROUND)) {
+    LOG(ERROR) << "Unable to start the asynchronous logging thread.";
+    return false;
+  }
+  base::subtle::Release_Store(&async_thread_running_, 1);
+  return true;
+}
+
+void AsanLogger::Flush() {
+  if (!async_writes_enabled())
+    return;
+  base::AutoLock lock(flush_lock_);
+  FlushImpl();
+}
+
 void AsanLogger::Write(const std::string& message) {
   // If we're bound to a logging endpoint, log the message there.
-  if (rpc_binding_.Get() != NULL) {
+  if (async_writes_enabled()) {
+    PendingMessage* pending_message = new PendingMessage();
+    pending_message->text = message;
+    PushMessage(pending_message);
+  } else if (rpc_binding_.Get() != NULL) {
     ::common::rpc::InvokeRpc(
         &LoggerClient_Write, rpc_binding_.Get(),
         reinterpret_cast<const unsigned char*>(message.c_str()));
@@ -110,6 +217,10 @@ void AsanLogger::Write(const std::string& message) {
 
 void AsanLogger::WriteWithContext(const std::string& message,
                                   const CONTEXT& context) {
+  // The logger walks the stack of this thread while handling this call, so it
+  // can't be deferred. Send the pending messages first to preserve the order.
+  Flush();
+
   // If we're bound to a logging endpoint, log the message there.
   if (rpc_binding_.Get() != NULL) {
     ExecutionContext exec_context = {};
@@ -124,7 +235,14 @@ void AsanLogger::WriteWithStackTrace(const std::string& message,
                                      const void * const * trace_data,
                                      uint32_t trace_length) {
   // If we're bound to a logging endpoint, log the message there.
-  if (rpc_binding_.Get() != NULL) {
+  if (async_writes_enabled()) {
+    PendingMessage* pending_message = new PendingMessage();
+    pending_message->text = message;
+    pending_message->trace.assign(
+        reinterpret_cast<const uintptr_t*>(trace_data),
+        reinterpret_cast<const uintptr_t*>(trace_data) + trace_length);
+    PushMessage(pending_message);
+  } else if (rpc_binding_.Get() != NULL) {
     ::common::rpc::InvokeRpc(
         &LoggerClient_WriteWithTrace, rpc_binding_.Get(),
         reinterpret_cast<const unsigned char*>(message.c_str()),
@@ -143,6 +261,9 @@ void AsanLogger::SaveMinidumpWithProtobufAndMemoryRanges(
   if (rpc_binding_.Get() == NULL)
     return;
 
+  // Make sure that the log is complete before the minidump is taken.
+  Flush();
+
   // Convert the memory ranges to arrays.
   std::vector<const void*> base_addresses;
   std::vector<size_t> range_lengths;
@@ -169,5 +290,169 @@ void AsanLogger::SaveMinidumpWithProtobufAndMemoryRanges(
       static_cast<uint32_t>(memory_ranges.size()));
 }
 
+bool AsanLogger::PushMessage(PendingMessage* message) {
+  DCHECK_NE(static_cast<PendingMessage*>(nullptr), message);
+
+  // Claim a slot by advancing the tail. A slot is free when its sequence
+  // number matches the position being claimed.
+  uint32_t position =
+      static_cast<uint32_t>(base::subtle::NoBarrier_Load(&ring_tail_));
+  RingBufferSlot* slot = nullptr;
+  while (true) {
+    slot = &ring_[position & (kRingBufferSize - 1)];
+    uint32_t sequence =
+        static_cast<uint32_t>(base::subtle::Acquire_Load(&slot->sequence));
+    int32_t difference =
+        static_cast<int32_t>(sequence) - static_cast<int32_t>(position);
+    if (difference == 0) {
+      uint32_t old_position = static_cast<uint32_t>(
+          base::subtle::NoBarrier_CompareAndSwap(
+              &ring_tail_, static_cast<base::subtle::Atomic32>(position),
+              static_cast<base::subtle::Atomic32>(position + 1)));
+      if (old_position == position)
+        break;
+      position = old_position;
+    } else if (difference < 0) {
+      // The ring buffer is full.
+      delete message;
+      base::subtle::NoBarrier_AtomicIncrement(&dropped_count_, 1);
+      return false;
+    } else {
+      // Another producer claimed this slot, try again with the new tail.
+      position =
+          static_cast<uint32_t>(base::subtle::NoBarrier_Load(&ring_tail_));
+    }
+  }
+
+  // Publish the message to the consumer.
+  slot->message = message;
+  base::subtle::Release_Store(
+      &slot->sequence, static_cast<base::subtle::Atomic32>(position + 1));
+
+  // Avoid over signaling by trying to raise the |work_signaled_| flag and
+  // bailing if the flag was already raised.
+  if (base::subtle::NoBarrier_CompareAndSwap(&work_signaled_, 0, 1) == 0)
+    work_event_.Signal();
+
+  // The asynchronous writes may have been stopped since the caller checked
+  // them, in which case the final flush in StopAsyncWrites may have missed
+  // this message. The barrier pairs with the one in StopAsyncWrites: either
+  // that flush sees the message, or we see the cleared flag and send the
+  // pending messages synchronously.
+  base::subtle::MemoryBarrier();
+  if (base::subtle::NoBarrier_Load(&async_thread_running_) == 0) {
+    base::AutoLock lock(flush_lock_);
+    FlushImpl();
+  }
+  return true;
+}
+
+AsanLogger::PendingMessage* AsanLogger::PopMessage() {
+  flush_lock_.AssertAcquired();
+
+  // The slot at the head is ready once its producer has published it. This
+  // also stops at a slot that has been claimed but not yet published, which
+  // preserves the order of the messages.
+  RingBufferSlot* slot = &ring_[ring_head_ & (kRingBufferSize - 1)];
+  uint32_t sequence =
+      static_cast<uint32_t>(base::subtle::Acquire_Load(&slot->sequence));
+  if (sequence != ring_head_ + 1)
+    return nullptr;
+
+  // Hand the slot back to the producers for the next lap of the ring.
+  PendingMessage* message = slot->message;
+  slot->message = nullptr;
+  base::subtle::Release_Store(
+      &slot->sequence,
+      static_cast<base::subtle::Atomic32>(ring_head_ + kRingBufferSize));
+  ++ring_head_;
+  return message;
+}
+
+void AsanLogger::FlushImpl() {
+  flush_lock_.AssertAcquired();
+
+  std::string text;
+  std::vector<unsigned long> trace_lengths;
+  std::vector<uintptr_t> trace_data;
+  while (true) {
+    text.clear();
+    trace_lengths.clear();
+    trace_data.clear();
+
+    // Report the messages that have been dropped since the last batch.
+    base::subtle::Atomic32 dropped_count =
+        base::subtle::NoBarrier_AtomicExchange(&dropped_count_, 0);
+    if (dropped_count != 0) {
+      text.append(base::StringPrintf(
+          "SyzyASAN: Dropped %d log messages.\n", dropped_count));
+      text.push_back('\0');
+      trace_lengths.push_back(0);
+    }
+
+    while (trace_lengths.size() < kMaxBatchSize &&
+           text.size() < kMaxBatchTextSize) {
+      std::unique_ptr<PendingMessage> message(PopMessage());
+      if (message.get() == nullptr)
+        break;
+      text.append(message->text);
+      text.push_back('\0');
+      trace_lengths.push_back(static_cast<unsigned long>(
+          message->trace.size()));
+      trace_data.insert(trace_data.end(), message->trace.begin(),
+                        message->trace.end());
+    }
+
+    if (trace_lengths.empty())
+      return;
+
+    // The RPC runtime doesn't accept null arrays, even when they're empty.
+    uintptr_t dummy_trace_data = 0;
+    ::common::rpc::InvokeRpc(
+        &LoggerClient_WriteBatch, rpc_binding_.Get(),
+        static_cast<unsigned long>(trace_lengths.size()),
+        reinterpret_cast<const byte*>(text.data()),
+        static_cast<unsigned long>(text.size()), trace_lengths.data(),
+        trace_data.empty() ? &dummy_trace_data : trace_data.data(),
+        static_cast<unsigned long>(trace_data.size()));
+  }
+}
+
+void AsanLogger::StopAsyncWrites() {
+  DCHECK(async_writes_enabled());
+
+  // Signal so that the thread can exit cleanly and then join it.
+  base::subtle::NoBarrier_Store(&async_thread_stopping_, 1);
+  // Make sure the change to |async_thread_stopping_| is not reordered.
+  base::subtle::MemoryBarrier();
+  work_event_.Signal();
+  base::PlatformThread::Join(async_thread_);
+
+  // From now on the messages are sent synchronously. Send the ones that are
+  // still pending. A producer that pushes a message after this flush sees the
+  // cleared flag, and sends it itself. See PushMessage.
+  base::subtle::NoBarrier_Store(&async_thread_running_, 0);
+  base::subtle::MemoryBarrier();
+  base::AutoLock lock(flush_lock_);
+  FlushImpl();
+}
+
+void AsanLogger::ThreadMain() {
+  base::PlatformThread::SetName("SyzyASAN Logger Thread");
+  while (true) {
+    work_event_.Wait();
+    if (base::subtle::NoBarrier_Load(&async_thread_stopping_))
+      break;
+    // Clear the |work_signaled_| flag before flushing, so that the messages
+    // pushed in the meantime cause another wake up.
+    base::subtle::NoBarrier_Store(&work_signaled_, 0);
+    base::AutoLock lock(flush_lock_);
+    FlushImpl();
+  }
+
+  // This must be the last use of this object by the thread.
+  async_thread_exited_.Signal();
+}
+
 }  // namespace asan
 }  // namespace agent
@@ -16,8 +16,13 @@
 #define SYZYGY_AGENT_ASAN_LOGGER_H_
 
 #include <string>
+#include <vector>
 
+#include "base/atomicops.h"
 #include "base/logging.h"
+#include "base/synchronization/lock.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/platform_thread.h"
 #include "syzygy/agent/asan/error_info.h"
 #include "syzygy/common/rpc/helpers.h"
 
@@ -27,9 +32,26 @@ namespace asan {
 struct AsanErrorInfo;
 
 // A wrapper class to manage the singleton Asan RPC logger instance.
-class AsanLogger {
+//
+// By default every message is sent to the logger with a synchronous RPC. When
+// asynchronous writes are enabled, Write and WriteWithStackTrace instead push
+// the message to a lock-free ring buffer and return immediately. A background
+// thread drains the buffer and sends the messages to the logger in batches.
+// If the buffer is full the message is dropped, and the number of dropped
+// messages is reported in the log. Messages that can't be deferred, like the
+// ones written with a context, flush the buffer before being sent so that the
+// order of the messages is preserved.
+class AsanLogger : public base::PlatformThread::Delegate {
  public:
+  // The number of messages that can be waiting to be sent to the logger.
+  // This must be a power of two.
+  static const size_t kRingBufferSize = 1024;
+
+  // The maximum number of messages sent to the logger in a single batch.
+  static const size_t kMaxBatchSize = 64;
+
   AsanLogger();
+  ~AsanLogger() override;
 
   // Set the RPC instance ID to use. If an instance-id is to be used by the
   // logger, it must be set before calling Init().
@@ -50,9 +72,40 @@ class AsanLogger {
   // Initialize the logger.
   void Init();
 
-  // Stop the logger.
+  // Stop the logger. This flushes the pending messages.
   void Stop();
 
+  // Stops the asynchronous writes when the runtime is unloaded. This runs
+  // under the loader lock, so it doesn't join the background thread, which
+  // can't exit without the loader lock, and it doesn't block on flush_lock_,
+  // which could be held by a thread that has been terminated at process exit.
+  // It only waits, for a bounded time, for a live background thread to leave
+  // ThreadMain. The pending messages are then sent if flush_lock_ is free.
+  // @returns true if the background thread no longer uses this object, in
+  //     which case it can be destroyed. Otherwise it must be leaked.
+  bool StopAsyncWritesForUnload();
+
+  // Enables the asynchronous writes. This starts the background thread, and
+  // must be called after Init.
+  // @returns true on success, false otherwise.
+  bool EnableAsyncWrites();
+
+  // @returns true if the asynchronous writes are enabled.
+  bool async_writes_enabled() const {
+    return base::subtle::Acquire_Load(&async_thread_running_) != 0;
+  }
+
+  // Sends all the pending messages to the logger, and waits for them to be
+  // written. This does nothing if the asynchronous writes aren't enabled.
+  void Flush();
+
+  // @returns the number of messages that have been dropped because the ring
+  //     buffer was full, since the last time that they were reported in the
+  //     log.
+  size_t dropped_message_count() const {
+    return static_cast<size_t>(base::subtle::NoBarrier_Load(&dropped_count_));
+  }
+
   // Write a @p message to the logger.
   void Write(const std::string& message);
 
@@ -80,6 +133,43 @@ class AsanLogger {
       const MemoryRanges& memory_ranges);
 
  protected:
+  // A message waiting to be sent to the logger.
+  struct PendingMessage {
+    std::string text;
+    std::vector<uintptr_t> trace;
+  };
+
+  // A slot of the ring buffer. The sequence number is used to hand the slot
+  // back and forth between the producers and the consumer.
+  struct RingBufferSlot {
+    base::subtle::Atomic32 sequence;
+    PendingMessage* message;
+  };
+
+  // Pushes a message to the ring buffer, waking up the background thread if
+  // necessary. If the asynchronous writes are stopped concurrently, this
+  // sends the pending messages synchronously instead. Takes ownership of
+  // @p message.
+  // @returns false if the ring buffer is full, in which case the message is
+  //     deleted and dropped.
+  bool PushMessage(PendingMessage* message);
+
+  // Pops a message from the ring buffer. The caller must hold flush_lock_.
+  // @returns the message, or nullptr if the ring buffer is empty. The caller
+  //     takes ownership of the message.
+  PendingMessage* PopMessage();
+
+  // Sends all the pending messages to the logger, in batches. The caller must
+  // hold flush_lock_.
+  void FlushImpl();
+
+  // Stops the background thread and flushes the pending messages.
+  void StopAsyncWrites();
+
+  // Implementation of base::PlatformThread::Delegate. This is the body of the
+  // background thread.
+  void ThreadMain() override;
+
   // The RPC binding.
   ::common::rpc::ScopedRpcBinding rpc_binding_;
 
@@ -94,6 +184,39 @@ class AsanLogger {
   // Default: false.
   bool minidump_on_failure_;
 
+  // The ring buffer of pending messages. The producers claim a slot by
+  // incrementing ring_tail_, and the single consumer (whoever holds
+  // flush_lock_) releases it by incrementing ring_head_.
+  RingBufferSlot ring_[kRingBufferSize];
+  base::subtle::Atomic32 ring_tail_;
+  uint32_t ring_head_;  // Under flush_lock_.
+
+  // Serializes the consumers of the ring buffer, so that the messages are
+  // sent in order.
+  base::Lock flush_lock_;
+
+  // The number of messages that have been dropped since they were last
+  // reported.
+  base::subtle::Atomic32 dropped_count_;
+
+  // Used to wake up the background thread. The flag is raised by the
+  // producer that signals the event, and is cleared by the background thread
+  // when it wakes up, to avoid over signaling.
+  base::WaitableEvent work_event_;
+  base::subtle::Atomic32 work_signaled_;
+
+  // The background thread, and whether it is running. The flag is read by
+  // the producers without holding any lock, and is cleared before the final
+  // flush in StopAsyncWrites.
+  base::PlatformThreadHandle async_thread_;
+  base::subtle::Atomic32 async_thread_running_;
+  base::subtle::Atomic32 async_thread_stopping_;
+
+  // Signaled by the background thread when it leaves ThreadMain, after which
+  // it no longer uses this object. This can be waited on under the loader
+  // lock, unlike the thread handle.
+  base::WaitableEvent async_thread_exited_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(AsanLogger);
 };
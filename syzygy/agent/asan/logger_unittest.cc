@@ -44,6 +44,7 @@ using testing::Return;
 
 class TestAsanLogger : public AsanLogger {
  public:
+  using AsanLogger::async_thread_exited_;
   using AsanLogger::instance_id_;
   using AsanLogger::rpc_binding_;
 };
@@ -141,6 +142,95 @@ TEST_F(AsanLoggerTest, EndToEnd) {
   // TODO(rogerm): Inspect the contents of the minidump.
 }
 
+TEST_F(AsanLoggerTest, AsyncWrites) {
+  const char* kMessages[] = {
+      "First message\n", "Second message\n", "Third message\n"};
+
+  {
+    // Setup a log file destination.
+    base::ScopedFILE destination(base::OpenFile(temp_path_, "wb"));
+
+    // Start up the logging service.
+    trace::agent_logger::AgentLogger server;
+    trace::agent_logger::RpcLoggerInstanceManager instance_manager(&server);
+    server.set_instance_id(instance_id_);
+    server.set_destination(destination.get());
+    ASSERT_TRUE(server.Start());
+
+    // Use the AsanLogger client, with asynchronous writes.
+    client_.set_instance_id(instance_id_);
+    client_.Init();
+    ASSERT_TRUE(client_.rpc_binding_.Get() != NULL);
+    ASSERT_TRUE(client_.EnableAsyncWrites());
+    EXPECT_TRUE(client_.async_writes_enabled());
+
+    void* trace[8] = {};
+    uint32_t trace_length =
+        ::CaptureStackBackTrace(0, arraysize(trace), trace, NULL);
+    client_.Write(kMessages[0]);
+    client_.WriteWithStackTrace(kMessages[1], trace, trace_length);
+    client_.Write(kMessages[2]);
+    client_.Flush();
+    EXPECT_EQ(0u, client_.dropped_message_count());
+
+    // Stopping the client switches back to synchronous writes.
+    client_.Stop();
+    EXPECT_FALSE(client_.async_writes_enabled());
+    ASSERT_TRUE(server.Join());
+  }
+
+  // The messages should have been logged in order.
+  std::string content;
+  ASSERT_TRUE(base::ReadFileToString(temp_path_, &content));
+  size_t first = content.find(kMessages[0]);
+  size_t second = content.find(kMessages[1]);
+  size_t third = content.find(kMessages[2]);
+  ASSERT_NE(std::string::npos, first);
+  ASSERT_NE(std::string::npos, second);
+  ASSERT_NE(std::string::npos, third);
+  EXPECT_LT(first, second);
+  EXPECT_LT(second, third);
+
+  // The stack trace should have been logged after the second message.
+  EXPECT_LT(second + ::strlen(kMessages[1]), third);
+}
+
+TEST_F(AsanLoggerTest, StopAsyncWritesForUnload) {
+  const char kMessage[] = "Pending message\n";
+
+  {
+    // Setup a log file destination.
+    base::ScopedFILE destination(base::OpenFile(temp_path_, "wb"));
+
+    // Start up the logging service.
+    trace::agent_logger::AgentLogger server;
+    trace::agent_logger::RpcLoggerInstanceManager instance_manager(&server);
+    server.set_instance_id(instance_id_);
+    server.set_destination(destination.get());
+    ASSERT_TRUE(server.Start());
+
+    // Use the AsanLogger client, with asynchronous writes.
+    client_.set_instance_id(instance_id_);
+    client_.Init();
+    ASSERT_TRUE(client_.rpc_binding_.Get() != NULL);
+    ASSERT_TRUE(client_.EnableAsyncWrites());
+
+    // The background thread leaves ThreadMain without being joined, and the
+    // pending message is sent.
+    client_.Write(kMessage);
+    EXPECT_TRUE(client_.StopAsyncWritesForUnload());
+    EXPECT_FALSE(client_.async_writes_enabled());
+    EXPECT_TRUE(client_.async_thread_exited_.IsSignaled());
+
+    client_.Stop();
+    ASSERT_TRUE(server.Join());
+  }
+
+  std::string content;
+  ASSERT_TRUE(base::ReadFileToString(temp_path_, &content));
+  EXPECT_NE(std::string::npos, content.find(kMessage));
+}
+
 TEST_F(AsanLoggerTest, Stop) {
   // Setup a log file destination.
   base::ScopedFILE destination(base::OpenFile(temp_path_, "wb"));
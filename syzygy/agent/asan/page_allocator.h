@@ -36,6 +36,7 @@ struct PageAllocatorStatistics;
 namespace detail {
 template<bool kKeepStats> struct PageAllocatorStatisticsHelper;
 template<size_t kObjectSize, size_t kPageSize> struct PageAllocatorPage;
+template<typename ObjectType> struct PageAllocatorFreeListHead;
 }  // namespace detail
 
 
@@ -44,7 +45,9 @@ template<size_t kObjectSize, size_t kPageSize> struct PageAllocatorPage;
 //       objects will be rounded up in size to be 4-byte aligned.
 
 
-// An untyped PageAllocator. Thread safety is provided by this object.
+// An untyped PageAllocator. Thread safety is provided by this object. The free
+// lists are lock-free, so allocations and frees only ever take a lock when a
+// new page needs to be carved up.
 // @tparam kObjectSize The size of objects returned by the allocator,
 //     in bytes. Objects will be tightly packed so any alignment constraints
 //     should be reflected in this size. Must be at least as big as a pointer.
@@ -66,6 +69,7 @@ class PageAllocator {
  public:
   typedef detail::PageAllocatorPage<kObjectSize, kPageSize> Page;
   typedef typename Page::Object Object;
+  typedef detail::PageAllocatorFreeListHead<Object> FreeListHead;
 
   // Constructor.
   PageAllocator();
@@ -148,23 +152,34 @@ class PageAllocator {
   // @note Handles locking, so no locks must already be held.
   bool IsInFreeList(const void* object, size_t count);
 
-  // Pops the top item from the given free list.
+  // Pops the top item from the given free list. This is lock-free.
   // @param count The size class.
   // @returns a pointer to the popped item, NULL if there was none.
-  // @note Handles locking, so no free_lock_ should be already held.
   Object* FreePop(size_t count);
 
-  // Pushes the given object to the specified free list. Directives as to
-  // statistics keeping are provided directly here to minimize the number of
-  // times the statistics lock needs to be taken.
+  // Pushes the given object to the specified free list. This is lock-free.
+  // Directives as to statistics keeping are provided directly here.
   // @param object The objects to free.
   // @param count The number of objects to free.
   // @param decr_alloc_groups If true then decrements allocated_groups.
   // @param decr_alloc_objects If true then decrements allocated_object.
-  // @note Handles locking, so no free_lock_ should be already held.
   void FreePush(Object* object, size_t count,
                 bool decr_alloc_groups, bool decr_alloc_objects);
 
+  // Pushes a chain of objects linked through their next_free pointers to the
+  // specified free list. This is lock-free.
+  // @param first The first object of the chain.
+  // @param last The last object of the chain.
+  // @param count The size class.
+  void FreePushChain(Object* first, Object* last, size_t count);
+
+  // Atomically detaches the entire content of a free list. The detached
+  // objects can safely be walked as they are invisible to other threads, and
+  // must be returned with FreePushChain.
+  // @param count The size class.
+  // @returns the first detached object, or nullptr if the list was empty.
+  Object* FreeDetach(size_t count);
+
   // Reserves a new page of objects, modifying current_page_ and
   // current_object_. Any remaining unallocated objects are stuffed into the
   // appropriate freed list. There may be no more than kMaxObjectCount of them.
@@ -185,14 +200,14 @@ class PageAllocator {
   // The next object to be allocated in the current page. Under lock_.
   Object* object_;
 
-  // A singly linked list of freed objects, one per possible size category.
-  // These are under the corresponding free_lock_.
-  Object* free_[kMaxObjectCount];
-
-  // Locks for the freed lists. This keeps contention down while freeing.
-  base::Lock free_lock_[kMaxObjectCount];
+  // A lock-free singly linked list of freed objects, one per possible size
+  // category. Objects are never returned to the OS while the allocator is
+  // alive, so a thread may safely read the next_free pointer of an object
+  // that has been concurrently popped; the tag of the list head then causes
+  // its update to fail.
+  volatile FreeListHead free_[kMaxObjectCount];
 
-  // The global lock for the allocator.
+  // The global lock for the allocator. This protects the page bookkeeping.
   base::Lock lock_;
 
   // For keeping statistics. If kKeepStats == 0 this is an empty struct with
@@ -22,6 +22,7 @@
 
 #include <algorithm>
 
+#include "base/atomicops.h"
 #include "base/logging.h"
 #include "syzygy/agent/asan/constants.h"
 #include "syzygy/common/align.h"
@@ -33,8 +34,6 @@ namespace detail {
 
 // Empty statistics helper.
 template<> struct PageAllocatorStatisticsHelper<false> {
-  void Lock() { }
-  void Unlock() { }
   template<size_t PageAllocatorStatistics::*stat> void Increment(size_t) { }
   template<size_t PageAllocatorStatistics::*stat> void Decrement(size_t) { }
   void GetStatistics(PageAllocatorStatistics* stats) const {
@@ -43,34 +42,50 @@ template<> struct PageAllocatorStatisticsHelper<false> {
   }
 };
 
-// Actual statistics helper.
+// Actual statistics helper. The individual statistics are updated atomically
+// so that keeping them doesn't serialize the allocator. A snapshot taken while
+// the allocator is in use may not be consistent across fields.
 template<> struct PageAllocatorStatisticsHelper<true> {
+  static_assert(sizeof(size_t) == sizeof(base::subtle::AtomicWord),
+                "Statistics can't be atomically updated.");
+
   PageAllocatorStatisticsHelper() {
     ::memset(&stats, 0, sizeof(stats));
   }
 
-  void Lock() { lock.Acquire(); }
-  void Unlock() { lock.Release(); }
-
   template<size_t PageAllocatorStatistics::*member>
   void Increment(size_t amount) {
-    lock.AssertAcquired();
-    stats.*member += amount;
+    base::subtle::NoBarrier_AtomicIncrement(Get<member>(), amount);
   }
 
   template<size_t PageAllocatorStatistics::*member>
   void Decrement(size_t amount) {
-    lock.AssertAcquired();
-    stats.*member -= amount;
+    base::subtle::NoBarrier_AtomicIncrement(
+        Get<member>(), -static_cast<base::subtle::AtomicWord>(amount));
   }
 
   void GetStatistics(PageAllocatorStatistics* stats) const {
-    lock.AssertAcquired();
     DCHECK_NE(static_cast<PageAllocatorStatistics*>(nullptr), stats);
-    *stats = this->stats;
+    stats->page_count = Load<&PageAllocatorStatistics::page_count>();
+    stats->allocated_groups =
+        Load<&PageAllocatorStatistics::allocated_groups>();
+    stats->allocated_objects =
+        Load<&PageAllocatorStatistics::allocated_objects>();
+    stats->freed_groups = Load<&PageAllocatorStatistics::freed_groups>();
+    stats->freed_objects = Load<&PageAllocatorStatistics::freed_objects>();
+  }
+
+  template<size_t PageAllocatorStatistics::*member>
+  base::subtle::AtomicWord* Get() {
+    return reinterpret_cast<base::subtle::AtomicWord*>(&(stats.*member));
+  }
+
+  template<size_t PageAllocatorStatistics::*member>
+  size_t Load() const {
+    return base::subtle::NoBarrier_Load(
+        reinterpret_cast<const base::subtle::AtomicWord*>(&(stats.*member)));
   }
 
-  base::Lock lock;
   PageAllocatorStatistics stats;
 };
 
@@ -87,6 +102,66 @@ struct PageAllocatorObject {
 };
 
 
+// The head of a lock-free (Treiber) free list. This pairs the top of the list
+// with a tag that is incremented every time an object is popped, so that a
+// pop racing with other pops and pushes of the same object (the ABA problem)
+// fails rather than corrupting the list. The pair is updated with a double
+// width compare-and-swap.
+template<typename ObjectType>
+#ifdef _WIN64
+struct __declspec(align(16)) PageAllocatorFreeListHead {
+#else
+struct __declspec(align(8)) PageAllocatorFreeListHead {
+#endif
+  ObjectType* top;
+  uintptr_t tag;
+};
+
+// Atomically replaces @p head with @p desired if it is equal to @p expected.
+// @param head The free list head to update.
+// @param expected The expected value of @p head. On failure this is updated
+//     with its current value.
+// @param desired The new value of @p head.
+// @returns true if @p head was updated.
+template<typename ObjectType>
+bool PageAllocatorFreeListHeadCompareAndSwap(
+    volatile PageAllocatorFreeListHead<ObjectType>* head,
+    PageAllocatorFreeListHead<ObjectType>* expected,
+    const PageAllocatorFreeListHead<ObjectType>& desired) {
+  static_assert(sizeof(*head) == 2 * sizeof(void*),
+                "Free list head must be double pointer sized.");
+#ifdef _WIN64
+  return ::InterlockedCompareExchange128(
+      reinterpret_cast<volatile LONG64*>(head),
+      static_cast<LONG64>(desired.tag),
+      reinterpret_cast<LONG64>(desired.top),
+      reinterpret_cast<LONG64*>(expected)) != 0;
+#else
+  LONG64 expected_value = *reinterpret_cast<const LONG64*>(expected);
+  LONG64 value = ::InterlockedCompareExchange64(
+      reinterpret_cast<volatile LONG64*>(head),
+      *reinterpret_cast<const LONG64*>(&desired),
+      expected_value);
+  if (value == expected_value)
+    return true;
+  *reinterpret_cast<LONG64*>(expected) = value;
+  return false;
+#endif
+}
+
+// Reads the head of a free list. The read isn't atomic and can be torn, but
+// any inconsistency is caught by the subsequent compare-and-swap.
+// @param head The free list head to read.
+// @returns a copy of @p head.
+template<typename ObjectType>
+PageAllocatorFreeListHead<ObjectType> PageAllocatorFreeListHeadRead(
+    const volatile PageAllocatorFreeListHead<ObjectType>* head) {
+  PageAllocatorFreeListHead<ObjectType> value = {};
+  value.top = head->top;
+  value.tag = head->tag;
+  return value;
+}
+
 template<size_t kMinPageSize>
 struct PageAllocatorPageSize {
   // The kPageSize calculation below presumes a 64KB allocation
@@ -158,7 +233,10 @@ PageAllocator()
   static_assert(sizeof(Page) % kUsualPageSize == 0, "Invalid page size.");
 
   // Clear the freelists.
-  ::memset(free_, 0, sizeof(free_));
+  for (size_t i = 0; i < kMaxObjectCount; ++i) {
+    free_[i].top = nullptr;
+    free_[i].tag = 0;
+  }
 }
 
 template<size_t kObjectSize, size_t kMaxObjectCount, size_t kPageSize,
@@ -228,21 +306,18 @@ Allocate(size_t count, size_t* received) {
   // freed list.
   for (size_t n = count; n <= kMaxObjectCount; ++n) {
     // This is racy and can end up lying to us. However, it's faster to first
-    // check this outside of the lock. We do this properly afterwards.
-    if (free_[n - 1] == nullptr)
+    // check this before attempting to pop from the list.
+    if (free_[n - 1].top == nullptr)
       continue;
 
-    // Unlink the objects from the free list of size n. This actually acquires
-    // the appropriate free-list lock.
+    // Unlink the objects from the free list of size n.
     object = FreePop(n);
     if (object == nullptr)
       continue;
 
     // Update statistics.
-    stats_.Lock();
     stats_.Increment<&PageAllocatorStatistics::allocated_groups>(1);
     stats_.Increment<&PageAllocatorStatistics::allocated_objects>(n);
-    stats_.Unlock();
 
     *received = n;
     return object;
@@ -269,10 +344,8 @@ Allocate(size_t count, size_t* received) {
   }
 
   // Update statistics.
-  stats_.Lock();
   stats_.Increment<&PageAllocatorStatistics::allocated_groups>(1);
   stats_.Increment<&PageAllocatorStatistics::allocated_objects>(count);
-  stats_.Unlock();
 
   *received = count;
   return object;
@@ -303,10 +376,7 @@ template<size_t kObjectSize, size_t kMaxObjectCount, size_t kPageSize,
 void PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats>::
 GetStatistics(PageAllocatorStatistics* stats) {
   DCHECK_NE(static_cast<PageAllocatorStatistics*>(nullptr), stats);
-
-  stats_.Lock();
   stats_.GetStatistics(stats);
-  stats_.Unlock();
 }
 
 template<size_t kObjectSize, size_t kMaxObjectCount, size_t kPageSize,
@@ -384,23 +454,31 @@ IsInFreeList(const void* object, size_t count) {
     n_max = count;
   }
 
-  // Iterate over the applicable size classes.
-  for (size_t n = n_min; n <= n_max; ++n) {
-    base::AutoLock lock(free_lock_[n - 1]);
+  // Iterate over the applicable size classes. As other threads may be
+  // concurrently popping objects and reusing them, the lists can't be walked
+  // in place. Each one is detached, walked and then returned.
+  bool found = false;
+  for (size_t n = n_min; n <= n_max && !found; ++n) {
+    Object* first = FreeDetach(n);
+    if (first == nullptr)
+      continue;
 
     // Walk the list for this size class.
-    Object* free = free_[n - 1];
-    while (free) {
-      if (free == object)
-        return true;
+    Object* last = first;
+    while (true) {
+      if (last == object)
+        found = true;
+      if (last->next_free == nullptr)
+        break;
 
       // Jump to the next freed object in this size class.
-      free = free->next_free;
+      last = last->next_free;
     }
+
+    FreePushChain(first, last, n);
   }
 
-  // The freed objects have been exhausted and no match was found.
-  return false;
+  return found;
 }
 
 template<size_t kObjectSize, size_t kMaxObjectCount, size_t kPageSize,
@@ -412,20 +490,28 @@ PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats>::
   DCHECK_LT(0u, count);
   DCHECK_GE(kMaxObjectCount, count);
 
-  Object* object = nullptr;
-  {
-    base::AutoLock lock(free_lock_[count - 1]);
-    object = free_[count - 1];
-    if (object)
-      free_[count - 1] = object->next_free;
+  volatile FreeListHead* head = &free_[count - 1];
+  FreeListHead expected = detail::PageAllocatorFreeListHeadRead(head);
+  while (expected.top != nullptr) {
+    // The top object may concurrently be popped and handed out, in which case
+    // this reads garbage. The tag will have changed and the swap will fail.
+    FreeListHead desired = {};
+    desired.top = expected.top->next_free;
+    desired.tag = expected.tag + 1;
+    if (detail::PageAllocatorFreeListHeadCompareAndSwap(head, &expected,
+                                                        desired)) {
+      break;
+    }
   }
+
+  Object* object = expected.top;
+  if (object == nullptr)
+    return nullptr;
   object->next_free = nullptr;
 
   // Update statistics.
-  stats_.Lock();
   stats_.Decrement<&PageAllocatorStatistics::freed_groups>(1);
   stats_.Decrement<&PageAllocatorStatistics::freed_objects>(count);
-  stats_.Unlock();
 
   return object;
 }
@@ -439,21 +525,58 @@ void PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats>::
   DCHECK_LT(0u, count);
   DCHECK_GE(kMaxObjectCount, count);
 
-  {
-    base::AutoLock lock(free_lock_[count - 1]);
-    object->next_free = free_[count - 1];
-    free_[count - 1] = object;
-  }
+  FreePushChain(object, object, count);
 
   // Update statistics.
-  stats_.Lock();
   if (decr_alloc_groups)
     stats_.Decrement<&PageAllocatorStatistics::allocated_groups>(1);
   if (decr_alloc_objects)
     stats_.Decrement<&PageAllocatorStatistics::allocated_objects>(count);
   stats_.Increment<&PageAllocatorStatistics::freed_groups>(1);
   stats_.Increment<&PageAllocatorStatistics::freed_objects>(count);
-  stats_.Unlock();
+}
+
+template<size_t kObjectSize, size_t kMaxObjectCount, size_t kPageSize,
+         bool kKeepStats>
+void PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats>::
+    FreePushChain(Object* first, Object* last, size_t count) {
+  DCHECK_NE(static_cast<Object*>(nullptr), first);
+  DCHECK_NE(static_cast<Object*>(nullptr), last);
+  DCHECK_LT(0u, count);
+  DCHECK_GE(kMaxObjectCount, count);
+
+  // Pushing doesn't need to change the tag, only pops are subject to ABA.
+  volatile FreeListHead* head = &free_[count - 1];
+  FreeListHead expected = detail::PageAllocatorFreeListHeadRead(head);
+  FreeListHead desired = {};
+  desired.top = first;
+  do {
+    last->next_free = expected.top;
+    desired.tag = expected.tag;
+  } while (!detail::PageAllocatorFreeListHeadCompareAndSwap(head, &expected,
+                                                            desired));
+}
+
+template<size_t kObjectSize, size_t kMaxObjectCount, size_t kPageSize,
+         bool kKeepStats>
+typename
+PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats>::Object*
+PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats>::
+    FreeDetach(size_t count) {
+  DCHECK_LT(0u, count);
+  DCHECK_GE(kMaxObjectCount, count);
+
+  volatile FreeListHead* head = &free_[count - 1];
+  FreeListHead expected = detail::PageAllocatorFreeListHeadRead(head);
+  FreeListHead desired = {};
+  while (expected.top != nullptr) {
+    desired.tag = expected.tag + 1;
+    if (detail::PageAllocatorFreeListHeadCompareAndSwap(head, &expected,
+                                                        desired)) {
+      break;
+    }
+  }
+  return expected.top;
 }
 
 template<size_t kObjectSize, size_t kMaxObjectCount, size_t kPageSize,
@@ -507,10 +630,7 @@ bool PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats>::
   ++page_count_;
 
   // Update statistics.
-  // NOTE: This can also be moved out from under lock_.
-  stats_.Lock();
   stats_.Increment<&PageAllocatorStatistics::page_count>(1);
-  stats_.Unlock();
 
   return true;
 }
@@ -14,7 +14,14 @@
 
 #include "syzygy/agent/asan/page_allocator.h"
 
+#include <memory>
+#include <vector>
+
+#include "base/strings/stringprintf.h"
+#include "base/threading/simple_thread.h"
 #include "gtest/gtest.h"
+#include "syzygy/testing/metrics.h"
+#include "syzygy/testing/thread_utils.h"
 
 namespace agent {
 namespace asan {
@@ -48,7 +55,7 @@ class TestPageAllocator
 
     size_t free_objects = 0;
     for (size_t n = n_min; n <= n_max; ++n) {
-      Object* free = free_[n - 1];
+      Object* free = free_[n - 1].top;
       while (free) {
         free_objects += n;
         free = free->next_free;
@@ -63,6 +70,7 @@ class TestPageAllocator
   }
 
   using Super::AllocatePageLocked;
+  using Super::FreePop;
   using Super::page_;
   using Super::object_;
   using Super::free_;
@@ -86,6 +94,80 @@ class TestTypedPageAllocator
 typedef TestPageAllocator<16, 1, 4096> TestPageAllocator255;
 typedef TestPageAllocator<16, 10, 4096> TestPageAllocatorMulti255;
 
+// Repeatedly allocates and frees objects from a shared allocator. Each thread
+// keeps a window of live allocations, which it fills with a thread specific
+// pattern and validates before freeing them.
+class AllocatorChurnRunner : public base::DelegateSimpleThread::Delegate {
+ public:
+  static const size_t kWindowSize = 16;
+
+  AllocatorChurnRunner(TestPageAllocatorMulti255* allocator,
+                       size_t iterations,
+                       uint8_t pattern)
+      : allocator_(allocator), iterations_(iterations), pattern_(pattern),
+        corrupt_(false) {}
+
+  void Run() override {
+    void* window[kWindowSize] = {};
+    size_t counts[kWindowSize] = {};
+    for (size_t i = 0; i < iterations_; ++i) {
+      size_t slot = i % kWindowSize;
+      if (window[slot] != nullptr) {
+        if (!CheckPattern(window[slot], counts[slot]))
+          corrupt_ = true;
+        allocator_->Free(window[slot], counts[slot]);
+      }
+      counts[slot] = (i % 3) + 1;
+      window[slot] = allocator_->Allocate(counts[slot]);
+      ::memset(window[slot], pattern_, counts[slot] * 16);
+    }
+
+    for (size_t i = 0; i < kWindowSize; ++i) {
+      if (window[i] == nullptr)
+        continue;
+      if (!CheckPattern(window[i], counts[i]))
+        corrupt_ = true;
+      allocator_->Free(window[i], counts[i]);
+    }
+  }
+
+  bool corrupt() const { return corrupt_; }
+
+ private:
+  bool CheckPattern(const void* alloc, size_t count) const {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(alloc);
+    for (size_t i = 0; i < count * 16; ++i) {
+      if (bytes[i] != pattern_)
+        return false;
+    }
+    return true;
+  }
+
+  TestPageAllocatorMulti255* allocator_;
+  size_t iterations_;
+  uint8_t pattern_;
+  bool corrupt_;
+};
+
+// Runs @p thread_count AllocatorChurnRunners concurrently on @p allocator.
+// @returns the average number of cycles per allocation and free pair on each
+//     thread.
+uint64_t RunAllocatorChurn(TestPageAllocatorMulti255* allocator,
+                           size_t thread_count,
+                           size_t iterations) {
+  std::vector<std::unique_ptr<AllocatorChurnRunner>> runners;
+  for (size_t i = 0; i < thread_count; ++i) {
+    runners.push_back(std::unique_ptr<AllocatorChurnRunner>(
+        new AllocatorChurnRunner(allocator, iterations,
+                                 static_cast<uint8_t>(i + 1))));
+  }
+  uint64_t cycles = testing::RunDelegatesConcurrently(runners);
+
+  for (auto& runner : runners)
+    EXPECT_FALSE(runner->corrupt());
+  return cycles / iterations;
+}
+
 }  // namespace
 
 TEST(PageAllocatorTest, Constructor) {
@@ -93,14 +175,14 @@ TEST(PageAllocatorTest, Constructor) {
   EXPECT_EQ(255, TestPageAllocator255::Page::kObjectsPerPage);
   EXPECT_TRUE(pa.page_ == nullptr);
   EXPECT_TRUE(pa.object_ == nullptr);
-  EXPECT_TRUE(pa.free_[0] == nullptr);
+  EXPECT_TRUE(pa.free_[0].top == nullptr);
 
   TestPageAllocatorMulti255 mpa;
   EXPECT_EQ(255, TestPageAllocatorMulti255::Page::kObjectsPerPage);
   EXPECT_TRUE(mpa.page_ == nullptr);
   EXPECT_TRUE(mpa.object_ == nullptr);
   for (size_t i = 0; i < arraysize(mpa.free_); ++i)
-    EXPECT_TRUE(mpa.free_[i] == nullptr);
+    EXPECT_TRUE(mpa.free_[i].top == nullptr);
 }
 
 TEST(PageAllocatorTest, AllocatePage) {
@@ -401,6 +483,41 @@ TEST(PageAllocatorTest, MultiSlabsPagesBiggerThanAllGranularity) {
     pa.Allocate(1);
 }
 
+TEST(PageAllocatorTest, FreePopFromEmptyList) {
+  TestPageAllocatorMulti255 pa;
+  EXPECT_EQ(static_cast<TestPageAllocatorMulti255::Object*>(nullptr),
+            pa.FreePop(1));
+
+  void* alloc = pa.Allocate(2);
+  pa.Free(alloc, 2);
+  EXPECT_EQ(alloc, pa.FreePop(2));
+  EXPECT_EQ(static_cast<TestPageAllocatorMulti255::Object*>(nullptr),
+            pa.FreePop(2));
+}
+
+TEST(PageAllocatorTest, ConcurrentAllocsAndFrees) {
+  TestPageAllocatorMulti255 pa;
+  RunAllocatorChurn(&pa, 4, 100000);
+
+  // Everything has been returned, and the free lists are intact.
+  EXPECT_EQ(0u, pa.stats().allocated_groups);
+  EXPECT_EQ(0u, pa.stats().allocated_objects);
+  EXPECT_EQ(pa.stats().freed_objects, pa.FreeObjects(0));
+}
+
+TEST(PageAllocatorTest, ContentionPerfTest) {
+  // Emits the average number of cycles per allocation and free pair as the
+  // number of threads sharing the allocator grows.
+  for (size_t thread_count = 1; thread_count <= 8; thread_count *= 2) {
+    TestPageAllocatorMulti255 pa;
+    uint64_t cycles = RunAllocatorChurn(&pa, thread_count, 200000);
+    testing::EmitMetric(
+        base::StringPrintf("Syzygy.Asan.PageAllocator.Contention.%uThreads",
+                           static_cast<uint32_t>(thread_count)),
+        cycles);
+  }
+}
+
 TEST(TypedPageAllocatorTest, SingleEndToEnd) {
   TypedPageAllocator<size_t, 1, 1000, true> pa;
   for (size_t i = 0; i < 1600; ++i) {
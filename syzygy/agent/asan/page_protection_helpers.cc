@@ -65,6 +65,14 @@ void BlockProtectNone(const BlockInfo& block_info, Shadow* shadow) {
     return;
 
   ::common::AutoRecursiveLock lock(block_protect_lock);
+  BlockProtectNoneUnlocked(block_info, shadow);
+}
+
+void BlockProtectNoneUnlocked(const BlockInfo& block_info, Shadow* shadow) {
+  DCHECK_NE(static_cast<Shadow*>(nullptr), shadow);
+  if (block_info.block_pages_size == 0)
+    return;
+
   DCHECK_NE(static_cast<uint8_t*>(nullptr), block_info.block_pages);
   DWORD old_protection = 0;
   DWORD ret = ::VirtualProtect(block_info.block_pages,
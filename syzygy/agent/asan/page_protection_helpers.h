@@ -56,6 +56,14 @@ bool GetBlockInfo(const Shadow* shadow,
 // @note Under block_protect_lock.
 void BlockProtectNone(const BlockInfo& block_info, Shadow* shadow);
 
+// Same as BlockProtectNone, but doesn't acquire block_protect_lock. This is
+// used by the threads that the heap checker spreads its work across.
+// @param block_info The block whose protections are to be modified.
+// @param shadow The shadow to update.
+// @note The caller must ensure that block_protect_lock is held on its behalf
+//     by another thread for the duration of the call.
+void BlockProtectNoneUnlocked(const BlockInfo& block_info, Shadow* shadow);
+
 // Protects all entire pages that are spanned by the redzones of the
 // block. All pages intersecting the body of the block will be explicitly
 // unprotected. All pages not intersecting the body but only partially
@@ -0,0 +1,158 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Implements a quarantine that segregates objects by size class.
+
+#ifndef SYZYGY_AGENT_ASAN_QUARANTINES_SIZE_CLASS_QUARANTINE_H_
+#define SYZYGY_AGENT_ASAN_QUARANTINES_SIZE_CLASS_QUARANTINE_H_
+
+#include "base/atomicops.h"
+#include "base/synchronization/lock.h"
+#include "syzygy/agent/asan/page_allocator.h"
+#include "syzygy/agent/asan/quarantines/sharded_quarantine.h"
+#include "syzygy/agent/asan/quarantines/size_limited_quarantine.h"
+
+namespace agent {
+namespace asan {
+namespace quarantines {
+
+// A sharded quarantine that keeps a separate set of FIFO lists for each of a
+// fixed number of size classes. Each size class is given an equal share of
+// the quarantine budget, and objects are always evicted from the class that
+// exceeds its share by the most. This prevents a burst of large objects from
+// flushing out all of the small ones, which would otherwise dramatically
+// shorten the time during which a use-after-free on them can be detected.
+//
+// Within a size class, objects are distributed among shards exactly like in
+// ShardedQuarantine. Each (size class, shard) list has its own lock, and
+// selecting a victim only requires looking at the per-class sizes, so
+// trimming is O(1) in the number of quarantined objects.
+//
+// @tparam ObjectType The type of object being stored in the cache.
+// @tparam SizeFunctorType A functor for extracting the size associated with
+//     an object.
+// @tparam HashFunctorType A functor for calculating a hash value associated
+//     with an object. See ShardedQuarantine for details.
+// @tparam ShardingFactor The number of shards per size class. Must be at
+//     least 1.
+template<typename ObjectType,
+         typename SizeFunctorType,
+         typename HashFunctorType,
+         size_t ShardingFactor>
+class SizeClassQuarantine
+    : public SizeLimitedQuarantineImpl<ObjectType, SizeFunctorType> {
+ public:
+  typedef HashFunctorType HashFunctor;
+
+  static const size_t kShardingFactor = ShardingFactor;
+
+  // The number of size classes. The upper bounds of the classes are 64B,
+  // 256B, 1KB, 4KB, 16KB, 64KB and 256KB, and the last class holds all of
+  // the bigger objects.
+  static const size_t kSizeClassCount = 8;
+
+  // Constructor. The hash functor must have a default constructor.
+  SizeClassQuarantine();
+
+  // Constructor with explicit hash functor. The hash functor must have
+  // a copy constructor.
+  explicit SizeClassQuarantine(const HashFunctor& hash_functor);
+
+  // Virtual destructor.
+  virtual ~SizeClassQuarantine() { }
+
+  // Returns the size class of an object of a given size.
+  // @param size The size of the object.
+  // @returns the size class, in [0, kSizeClassCount).
+  static size_t GetSizeClass(size_t size);
+
+  // @returns the total size of the objects in a size class. This is racy and
+  //     should only be used in tests.
+  // @param size_class The size class to query.
+  size_t GetSizeClassSizeForTesting(size_t size_class) const;
+
+ protected:
+  // @name SizeLimitedQuarantineImpl implementation.
+  // @{
+  bool PushImpl(const Object& object) override;
+  bool PopImpl(Object* object) override;
+  void EmptyImpl(ObjectVector* objects) override;
+  void PopBatchImpl(size_t max_count,
+                    size_t max_size,
+                    ObjectVector* objects) override;
+  size_t GetLockIdImpl(const Object& object) override;
+  void LockImpl(size_t id) override;
+  void UnlockImpl(size_t id) override;
+  // @}
+
+  // The internal type used for storing objects. This augments them with a
+  // 'next' pointer for chaining them together in the cache. These live in
+  // a simple page-allocator.
+  struct Node {
+    Object object;
+    Node* next;
+  };
+
+  // A simple page allocator that can only allocate individual nodes, and
+  // does no bookkeeping. See ShardedQuarantine for the choice of page size.
+  typedef TypedPageAllocator<Node, 1, 32 * 1024, false> NodeCache;
+
+  // Returns the size class whose objects should be evicted next. This is the
+  // class that exceeds its share of the budget by the most, or the biggest
+  // one if none of them exceeds it.
+  // @returns the size class to evict from.
+  size_t SelectVictimSizeClass() const;
+
+  // Pops up to @p max_count objects, or @p max_size bytes worth of objects,
+  // from a single non-empty list of a size class.
+  // @param size_class The size class to pop from.
+  // @param max_count The maximum number of objects to pop.
+  // @param max_size The size after which to stop popping objects.
+  // @param objects The popped objects are appended to this vector.
+  // @returns the total size of the popped objects.
+  size_t PopFromSizeClass(size_t size_class,
+                          size_t max_count,
+                          size_t max_size,
+                          ObjectVector* objects);
+
+  // Linked lists containing quarantined objects, indexed by size class and
+  // shard. Each list is under the corresponding locks_ entry. Objects are
+  // inserted at the tail, and removed from the head.
+  Node* heads_[kSizeClassCount][kShardingFactor];
+  Node* tails_[kSizeClassCount][kShardingFactor];
+
+  // Storage for nodes, one per list. Each is under its own internal lock.
+  NodeCache node_caches_[kSizeClassCount][kShardingFactor];
+
+  // Locks, one per linked list.
+  base::Lock locks_[kSizeClassCount][kShardingFactor];
+
+  // The total size of the objects in each size class. These are atomically
+  // accessed and, like the overall size, are only eventually consistent.
+  base::subtle::AtomicWord size_class_sizes_[kSizeClassCount];
+
+  // The hash functor that will be used to assign objects to shards.
+  HashFunctor hash_functor_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(SizeClassQuarantine);
+};
+
+}  // namespace quarantines
+}  // namespace asan
+}  // namespace agent
+
+#include "syzygy/agent/asan/quarantines/size_class_quarantine_impl.h"
+
+#endif  // SYZYGY_AGENT_ASAN_QUARANTINES_SIZE_CLASS_QUARANTINE_H_
@@ -0,0 +1,270 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Internal implementation of a size class quarantine. This file is not
+// meant to be included directly.
+
+#ifndef SYZYGY_AGENT_ASAN_QUARANTINES_SIZE_CLASS_QUARANTINE_IMPL_H_
+#define SYZYGY_AGENT_ASAN_QUARANTINES_SIZE_CLASS_QUARANTINE_IMPL_H_
+
+#include "string.h"
+
+namespace agent {
+namespace asan {
+namespace quarantines {
+
+template<typename OT, typename SFT, typename HFT, size_t SF>
+SizeClassQuarantine<OT, SFT, HFT, SF>::SizeClassQuarantine() {
+  static_assert(kShardingFactor >= 1, "Invalid sharding factor.");
+  ::memset(heads_, 0, sizeof(heads_));
+  ::memset(tails_, 0, sizeof(tails_));
+  ::memset(size_class_sizes_, 0, sizeof(size_class_sizes_));
+}
+
+template<typename OT, typename SFT, typename HFT, size_t SF>
+SizeClassQuarantine<OT, SFT, HFT, SF>::SizeClassQuarantine(
+    const HashFunctor& hash_functor)
+    : hash_functor_(hash_functor) {
+  static_assert(kShardingFactor >= 1, "Invalid sharding factor.");
+  ::memset(heads_, 0, sizeof(heads_));
+  ::memset(tails_, 0, sizeof(tails_));
+  ::memset(size_class_sizes_, 0, sizeof(size_class_sizes_));
+}
+
+template<typename OT, typename SFT, typename HFT, size_t SF>
+size_t SizeClassQuarantine<OT, SFT, HFT, SF>::GetSizeClass(size_t size) {
+  // The classes grow by a factor of 4, starting at 64 bytes.
+  size_t size_class = 0;
+  size_t bound = 64;
+  while (size_class + 1 < kSizeClassCount && size > bound) {
+    ++size_class;
+    bound <<= 2;
+  }
+  return size_class;
+}
+
+template<typename OT, typename SFT, typename HFT, size_t SF>
+size_t SizeClassQuarantine<OT, SFT, HFT, SF>::GetSizeClassSizeForTesting(
+    size_t size_class) const {
+  DCHECK_LT(size_class, kSizeClassCount);
+  return base::subtle::NoBarrier_Load(&size_class_sizes_[size_class]);
+}
+
+template<typename OT, typename SFT, typename HFT, size_t SF>
+bool SizeClassQuarantine<OT, SFT, HFT, SF>::PushImpl(const Object& object) {
+  size_t size = size_functor_(object);
+  size_t size_class = GetSizeClass(size);
+  size_t hash = hash_functor_(object);
+  size_t shard = detail::ShardedQuarantineHash<kShardingFactor>(hash);
+  // Make sure the corresponding lock is held.
+  locks_[size_class][shard].AssertAcquired();
+
+  Node* node = node_caches_[size_class][shard].Allocate(1);
+  if (node == NULL)
+    return false;
+  node->object = object;
+  node->next = NULL;
+
+  // Append the node to the tail of this list.
+  Node*& head = heads_[size_class][shard];
+  Node*& tail = tails_[size_class][shard];
+  if (tail != NULL) {
+    DCHECK_NE(static_cast<Node*>(NULL), head);
+    tail->next = node;
+    tail = node;
+  } else {
+    DCHECK_EQ(static_cast<Node*>(NULL), head);
+    head = node;
+    tail = node;
+  }
+
+  base::subtle::NoBarrier_AtomicIncrement(&size_class_sizes_[size_class],
+                                          size);
+  return true;
+}
+
+template<typename OT, typename SFT, typename HFT, size_t SF>
+bool SizeClassQuarantine<OT, SFT, HFT, SF>::PopImpl(Object* object) {
+  DCHECK_NE(static_cast<Object*>(NULL), object);
+
+  ObjectVector objects;
+  PopBatchImpl(1, 1, &objects);
+  if (objects.empty())
+    return false;
+  DCHECK_EQ(1u, objects.size());
+  *object = objects.front();
+  return true;
+}
+
+template<typename OT, typename SFT, typename HFT, size_t SF>
+void SizeClassQuarantine<OT, SFT, HFT, SF>::PopBatchImpl(
+    size_t max_count, size_t max_size, ObjectVector* objects) {
+  DCHECK_NE(static_cast<ObjectVector*>(NULL), objects);
+
+  size_t popped_count = 0;
+  size_t popped_size = 0;
+  while (popped_count < max_count && popped_size < max_size) {
+    size_t old_count = objects->size();
+    size_t size_class = SelectVictimSizeClass();
+    popped_size += PopFromSizeClass(size_class, max_count - popped_count,
+                                    max_size - popped_size, objects);
+
+    // The victim class can turn out to be empty if other threads emptied it
+    // since its size was read. Fall back to scanning all of the classes,
+    // starting with the ones containing the biggest objects.
+    for (size_t i = kSizeClassCount; objects->size() == old_count && i > 0;
+         --i) {
+      popped_size += PopFromSizeClass(i - 1, max_count - popped_count,
+                                      max_size - popped_size, objects);
+    }
+
+    // There's nothing left to pop.
+    if (objects->size() == old_count)
+      return;
+    popped_count += objects->size() - old_count;
+  }
+}
+
+template<typename OT, typename SFT, typename HFT, size_t SF>
+void SizeClassQuarantine<OT, SFT, HFT, SF>::EmptyImpl(ObjectVector* objects) {
+  DCHECK_NE(static_cast<ObjectVector*>(NULL), objects);
+
+  // Iterate over each list and add the objects to the vector.
+  for (size_t size_class = 0; size_class < kSizeClassCount; ++size_class) {
+    for (size_t shard = 0; shard < kShardingFactor; ++shard) {
+      base::AutoLock lock(locks_[size_class][shard]);
+
+      size_t size = 0;
+      Node* node = heads_[size_class][shard];
+      while (node) {
+        objects->push_back(node->object);
+        size += size_functor_(node->object);
+        Node* next_node = node->next;
+        node_caches_[size_class][shard].Free(node, 1);
+        node = next_node;
+      }
+      heads_[size_class][shard] = NULL;
+      tails_[size_class][shard] = NULL;
+
+      base::subtle::NoBarrier_AtomicIncrement(&size_class_sizes_[size_class],
+                                              -static_cast<SSIZE_T>(size));
+    }
+  }
+}
+
+template<typename OT, typename SFT, typename HFT, size_t SF>
+size_t SizeClassQuarantine<OT, SFT, HFT, SF>::GetLockIdImpl(
+    const Object& object) {
+  size_t size_class = GetSizeClass(size_functor_(object));
+  size_t hash = hash_functor_(object);
+  size_t shard = detail::ShardedQuarantineHash<kShardingFactor>(hash);
+  return size_class * kShardingFactor + shard;
+}
+
+template<typename OT, typename SFT, typename HFT, size_t SF>
+void SizeClassQuarantine<OT, SFT, HFT, SF>::LockImpl(size_t id) {
+  DCHECK_LT(id, kSizeClassCount * kShardingFactor);
+  locks_[id / kShardingFactor][id % kShardingFactor].Acquire();
+}
+
+template<typename OT, typename SFT, typename HFT, size_t SF>
+void SizeClassQuarantine<OT, SFT, HFT, SF>::UnlockImpl(size_t id) {
+  DCHECK_LT(id, kSizeClassCount * kShardingFactor);
+  base::Lock& lock = locks_[id / kShardingFactor][id % kShardingFactor];
+  lock.AssertAcquired();
+  lock.Release();
+}
+
+template<typename OT, typename SFT, typename HFT, size_t SF>
+size_t SizeClassQuarantine<OT, SFT, HFT, SF>::SelectVictimSizeClass() const {
+  // Each class gets an equal share of the budget. The sizes are read without
+  // any synchronization, so the choice can be slightly off; this only affects
+  // which objects get evicted, never the accounting.
+  SSIZE_T budget = 0;
+  if (max_quarantine_size_ != kUnboundedSize)
+    budget = static_cast<SSIZE_T>(max_quarantine_size_ / kSizeClassCount);
+
+  size_t victim = 0;
+  SSIZE_T victim_excess = 0;
+  for (size_t i = 0; i < kSizeClassCount; ++i) {
+    SSIZE_T excess =
+        base::subtle::NoBarrier_Load(&size_class_sizes_[i]) - budget;
+    if (i == 0 || excess > victim_excess) {
+      victim = i;
+      victim_excess = excess;
+    }
+  }
+  return victim;
+}
+
+template<typename OT, typename SFT, typename HFT, size_t SF>
+size_t SizeClassQuarantine<OT, SFT, HFT, SF>::PopFromSizeClass(
+    size_t size_class,
+    size_t max_count,
+    size_t max_size,
+    ObjectVector* objects) {
+  DCHECK_LT(size_class, kSizeClassCount);
+  DCHECK_LT(0u, max_count);
+
+  // Start with a random shard and scan linearly until finding a non-empty
+  // one. All of the objects are taken from that one shard, under a single
+  // acquisition of its lock.
+  size_t shard = rand() % kShardingFactor;
+  for (size_t i = 0; i < kShardingFactor; ++i) {
+    base::Lock& lock = locks_[size_class][shard];
+    lock.Acquire();
+    if (heads_[size_class][shard] == NULL) {
+      lock.Release();
+      shard = (shard + 1) % kShardingFactor;
+      continue;
+    }
+
+    // Detach the objects to evict from the head of the list.
+    Node* first = heads_[size_class][shard];
+    Node* last = first;
+    size_t count = 1;
+    size_t size = size_functor_(first->object);
+    while (count < max_count && size < max_size && last->next != NULL) {
+      last = last->next;
+      size += size_functor_(last->object);
+      ++count;
+    }
+    heads_[size_class][shard] = last->next;
+    if (heads_[size_class][shard] == NULL)
+      tails_[size_class][shard] = NULL;
+    lock.Release();
+
+    base::subtle::NoBarrier_AtomicIncrement(&size_class_sizes_[size_class],
+                                            -static_cast<SSIZE_T>(size));
+
+    // Return the detached nodes to the cache outside of the list lock, the
+    // cache has its own synchronization.
+    Node* node = first;
+    for (size_t j = 0; j < count; ++j) {
+      objects->push_back(node->object);
+      Node* next_node = node->next;
+      node_caches_[size_class][shard].Free(node, 1);
+      node = next_node;
+    }
+    return size;
+  }
+
+  return 0;
+}
+
+}  // namespace quarantines
+}  // namespace asan
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_ASAN_QUARANTINES_SIZE_CLASS_QUARANTINE_IMPL_H_
@@ -0,0 +1,422 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/quarantines/size_class_quarantine.h"
+
+#include <intrin.h>
+#include <memory>
+#include <set>
+#include <vector>
+
+#include "base/atomicops.h"
+#include "base/strings/stringprintf.h"
+#include "base/synchronization/lock.h"
+#include "base/threading/simple_thread.h"
+#include "gtest/gtest.h"
+#include "syzygy/agent/asan/quarantines/sharded_quarantine.h"
+#include "syzygy/testing/metrics.h"
+
+namespace agent {
+namespace asan {
+namespace quarantines {
+
+namespace {
+
+struct DummyObject {
+  size_t size;
+  size_t hash;
+  // A sequence number used to measure how long objects stay quarantined.
+  base::subtle::AtomicWord sequence;
+
+  DummyObject() : size(0), hash(0), sequence(0) { }
+  explicit DummyObject(size_t size) : size(size), hash(0), sequence(0) { }
+};
+
+struct DummyObjectSizeFunctor {
+  size_t operator()(const DummyObject& o) {
+    return o.size;
+  }
+};
+
+struct DummyObjectHashFunctor {
+  size_t operator()(const DummyObject& o) { return o.hash; }
+};
+
+typedef SizeClassQuarantine<DummyObject,
+                            DummyObjectSizeFunctor,
+                            DummyObjectHashFunctor,
+                            4> TestSizeClassQuarantine;
+
+// Pushes an object in a quarantine, under the appropriate lock.
+template <typename QuarantineType>
+PushResult PushObject(QuarantineType* q, const DummyObject& d) {
+  typename QuarantineType::AutoQuarantineLock lock(q, d);
+  return q->Push(d);
+}
+
+// Simulates a heap under multi-threaded churn. Each thread pushes a mix of
+// small and large objects in the quarantine, synchronously trimming it when
+// it gets in the BLACK zone, while a trimming thread brings it back to GREEN
+// in the background like the deferred free thread does.
+template <typename QuarantineType>
+class ChurnBenchmark {
+ public:
+  static const size_t kThreadCount = 4;
+  static const size_t kPushesPerThread = 50000;
+  static const size_t kMaxQuarantineSize = 1024 * 1024;
+  static const size_t kSmallObjectSize = 32;
+  static const size_t kBatchSize = 64;
+
+  ChurnBenchmark()
+      : sequence_(0), done_(0), push_cycles_(0), small_evictions_(0),
+        small_window_(0) {
+    quarantine_.set_max_quarantine_size(kMaxQuarantineSize);
+    quarantine_.SetOverbudgetSize(kMaxQuarantineSize / 10);
+  }
+
+  // Runs the benchmark and emits its metrics.
+  // @param name The name of the quarantine type, used in the metric names.
+  void Run(const char* name) {
+    base::DelegateSimpleThread trimmer(&trimmer_delegate_, "Trimmer");
+    trimmer_delegate_.benchmark_ = this;
+    trimmer.Start();
+
+    std::vector<std::unique_ptr<PusherDelegate>> delegates;
+    std::vector<std::unique_ptr<base::DelegateSimpleThread>> threads;
+    for (size_t i = 0; i < kThreadCount; ++i) {
+      delegates.push_back(std::unique_ptr<PusherDelegate>(
+          new PusherDelegate(this, i)));
+      threads.push_back(std::unique_ptr<base::DelegateSimpleThread>(
+          new base::DelegateSimpleThread(delegates.back().get(), "Pusher")));
+      threads.back()->Start();
+    }
+    for (auto& thread : threads)
+      thread->Join();
+
+    base::subtle::Release_Store(&done_, 1);
+    trimmer.Join();
+
+    typename QuarantineType::ObjectVector objects;
+    quarantine_.Empty(&objects);
+
+    // The free throughput is expressed as the average number of cycles spent
+    // pushing an object, including the synchronous trimming. The detection
+    // window of small objects is the average number of frees that happen
+    // while they are in the quarantine.
+    testing::EmitMetric(
+        base::StringPrintf("Syzygy.Asan.Quarantine.Churn.%s.PushCycles", name),
+        push_cycles_ / (kThreadCount * kPushesPerThread));
+    ASSERT_LT(0u, small_evictions_);
+    testing::EmitMetric(
+        base::StringPrintf("Syzygy.Asan.Quarantine.Churn.%s.SmallObjectWindow",
+                           name),
+        small_window_ / small_evictions_);
+  }
+
+ private:
+  class PusherDelegate : public base::DelegateSimpleThread::Delegate {
+   public:
+    PusherDelegate(ChurnBenchmark* benchmark, size_t index)
+        : benchmark_(benchmark), seed_(static_cast<uint32_t>(index) + 1) {}
+
+    void Run() override {
+      QuarantineType* q = &benchmark_->quarantine_;
+      uint64_t cycles = 0;
+      for (size_t i = 0; i < kPushesPerThread; ++i) {
+        // 7 out of 8 objects are small, the others are between 4KB and 128KB.
+        seed_ = seed_ * 1103515245 + 12345;
+        DummyObject d(kSmallObjectSize);
+        if ((seed_ >> 16) % 8 == 0)
+          d.size = 4096 << ((seed_ >> 20) % 6);
+        d.hash = seed_;
+        d.sequence = base::subtle::NoBarrier_AtomicIncrement(
+            &benchmark_->sequence_, 1);
+
+        uint64_t t0 = ::__rdtsc();
+        PushResult result = PushObject(q, d);
+        if (result.trim_status & TrimStatusBits::SYNC_TRIM_REQUIRED) {
+          DummyObject popped;
+          while (true) {
+            PopResult pop_result = q->Pop(&popped);
+            if (!pop_result.pop_successful)
+              break;
+            benchmark_->RecordEviction(popped);
+            if (pop_result.trim_color <= TrimColor::YELLOW)
+              break;
+          }
+        }
+        uint64_t t1 = ::__rdtsc();
+        cycles += t1 - t0;
+      }
+
+      base::AutoLock lock(benchmark_->lock_);
+      benchmark_->push_cycles_ += cycles;
+    }
+
+   private:
+    ChurnBenchmark* benchmark_;
+    uint32_t seed_;
+  };
+
+  class TrimmerDelegate : public base::DelegateSimpleThread::Delegate {
+   public:
+    void Run() override {
+      QuarantineType* q = &benchmark_->quarantine_;
+      typename QuarantineType::ObjectVector objects;
+      while (!base::subtle::Acquire_Load(&benchmark_->done_)) {
+        objects.clear();
+        PopResult result = q->PopBatch(kBatchSize, &objects);
+        for (const auto& object : objects)
+          benchmark_->RecordEviction(object);
+        if (!result.pop_successful)
+          base::PlatformThread::YieldCurrentThread();
+      }
+    }
+
+    ChurnBenchmark* benchmark_;
+  };
+
+  void RecordEviction(const DummyObject& object) {
+    if (object.size != kSmallObjectSize)
+      return;
+    base::subtle::AtomicWord window =
+        base::subtle::NoBarrier_Load(&sequence_) - object.sequence;
+    base::AutoLock lock(lock_);
+    ++small_evictions_;
+    small_window_ += window;
+  }
+
+  QuarantineType quarantine_;
+  TrimmerDelegate trimmer_delegate_;
+
+  base::subtle::AtomicWord sequence_;
+  base::subtle::AtomicWord done_;
+
+  // The results. These are under lock_.
+  base::Lock lock_;
+  uint64_t push_cycles_;
+  uint64_t small_evictions_;
+  uint64_t small_window_;
+};
+
+}  // namespace
+
+TEST(SizeClassQuarantineTest, GetSizeClass) {
+  EXPECT_EQ(0u, TestSizeClassQuarantine::GetSizeClass(0));
+  EXPECT_EQ(0u, TestSizeClassQuarantine::GetSizeClass(64));
+  EXPECT_EQ(1u, TestSizeClassQuarantine::GetSizeClass(65));
+  EXPECT_EQ(1u, TestSizeClassQuarantine::GetSizeClass(256));
+  EXPECT_EQ(2u, TestSizeClassQuarantine::GetSizeClass(1024));
+  EXPECT_EQ(3u, TestSizeClassQuarantine::GetSizeClass(4096));
+  EXPECT_EQ(4u, TestSizeClassQuarantine::GetSizeClass(16 * 1024));
+  EXPECT_EQ(5u, TestSizeClassQuarantine::GetSizeClass(64 * 1024));
+  EXPECT_EQ(6u, TestSizeClassQuarantine::GetSizeClass(256 * 1024));
+  EXPECT_EQ(7u, TestSizeClassQuarantine::GetSizeClass(256 * 1024 + 1));
+  EXPECT_EQ(7u, TestSizeClassQuarantine::GetSizeClass(SIZE_MAX));
+}
+
+TEST(SizeClassQuarantineTest, LockIdsAreDistinctPerSizeClass) {
+  TestSizeClassQuarantine q;
+  std::set<size_t> lock_ids;
+  for (size_t i = 0; i < TestSizeClassQuarantine::kSizeClassCount; ++i) {
+    DummyObject d(static_cast<size_t>(64) << (2 * i));
+    for (size_t j = 0; j < 64; ++j) {
+      d.hash = j;
+      size_t lock_id = q.GetLockId(d);
+      EXPECT_EQ(i, lock_id / TestSizeClassQuarantine::kShardingFactor);
+      lock_ids.insert(lock_id);
+    }
+  }
+  EXPECT_EQ(TestSizeClassQuarantine::kSizeClassCount *
+                TestSizeClassQuarantine::kShardingFactor,
+            lock_ids.size());
+}
+
+TEST(SizeClassQuarantineTest, LargeObjectsDoNotEvictSmallOnes) {
+  TestSizeClassQuarantine q;
+  q.set_max_quarantine_size(64 * 1024);
+
+  // Fill the smallest class to below its share of the budget.
+  const size_t kSmallCount = 100;
+  DummyObject small(32);
+  for (size_t i = 0; i < kSmallCount; ++i) {
+    small.hash = i;
+    EXPECT_TRUE(PushObject(&q, small).push_successful);
+  }
+  EXPECT_EQ(kSmallCount * small.size, q.GetSizeClassSizeForTesting(0));
+
+  // Push a burst of large objects, trimming as we go. Only large objects
+  // should ever be evicted.
+  DummyObject large(16 * 1024);
+  DummyObject popped;
+  for (size_t i = 0; i < 100; ++i) {
+    large.hash = i;
+    EXPECT_TRUE(PushObject(&q, large).push_successful);
+    while (q.Pop(&popped).pop_successful)
+      EXPECT_EQ(large.size, popped.size);
+  }
+
+  EXPECT_EQ(kSmallCount * small.size, q.GetSizeClassSizeForTesting(0));
+  EXPECT_GE(q.max_quarantine_size(), q.GetSizeForTesting());
+}
+
+TEST(SizeClassQuarantineTest, EvictsFromTheMostOverBudgetClass) {
+  TestSizeClassQuarantine q;
+  q.set_max_quarantine_size(8 * 1024);
+
+  // The budget of each class is 1KB. Put 4KB worth of small objects and a
+  // single medium one in the quarantine.
+  DummyObject small(64);
+  for (size_t i = 0; i < 64; ++i) {
+    small.hash = i;
+    EXPECT_TRUE(PushObject(&q, small).push_successful);
+  }
+  DummyObject medium(512);
+  EXPECT_TRUE(PushObject(&q, medium).push_successful);
+
+  // Go over budget with a big object. It is the one that exceeds its share
+  // the most, so it gets evicted first.
+  DummyObject big(8 * 1024);
+  EXPECT_TRUE(PushObject(&q, big).push_successful);
+  DummyObject popped;
+  EXPECT_TRUE(q.Pop(&popped).pop_successful);
+  EXPECT_EQ(big.size, popped.size);
+
+  // The small objects are evicted next, rather than the medium one.
+  q.set_max_quarantine_size(2 * 1024);
+  while (q.Pop(&popped).pop_successful)
+    EXPECT_EQ(small.size, popped.size);
+  EXPECT_EQ(medium.size, q.GetSizeClassSizeForTesting(
+                             TestSizeClassQuarantine::GetSizeClass(512)));
+}
+
+TEST(SizeClassQuarantineTest, PopBatch) {
+  TestSizeClassQuarantine q;
+  q.set_max_quarantine_size(10000);
+  q.SetOverbudgetSize(2000);
+  EXPECT_EQ(8000u, q.GetMaxSizeForColorForTesting(TrimColor::GREEN));
+
+  DummyObject d(10);
+  for (size_t i = 0; i < 1100; ++i) {
+    d.hash = i;
+    PushObject(&q, d);
+  }
+  EXPECT_EQ(11000u, q.GetSizeForTesting());
+
+  // The number of popped objects is bounded by the batch size.
+  TestSizeClassQuarantine::ObjectVector objects;
+  PopResult result = q.PopBatch(100, &objects);
+  EXPECT_TRUE(result.pop_successful);
+  EXPECT_EQ(TrimColor::YELLOW, result.trim_color);
+  EXPECT_EQ(100u, objects.size());
+  EXPECT_EQ(10000u, q.GetSizeForTesting());
+
+  // A big batch stops as soon as the quarantine is back to GREEN.
+  objects.clear();
+  result = q.PopBatch(1000, &objects);
+  EXPECT_TRUE(result.pop_successful);
+  EXPECT_EQ(TrimColor::GREEN, result.trim_color);
+  EXPECT_EQ(200u, objects.size());
+  EXPECT_EQ(8000u, q.GetSizeForTesting());
+  EXPECT_EQ(800u, q.GetCountForTesting());
+
+  // Nothing gets popped once in GREEN.
+  objects.clear();
+  EXPECT_FALSE(q.PopBatch(1000, &objects).pop_successful);
+  EXPECT_TRUE(objects.empty());
+
+  q.Empty(&objects);
+  EXPECT_EQ(800u, objects.size());
+  EXPECT_EQ(0u, q.GetSizeForTesting());
+  for (size_t i = 0; i < TestSizeClassQuarantine::kSizeClassCount; ++i)
+    EXPECT_EQ(0u, q.GetSizeClassSizeForTesting(i));
+}
+
+TEST(SizeClassQuarantineTest, StressTest) {
+  TestSizeClassQuarantine q;
+
+  // Doesn't allow the largest of objects we generate.
+  q.set_max_object_size((1 << 12) - 1);
+  q.set_max_quarantine_size(16 * (1 << 12));
+
+  for (size_t i = 0; i < 100000; ++i) {
+    // Generates a logarithmic distribution of element sizes.
+    uint32_t logsize = (1 << rand() % 13);
+    uint32_t size = (rand() & (logsize - 1)) | logsize;
+    DummyObject d(size);
+    d.hash = rand();
+
+    size_t old_size = q.GetSizeForTesting();
+    size_t old_count = q.GetCountForTesting();
+    if (size > q.max_object_size()) {
+      EXPECT_FALSE(PushObject(&q, d).push_successful);
+      EXPECT_EQ(old_size, q.GetSizeForTesting());
+      EXPECT_EQ(old_count, q.GetCountForTesting());
+    } else {
+      EXPECT_TRUE(PushObject(&q, d).push_successful);
+      EXPECT_EQ(old_size + size, q.GetSizeForTesting());
+      EXPECT_EQ(old_count + 1, q.GetCountForTesting());
+    }
+
+    DummyObject popped;
+    while (q.GetSizeForTesting() > q.max_quarantine_size()) {
+      old_size = q.GetSizeForTesting();
+      old_count = q.GetCountForTesting();
+      EXPECT_TRUE(q.Pop(&popped).pop_successful);
+      EXPECT_EQ(old_size - popped.size, q.GetSizeForTesting());
+      EXPECT_EQ(old_count - 1, q.GetCountForTesting());
+    }
+    EXPECT_FALSE(q.Pop(&popped).pop_successful);
+  }
+
+  size_t class_sizes = 0;
+  for (size_t i = 0; i < TestSizeClassQuarantine::kSizeClassCount; ++i)
+    class_sizes += q.GetSizeClassSizeForTesting(i);
+  EXPECT_EQ(q.GetSizeForTesting(), class_sizes);
+
+  size_t old_size = q.GetSizeForTesting();
+  size_t old_count = q.GetCountForTesting();
+  TestSizeClassQuarantine::ObjectVector os;
+  q.Empty(&os);
+  EXPECT_EQ(0u, q.GetSizeForTesting());
+  EXPECT_EQ(0u, q.GetCountForTesting());
+  EXPECT_EQ(old_count, os.size());
+  size_t emptied_size = 0;
+  for (size_t i = 0; i < os.size(); ++i)
+    emptied_size += os[i].size;
+  EXPECT_EQ(old_size, emptied_size);
+}
+
+TEST(SizeClassQuarantineTest, ChurnPerfTest) {
+  typedef ShardedQuarantine<DummyObject,
+                            DummyObjectSizeFunctor,
+                            DummyObjectHashFunctor,
+                            32> ShardedTestQuarantine;
+  typedef SizeClassQuarantine<DummyObject,
+                              DummyObjectSizeFunctor,
+                              DummyObjectHashFunctor,
+                              4> SizeClassTestQuarantine;
+
+  std::unique_ptr<ChurnBenchmark<ShardedTestQuarantine>> sharded(
+      new ChurnBenchmark<ShardedTestQuarantine>());
+  sharded->Run("Sharded");
+
+  std::unique_ptr<ChurnBenchmark<SizeClassTestQuarantine>> size_class(
+      new ChurnBenchmark<SizeClassTestQuarantine>());
+  size_class->Run("SizeClass");
+}
+
+}  // namespace quarantines
+}  // namespace asan
+}  // namespace agent
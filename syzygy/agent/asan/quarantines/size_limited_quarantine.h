@@ -21,7 +21,6 @@
 #include <utility>
 
 #include "base/atomicops.h"
-#include "base/synchronization/lock.h"
 #include "syzygy/agent/asan/quarantine.h"
 
 namespace agent {
@@ -29,10 +28,10 @@ namespace asan {
 namespace quarantines {
 
 // Provides both the size of the quarantine and the number of elements it
-// contains. Both of these are accessed behind a lock, to ensure their
-// consistency. Hence, the lock must be acquired (by calling Lock) before any
-// other operation is performed. The lock should be returned (by calling Unlock)
-// as soon as possible to minimize the locked time.
+// contains. Both of these are updated with atomic operations so that pushing
+// and popping objects never serializes on a single global lock. Individually
+// each value is always exact, but they are not updated as a pair and a reader
+// may observe one without the other.
 // Note that since pushing/popping the quarantine are not atomic operations, the
 // size/count can become negative in transition, hence the need to have them as
 // signed integer (only their eventual consistency is guaranteed).
@@ -41,36 +40,19 @@ class QuarantineSizeCount {
   // Default constructor that sets the size and count to 0.
   QuarantineSizeCount() : size_(0), count_(0) {}
 
-  // Must be called before any other operation to acquire the lock.
-  void Lock() { lock_.Acquire(); }
-
-  // Releases the lock.
-  void Unlock() {
-    lock_.AssertAcquired();
-    lock_.Release();
-  }
-
   // @returns the size.
-  SSIZE_T size() const {
-    lock_.AssertAcquired();
-    return size_;
-  }
+  SSIZE_T size() const { return base::subtle::NoBarrier_Load(&size_); }
 
   // @returns the count.
-  SSIZE_T count() const {
-    lock_.AssertAcquired();
-    return count_;
-  }
+  SSIZE_T count() const { return base::subtle::NoBarrier_Load(&count_); }
 
   // Increments the size and count.
   // @param size_delta The delta by which the size is incremented.
   // @param count_delta The delta by which the count is incremented.
   // @returns the new size.
   SSIZE_T Increment(SSIZE_T size_delta, SSIZE_T count_delta) {
-    lock_.AssertAcquired();
-    size_ += size_delta;
-    count_ += count_delta;
-    return size_;
+    base::subtle::NoBarrier_AtomicIncrement(&count_, count_delta);
+    return base::subtle::NoBarrier_AtomicIncrement(&size_, size_delta);
   }
 
   // Decrements the size and count.
@@ -78,38 +60,17 @@ class QuarantineSizeCount {
   // @param count_delta The delta by which the count is decremented.
   // @returns the new size.
   SSIZE_T Decrement(SSIZE_T size_delta, SSIZE_T count_delta) {
-    lock_.AssertAcquired();
-    size_ -= size_delta;
-    count_ -= count_delta;
-    return size_;
-  }
-
- private:
-  // The current size of the quarantine.
-  SSIZE_T size_;
-  // The number of elements in the quarantine.
-  SSIZE_T count_;
-  // Single lock that's used for both |size_| and |count_|.
-  base::Lock lock_;
-};
-
-// An automatic lock on QuarantineSizeCount.
-class ScopedQuarantineSizeCountLock {
- public:
-  // Constructor. Automatically lock the quarantine.
-  explicit ScopedQuarantineSizeCountLock(QuarantineSizeCount& size_count)
-      : size_count_(size_count) {
-    size_count_.Lock();
+    base::subtle::NoBarrier_AtomicIncrement(&count_, -count_delta);
+    return base::subtle::NoBarrier_AtomicIncrement(&size_, -size_delta);
   }
 
-  // Destructor. Automatically unlock the quarantine.
-  ~ScopedQuarantineSizeCountLock() { size_count_.Unlock(); }
-
  private:
-  // The QuarantineSizeCount that this holds.
-  QuarantineSizeCount& size_count_;
+  // The current size of the quarantine. This is atomically accessed.
+  base::subtle::AtomicWord size_;
+  // The number of elements in the quarantine. This is atomically accessed.
+  base::subtle::AtomicWord count_;
 
-  DISALLOW_COPY_AND_ASSIGN(ScopedQuarantineSizeCountLock);
+  DISALLOW_COPY_AND_ASSIGN(QuarantineSizeCount);
 };
 
 // A partial implementation of a size-limited quarantine. This quarantine
@@ -124,6 +85,9 @@ class ScopedQuarantineSizeCountLock {
 //   bool PopImpl(ObjectType* object);
 //   void EmptyImpl(ObjectVector* object);
 //
+// A derived class may also override PopBatchImpl if it is able to evict
+// several objects more cheaply than by repeatedly calling PopImpl.
+//
 // Calculates the sizes of objects using the provided SizeFunctor. This
 // must satisfy the following interface:
 //
@@ -194,10 +158,7 @@ class SizeLimitedQuarantineImpl : public QuarantineInterface<ObjectType> {
   // @returns the current size of the quarantine.
   // @note that this function could be racing with a push/pop operation and
   // return a stale value. It is only used in tests.
-  size_t GetSizeForTesting() {
-    ScopedQuarantineSizeCountLock size_count_lock(size_count_);
-    return size_count_.size();
-  }
+  size_t GetSizeForTesting() { return size_count_.size(); }
 
   // @returns the current overbudget size.
   size_t GetOverbudgetSizeForTesting() const { return overbudget_size_; }
@@ -223,6 +184,16 @@ class SizeLimitedQuarantineImpl : public QuarantineInterface<ObjectType> {
   // @returns the size.
   size_t GetMaxSizeForColorForTesting(TrimColor color) const;
 
+  // Pops up to @p max_count objects from the quarantine, stopping as soon as
+  // enough of them have been removed to bring it back to the GREEN color.
+  // This amortizes the cost of the locking over several objects and is meant
+  // to be used for asynchronous trimming.
+  // @param max_count The maximum number of objects to pop. Must be non-zero.
+  // @param objects The popped objects are appended to this vector.
+  // @returns the result of the operation. The operation is successful if at
+  //     least one object was popped.
+  PopResult PopBatch(size_t max_count, ObjectVector* objects);
+
   // @name QuarantineInterface implementation.
   // @note that GetCountForTest could be racing with a push/pop operation and
   // return a stale value. It is only used in in tests.
@@ -247,6 +218,16 @@ class SizeLimitedQuarantineImpl : public QuarantineInterface<ObjectType> {
   virtual void UnlockImpl(size_t id) = 0;
   // @}
 
+  // Pops objects until either @p max_count of them or at least @p max_size
+  // bytes worth of them have been removed. The default implementation
+  // repeatedly calls PopImpl.
+  // @param max_count The maximum number of objects to pop.
+  // @param max_size The size after which to stop popping objects.
+  // @param objects The popped objects are appended to this vector.
+  virtual void PopBatchImpl(size_t max_count,
+                            size_t max_size,
+                            ObjectVector* objects);
+
   // Parameters controlling the quarantine invariant.
   size_t max_object_size_;
   size_t max_quarantine_size_;
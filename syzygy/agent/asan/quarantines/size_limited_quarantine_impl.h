@@ -33,13 +33,9 @@ PushResult SizeLimitedQuarantineImpl<OT, SFT>::Push(const Object& object) {
 
   // This will contain the size of quarantine after the implementation of push,
   // whether successful or not.
-  size_t new_size = 0;
-  {
-    // Note that if a thread gets preempted here, the size/count will be wrong,
-    // until the thread resumes (the size will eventually become consistent).
-    ScopedQuarantineSizeCountLock size_count_lock(size_count_);
-    new_size = size_count_.Increment(size, 1);
-  }
+  // Note that if a thread gets preempted here, the size/count will be wrong,
+  // until the thread resumes (the size will eventually become consistent).
+  size_t new_size = size_count_.Increment(size, 1);
 
   // This is the size of the quarantine before the call to PushImpl and is
   // needed to calculate the old color and infer potential transitions.
@@ -50,7 +46,6 @@ PushResult SizeLimitedQuarantineImpl<OT, SFT>::Push(const Object& object) {
     // Decrementing here is not guaranteed to give the same size as before the
     // increment, as the whole sequence is not atomic. Trimming might still be
     // required and will be signaled if need be.
-    ScopedQuarantineSizeCountLock size_count_lock(size_count_);
     new_size = size_count_.Decrement(size, 1);
   }
 
@@ -92,17 +87,14 @@ PopResult SizeLimitedQuarantineImpl<OT, SFT>::Pop(Object* object) {
   if (max_quarantine_size_ == kUnboundedSize)
     return result;
 
-  {
-    // Never pop if already in GREEN as this is the lowest bound.
-    // Note that because GetQuarantineColor can return the wrong color (see note
-    // in its implementation), this verification might not always be correct
-    // which might cause either an over popping or an under popping. Either way,
-    // that is acceptable as the extra or missing pop operations are not harmful
-    // and the size will eventually get consistency.
-    ScopedQuarantineSizeCountLock size_count_lock(size_count_);
-    if (GetQuarantineColor(size_count_.size()) == TrimColor::GREEN)
-      return result;
-  }
+  // Never pop if already in GREEN as this is the lowest bound.
+  // Note that because GetQuarantineColor can return the wrong color (see note
+  // in its implementation), this verification might not always be correct
+  // which might cause either an over popping or an under popping. Either way,
+  // that is acceptable as the extra or missing pop operations are not harmful
+  // and the size will eventually get consistency.
+  if (GetQuarantineColor(size_count_.size()) == TrimColor::GREEN)
+    return result;
 
   if (!PopImpl(object))
     return result;
@@ -110,8 +102,6 @@ PopResult SizeLimitedQuarantineImpl<OT, SFT>::Pop(Object* object) {
   // Note that if a thread gets preempted here, the size/count will be wrong,
   // until the thread resumes.
   size_t size = size_functor_(*object);
-  ScopedQuarantineSizeCountLock size_count_lock(size_count_);
-
   size_t new_size = size_count_.Decrement(size, 1);
 
   // Return success and the new quarantine color.
@@ -139,13 +129,46 @@ void SizeLimitedQuarantineImpl<OT, SFT>::Empty(
     net_size += size;
   }
 
-  ScopedQuarantineSizeCountLock size_count_lock(size_count_);
   size_count_.Decrement(net_size, objects->size());
 }
 
+template <typename OT, typename SFT>
+PopResult SizeLimitedQuarantineImpl<OT, SFT>::PopBatch(size_t max_count,
+                                                       ObjectVector* objects) {
+  DCHECK_LT(0u, max_count);
+  DCHECK_NE(static_cast<ObjectVector*>(NULL), objects);
+  PopResult result = {false, TrimColor::GREEN};
+
+  if (max_quarantine_size_ == kUnboundedSize)
+    return result;
+
+  // Determine how much needs to be evicted to get back to GREEN. See the note
+  // in Pop about the raciness of this. The size can also transiently be
+  // negative, in which case there is nothing to evict.
+  SSIZE_T size = size_count_.size();
+  size_t green_size = max_quarantine_size_ -
+                      base::subtle::NoBarrier_Load(&overbudget_size_);
+  if (size <= 0 || static_cast<size_t>(size) <= green_size)
+    return result;
+
+  size_t old_count = objects->size();
+  PopBatchImpl(max_count, static_cast<size_t>(size) - green_size, objects);
+  if (objects->size() == old_count)
+    return result;
+
+  size_t net_size = 0;
+  for (size_t i = old_count; i < objects->size(); ++i)
+    net_size += size_functor_(objects->at(i));
+  size_t new_size =
+      size_count_.Decrement(net_size, objects->size() - old_count);
+
+  result.pop_successful = true;
+  result.trim_color = GetQuarantineColor(new_size);
+  return result;
+}
+
 template <typename OT, typename SFT>
 size_t SizeLimitedQuarantineImpl<OT, SFT>::GetCountForTesting() {
-  ScopedQuarantineSizeCountLock size_count_lock(size_count_);
   return size_count_.count();
 }
 
@@ -165,6 +188,21 @@ void SizeLimitedQuarantineImpl<OT, SFT>::Unlock(size_t id) {
   UnlockImpl(id);
 }
 
+template <typename OT, typename SFT>
+void SizeLimitedQuarantineImpl<OT, SFT>::PopBatchImpl(size_t max_count,
+                                                      size_t max_size,
+                                                      ObjectVector* objects) {
+  DCHECK_NE(static_cast<ObjectVector*>(NULL), objects);
+  size_t popped_size = 0;
+  Object object;
+  for (size_t i = 0; i < max_count && popped_size < max_size; ++i) {
+    if (!PopImpl(&object))
+      return;
+    objects->push_back(object);
+    popped_size += size_functor_(object);
+  }
+}
+
 template <typename OT, typename SFT>
 TrimColor SizeLimitedQuarantineImpl<OT, SFT>::GetQuarantineColor(
     size_t size) const {
@@ -187,6 +187,22 @@ TEST_F(AsanRtlTest, GetProcessHeap) {
                                      asan_heap_handle);
 }
 
+#ifndef _WIN64
+TEST_F(AsanRtlTest, ShadowMemoryInfoExport) {
+  // The inlined access checks import the shadow memory information from the
+  // RTL, so it must be exported and describe the shadow of the runtime.
+  const uintptr_t* shadow_memory_info = reinterpret_cast<const uintptr_t*>(
+      ::GetProcAddress(asan_rtl_, "asan_shadow_memory_info"));
+  ASSERT_NE(static_cast<const uintptr_t*>(nullptr), shadow_memory_info);
+
+  agent::asan::AsanRuntime* runtime = GetActiveRuntimeFunction();
+  ASSERT_NE(static_cast<agent::asan::AsanRuntime*>(nullptr), runtime);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(runtime->shadow()->shadow()),
+            shadow_memory_info[0]);
+  EXPECT_EQ(runtime->shadow()->length(), shadow_memory_info[1]);
+}
+#endif
+
 TYPED_TEST(AsanRtlTypedTest, AsanCheckGoodAccess) {
   FARPROC check_access_fn =
       ::GetProcAddress(asan_rtl_, tester_.function_name());
@@ -18,6 +18,7 @@
 #include <utility>
 #include <vector>
 
+#include "base/atomicops.h"
 #include "base/bind.h"
 #include "base/command_line.h"
 #include "base/environment.h"
@@ -33,6 +34,8 @@
 #include "base/win/pe_image.h"
 #include "base/win/wrapped_window_proc.h"
 #include "syzygy/agent/asan/block.h"
+#include "syzygy/agent/asan/block_checksum.h"
+#include "syzygy/agent/asan/check_access_sampler.h"
 #include "syzygy/agent/asan/crt_interceptors.h"
 #include "syzygy/agent/asan/heap_checker.h"
 #include "syzygy/agent/asan/logger.h"
@@ -46,6 +49,7 @@
 #include "syzygy/agent/asan/memory_notifiers/shadow_memory_notifier.h"
 #include "syzygy/agent/asan/reporters/breakpad_reporter.h"
 #include "syzygy/agent/asan/reporters/crashpad_reporter.h"
+#include "syzygy/agent/common/stack_walker.h"
 #include "syzygy/crashdata/crashdata.h"
 #include "syzygy/trace/client/client_utils.h"
 #include "syzygy/trace/protocol/call_trace_defs.h"
@@ -537,6 +541,8 @@ bool AsanRuntime::SetUp(const std::wstring& flags_command_line) {
 void AsanRuntime::TearDown() {
   base::AutoLock auto_lock(lock_);
 
+  TearDownCheckAccessSampler();
+
   // The WindowsHeapAdapter will only have been initialized if the heap manager
   // was successfully created and initialized.
   if (heap_manager_.get() != nullptr)
@@ -563,7 +569,19 @@ void AsanRuntime::OnErrorImpl(AsanErrorInfo* error_info) {
   error_info->asan_parameters = params_;
   error_info->feature_set = GetEnabledFeatureSet();
 
+  // Check every access of the faulting image for a while, as errors tend to
+  // come in clusters.
+  {
+    base::AutoLock lock(check_access_sampler_lock_);
+    if (check_access_sampler_.get() != nullptr) {
+      check_access_sampler_->OnError(
+          GetInstructionPointer(error_info->context));
+    }
+  }
+
   LogAsanErrorInfo(error_info);
+  // Make sure the report reaches the log even if the process dies right away.
+  logger_->Flush();
 
   if (params_.minidump_on_failure) {
     DCHECK(logger_.get() != NULL);
@@ -625,6 +643,12 @@ bool AsanRuntime::SetUpShadow() {
   agent::asan::SetMemoryInterceptorShadow(shadow_.get());
   agent::asan::SetSystemInterceptorShadow(shadow_.get());
 
+  // Enable the inlined fast paths. The length is set last so that they never
+  // see an incomplete description of the shadow.
+  asan_shadow_memory_info[0] = reinterpret_cast<uintptr_t>(shadow_->shadow());
+  base::subtle::MemoryBarrier();
+  asan_shadow_memory_info[1] = shadow_->length();
+
   return true;
 }
 
@@ -633,6 +657,11 @@ void AsanRuntime::TearDownShadow() {
   if (shadow_->shadow() == nullptr)
     return;
 
+  // Send the inlined fast paths back to their slow path.
+  asan_shadow_memory_info[1] = 0;
+  base::subtle::MemoryBarrier();
+  asan_shadow_memory_info[0] = 0;
+
   shadow_->TearDown();
   agent::asan::SetCrtInterceptorShadow(nullptr);
   agent::asan::SetMemoryInterceptorShadow(nullptr);
@@ -700,6 +729,14 @@ void AsanRuntime::TearDownLogger() {
 
   DCHECK_NE(static_cast<MemoryNotifierInterface*>(nullptr),
             memory_notifier_.get());
+
+  // This runs under the loader lock. If the logging thread is still using the
+  // logger, it is leaked rather than destroyed under the thread.
+  if (!logger_->StopAsyncWritesForUnload()) {
+    ignore_result(logger_.release());
+    return;
+  }
+
   memory_notifier_->NotifyReturnedToOS(logger_.get(), sizeof(*logger_.get()));
   logger_.reset();
 }
@@ -770,6 +807,20 @@ void AsanRuntime::TearDownHeapManager() {
   heap_manager_.reset();
 }
 
+void AsanRuntime::TearDownCheckAccessSampler() {
+  base::AutoLock lock(check_access_sampler_lock_);
+  if (check_access_sampler_.get() == nullptr)
+    return;
+
+  // The sampler thread can't exit while the loader lock is held, so it can't
+  // be joined here. It is only asked to stop, and the sampler is leaked as the
+  // thread may still be using it.
+  LOG(WARNING) << "The access check sampler wasn't disabled before unloading "
+               << "the runtime.";
+  check_access_sampler_->SignalStop();
+  ignore_result(check_access_sampler_.release());
+}
+
 bool AsanRuntime::GetAsanFlagsEnvVar(std::wstring* env_var_wstr) {
   std::unique_ptr<base::Environment> env(base::Environment::Create());
   if (env.get() == NULL) {
@@ -792,13 +843,13 @@ void AsanRuntime::PropagateParams() {
   // This function has to be kept in sync with the AsanParameters struct. These
   // checks will ensure that this is the case.
 #ifdef _WIN64
-  static_assert(sizeof(::common::AsanParameters) == 64,
+  static_assert(sizeof(::common::AsanParameters) == 76,
                 "Must propagate parameters.");
 #else
-  static_assert(sizeof(::common::AsanParameters) == 60,
+  static_assert(sizeof(::common::AsanParameters) == 72,
                 "Must propagate parameters.");
 #endif
-  static_assert(::common::kAsanParametersVersion == 15,
+  static_assert(::common::kAsanParametersVersion == 19,
                 "Must update parameters version.");
 
   // Push the configured parameter values to the appropriate endpoints.
@@ -807,10 +858,16 @@ void AsanRuntime::PropagateParams() {
   common::StackCapture::set_bottom_frames_to_skip(
       params_.bottom_frames_to_skip);
   stack_cache_->set_max_num_frames(params_.max_num_frames);
+  common::SetStackWalkCacheEnabled(params_.enable_fast_stack_capture);
   // ignored_stack_ids is used locally by AsanRuntime.
   logger_->set_log_as_text(params_.log_as_text);
   // exit_on_failure is used locally by AsanRuntime.
   logger_->set_minidump_on_failure(params_.minidump_on_failure);
+  if (params_.enable_async_logging && !logger_->async_writes_enabled())
+    logger_->EnableAsyncWrites();
+  // check_access_sampling_rate is used locally by AsanRuntime.
+  SetBlockChecksumOptions(params_.block_checksum_algorithm,
+                          params_.block_checksum_body_sample_size);
 }
 
 size_t AsanRuntime::CalculateCorruptHeapInfoSize(
@@ -1192,6 +1249,40 @@ void AsanRuntime::DisableDeferredFreeThread() {
   heap_manager_->DisableDeferredFreeThread();
 }
 
+void AsanRuntime::EnableCheckAccessSampler() {
+  // The instrumenter zero-initializes the sampling tables, which checks every
+  // access, so there's nothing to do unless a lower rate is requested.
+  if (params_.check_access_sampling_rate >= 1.0f)
+    return;
+
+  std::unique_ptr<CheckAccessSampler> sampler(
+      new CheckAccessSampler(params_.check_access_sampling_rate));
+  // A failure to sample the access checks only costs performance, so it isn't
+  // fatal.
+  if (!sampler->Start()) {
+    LOG(ERROR) << "Unable to sample the access checks.";
+    return;
+  }
+
+  base::AutoLock lock(check_access_sampler_lock_);
+  DCHECK_EQ(static_cast<CheckAccessSampler*>(nullptr),
+            check_access_sampler_.get());
+  check_access_sampler_.swap(sampler);
+}
+
+void AsanRuntime::DisableCheckAccessSampler() {
+  // Reset |check_access_sampler_| before stopping the sampler, so that the
+  // lock isn't held while joining its thread.
+  std::unique_ptr<CheckAccessSampler> sampler;
+  {
+    base::AutoLock lock(check_access_sampler_lock_);
+    sampler.swap(check_access_sampler_);
+  }
+
+  if (sampler.get() != nullptr)
+    sampler->Stop();
+}
+
 AsanFeatureSet AsanRuntime::GetEnabledFeatureSet() {
   AsanFeatureSet enabled_features = static_cast<AsanFeatureSet>(0U);
   if (heap_manager_->enable_page_protections_)
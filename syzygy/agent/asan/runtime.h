@@ -37,6 +37,7 @@ namespace asan {
 
 // Forward declarations.
 class AsanLogger;
+class CheckAccessSampler;
 
 // An Asan Runtime manager.
 // This class takes care of initializing the different modules (stack cache,
@@ -194,6 +195,14 @@ class AsanRuntime {
   // Disables the deferred free thread.
   void DisableDeferredFreeThread();
 
+  // Starts adapting the sampling rates of the sampled access checks, if a
+  // sampling rate is requested.
+  void EnableCheckAccessSampler();
+
+  // Stops adapting the sampling rates of the sampled access checks. This must
+  // be called before the runtime is unloaded if the sampler was enabled.
+  void DisableCheckAccessSampler();
+
   // @returns the list of enabled features.
   AsanFeatureSet GetEnabledFeatureSet();
 
@@ -281,6 +290,10 @@ class AsanRuntime {
   // Tear down the heap manager.
   void TearDownHeapManager();
 
+  // Tear down the access check sampler, if it hasn't been disabled. This runs
+  // under the loader lock, so the sampler thread can't be joined.
+  void TearDownCheckAccessSampler();
+
   // The unhandled exception filter registered by this runtime. This is used
   // to catch unhandled exceptions so we can augment them with information
   // about the corrupt heap.
@@ -318,6 +331,13 @@ class AsanRuntime {
   // The shared stack cache instance that will be used by all the heaps.
   std::unique_ptr<StackCaptureCache> stack_cache_;
 
+  // The sampler that adjusts the sampling rates of the access checks of the
+  // instrumented images. This is left null if every access is checked, or if
+  // the sampler isn't enabled.
+  base::Lock check_access_sampler_lock_;
+  std::unique_ptr<CheckAccessSampler>
+      check_access_sampler_;  // Under check_access_sampler_lock_.
+
   // The asan error callback functor.
   AsanOnErrorCallBack asan_error_callback_;
 
@@ -15,10 +15,12 @@
 #include "syzygy/agent/asan/shadow.h"
 
 #include <windows.h>
+#include <intrin.h>
 #include <algorithm>
 
 #include "base/strings/stringprintf.h"
 #include "base/win/pe_image.h"
+#include "syzygy/agent/asan/shadow_simd.h"
 #include "syzygy/common/align.h"
 
 namespace agent {
@@ -35,9 +37,9 @@ base::Lock shadow_instance_lock;
 // TODO(loskutov): eliminate this by enforcing Shadow to be a singleton.
 const Shadow* shadow_instance = nullptr;
 
-// The exception handler, intended to map the pages for shadow and page_bits
-// on demand. When a page fault happens, the operating systems calls
-// this handler, and if the page is inside shadow or page_bits, it gets
+// The exception handler, intended to map the pages for shadow, page_bits and
+// block_start_bits on demand. When a page fault happens, the operating systems
+// calls this handler, and if the page is inside one of them, it gets
 // commited seamlessly for the caller, and then execution continues.
 // Otherwise, the OS keeps searching for an appropriate handler.
 LONG NTAPI ShadowExceptionHandler(PEXCEPTION_POINTERS exception_pointers) {
@@ -48,8 +50,8 @@ LONG NTAPI ShadowExceptionHandler(PEXCEPTION_POINTERS exception_pointers) {
     return EXCEPTION_CONTINUE_SEARCH;
   }
 
-  // Only handle access violations that land within the shadow memory
-  // or the page bits.
+  // Only handle access violations that land within the shadow memory,
+  // the page bits or the block start bits.
 
   void* addr = reinterpret_cast<void*>(
       exception_pointers->ExceptionRecord->ExceptionInformation[1]);
@@ -62,10 +64,18 @@ LONG NTAPI ShadowExceptionHandler(PEXCEPTION_POINTERS exception_pointers) {
   bool is_outside_of_page_bits = shadow_instance == nullptr ||
       addr < shadow_instance->page_bits() ||
       addr >= shadow_instance->page_bits() + shadow_instance->page_bits_size();
+  const uint8_t* block_start_bits =
+      shadow_instance == nullptr ? nullptr :
+          reinterpret_cast<const uint8_t*>(shadow_instance->block_start_bits());
+  bool is_outside_of_block_start_bits = shadow_instance == nullptr ||
+      addr < block_start_bits ||
+      addr >= block_start_bits + shadow_instance->block_start_bits_size();
 
   // Check valid shadow range.
-  if (is_outside_of_shadow && is_outside_of_page_bits)
+  if (is_outside_of_shadow && is_outside_of_page_bits &&
+      is_outside_of_block_start_bits) {
     return EXCEPTION_CONTINUE_SEARCH;
+  }
 
   // This is an access violation while trying to read from the shadow. Commit
   // the relevant page and let execution continue.
@@ -93,6 +103,17 @@ inline void AddressToPageMask(const void* address,
   *mask = 1 << (i % 8);
 }
 
+// The number of bits in each word of the block start index.
+const size_t kBlockStartBitsPerWord = 32;
+
+// Returns the index of the lowest set bit of a non-zero word.
+inline size_t LowestSetBit(uint32_t word) {
+  DCHECK_NE(0u, word);
+  unsigned long index = 0;
+  _BitScanForward(&index, word);
+  return index;
+}
+
 }  // namespace
 
 extern "C" {
@@ -101,19 +122,27 @@ extern "C" {
 // to this dummy shadow memory are run they will behave badly until they have
 // been patched using 'PatchMemoryInterceptorShadowReferences'.
 uint8_t asan_memory_interceptors_shadow_memory[1] = {};
+
+// The shadow memory information exported to the instrumented images. This is
+// set up by the runtime once the shadow memory is allocated.
+uintptr_t asan_shadow_memory_info[2] = {};
 }
 
-Shadow::Shadow() : own_memory_(false), shadow_(nullptr), length_(0) {
+Shadow::Shadow()
+    : own_memory_(false), shadow_(nullptr), length_(0),
+      block_start_bits_(nullptr), block_start_bits_length_(0) {
   Init(RequiredLength());
 }
 
 Shadow::Shadow(size_t length)
-    : own_memory_(false), shadow_(nullptr), length_(0) {
+    : own_memory_(false), shadow_(nullptr), length_(0),
+      block_start_bits_(nullptr), block_start_bits_length_(0) {
   Init(length);
 }
 
 Shadow::Shadow(void* shadow, size_t length)
-    : own_memory_(false), shadow_(nullptr), length_(0) {
+    : own_memory_(false), shadow_(nullptr), length_(0),
+      block_start_bits_(nullptr), block_start_bits_length_(0) {
   Init(false, shadow, length);
 }
 
@@ -129,6 +158,7 @@ Shadow::~Shadow() {
   if (own_memory_)
     CHECK(::VirtualFree(shadow_, 0, MEM_RELEASE));
   CHECK(::VirtualFree(page_bits_, 0, MEM_RELEASE));
+  CHECK(::VirtualFree(block_start_bits_, 0, MEM_RELEASE));
   own_memory_ = false;
   shadow_ = nullptr;
   length_ = 0;
@@ -165,6 +195,8 @@ void Shadow::SetUp() {
   Poison(shadow_, length_, kAsanMemoryMarker);
   // Poison the protection bits array.
   Poison(page_bits_, page_bits_length_, kAsanMemoryMarker);
+  // Poison the block start index.
+  Poison(block_start_bits_, block_start_bits_length_, kAsanMemoryMarker);
 #endif
 }
 
@@ -184,6 +216,8 @@ void Shadow::TearDown() {
   Unpoison(shadow_, length_);
   // Unpoison the protection bits array.
   Unpoison(page_bits_, page_bits_length_);
+  // Unpoison the block start index.
+  Unpoison(block_start_bits_, block_start_bits_length_);
 #endif
 }
 
@@ -201,6 +235,14 @@ bool Shadow::IsClean() const {
       reinterpret_cast<uintptr_t>(page_bits_ + page_bits_length_) >>
           kShadowRatioLog;
 
+  const uint8_t* block_start_bits =
+      reinterpret_cast<const uint8_t*>(block_start_bits_);
+  const size_t block_start_bits_begin =
+      reinterpret_cast<uintptr_t>(block_start_bits) >> kShadowRatioLog;
+  const size_t block_start_bits_end =
+      reinterpret_cast<uintptr_t>(block_start_bits +
+                                  block_start_bits_length_) >> kShadowRatioLog;
+
   void const* self = nullptr;
   size_t self_size = 0;
   GetPointerAndSize(&self, &self_size);
@@ -234,6 +276,7 @@ bool Shadow::IsClean() const {
     for (; i < next_i; ++i) {
       if ((i >= shadow_begin && i < shadow_end) ||
           (i >= page_bits_begin && i < page_bits_end) ||
+          (i >= block_start_bits_begin && i < block_start_bits_end) ||
           (i >= this_begin && i < this_end)) {
         if (shadow_[i] != kAsanMemoryMarker)
           return false;
@@ -325,15 +368,36 @@ void Shadow::Init(bool own_memory, void* shadow, size_t length) {
                                                     MEM_RESERVE,
                                                     PAGE_NOACCESS));
 #endif
+
+  // Initialize the block start index. Its length is rounded up to a whole
+  // number of words so that it can be scanned a word at a time, and to the
+  // shadow ratio so that it can be poisoned.
+  size_t shadow_page_count =
+      (length + kBlockStartIndexGranularity - 1) / kBlockStartIndexGranularity;
+  size_t word_count = (shadow_page_count + kBlockStartBitsPerWord - 1) /
+      kBlockStartBitsPerWord;
+  block_start_bits_length_ =
+      ::common::AlignUp(word_count * sizeof(uint32_t), kShadowRatio);
+#ifndef _WIN64
+  block_start_bits_ = static_cast<uint32_t*>(
+      ::VirtualAlloc(nullptr, block_start_bits_length_, MEM_COMMIT,
+                     PAGE_READWRITE));
+#else
+  block_start_bits_ = static_cast<uint32_t*>(
+      ::VirtualAlloc(nullptr, block_start_bits_length_, MEM_RESERVE,
+                     PAGE_NOACCESS));
+#endif
 }
 
 void Shadow::Reset() {
 #ifndef _WIN64
   ::memset(shadow_, 0, length_);
   ::memset(page_bits_, 0, page_bits_length_);
+  ::memset(block_start_bits_, 0, block_start_bits_length_);
 #else
   ::VirtualFree(shadow_, length_, MEM_DECOMMIT);
   ::VirtualFree(page_bits_, page_bits_length_, MEM_DECOMMIT);
+  ::VirtualFree(block_start_bits_, block_start_bits_length_, MEM_DECOMMIT);
 #endif
 
   SetShadowMemory(0, kShadowRatio * length_, kHeapAddressableMarker);
@@ -365,72 +429,13 @@ void Shadow::Unpoison(const void* addr, size_t size) {
   index >>= kShadowRatioLog;
   size >>= kShadowRatioLog;
   DCHECK_GT(length_, index + size);
+  ClearBlockStartBits(index, size);
   ::memset(shadow_ + index, kHeapAddressableMarker, size);
 
   if (remainder != 0)
     shadow_[index + size] = remainder;
 }
 
-namespace {
-
-static const uint8_t kFreedMarker8 = kHeapFreedMarker;
-static const uint16_t kFreedMarker16 =
-    (static_cast<const uint16_t>(kFreedMarker8) << 8) | kFreedMarker8;
-static const uint32_t kFreedMarker32 =
-    (static_cast<const uint32_t>(kFreedMarker16) << 16) | kFreedMarker16;
-static const uint64_t kFreedMarker64 =
-    (static_cast<const uint64_t>(kFreedMarker32) << 32) | kFreedMarker32;
-
-// Marks the given range of shadow bytes as freed, preserving left and right
-// redzone bytes.
-inline void MarkAsFreedImpl8(uint8_t* cursor, uint8_t* cursor_end) {
-  for (; cursor != cursor_end; ++cursor) {
-    // Preserve block beginnings/ends/redzones as they were originally.
-    // This is necessary to preserve information about nested blocks.
-    if (ShadowMarkerHelper::IsActiveLeftRedzone(*cursor) ||
-        ShadowMarkerHelper::IsActiveRightRedzone(*cursor)) {
-      continue;
-    }
-
-    // Anything else gets marked as freed.
-    *cursor = kHeapFreedMarker;
-  }
-}
-
-// Marks the given range of shadow bytes as freed, preserving left and right
-// redzone bytes. |cursor| and |cursor_end| must be 8-byte aligned.
-inline void MarkAsFreedImplAligned64(uint64_t* cursor, uint64_t* cursor_end) {
-  DCHECK(::common::IsAligned(cursor, sizeof(uint64_t)));
-  DCHECK(::common::IsAligned(cursor_end, sizeof(uint64_t)));
-
-  for (; cursor != cursor_end; ++cursor) {
-    // If the block of shadow memory is entirely green then mark as freed.
-    // Otherwise go check its contents byte by byte.
-    if (*cursor == 0) {
-      *cursor = kFreedMarker64;
-    } else {
-      MarkAsFreedImpl8(reinterpret_cast<uint8_t*>(cursor),
-                       reinterpret_cast<uint8_t*>(cursor + 1));
-    }
-  }
-}
-
-inline void MarkAsFreedImpl64(uint8_t* cursor, uint8_t* cursor_end) {
-  if (cursor_end - cursor >= 2 * sizeof(uint64_t)) {
-    uint8_t* cursor_aligned = ::common::AlignUp(cursor, sizeof(uint64_t));
-    uint8_t* cursor_end_aligned =
-        ::common::AlignDown(cursor_end, sizeof(uint64_t));
-    MarkAsFreedImpl8(cursor, cursor_aligned);
-    MarkAsFreedImplAligned64(reinterpret_cast<uint64_t*>(cursor_aligned),
-                             reinterpret_cast<uint64_t*>(cursor_end_aligned));
-    MarkAsFreedImpl8(cursor_end_aligned, cursor_end);
-  } else {
-    MarkAsFreedImpl8(cursor, cursor_end);
-  }
-}
-
-}  // namespace
-
 void Shadow::MarkAsFreed(const void* addr, size_t size) {
   DCHECK_LE(kAddressLowerBound, reinterpret_cast<uintptr_t>(addr));
   DCHECK(::common::IsAligned(addr, kShadowRatio));
@@ -447,7 +452,7 @@ void Shadow::MarkAsFreed(const void* addr, size_t size) {
 
   // This isn't as simple as a memset because we need to preserve left and
   // right redzone padding bytes that may be found in the range.
-  MarkAsFreedImpl64(cursor, cursor_end);
+  internal::MarkAsFreed(cursor, cursor_end);
 }
 
 bool Shadow::IsAccessible(const void* addr) const {
@@ -504,8 +509,8 @@ bool Shadow::IsRangeAccessible(const void* addr, size_t size) const {
 
   // Now run over the shadow bytes from start to end, which all need to be
   // zero.
-  if (!internal::IsZeroBufferImpl<uint64_t>(&shadow_[start], &shadow_[end]))
-      return false;
+  if (!internal::IsZeroBuffer(&shadow_[start], &shadow_[end]))
+    return false;
 
   // Finally test the end point if there's a tail offset.
   if (end_offs == 0U)
@@ -560,12 +565,15 @@ const void* Shadow::FindFirstPoisonedByte(const void* addr, size_t size) const {
   if (end > length_)
     return out_addr;
 
-  for (size_t curr = start; curr < end; ++curr, out_addr += kShadowRatio) {
-    shadow = shadow_[curr];
+  // Skip directly to the first non-zero shadow byte, if any.
+  const uint8_t* poisoned =
+      internal::FindFirstNonZero(&shadow_[start], &shadow_[end]);
+  out_addr += (poisoned - &shadow_[start]) * kShadowRatio;
+  if (poisoned != &shadow_[end]) {
+    shadow = *poisoned;
     if (ShadowMarkerHelper::IsRedzone(shadow))
       return out_addr;
-    if (shadow != 0)
-      return out_addr + shadow;
+    return out_addr + shadow;
   }
 
   // Finally test the end point if there's a tail offset.
@@ -672,6 +680,10 @@ void Shadow::PoisonAllocatedBlock(const BlockInfo& info) {
   // Determine the marker byte for the trailer.
   ShadowMarker trailer_marker = ShadowMarkerHelper::BuildBlockEnd(true);
 
+  // Update the block start index before writing the marker, so that a
+  // concurrent walker can't miss the block.
+  SetBlockStartBit(index);
+
   // Poison the header and left padding.
   uint8_t* cursor = shadow_ + index;
   ::memset(cursor, header_marker, 1);
@@ -695,6 +707,59 @@ void Shadow::PoisonAllocatedBlock(const BlockInfo& info) {
                   kHeapRightPaddingMarker);
 }
 
+size_t Shadow::FindBlockStartCandidate(size_t index,
+                                       size_t end_index) const {
+  DCHECK_LE(index, end_index);
+  DCHECK_LE(end_index, length_);
+
+  // Scan the index a word at a time, which covers 32 pages of shadow memory
+  // (1MB of memory with a 4KB page size) per iteration.
+  const volatile uint32_t* bits = block_start_bits_;
+  size_t page = index / kBlockStartIndexGranularity;
+  size_t end_page = (end_index + kBlockStartIndexGranularity - 1) /
+      kBlockStartIndexGranularity;
+  while (page < end_page) {
+    size_t word_index = page / kBlockStartBitsPerWord;
+    uint32_t word = bits[word_index] >> (page % kBlockStartBitsPerWord);
+    if (word != 0) {
+      page += LowestSetBit(word);
+      if (page >= end_page)
+        break;
+      return std::max(index, page * kBlockStartIndexGranularity);
+    }
+    page = (word_index + 1) * kBlockStartBitsPerWord;
+  }
+
+  return end_index;
+}
+
+void Shadow::SetBlockStartBit(size_t index) {
+  DCHECK_LT(index, length_);
+  size_t page = index / kBlockStartIndexGranularity;
+  LONG mask = static_cast<LONG>(1u << (page % kBlockStartBitsPerWord));
+  volatile LONG* word = reinterpret_cast<volatile LONG*>(
+      block_start_bits_ + page / kBlockStartBitsPerWord);
+
+  // Most allocations land in pages that already contain blocks, so avoid the
+  // locked operation when the bit is already set.
+  if ((*word & mask) == 0)
+    ::InterlockedOr(word, mask);
+}
+
+void Shadow::ClearBlockStartBits(size_t index, size_t length) {
+  DCHECK_LE(index + length, length_);
+  size_t page = (index + kBlockStartIndexGranularity - 1) /
+      kBlockStartIndexGranularity;
+  size_t end_page = (index + length) / kBlockStartIndexGranularity;
+  for (; page < end_page; ++page) {
+    LONG mask = static_cast<LONG>(1u << (page % kBlockStartBitsPerWord));
+    volatile LONG* word = reinterpret_cast<volatile LONG*>(
+        block_start_bits_ + page / kBlockStartBitsPerWord);
+    if ((*word & mask) != 0)
+      ::InterlockedAnd(word, ~mask);
+  }
+}
+
 bool Shadow::BlockInfoFromShadow(
     const void* addr, CompactBlockInfo* info) const {
   DCHECK_NE(static_cast<void*>(NULL), addr);
@@ -869,119 +934,39 @@ bool Shadow::ScanLeftForBracketingBlockStart(size_t cursor,
 
   size_t left = cursor;
 
-#ifdef _WIN64
-  // In 64-bit we don't commit the full shadow address space, so we need to
-  // skip over the uncommitted ranges.
-  MEMORY_BASIC_INFORMATION memory_info = {};
-  SIZE_T ret =
-      ::VirtualQuery(&shadow_[left], &memory_info, sizeof(memory_info));
-  DCHECK_GT(ret, 0u);
-  if (memory_info.State != MEM_COMMIT)
-    return false;
-#endif
-
   while (true) {
+    // The lowest shadow index that may be scanned in this iteration.
+    size_t lower = std::min(kLowerBound, left);
+
 #ifdef _WIN64
-    if (&shadow_[left] < static_cast<const uint8_t*>(memory_info.BaseAddress)) {
-      ret = ::VirtualQuery(&shadow_[left], &memory_info, sizeof(memory_info));
-      DCHECK_GT(ret, 0u);
-      if (memory_info.State != MEM_COMMIT)
-        return false;
-    }
+    // In 64-bit we don't commit the full shadow address space, so we need to
+    // restrict each scan to a committed range.
+    MEMORY_BASIC_INFORMATION memory_info = {};
+    SIZE_T ret =
+        ::VirtualQuery(&shadow_[left], &memory_info, sizeof(memory_info));
+    DCHECK_GT(ret, 0u);
+    if (memory_info.State != MEM_COMMIT)
+      return false;
+    const uint8_t* region_base =
+        static_cast<const uint8_t*>(memory_info.BaseAddress);
+    if (region_base > &shadow_[lower])
+      lower = region_base - shadow_;
 #endif
-    if (ShadowMarkerHelper::IsBlockStart(shadow_[left])) {
-      *location = left;
+
+    const uint8_t* block_start =
+        internal::FindLastBlockStart(&shadow_[lower], &shadow_[left + 1]);
+    if (block_start != nullptr) {
+      *location = block_start - shadow_;
       return true;
     }
-    if (left <= kLowerBound)
+    if (lower <= kLowerBound)
       return false;
-    --left;
+    left = lower - 1;
   }
 
   NOTREACHED();
 }
 
-namespace {
-
-// This handles an unaligned input cursor. It can potentially read up to 7
-// bytes past the end of the cursor, but only up to an 8 byte boundary. Thus
-// this out of bounds access is safe.
-inline const uint8_t* ScanRightForPotentialHeaderBytes(const uint8_t* pos,
-                                                       const uint8_t* end) {
-  DCHECK(::common::IsAligned(end, 8));
-
-  // Handle the first few bytes that aren't aligned. If pos == end then
-  // it is already 8-byte aligned and we'll simply fall through to the end.
-  // This is a kind of Duffy's device that takes bytes 'as large as possible'
-  // until we reach an 8 byte alignment.
-  switch (reinterpret_cast<uintptr_t>(pos) & 0x7) {
-    case 1:
-      if (*pos != 0 && *pos != kFreedMarker8)
-        return pos;
-      pos += 1;
-    case 2:
-      if (*reinterpret_cast<const uint16_t*>(pos) != 0 &&
-          *reinterpret_cast<const uint16_t*>(pos) != kFreedMarker16) {
-        return pos;
-      }
-      pos += 2;
-    case 4:
-      if (*reinterpret_cast<const uint32_t*>(pos) != 0 &&
-          *reinterpret_cast<const uint32_t*>(pos) != kFreedMarker32) {
-        return pos;
-      }
-      pos += 4;
-      break;
-
-    case 3:
-      if (*pos != 0 && *pos != kFreedMarker8)
-        return pos;
-      pos += 1;
-      // Now have alignment of 4.
-      if (*reinterpret_cast<const uint32_t*>(pos) != 0 &&
-          *reinterpret_cast<const uint32_t*>(pos) != kFreedMarker32) {
-        return pos;
-      }
-      pos += 4;
-      break;
-
-    case 5:
-      if (*pos != 0 && *pos != kFreedMarker8)
-        return pos;
-      pos += 1;
-    case 6:
-      if (*reinterpret_cast<const uint16_t*>(pos) != 0 &&
-          *reinterpret_cast<const uint16_t*>(pos) != kFreedMarker16) {
-        return pos;
-      }
-      pos += 2;
-      break;
-
-    case 7:
-      if (*pos != 0 && *pos != kFreedMarker8)
-        return pos;
-      pos += 1;
-
-    case 0:
-    default:
-      // Do nothing, as we're already 8 byte aligned.
-      break;
-  }
-
-  // Handle the 8-byte aligned bytes as much as we can.
-  while (pos < end) {
-    if (*reinterpret_cast<const uint64_t*>(pos) != 0 &&
-        *reinterpret_cast<const uint64_t*>(pos) != kFreedMarker64) {
-      return pos;
-    }
-    pos += 8;
-  }
-
-  return pos;
-}
-
-}  // namespace
-
 bool Shadow::ScanRightForBracketingBlockEnd(size_t cursor,
                                             size_t* location) const {
   DCHECK_NE(static_cast<size_t*>(NULL), location);
@@ -990,14 +975,12 @@ bool Shadow::ScanRightForBracketingBlockEnd(size_t cursor,
   const uint8_t* pos = shadow_ + cursor;
   while (pos < shadow_end) {
     // Skips past as many addressable and freed bytes as possible.
-    pos = ScanRightForPotentialHeaderBytes(pos, shadow_end);
+    pos = internal::FindFirstNotAddressableOrFreed(pos, shadow_end);
     if (pos == shadow_end)
       return false;
 
-    // When the above loop exits early then somewhere in the next 8 bytes
-    // there's non-addressable data that isn't 'freed'. Look byte by byte to
-    // see what's up.
-
+    // |pos| now points at non-addressable data that isn't 'freed'. Check if
+    // it's the end of a block.
     if (ShadowMarkerHelper::IsBlockEnd(*pos)) {
       *location = pos - shadow_;
       return true;
@@ -1132,17 +1115,25 @@ bool ShadowWalker::Next(BlockInfo* info) {
 #endif
 
     // Scan this committed portion of the shadow.
+    const uint8_t* shadow_begin = shadow_->shadow();
     while (shadow_cursor_ < end_of_region) {
-      uint8_t marker = *shadow_cursor_;
+      // Skip over the pages of the shadow that the block start index reports
+      // as not containing any block.
+      size_t index = shadow_->FindBlockStartCandidate(
+          shadow_cursor_ - shadow_begin, end_of_region - shadow_begin);
+      shadow_cursor_ = shadow_begin + index;
+      if (shadow_cursor_ >= end_of_region)
+        break;
 
-      // Update the nesting depth when block end markers are encountered.
-      if (ShadowMarkerHelper::IsBlockEnd(marker)) {
-        ++shadow_cursor_;
-        continue;
-      }
+      // Look for a block start marker in the rest of this page.
+      size_t page_end_index =
+          ::common::AlignDown(index, Shadow::kBlockStartIndexGranularity) +
+          Shadow::kBlockStartIndexGranularity;
+      const uint8_t* page_end =
+          std::min(end_of_region, shadow_begin + page_end_index);
+      shadow_cursor_ = internal::FindFirstBlockStart(shadow_cursor_, page_end);
 
-      // Look for a block start marker.
-      if (ShadowMarkerHelper::IsBlockStart(marker)) {
+      if (shadow_cursor_ < page_end) {
         // This can only fail if the shadow memory is malformed.
         size_t block_index = shadow_cursor_ - shadow_->shadow();
         void* block_address =
@@ -1158,9 +1149,6 @@ bool ShadowWalker::Next(BlockInfo* info) {
         // caller.
         return true;
       }
-
-      // Advance the shadow cursor.
-      ++shadow_cursor_;
     }  // while (shadow_cursor_ < end_of_region)
   }
 
@@ -89,6 +89,10 @@ class Shadow {
   // shadow bytes will be reported in all.
   static const size_t kShadowContextLines = 4;
 
+  // The number of shadow bytes covered by each bit of the block start index,
+  // which is a page of shadow memory.
+  static const size_t kBlockStartIndexGranularity = 4096;
+
   // Default constructor. Creates a shadow memory of the appropriate size
   // depending on the addressable memory for this process.
   // @note The allocation may fail, in which case 'shadow()' will return
@@ -224,8 +228,22 @@ class Shadow {
   // Poisons memory for an freshly allocated block.
   // @param info Info about the block layout.
   // @note The block must be readable.
+  // @note This is the only way that block start markers should be written to
+  //     the shadow, as it also keeps the block start index up to date.
   void PoisonAllocatedBlock(const BlockInfo& info);
 
+  // Uses the block start index to find the first shadow page that may contain
+  // a block start marker in a range of the shadow. The index is conservative:
+  // pages with a clear bit are guaranteed not to contain any block start,
+  // while pages with a set bit only may contain one.
+  // @param index The index of the first shadow byte to consider.
+  // @param end_index The index of the shadow byte after the last one to
+  //     consider.
+  // @returns the index of the first shadow byte in [@p index, @p end_index)
+  //     that lies in a page that may contain a block start, or @p end_index
+  //     if there is none.
+  size_t FindBlockStartCandidate(size_t index, size_t end_index) const;
+
   // Inspects shadow memory to determine the layout of a block in memory.
   // Does not rely on any block content itself, strictly reading from the
   // shadow memory.
@@ -291,6 +309,12 @@ class Shadow {
   // Returns the length of the page bits array.
   size_t const page_bits_size() const { return page_bits_length_; }
 
+  // Read only accessor of the block start index.
+  const uint32_t* block_start_bits() const { return block_start_bits_; }
+
+  // Returns the length of the block start index, in bytes.
+  size_t block_start_bits_size() const { return block_start_bits_length_; }
+
   // Determines if the shadow memory is clean. That is, it reflects the
   // state of shadow memory immediately after construction and a call to
   // SetUp.
@@ -319,6 +343,18 @@ class Shadow {
   // Reset the shadow memory.
   void Reset();
 
+  // Marks the shadow page containing a given shadow byte as containing a
+  // block start in the block start index.
+  // @param index The index of the shadow byte.
+  void SetBlockStartBit(size_t index);
+
+  // Clears the bits of the block start index for the shadow pages that are
+  // entirely contained in a range of the shadow. Partially covered pages are
+  // left alone, as they may still contain other block starts.
+  // @param index The index of the first shadow byte of the range.
+  // @param length The length of the range, in shadow bytes.
+  void ClearBlockStartBits(size_t index, size_t length);
+
   // Appends a line of shadow byte text for the bytes ranging from
   // shadow_[index] to shadow_[index + 7], prefixed by @p prefix. If the index
   // @p bug_index is present in this range then its value will be surrounded by
@@ -373,6 +409,16 @@ class Shadow {
   // The length of page_bits_. Under page_bits_lock_.
   size_t page_bits_length_;
 
+  // The block start index. This contains a bit per page of shadow memory,
+  // which is set if the page may contain a block start marker. It lets the
+  // ShadowWalker skip over the large parts of the shadow that contain no
+  // blocks. It is stored like page_bits_, and is modified with atomic
+  // operations.
+  uint32_t* block_start_bits_;
+
+  // The length of block_start_bits_, in bytes.
+  size_t block_start_bits_length_;
+
 #ifdef _WIN64
   // The exception handler handle to be able to remove it on object destruction.
   HANDLE exception_handler_;
@@ -424,6 +470,11 @@ class ShadowWalker {
 // The static shadow memory that is referred to by the memory interceptors.
 extern "C" {
 extern uint8_t asan_memory_interceptors_shadow_memory[];
+
+// The address and the length of the shadow memory, as used by the fast paths
+// that are inlined into instrumented images. The length is zero until the
+// shadow is set up, which sends every inlined check to its slow path.
+extern uintptr_t asan_shadow_memory_info[2];
 }
 
 // Bring in the implementation of the templated functions.
@@ -0,0 +1,304 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/shadow_simd.h"
+
+// SSE2 is always available on x64, and is the default target for x86.
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SHADOW_SIMD_USE_SSE2
+#include <emmintrin.h>
+#include <intrin.h>
+#endif
+
+#include "base/logging.h"
+#include "syzygy/agent/asan/shadow.h"
+#include "syzygy/agent/asan/shadow_marker.h"
+#include "syzygy/common/align.h"
+
+namespace agent {
+namespace asan {
+namespace internal {
+
+namespace {
+
+// @name Scalar kernels. These handle short ranges and the unaligned head and
+//     tail of longer ranges.
+// @{
+
+inline bool IsActiveRedzone(uint8_t marker) {
+  return ShadowMarkerHelper::IsActiveLeftRedzone(marker) ||
+         ShadowMarkerHelper::IsActiveRightRedzone(marker);
+}
+
+inline const uint8_t* FindFirstNonZeroScalar(const uint8_t* start,
+                                             const uint8_t* end) {
+  while (start != end && *start == 0)
+    ++start;
+  return start;
+}
+
+inline const uint8_t* FindFirstNotAddressableOrFreedScalar(
+    const uint8_t* start, const uint8_t* end) {
+  while (start != end && (*start == 0 || *start == kHeapFreedMarker))
+    ++start;
+  return start;
+}
+
+inline const uint8_t* FindFirstBlockStartScalar(const uint8_t* start,
+                                                const uint8_t* end) {
+  while (start != end && !ShadowMarkerHelper::IsBlockStart(*start))
+    ++start;
+  return start;
+}
+
+inline const uint8_t* FindLastBlockStartScalar(const uint8_t* start,
+                                               const uint8_t* end) {
+  while (end != start) {
+    --end;
+    if (ShadowMarkerHelper::IsBlockStart(*end))
+      return end;
+  }
+  return nullptr;
+}
+
+inline void MarkAsFreedScalar(uint8_t* start, uint8_t* end) {
+  for (; start != end; ++start) {
+    if (!IsActiveRedzone(*start))
+      *start = kHeapFreedMarker;
+  }
+}
+
+// @}
+
+#ifdef SHADOW_SIMD_USE_SSE2
+
+const size_t kVectorSize = sizeof(__m128i);
+
+// Ranges shorter than this are handled entirely by the scalar kernels, as the
+// vector loop wouldn't run often enough to pay for its setup.
+const size_t kMinVectorRange = 4 * kVectorSize;
+
+inline const __m128i* AsVector(const uint8_t* p) {
+  DCHECK(::common::IsAligned(p, kVectorSize));
+  return reinterpret_cast<const __m128i*>(p);
+}
+
+inline __m128i SplatByte(uint8_t value) {
+  return _mm_set1_epi8(static_cast<char>(value));
+}
+
+// Returns the index of the lowest set bit of a non-zero mask.
+inline size_t LowestSetBit(int mask) {
+  DCHECK_NE(0, mask);
+  unsigned long index = 0;
+  _BitScanForward(&index, static_cast<unsigned long>(mask));
+  return index;
+}
+
+// Returns the index of the highest set bit of a non-zero mask.
+inline size_t HighestSetBit(int mask) {
+  DCHECK_NE(0, mask);
+  unsigned long index = 0;
+  _BitScanReverse(&index, static_cast<unsigned long>(mask));
+  return index;
+}
+
+// Returns a 16-bit mask with a bit set for each byte of @p v that is a block
+// start marker. See ShadowMarkerHelper::IsBlockStart.
+inline int BlockStartMask(__m128i v) {
+  const __m128i kMask = SplatByte(0xD0);
+  const __m128i kValue = SplatByte(kHeapHistoricBlockStartMarker0);
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(v, kMask), kValue));
+}
+
+// Returns a vector with all bits set in each byte of @p v that is an active
+// left or right redzone marker. See ShadowMarkerHelper::IsActiveLeftRedzone
+// and ShadowMarkerHelper::IsActiveRightRedzone.
+inline __m128i ActiveRedzoneBytes(__m128i v) {
+  __m128i block_start = _mm_cmpeq_epi8(_mm_and_si128(v, SplatByte(0xF0)),
+                                       SplatByte(kHeapBlockStartMarker0));
+  __m128i left_padding = _mm_cmpeq_epi8(v, SplatByte(kHeapLeftPaddingMarker));
+  __m128i right_padding =
+      _mm_cmpeq_epi8(v, SplatByte(kHeapRightPaddingMarker));
+  __m128i block_end = _mm_cmpeq_epi8(v, SplatByte(kHeapBlockEndMarker));
+  return _mm_or_si128(_mm_or_si128(block_start, left_padding),
+                      _mm_or_si128(right_padding, block_end));
+}
+
+#endif  // SHADOW_SIMD_USE_SSE2
+
+}  // namespace
+
+bool IsZeroBuffer(const uint8_t* start, const uint8_t* end) {
+  DCHECK_LE(start, end);
+#ifdef SHADOW_SIMD_USE_SSE2
+  if (static_cast<size_t>(end - start) >= kMinVectorRange) {
+    const uint8_t* start_aligned = ::common::AlignUp(start, kVectorSize);
+    const uint8_t* end_aligned = ::common::AlignDown(end, kVectorSize);
+    if (!IsZeroBufferImpl<uint64_t>(start, start_aligned))
+      return false;
+
+    // Accumulate a few vectors at a time to keep the number of branches down.
+    const uint8_t* cursor = start_aligned;
+    for (; cursor + 4 * kVectorSize <= end_aligned;
+         cursor += 4 * kVectorSize) {
+      __m128i v = _mm_or_si128(
+          _mm_or_si128(_mm_load_si128(AsVector(cursor)),
+                       _mm_load_si128(AsVector(cursor + kVectorSize))),
+          _mm_or_si128(_mm_load_si128(AsVector(cursor + 2 * kVectorSize)),
+                       _mm_load_si128(AsVector(cursor + 3 * kVectorSize))));
+      if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) != 0xFFFF)
+        return false;
+    }
+    for (; cursor < end_aligned; cursor += kVectorSize) {
+      __m128i v = _mm_load_si128(AsVector(cursor));
+      if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) != 0xFFFF)
+        return false;
+    }
+
+    return IsZeroBufferImpl<uint64_t>(end_aligned, end);
+  }
+#endif
+  return IsZeroBufferImpl<uint64_t>(start, end);
+}
+
+const uint8_t* FindFirstNonZero(const uint8_t* start, const uint8_t* end) {
+  DCHECK_LE(start, end);
+#ifdef SHADOW_SIMD_USE_SSE2
+  if (static_cast<size_t>(end - start) >= kMinVectorRange) {
+    const uint8_t* start_aligned = ::common::AlignUp(start, kVectorSize);
+    const uint8_t* end_aligned = ::common::AlignDown(end, kVectorSize);
+    const uint8_t* found = FindFirstNonZeroScalar(start, start_aligned);
+    if (found != start_aligned)
+      return found;
+
+    for (const uint8_t* cursor = start_aligned; cursor < end_aligned;
+         cursor += kVectorSize) {
+      __m128i v = _mm_load_si128(AsVector(cursor));
+      int zero = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128()));
+      if (zero != 0xFFFF)
+        return cursor + LowestSetBit(~zero & 0xFFFF);
+    }
+
+    return FindFirstNonZeroScalar(end_aligned, end);
+  }
+#endif
+  return FindFirstNonZeroScalar(start, end);
+}
+
+const uint8_t* FindFirstNotAddressableOrFreed(const uint8_t* start,
+                                              const uint8_t* end) {
+  DCHECK_LE(start, end);
+#ifdef SHADOW_SIMD_USE_SSE2
+  if (static_cast<size_t>(end - start) >= kMinVectorRange) {
+    const uint8_t* start_aligned = ::common::AlignUp(start, kVectorSize);
+    const uint8_t* end_aligned = ::common::AlignDown(end, kVectorSize);
+    const uint8_t* found =
+        FindFirstNotAddressableOrFreedScalar(start, start_aligned);
+    if (found != start_aligned)
+      return found;
+
+    const __m128i kFreed = SplatByte(kHeapFreedMarker);
+    for (const uint8_t* cursor = start_aligned; cursor < end_aligned;
+         cursor += kVectorSize) {
+      __m128i v = _mm_load_si128(AsVector(cursor));
+      int skippable = _mm_movemask_epi8(
+          _mm_or_si128(_mm_cmpeq_epi8(v, _mm_setzero_si128()),
+                       _mm_cmpeq_epi8(v, kFreed)));
+      if (skippable != 0xFFFF)
+        return cursor + LowestSetBit(~skippable & 0xFFFF);
+    }
+
+    return FindFirstNotAddressableOrFreedScalar(end_aligned, end);
+  }
+#endif
+  return FindFirstNotAddressableOrFreedScalar(start, end);
+}
+
+const uint8_t* FindFirstBlockStart(const uint8_t* start, const uint8_t* end) {
+  DCHECK_LE(start, end);
+#ifdef SHADOW_SIMD_USE_SSE2
+  if (static_cast<size_t>(end - start) >= kMinVectorRange) {
+    const uint8_t* start_aligned = ::common::AlignUp(start, kVectorSize);
+    const uint8_t* end_aligned = ::common::AlignDown(end, kVectorSize);
+    const uint8_t* found = FindFirstBlockStartScalar(start, start_aligned);
+    if (found != start_aligned)
+      return found;
+
+    for (const uint8_t* cursor = start_aligned; cursor < end_aligned;
+         cursor += kVectorSize) {
+      int mask = BlockStartMask(_mm_load_si128(AsVector(cursor)));
+      if (mask != 0)
+        return cursor + LowestSetBit(mask);
+    }
+
+    return FindFirstBlockStartScalar(end_aligned, end);
+  }
+#endif
+  return FindFirstBlockStartScalar(start, end);
+}
+
+const uint8_t* FindLastBlockStart(const uint8_t* start, const uint8_t* end) {
+  DCHECK_LE(start, end);
+#ifdef SHADOW_SIMD_USE_SSE2
+  if (static_cast<size_t>(end - start) >= kMinVectorRange) {
+    const uint8_t* start_aligned = ::common::AlignUp(start, kVectorSize);
+    const uint8_t* end_aligned = ::common::AlignDown(end, kVectorSize);
+    const uint8_t* found = FindLastBlockStartScalar(end_aligned, end);
+    if (found != nullptr)
+      return found;
+
+    for (const uint8_t* cursor = end_aligned; cursor > start_aligned;) {
+      cursor -= kVectorSize;
+      int mask = BlockStartMask(_mm_load_si128(AsVector(cursor)));
+      if (mask != 0)
+        return cursor + HighestSetBit(mask);
+    }
+
+    return FindLastBlockStartScalar(start, start_aligned);
+  }
+#endif
+  return FindLastBlockStartScalar(start, end);
+}
+
+void MarkAsFreed(uint8_t* start, uint8_t* end) {
+  DCHECK_LE(start, end);
+#ifdef SHADOW_SIMD_USE_SSE2
+  if (static_cast<size_t>(end - start) >= kMinVectorRange) {
+    uint8_t* start_aligned = ::common::AlignUp(start, kVectorSize);
+    uint8_t* end_aligned = ::common::AlignDown(end, kVectorSize);
+    MarkAsFreedScalar(start, start_aligned);
+
+    // Each byte becomes freed unless it is an active redzone, in which case
+    // it is kept as is. This is done branch-free with a select.
+    const __m128i kFreed = SplatByte(kHeapFreedMarker);
+    for (uint8_t* cursor = start_aligned; cursor < end_aligned;
+         cursor += kVectorSize) {
+      __m128i* vector = reinterpret_cast<__m128i*>(cursor);
+      __m128i v = _mm_load_si128(vector);
+      __m128i keep = ActiveRedzoneBytes(v);
+      _mm_store_si128(vector, _mm_or_si128(_mm_and_si128(keep, v),
+                                           _mm_andnot_si128(keep, kFreed)));
+    }
+
+    MarkAsFreedScalar(end_aligned, end);
+    return;
+  }
+#endif
+  MarkAsFreedScalar(start, end);
+}
+
+}  // namespace internal
+}  // namespace asan
+}  // namespace agent
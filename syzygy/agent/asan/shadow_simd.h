@@ -0,0 +1,76 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the bulk shadow memory kernels used by the Shadow class. Each
+// kernel processes the shadow 16 bytes at a time using SSE2, with scalar code
+// handling the unaligned head and tail of a range and short ranges. On
+// platforms without SSE2 the scalar code is used throughout.
+
+#ifndef SYZYGY_AGENT_ASAN_SHADOW_SIMD_H_
+#define SYZYGY_AGENT_ASAN_SHADOW_SIMD_H_
+
+#include <stdint.h>
+
+namespace agent {
+namespace asan {
+namespace internal {
+
+// Determines if a range of shadow bytes is entirely zero.
+// @param start The first shadow byte to test.
+// @param end The shadow byte after the last one to test.
+// @returns true iff every byte in [@p start, @p end) is zero.
+bool IsZeroBuffer(const uint8_t* start, const uint8_t* end);
+
+// Finds the first non-zero shadow byte in a range.
+// @param start The first shadow byte to test.
+// @param end The shadow byte after the last one to test.
+// @returns a pointer to the first non-zero byte in [@p start, @p end), or
+//     @p end if there is none.
+const uint8_t* FindFirstNonZero(const uint8_t* start, const uint8_t* end);
+
+// Finds the first shadow byte in a range that is neither addressable nor
+// freed. These are the only bytes that can be part of a block header.
+// @param start The first shadow byte to test.
+// @param end The shadow byte after the last one to test.
+// @returns a pointer to the first such byte in [@p start, @p end), or @p end
+//     if there is none.
+const uint8_t* FindFirstNotAddressableOrFreed(const uint8_t* start,
+                                              const uint8_t* end);
+
+// Finds the first block start marker (active or historic) in a range.
+// @param start The first shadow byte to test.
+// @param end The shadow byte after the last one to test.
+// @returns a pointer to the first block start byte in [@p start, @p end), or
+//     @p end if there is none.
+const uint8_t* FindFirstBlockStart(const uint8_t* start, const uint8_t* end);
+
+// Finds the last block start marker (active or historic) in a range.
+// @param start The first shadow byte to test.
+// @param end The shadow byte after the last one to test.
+// @returns a pointer to the last block start byte in [@p start, @p end), or
+//     nullptr if there is none.
+const uint8_t* FindLastBlockStart(const uint8_t* start, const uint8_t* end);
+
+// Marks a range of shadow bytes as freed, preserving active left and right
+// redzone bytes. These are left untouched in order to preserve information
+// about nested blocks.
+// @param start The first shadow byte to modify.
+// @param end The shadow byte after the last one to modify.
+void MarkAsFreed(uint8_t* start, uint8_t* end);
+
+}  // namespace internal
+}  // namespace asan
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_ASAN_SHADOW_SIMD_H_
@@ -0,0 +1,195 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/shadow_simd.h"
+
+#include <string.h>
+#include <algorithm>
+
+#include "base/compiler_specific.h"
+#include "gtest/gtest.h"
+#include "syzygy/agent/asan/shadow_marker.h"
+
+namespace agent {
+namespace asan {
+namespace internal {
+
+namespace {
+
+// Long enough to exercise the vector loops with every head and tail
+// alignment.
+const size_t kBufferSize = 256;
+
+// A selection of markers that the kernels treat differently.
+const uint8_t kMarkers[] = {
+    kHeapAddressableMarker,
+    kHeapPartiallyAddressableByte3,
+    kHeapHistoricBlockStartMarker2,
+    kHeapHistoricLeftPaddingMarker,
+    kHeapBlockStartMarker0,
+    kHeapBlockStartMarker7,
+    kHeapBlockEndMarker,
+    kHeapLeftPaddingMarker,
+    kHeapRightPaddingMarker,
+    kAsanReservedMarker,
+    kHeapFreedMarker,
+};
+
+// Straightforward implementations against which the kernels are checked.
+bool ReferenceIsZeroBuffer(const uint8_t* start, const uint8_t* end) {
+  for (; start != end; ++start) {
+    if (*start != 0)
+      return false;
+  }
+  return true;
+}
+
+const uint8_t* ReferenceFindFirstNonZero(const uint8_t* start,
+                                         const uint8_t* end) {
+  for (; start != end; ++start) {
+    if (*start != 0)
+      return start;
+  }
+  return end;
+}
+
+const uint8_t* ReferenceFindFirstNotAddressableOrFreed(const uint8_t* start,
+                                                       const uint8_t* end) {
+  for (; start != end; ++start) {
+    if (*start != 0 && *start != kHeapFreedMarker)
+      return start;
+  }
+  return end;
+}
+
+const uint8_t* ReferenceFindFirstBlockStart(const uint8_t* start,
+                                            const uint8_t* end) {
+  for (; start != end; ++start) {
+    if (ShadowMarkerHelper::IsBlockStart(*start))
+      return start;
+  }
+  return end;
+}
+
+const uint8_t* ReferenceFindLastBlockStart(const uint8_t* start,
+                                           const uint8_t* end) {
+  for (const uint8_t* cursor = end; cursor != start; --cursor) {
+    if (ShadowMarkerHelper::IsBlockStart(cursor[-1]))
+      return cursor - 1;
+  }
+  return nullptr;
+}
+
+void ReferenceMarkAsFreed(uint8_t* start, uint8_t* end) {
+  for (; start != end; ++start) {
+    if (!ShadowMarkerHelper::IsActiveLeftRedzone(*start) &&
+        !ShadowMarkerHelper::IsActiveRightRedzone(*start)) {
+      *start = kHeapFreedMarker;
+    }
+  }
+}
+
+// Invokes @p test for a range of every (mod 16) head and tail alignment, with
+// a single marker placed at a variety of positions within the range.
+template <typename TestFunctor>
+void ForEachRangeAndMarker(TestFunctor test) {
+  ALIGNAS(16) uint8_t buffer[kBufferSize];
+  for (size_t head = 0; head < 16; ++head) {
+    for (size_t tail = 0; tail < 16; ++tail) {
+      uint8_t* start = buffer + head;
+      uint8_t* end = buffer + kBufferSize - tail;
+      size_t length = end - start;
+      for (uint8_t marker : kMarkers) {
+        for (size_t pos = 0; pos < length; pos += 7) {
+          ::memset(buffer, 0, sizeof(buffer));
+          start[pos] = marker;
+          test(start, end);
+          // Also test a short range, which is handled by the scalar code.
+          test(start, start + std::min<size_t>(length, pos + 3));
+        }
+      }
+    }
+  }
+}
+
+}  // namespace
+
+TEST(ShadowSimdTest, IsZeroBuffer) {
+  ForEachRangeAndMarker([](const uint8_t* start, const uint8_t* end) {
+    ASSERT_EQ(ReferenceIsZeroBuffer(start, end), IsZeroBuffer(start, end));
+  });
+}
+
+TEST(ShadowSimdTest, FindFirstNonZero) {
+  ForEachRangeAndMarker([](const uint8_t* start, const uint8_t* end) {
+    ASSERT_EQ(ReferenceFindFirstNonZero(start, end),
+              FindFirstNonZero(start, end));
+  });
+}
+
+TEST(ShadowSimdTest, FindFirstNotAddressableOrFreed) {
+  ForEachRangeAndMarker([](uint8_t* start, uint8_t* end) {
+    // Surround the marker with freed bytes, which must be skipped too.
+    for (uint8_t* cursor = start; cursor != end; ++cursor) {
+      if (*cursor == 0 && (cursor - start) % 3 == 0)
+        *cursor = kHeapFreedMarker;
+    }
+    ASSERT_EQ(ReferenceFindFirstNotAddressableOrFreed(start, end),
+              FindFirstNotAddressableOrFreed(start, end));
+  });
+}
+
+TEST(ShadowSimdTest, FindFirstBlockStart) {
+  ForEachRangeAndMarker([](uint8_t* start, uint8_t* end) {
+    ASSERT_EQ(ReferenceFindFirstBlockStart(start, end),
+              FindFirstBlockStart(start, end));
+    // Add a second block start at the very end, which must only be found if
+    // there's no other.
+    if (start != end) {
+      end[-1] = kHeapBlockStartMarker1;
+      ASSERT_EQ(ReferenceFindFirstBlockStart(start, end),
+                FindFirstBlockStart(start, end));
+    }
+  });
+}
+
+TEST(ShadowSimdTest, FindLastBlockStart) {
+  ForEachRangeAndMarker([](uint8_t* start, uint8_t* end) {
+    ASSERT_EQ(ReferenceFindLastBlockStart(start, end),
+              FindLastBlockStart(start, end));
+    // Add a second block start at the very beginning, which must only be
+    // found if there's no other.
+    if (start != end) {
+      *start = kHeapBlockStartMarker1;
+      ASSERT_EQ(ReferenceFindLastBlockStart(start, end),
+                FindLastBlockStart(start, end));
+    }
+  });
+}
+
+TEST(ShadowSimdTest, MarkAsFreed) {
+  ForEachRangeAndMarker([](uint8_t* start, uint8_t* end) {
+    size_t length = end - start;
+    ALIGNAS(16) uint8_t expected[kBufferSize];
+    ::memcpy(expected, start, length);
+    ReferenceMarkAsFreed(expected, expected + length);
+
+    MarkAsFreed(start, end);
+    ASSERT_EQ(0, ::memcmp(expected, start, length));
+  });
+}
+
+}  // namespace internal
+}  // namespace asan
+}  // namespace agent
@@ -14,6 +14,7 @@
 
 #include "syzygy/agent/asan/shadow.h"
 
+#include <algorithm>
 #include <memory>
 
 #include "base/rand_util.h"
@@ -610,6 +611,64 @@ TEST_F(ShadowTest, MarkAsFreedPerfTest) {
   testing::EmitMetric("Syzygy.Asan.Shadow.MarkAsFreed", tnet);
 }
 
+TEST_F(ShadowTest, BulkOperationsPerfTest) {
+  // Only the shadow is touched, so the range needn't be backed by memory.
+  const uint8_t* kBase = reinterpret_cast<const uint8_t*>(0x10000000);
+  const size_t kMaxSize = 64 * 1024 * 1024;
+
+  // Emits the average number of cycles per call, for allocation sizes from
+  // 16 bytes to 64 MB.
+  for (size_t size = 16; size <= kMaxSize; size *= 4) {
+    const size_t kIterations =
+        std::min<size_t>(10000, std::max<size_t>(4, kMaxSize / size));
+    uint64_t poison = 0;
+    uint64_t unpoison = 0;
+    uint64_t is_range_accessible = 0;
+    uint64_t find_first_poisoned_byte = 0;
+    uint64_t mark_as_freed = 0;
+    for (size_t i = 0; i < kIterations; ++i) {
+      uint64_t t0 = ::__rdtsc();
+      test_shadow.Poison(kBase, size, kAsanReservedMarker);
+      uint64_t t1 = ::__rdtsc();
+      test_shadow.Unpoison(kBase, size);
+      uint64_t t2 = ::__rdtsc();
+      EXPECT_TRUE(test_shadow.IsRangeAccessible(kBase, size));
+      uint64_t t3 = ::__rdtsc();
+      EXPECT_EQ(nullptr, test_shadow.FindFirstPoisonedByte(kBase, size));
+      uint64_t t4 = ::__rdtsc();
+      test_shadow.MarkAsFreed(kBase, size);
+      uint64_t t5 = ::__rdtsc();
+      poison += t1 - t0;
+      unpoison += t2 - t1;
+      is_range_accessible += t3 - t2;
+      find_first_poisoned_byte += t4 - t3;
+      mark_as_freed += t5 - t4;
+    }
+
+    unsigned int size_u = static_cast<unsigned int>(size);
+
+    testing::EmitMetric(
+        base::StringPrintf("Syzygy.Asan.Shadow.Poison.%u", size_u),
+        poison / kIterations);
+    testing::EmitMetric(
+        base::StringPrintf("Syzygy.Asan.Shadow.Unpoison.%u", size_u),
+        unpoison / kIterations);
+    testing::EmitMetric(
+        base::StringPrintf("Syzygy.Asan.Shadow.IsRangeAccessible.%u", size_u),
+        is_range_accessible / kIterations);
+    testing::EmitMetric(
+        base::StringPrintf("Syzygy.Asan.Shadow.FindFirstPoisonedByte.%u",
+                           size_u),
+        find_first_poisoned_byte / kIterations);
+    testing::EmitMetric(
+        base::StringPrintf("Syzygy.Asan.Shadow.MarkAsFreed.%u", size_u),
+        mark_as_freed / kIterations);
+  }
+
+  // Reset the shadow memory.
+  test_shadow.Unpoison(kBase, kMaxSize);
+}
+
 TEST_F(ShadowTest, PageBits) {
   // Set an individual page.
   const uint8_t* addr = reinterpret_cast<const uint8_t*>(16 * 4096);
@@ -651,6 +710,48 @@ TEST_F(ShadowTest, PageBits) {
   EXPECT_FALSE(test_shadow.PageIsProtected(addr2 + 4096));
 }
 
+TEST_F(ShadowTest, BlockStartIndex) {
+  const size_t kPageBytes =
+      Shadow::kBlockStartIndexGranularity * kShadowRatio;
+  const size_t kDataSize = 4 * kPageBytes;
+  uint8_t* data = static_cast<uint8_t*>(
+      ::VirtualAlloc(nullptr, kDataSize, MEM_COMMIT, PAGE_READWRITE));
+  ASSERT_NE(static_cast<uint8_t*>(nullptr), data);
+
+  // The allocation is page aligned, so its shadow starts on a shadow page
+  // boundary if the memory is aligned to a multiple of the shadow page size.
+  uint8_t* aligned_data = ::common::AlignUp(data, kPageBytes);
+  size_t begin = reinterpret_cast<uintptr_t>(aligned_data) >> kShadowRatioLog;
+  size_t end = begin + Shadow::kBlockStartIndexGranularity * 2;
+  uint8_t* aligned_data_end = aligned_data + 2 * kPageBytes;
+  ASSERT_LE(aligned_data_end, data + kDataSize);
+  EXPECT_EQ(end, test_shadow.FindBlockStartCandidate(begin, end));
+
+  // Put a block in the second shadow page.
+  BlockLayout l = {};
+  EXPECT_TRUE(BlockPlanLayout(kShadowRatio, kShadowRatio, 7, 0, 0, &l));
+  BlockInfo info = {};
+  BlockInitialize(l, aligned_data + kPageBytes + 64, &info);
+  test_shadow.PoisonAllocatedBlock(info);
+
+  size_t second_page = begin + Shadow::kBlockStartIndexGranularity;
+  EXPECT_EQ(second_page, test_shadow.FindBlockStartCandidate(begin, end));
+  EXPECT_EQ(second_page + 10,
+            test_shadow.FindBlockStartCandidate(second_page + 10, end));
+  EXPECT_EQ(second_page,
+            test_shadow.FindBlockStartCandidate(begin, second_page));
+
+  // Unpoisoning only part of the page leaves it marked.
+  test_shadow.Unpoison(info.header, info.block_size);
+  EXPECT_EQ(second_page, test_shadow.FindBlockStartCandidate(begin, end));
+
+  // Unpoisoning all of it clears the bit.
+  test_shadow.Unpoison(aligned_data, 2 * kPageBytes);
+  EXPECT_EQ(end, test_shadow.FindBlockStartCandidate(begin, end));
+
+  EXPECT_TRUE(::VirtualFree(data, 0, MEM_RELEASE));
+}
+
 namespace {
 
 // A fixture for shadow walker tests.
@@ -709,6 +810,82 @@ TEST_F(ShadowWalkerTest, WalksBlocks) {
   delete [] data;
 }
 
+TEST_F(ShadowWalkerTest, WalksBlocksAcrossShadowPages) {
+  const size_t kPageBytes =
+      Shadow::kBlockStartIndexGranularity * kShadowRatio;
+  const size_t kDataSize = 8 * kPageBytes;
+  uint8_t* data = static_cast<uint8_t*>(
+      ::VirtualAlloc(nullptr, kDataSize, MEM_COMMIT, PAGE_READWRITE));
+  ASSERT_NE(static_cast<uint8_t*>(nullptr), data);
+
+  BlockLayout l = {};
+  EXPECT_TRUE(BlockPlanLayout(kShadowRatio, kShadowRatio, 7, 0, 0, &l));
+
+  // Place blocks at the very end of a shadow page, straddling two shadow
+  // pages, and in the middle of a page after a few empty ones.
+  std::vector<uint8_t*> blocks;
+  blocks.push_back(data + kPageBytes - l.block_size);
+  blocks.push_back(data + 2 * kPageBytes - kShadowRatio);
+  blocks.push_back(data + 6 * kPageBytes + kPageBytes / 2);
+  for (uint8_t* block : blocks) {
+    BlockInfo info = {};
+    BlockInitialize(l, block, &info);
+    test_shadow.PoisonAllocatedBlock(info);
+  }
+
+  ShadowWalker w(&test_shadow, data, data + kDataSize);
+  BlockInfo i = {};
+  for (uint8_t* block : blocks) {
+    EXPECT_TRUE(w.Next(&i));
+    EXPECT_EQ(block, i.RawBlock());
+  }
+  EXPECT_FALSE(w.Next(&i));
+
+  // A walk starting after a block start doesn't report that block.
+  ShadowWalker w1(&test_shadow, blocks[2] + kShadowRatio, data + kDataSize);
+  EXPECT_FALSE(w1.Next(&i));
+
+  test_shadow.Unpoison(data, kDataSize);
+  EXPECT_TRUE(::VirtualFree(data, 0, MEM_RELEASE));
+}
+
+TEST_F(ShadowWalkerTest, WalkSparseBlocksPerfTest) {
+  // Walk a 64MB region containing a block every 4MB.
+  const size_t kDataSize = 64 * 1024 * 1024;
+  const size_t kBlockSpacing = 4 * 1024 * 1024;
+  uint8_t* data = static_cast<uint8_t*>(
+      ::VirtualAlloc(nullptr, kDataSize, MEM_RESERVE, PAGE_NOACCESS));
+  ASSERT_NE(static_cast<uint8_t*>(nullptr), data);
+
+  BlockLayout l = {};
+  EXPECT_TRUE(BlockPlanLayout(kShadowRatio, kShadowRatio, 7, 0, 0, &l));
+  size_t block_count = 0;
+  for (size_t offset = kBlockSpacing / 2; offset < kDataSize;
+       offset += kBlockSpacing) {
+    ASSERT_NE(static_cast<void*>(nullptr),
+              ::VirtualAlloc(data + offset, l.block_size, MEM_COMMIT,
+                             PAGE_READWRITE));
+    BlockInfo info = {};
+    BlockInitialize(l, data + offset, &info);
+    test_shadow.PoisonAllocatedBlock(info);
+    ++block_count;
+  }
+
+  uint64_t t0 = ::__rdtsc();
+  ShadowWalker w(&test_shadow, data, data + kDataSize);
+  BlockInfo i = {};
+  size_t found_count = 0;
+  while (w.Next(&i))
+    ++found_count;
+  uint64_t t1 = ::__rdtsc();
+  EXPECT_EQ(block_count, found_count);
+
+  testing::EmitMetric("Syzygy.Asan.ShadowWalker.WalkSparseBlocks", t1 - t0);
+
+  test_shadow.Unpoison(data, kDataSize);
+  EXPECT_TRUE(::VirtualFree(data, 0, MEM_RELEASE));
+}
+
 TEST_F(ShadowWalkerTest, WalkShadowWithUncommittedRanges) {
   // Create a 512k memory block.
   const size_t kMemorySize = 512 * 1024;
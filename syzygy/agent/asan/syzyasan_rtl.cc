@@ -233,6 +233,18 @@ VOID WINAPI asan_DisableDeferredFreeThread() {
   asan_runtime->DisableDeferredFreeThread();
 }
 
+// Enables the adaptation of the sampling rates of the access checks, if the
+// runtime was configured with a check access sampling rate below 1.
+VOID WINAPI asan_EnableCheckAccessSampler() {
+  asan_runtime->EnableCheckAccessSampler();
+}
+
+// Disables the adaptation of the sampling rates of the access checks. This
+// must be called before the runtime is unloaded if it was enabled.
+VOID WINAPI asan_DisableCheckAccessSampler() {
+  asan_runtime->DisableCheckAccessSampler();
+}
+
 void WINAPI asan_EnumExperiments(AsanExperimentCallback callback) {
   DCHECK(callback != nullptr);
 
@@ -65,6 +65,7 @@
         '<(src)/base/base.gyp:base',
         '<(src)/base/base.gyp:test_support_base',
         '<(src)/syzygy/core/core.gyp:core_unittest_utils',
+        '<(src)/syzygy/testing/testing.gyp:testing_lib',
         '<(src)/syzygy/trace/common/common.gyp:trace_unittest_utils',
         '<(src)/syzygy/trace/parse/parse.gyp:parse_lib',
         '<(src)/syzygy/trace/service/service.gyp:call_trace_service_exe',
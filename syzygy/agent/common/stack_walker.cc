@@ -25,12 +25,33 @@
 namespace agent {
 namespace common {
 
+namespace {
+
+// Indicates if WalkStack uses the stack walk caches.
+bool stack_walk_cache_enabled = false;
+
+}  // namespace
+
+void SetStackWalkCacheEnabled(bool enabled) {
+  stack_walk_cache_enabled = enabled;
+}
+
+bool IsStackWalkCacheEnabled() {
+  return stack_walk_cache_enabled;
+}
+
 #ifndef _WIN64
 
 namespace {
 
 static size_t kPointerSize = sizeof(void*);
 
+// The stack walk caches. Threads are assigned to them by thread ID, and a
+// cache can only be used by one thread at a time.
+const size_t kStackWalkCacheCount = 32;
+StackWalkCache stack_walk_caches[kStackWalkCacheCount];
+volatile LONG stack_walk_cache_in_use[kStackWalkCacheCount];
+
 __declspec(naked) void* GetEbp() {
   __asm {
     mov eax, ebp
@@ -97,8 +118,74 @@ __forceinline bool CanAdvanceFrame(const StackFrame* frame) {
   return true;
 }
 
+// Returns the stack walk cache to be used by the current thread, or nullptr if
+// the caches are disabled or if that cache is being used by another thread.
+// A returned cache must be released with ReleaseStackWalkCache.
+StackWalkCache* AcquireStackWalkCache() {
+  if (!stack_walk_cache_enabled)
+    return nullptr;
+
+  // Thread IDs are multiples of 4.
+  size_t index = (::GetCurrentThreadId() >> 2) % kStackWalkCacheCount;
+  if (::InterlockedExchange(&stack_walk_cache_in_use[index], 1) != 0)
+    return nullptr;
+  return &stack_walk_caches[index];
+}
+
+void ReleaseStackWalkCache(StackWalkCache* cache) {
+  DCHECK_NE(static_cast<StackWalkCache*>(nullptr), cache);
+  size_t index = static_cast<size_t>(cache - stack_walk_caches);
+  DCHECK_LT(index, kStackWalkCacheCount);
+  DCHECK_EQ(1, stack_walk_cache_in_use[index]);
+  // A volatile write has release semantics.
+  stack_walk_cache_in_use[index] = 0;
+}
+
 }  // namespace
 
+const StackWalkCache::Entry* StackWalkCache::Lookup(
+    const void* const* frames,
+    const void* const* return_addresses) const {
+  DCHECK_NE(static_cast<const void* const*>(nullptr), frames);
+  DCHECK_NE(static_cast<const void* const*>(nullptr), return_addresses);
+
+  for (size_t i = 1; i <= kEntryCount; ++i) {
+    const Entry& entry = entries[(next_entry + kEntryCount - i) % kEntryCount];
+    // The entry must be able to provide at least one more frame.
+    if (entry.num_frames <= kMatchDepth)
+      continue;
+    size_t j = 0;
+    for (; j < kMatchDepth; ++j) {
+      if (entry.frames[j] != frames[j] ||
+          entry.return_addresses[j] != return_addresses[j]) {
+        break;
+      }
+    }
+    if (j == kMatchDepth)
+      return &entry;
+  }
+
+  return nullptr;
+}
+
+void StackWalkCache::Insert(const void* const* frames,
+                            const void* const* return_addresses,
+                            const StackId* stack_ids,
+                            size_t num_frames) {
+  DCHECK_NE(static_cast<const void* const*>(nullptr), frames);
+  DCHECK_NE(static_cast<const void* const*>(nullptr), return_addresses);
+  DCHECK_NE(static_cast<const StackId*>(nullptr), stack_ids);
+  DCHECK_LE(num_frames, kMaxFrameCount);
+
+  Entry& entry = entries[next_entry];
+  entry.num_frames = num_frames;
+  ::memcpy(entry.frames, frames, num_frames * sizeof(*frames));
+  ::memcpy(entry.return_addresses, return_addresses,
+           num_frames * sizeof(*return_addresses));
+  ::memcpy(entry.stack_ids, stack_ids, num_frames * sizeof(*stack_ids));
+  next_entry = (next_entry + 1) % kEntryCount;
+}
+
 size_t __declspec(noinline) WalkStack(uint32_t bottom_frames_to_skip,
                                       uint32_t max_frame_count,
                                       void** frames,
@@ -128,9 +215,13 @@ size_t __declspec(noinline) WalkStack(uint32_t bottom_frames_to_skip,
     return 0;
   }
 
-  return WalkStackImpl(current_ebp, stack_bottom, stack_top,
-                       bottom_frames_to_skip, max_frame_count, frames,
-                       absolute_stack_id);
+  StackWalkCache* cache = AcquireStackWalkCache();
+  size_t num_frames = WalkStackImpl(current_ebp, stack_bottom, stack_top,
+                                    bottom_frames_to_skip, max_frame_count,
+                                    frames, absolute_stack_id, cache);
+  if (cache != nullptr)
+    ReleaseStackWalkCache(cache);
+  return num_frames;
 }
 
 size_t WalkStackImpl(const void* current_ebp,
@@ -139,7 +230,8 @@ size_t WalkStackImpl(const void* current_ebp,
                      size_t bottom_frames_to_skip,
                      size_t max_frame_count,
                      void** frames,
-                     StackId* absolute_stack_id) {
+                     StackId* absolute_stack_id,
+                     StackWalkCache* cache) {
   DCHECK(::common::IsAligned(current_ebp, kPointerSize));
   DCHECK(::common::IsAligned(stack_top, kPointerSize));
   DCHECK_LT(stack_bottom, stack_top);
@@ -163,25 +255,85 @@ size_t WalkStackImpl(const void* current_ebp,
     current_frame = current_frame->next_frame;
   }
 
+  // The locations of the walked frames and the intermediate stack IDs, for use
+  // with the cache.
+  const void* frame_locations[StackWalkCache::kMaxFrameCount];
+  StackId stack_ids[StackWalkCache::kMaxFrameCount];
+
+  // The cached stack whose innermost frames match the walked ones, if any, and
+  // the number of frames that were taken from it.
+  const StackWalkCache::Entry* entry = nullptr;
+  size_t num_cached_frames = 0;
+
   // Grab as many frames as possible.
   size_t num_frames = 0;
   while (num_frames < max_frame_count) {
     if (!FrameHasValidReturnAddress(stack_bottom, stack_top, current_frame))
       break;
     frames[num_frames] = current_frame->return_address;
-    ++num_frames;
     *absolute_stack_id = StackCapture::UpdateStackId(
         *absolute_stack_id, current_frame->return_address);
+    if (num_frames < StackWalkCache::kMaxFrameCount) {
+      frame_locations[num_frames] = current_frame;
+      stack_ids[num_frames] = *absolute_stack_id;
+    }
+    ++num_frames;
 
     if (!CanAdvanceFrame(current_frame))
       break;
 
+    if (cache != nullptr && num_frames == StackWalkCache::kMatchDepth)
+      entry = cache->Lookup(frame_locations, frames);
+
+    if (entry != nullptr) {
+      // Check how many of the following frames are the same as the cached
+      // ones. The frames of a cached stack are already known to be properly
+      // chained together, so only the last matching one needs to be checked
+      // with CanAdvanceFrame.
+      size_t i = num_frames;
+      for (; i < entry->num_frames && i < max_frame_count; ++i) {
+        const StackFrame* frame =
+            reinterpret_cast<const StackFrame*>(entry->frames[i]);
+        const StackFrame* previous_frame =
+            reinterpret_cast<const StackFrame*>(entry->frames[i - 1]);
+        if (previous_frame->next_frame != frame)
+          break;
+        if (!FrameHasValidReturnAddress(stack_bottom, stack_top, frame))
+          break;
+        if (frame->return_address != entry->return_addresses[i])
+          break;
+        frames[i] = entry->return_addresses[i];
+        frame_locations[i] = frame;
+        stack_ids[i] = entry->stack_ids[i];
+      }
+
+      if (i > num_frames) {
+        *absolute_stack_id = entry->stack_ids[i - 1];
+        num_cached_frames = i - num_frames;
+        num_frames = i;
+        current_frame =
+            reinterpret_cast<const StackFrame*>(entry->frames[i - 1]);
+      }
+
+      // Resume the regular walk after the last matching frame.
+      entry = nullptr;
+      if (num_frames == max_frame_count || !CanAdvanceFrame(current_frame))
+        break;
+    }
+
     current_frame = current_frame->next_frame;
   }
 
   *absolute_stack_id =
       StackCapture::FinalizeStackId(*absolute_stack_id, num_frames);
 
+  // Remember this stack, unless it was entirely taken from the cache.
+  if (cache != nullptr && num_frames > StackWalkCache::kMatchDepth &&
+      num_frames <= StackWalkCache::kMaxFrameCount &&
+      num_cached_frames + StackWalkCache::kMatchDepth != num_frames) {
+    cache->Insert(frame_locations, frames, stack_ids, num_frames);
+  }
+
   return num_frames;
 }
 
@@ -90,7 +90,76 @@ size_t WalkStack(uint32_t bottom_frames_to_skip,
                  void** frames,
                  StackId* absolute_stack_id);
 
+// Enables or disables the use of the stack walk caches by WalkStack. This is
+// disabled by default, and has no effect on Win64 where the stack is walked
+// by the OS.
+// @param enabled True to enable the caches, false to disable them.
+void SetStackWalkCacheEnabled(bool enabled);
+
+// @returns true if WalkStack uses the stack walk caches.
+bool IsStackWalkCacheEnabled();
+
 #ifndef _WIN64
+// A small cache of recently walked stacks. Each thread hashes to one of these,
+// so in practice it is a cache of the stacks recently walked by that thread.
+//
+// Once the innermost kMatchDepth frames of a walk match those of a cached
+// stack, the walker checks the rest of the cached frames directly against the
+// stack instead of following the saved frame pointers. As the location of
+// each frame is known in advance these reads don't depend on each other, and
+// the stack ID doesn't need to be updated for each of the matching frames.
+// Every cached frame is still checked, so the result is always identical to
+// that of a regular walk.
+//
+// This must be zero-initialized.
+struct StackWalkCache {
+  // The number of stacks held by a cache.
+  static const size_t kEntryCount = 4;
+  // The number of innermost frames that must match before a cached stack is
+  // used for the rest of a walk.
+  static const size_t kMatchDepth = 4;
+  // The maximum number of frames of a cached stack. This is the maximum
+  // number of frames of a StackCapture.
+  static const size_t kMaxFrameCount = 62;
+
+  // A cached stack.
+  struct Entry {
+    // The number of valid frames in this entry.
+    size_t num_frames;
+    // The location of each frame, i.e. the value of its frame pointer.
+    const void* frames[kMaxFrameCount];
+    // The return address of each frame.
+    void* return_addresses[kMaxFrameCount];
+    // The unfinalized stack ID of the stack up to and including each frame.
+    StackId stack_ids[kMaxFrameCount];
+  };
+
+  // Looks for a cached stack whose innermost frames are given ones. The most
+  // recently inserted stacks are considered first.
+  // @param frames The locations of the kMatchDepth innermost frames.
+  // @param return_addresses The return addresses of the kMatchDepth innermost
+  //     frames.
+  // @returns the matching entry, or nullptr if there's none.
+  const Entry* Lookup(const void* const* frames,
+                      const void* const* return_addresses) const;
+
+  // Inserts a stack in the cache, evicting the least recently inserted one.
+  // @param frames The locations of the frames of the stack.
+  // @param return_addresses The return addresses of the frames of the stack.
+  // @param stack_ids The unfinalized stack IDs of the stack up to and
+  //     including each frame.
+  // @param num_frames The number of frames in the stack. This must be at most
+  //     kMaxFrameCount.
+  void Insert(const void* const* frames,
+              const void* const* return_addresses,
+              const StackId* stack_ids,
+              size_t num_frames);
+
+  Entry entries[kEntryCount];
+  // The index of the entry that will be replaced by the next insertion.
+  size_t next_entry;
+};
+
 // Implementation of WalkStack, with explicitly provided @p current_ebp,
 // @p stack_bottom and @p stack_top. Exposed for much easier unittesting.
 // @param current_ebp The current stack frame base to start walking from.
@@ -104,6 +173,8 @@ size_t WalkStack(uint32_t bottom_frames_to_skip,
 // @param frames The array to be populated with the computed frames.
 // @param absolute_stack_id Pointer to the stack ID that will be calculated as
 //     we are walking the stack.
+// @param cache The cache to use to speed up the walk, and to which the walked
+//     stack is added. May be nullptr.
 // @returns the number of frames successfully walked and stored in @p frames.
 size_t WalkStackImpl(const void* current_ebp,
                      const void* stack_bottom,
@@ -111,7 +182,8 @@ size_t WalkStackImpl(const void* current_ebp,
                      uint32_t bottom_frames_to_skip,
                      uint32_t max_frame_count,
                      void** frames,
-                     StackId* absolute_stack_id);
+                     StackId* absolute_stack_id,
+                     StackWalkCache* cache);
 #endif  // !defined _WIN64
 
 }  // namespace common
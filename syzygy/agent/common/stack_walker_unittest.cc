@@ -14,15 +14,17 @@
 
 #include "syzygy/agent/common/stack_walker.h"
 
+#include <intrin.h>
 #include <windows.h>
 
+#include "base/strings/stringprintf.h"
 #include "gtest/gtest.h"
+#include "syzygy/agent/common/stack_capture.h"
 #include "syzygy/testing/metrics.h"
 
 namespace agent {
 namespace common {
 
-
 namespace {
 
 class StackWalkerTest : public testing::Test {
@@ -33,6 +35,11 @@ class StackWalkerTest : public testing::Test {
     ::memset(frames2_, 0, sizeof(frames2_));
     ::memset(dummy_stack_, 0, sizeof(dummy_stack_));
   }
+
+  void TearDown() override {
+    SetStackWalkCacheEnabled(false);
+  }
+
 #ifndef _WIN64
   static const uintptr_t kBaseRet = 0x1000000u;
 
@@ -126,7 +133,8 @@ class StackWalkerTest : public testing::Test {
     EXPECT_EQ(num_frames,
               WalkStackImpl(dummy_ebp_, dummy_esp_,
                             dummy_stack_ + arraysize(dummy_stack_),
-                            frames_to_skip, kMaxFrames, frames_, &stack_id));
+                            frames_to_skip, kMaxFrames, frames_, &stack_id,
+                            nullptr));
     for (size_t i = 0; i < num_frames; ++i) {
       EXPECT_EQ(reinterpret_cast<void*>(dummy_ret_ - i - 1 - frames_to_skip),
                 frames_[i]);
@@ -135,6 +143,29 @@ class StackWalkerTest : public testing::Test {
     PopEbp();
   }
 
+  // Walks the dummy stack twice with @p cache, and once without it, and
+  // expects all of these walks to give the same results.
+  void ExpectSameWalkWithCache(StackWalkCache* cache) {
+    PushEbp();
+    StackId stack_id = 0;
+    size_t num_frames = WalkStackImpl(dummy_ebp_, dummy_esp_,
+                                      dummy_stack_ + arraysize(dummy_stack_),
+                                      0, kMaxFrames, frames_, &stack_id,
+                                      nullptr);
+    for (size_t i = 0; i < 2; ++i) {
+      StackId cached_stack_id = 0;
+      EXPECT_EQ(num_frames,
+                WalkStackImpl(dummy_ebp_, dummy_esp_,
+                              dummy_stack_ + arraysize(dummy_stack_),
+                              0, kMaxFrames, frames2_, &cached_stack_id,
+                              cache));
+      EXPECT_EQ(stack_id, cached_stack_id);
+      EXPECT_EQ(0,
+                ::memcmp(frames_, frames2_, num_frames * sizeof(*frames_)));
+    }
+    PopEbp();
+  }
+
 #endif  // !defined _WIN64
 
   static const size_t kMaxFrames = 100;
@@ -252,6 +283,96 @@ TEST_F(StackWalkerTest, WalkStopAtOverflowingBasePointer) {
   ExpectSuccessfulWalk(3, 1);
 }
 
+TEST_F(StackWalkerTest, StackWalkCacheLookup) {
+  StackWalkCache cache = {};
+  const void* frames[StackWalkCache::kMaxFrameCount] = {};
+  const void* return_addresses[StackWalkCache::kMaxFrameCount] = {};
+  StackId stack_ids[StackWalkCache::kMaxFrameCount] = {};
+  for (size_t i = 0; i < StackWalkCache::kMaxFrameCount; ++i) {
+    frames[i] = dummy_stack_ + 2 * i;
+    return_addresses[i] = reinterpret_cast<void*>(kBaseRet + i);
+    stack_ids[i] = static_cast<StackId>(i);
+  }
+  EXPECT_EQ(static_cast<const StackWalkCache::Entry*>(nullptr),
+            cache.Lookup(frames, return_addresses));
+
+  // Stacks that don't have more frames than the match depth can't be used.
+  cache.Insert(frames, return_addresses, stack_ids,
+               StackWalkCache::kMatchDepth);
+  EXPECT_EQ(static_cast<const StackWalkCache::Entry*>(nullptr),
+            cache.Lookup(frames, return_addresses));
+
+  cache.Insert(frames, return_addresses, stack_ids, 10);
+  const StackWalkCache::Entry* entry = cache.Lookup(frames, return_addresses);
+  ASSERT_NE(static_cast<const StackWalkCache::Entry*>(nullptr), entry);
+  EXPECT_EQ(10u, entry->num_frames);
+  EXPECT_EQ(0, ::memcmp(return_addresses, entry->return_addresses,
+                        10 * sizeof(*return_addresses)));
+  EXPECT_EQ(0, ::memcmp(stack_ids, entry->stack_ids, 10 * sizeof(*stack_ids)));
+
+  // The most recent matching stack is returned.
+  cache.Insert(frames, return_addresses, stack_ids, 20);
+  entry = cache.Lookup(frames, return_addresses);
+  ASSERT_NE(static_cast<const StackWalkCache::Entry*>(nullptr), entry);
+  EXPECT_EQ(20u, entry->num_frames);
+
+  // Both the locations and the return addresses must match.
+  return_addresses[0] = nullptr;
+  EXPECT_EQ(static_cast<const StackWalkCache::Entry*>(nullptr),
+            cache.Lookup(frames, return_addresses));
+
+  // The least recently inserted stacks get evicted.
+  for (size_t i = 0; i < StackWalkCache::kEntryCount; ++i)
+    cache.Insert(frames, return_addresses, stack_ids, 30);
+  return_addresses[0] = reinterpret_cast<void*>(kBaseRet);
+  EXPECT_EQ(static_cast<const StackWalkCache::Entry*>(nullptr),
+            cache.Lookup(frames, return_addresses));
+}
+
+TEST_F(StackWalkerTest, CachedWalkMatchesUncachedWalk) {
+  StackWalkCache cache = {};
+  for (size_t i = 0; i < 20; ++i)
+    BuildValidFrame(i % 3);
+  ExpectSameWalkWithCache(&cache);
+
+  // Build a stack whose innermost frames are at the same locations as before,
+  // but where the outermost frames are laid out differently.
+  uintptr_t* inner_ebp = dummy_ebp_;
+  uintptr_t* inner_esp = dummy_esp_;
+  uintptr_t inner_ret = dummy_ret_;
+  ResetStack();
+  BuildValidFrame(1);
+  BuildValidFrame(0);
+  for (size_t i = 2; i < 20; ++i)
+    BuildValidFrame(i % 3);
+  ASSERT_EQ(inner_ebp, dummy_ebp_);
+  ExpectSameWalkWithCache(&cache);
+
+  // Go back to the first stack, but change a return address in the middle.
+  ResetStack();
+  for (size_t i = 0; i < 20; ++i)
+    BuildValidFrame(i % 3);
+  ASSERT_EQ(inner_ebp, dummy_ebp_);
+  ASSERT_EQ(inner_esp, dummy_esp_);
+  ASSERT_EQ(inner_ret, dummy_ret_);
+  ExpectSameWalkWithCache(&cache);
+  uintptr_t* frame = reinterpret_cast<uintptr_t*>(*dummy_ebp_);
+  for (size_t i = 0; i < 10; ++i)
+    frame = reinterpret_cast<uintptr_t*>(*frame);
+  frame[1] = 0xBAADF00D;
+  ExpectSameWalkWithCache(&cache);
+
+  // Make the stack shorter by adding an invalid frame in the middle of it.
+  frame[1] = 0;
+  ExpectSameWalkWithCache(&cache);
+
+  // Make the stack longer than the cached stacks can be.
+  frame[1] = 0xBAADF00D;
+  for (size_t i = 0; i < StackWalkCache::kMaxFrameCount; ++i)
+    BuildValidFrame(1);
+  ExpectSameWalkWithCache(&cache);
+}
+
 #endif  // !defined _WIN64
 
 TEST_F(StackWalkerTest, CompareToCaptureStackBackTrace) {
@@ -274,5 +395,70 @@ TEST_F(StackWalkerTest, CompareToCaptureStackBackTrace) {
   }
 }
 
+TEST_F(StackWalkerTest, CompareToCaptureStackBackTraceWithCache) {
+  SetStackWalkCacheEnabled(true);
+  uint32_t num_frames =
+      ::CaptureStackBackTrace(1, kMaxFrames, frames_, nullptr);
+
+  // Walk the same stack several times, so that the later walks use the
+  // cache.
+  for (size_t i = 0; i < 3; ++i) {
+    StackId stack_id;
+    size_t num_frames2 = WalkStack(1, num_frames, frames2_, &stack_id);
+    EXPECT_EQ(num_frames, num_frames2);
+    EXPECT_EQ(0, ::memcmp(frames_, frames2_, num_frames * sizeof(*frames_)));
+  }
+}
+
+namespace {
+
+// The stack depths for which the walks are measured.
+const size_t kWalkStackPerfDepths[] = { 5, 10, 20, 30, 40, 50, 62 };
+
+// Builds a stack at least @p recursion frames deeper than the current one,
+// and measures how long it takes to walk the innermost frames of it.
+// @param recursion The number of frames to add to the stack.
+// @param cycles Receives the average number of cycles taken to walk each of
+//     the kWalkStackPerfDepths depths.
+#pragma optimize("", off)
+void __declspec(noinline) MeasureWalkStack(size_t recursion,
+                                           uint64_t* cycles) {
+  if (recursion > 0) {
+    MeasureWalkStack(recursion - 1, cycles);
+    return;
+  }
+
+  static const size_t kIterations = 10000;
+  void* frames[StackCapture::kMaxNumFrames];
+  for (size_t i = 0; i < arraysize(kWalkStackPerfDepths); ++i) {
+    StackId stack_id = 0;
+    uint64_t start = ::__rdtsc();
+    for (size_t j = 0; j < kIterations; ++j)
+      WalkStack(0, kWalkStackPerfDepths[i], frames, &stack_id);
+    cycles[i] = (::__rdtsc() - start) / kIterations;
+  }
+}
+#pragma optimize("", on)
+
+}  // namespace
+
+TEST_F(StackWalkerTest, WalkStackPerfTest) {
+  // Emits the average number of cycles per walk for each stack depth, with
+  // and without the stack walk caches.
+  for (size_t i = 0; i < 2; ++i) {
+    bool enable_cache = i == 1;
+    SetStackWalkCacheEnabled(enable_cache);
+    uint64_t cycles[arraysize(kWalkStackPerfDepths)] = {};
+    MeasureWalkStack(StackCapture::kMaxNumFrames, cycles);
+    for (size_t j = 0; j < arraysize(kWalkStackPerfDepths); ++j) {
+      testing::EmitMetric(
+          base::StringPrintf("Syzygy.Agent.StackWalker.%s.%uFrames",
+                             enable_cache ? "Cached" : "Uncached",
+                             static_cast<uint32_t>(kWalkStackPerfDepths[j])),
+          cycles[j]);
+    }
+  }
+}
+
 }  // namespace common
 }  // namespace agent
@@ -14,19 +14,46 @@
 
 #include "syzygy/agent/memprof/function_call_logger.h"
 
+#include "base/hash.h"
+#include "base/threading/platform_thread.h"
 #include "syzygy/agent/common/stack_capture.h"
 
 namespace agent {
 namespace memprof {
 
+namespace {
+
+// The value of a function table slot whose entry is being created.
+const base::subtle::AtomicWord kReservedFunctionEntry = 1;
+
+// Returns the first slot to probe for a stack trace ID.
+size_t GetStackIdSlot(uint32_t stack_id) {
+  // Fibonacci hashing, the IDs themselves aren't necessarily well mixed.
+  return (stack_id * 0x9E3779B1u) >> 16;
+}
+
+}  // namespace
+
 FunctionCallLogger::FunctionCallLogger(
     trace::client::RpcSession* session)
     : session_(session),
       stack_trace_tracking_(kTrackingNone),
       serialize_timestamps_(false),
       call_counter_(0),
+      function_table_(new base::subtle::AtomicWord[kFunctionTableSize]),
+      next_function_id_(0),
+      stack_id_table_(new base::subtle::Atomic32[kStackIdTableSize]),
+      zero_stack_id_emitted_(0),
       serial_(0) {
+  static_assert((kFunctionTableSize & (kFunctionTableSize - 1)) == 0,
+                "The function table size must be a power of two.");
+  static_assert((kStackIdTableSize & (kStackIdTableSize - 1)) == 0,
+                "The stack ID table size must be a power of two.");
   DCHECK_NE(static_cast<trace::client::RpcSession*>(nullptr), session);
+  ::memset(function_table_.get(), 0,
+           kFunctionTableSize * sizeof(function_table_[0]));
+  ::memset(stack_id_table_.get(), 0,
+           kStackIdTableSize * sizeof(stack_id_table_[0]));
 
   // Generate a unique 'serial number' for this instance. This is so that we
   // can tell one logger from the next in unittests, where they often end up
@@ -37,21 +64,29 @@ FunctionCallLogger::FunctionCallLogger(
             reinterpret_cast<uint32_t>(this);
 }
 
+FunctionCallLogger::~FunctionCallLogger() {
+  for (size_t i = 0; i < kFunctionTableSize; ++i) {
+    base::subtle::AtomicWord entry =
+        base::subtle::NoBarrier_Load(&function_table_[i]);
+    DCHECK_NE(kReservedFunctionEntry, entry);
+    delete reinterpret_cast<FunctionEntry*>(entry);
+  }
+}
+
 // Given a function name returns it's ID. If this is the first time seeing
 // a given function name then emits a record to the call-trace buffer.
 uint32_t FunctionCallLogger::GetFunctionId(TraceFileSegment* segment,
                                            const std::string& function_name) {
   DCHECK_NE(static_cast<TraceFileSegment*>(nullptr), segment);
-  size_t id = 0;
-
-  {
-    base::AutoLock lock(lock_);
-    auto it = function_id_map_.find(function_name);
-    if (it != function_id_map_.end())
-      return it->second;
-    id = function_id_map_.size();
-    function_id_map_.insert(std::make_pair(function_name, id));
-  }
+
+  // Only the thread that interns the name emits it, to its own segment. The
+  // other threads may use the ID before that record is committed; this is
+  // fine as the grinder holds on to the calls of unknown functions until
+  // their names are seen.
+  bool inserted = false;
+  uint32_t id = InternFunctionName(function_name, &inserted);
+  if (!inserted)
+    return id;
 
   size_t data_size = FIELD_OFFSET(TraceFunctionNameTableEntry, name) +
       function_name.size() + 1;
@@ -82,12 +117,7 @@ uint32_t FunctionCallLogger::GetStackTraceId(TraceFileSegment* segment) {
 
   // Insert the stack ID. If it already exists it doesn't need to be emitted
   // so return early.
-  bool inserted = false;
-  {
-    base::AutoLock lock(lock_);
-    inserted = emitted_stack_ids_.insert(stack.absolute_stack_id()).second;
-  }
-  if (!inserted)
+  if (!InsertEmittedStackId(stack.absolute_stack_id()))
     return stack.absolute_stack_id();
 
   size_t frame_size = sizeof(void*) * stack.num_frames();
@@ -106,6 +136,137 @@ uint32_t FunctionCallLogger::GetStackTraceId(TraceFileSegment* segment) {
   return stack.absolute_stack_id();
 }
 
+uint32_t FunctionCallLogger::InternFunctionName(
+    const std::string& function_name, bool* inserted) {
+  DCHECK_NE(static_cast<bool*>(nullptr), inserted);
+  *inserted = false;
+
+  uint32_t hash = base::SuperFastHash(function_name.data(),
+                                      static_cast<int>(function_name.size()));
+  for (size_t i = 0; i < kFunctionTableSize; ++i) {
+    base::subtle::AtomicWord* slot =
+        &function_table_[(hash + i) & (kFunctionTableSize - 1)];
+    base::subtle::AtomicWord entry = base::subtle::Acquire_Load(slot);
+
+    if (entry == 0) {
+      // Try to reserve the empty slot. If another thread beats us to it then
+      // look at what it stored in there.
+      entry = base::subtle::NoBarrier_CompareAndSwap(
+          slot, 0, kReservedFunctionEntry);
+      if (entry == 0) {
+        // The ID is only assigned once the slot is reserved, so that the IDs
+        // stay dense.
+        FunctionEntry* new_entry = new FunctionEntry();
+        new_entry->name = function_name;
+        new_entry->id = static_cast<uint32_t>(
+            base::subtle::NoBarrier_AtomicIncrement(&next_function_id_, 1) -
+            1);
+        base::subtle::Release_Store(
+            slot, reinterpret_cast<base::subtle::AtomicWord>(new_entry));
+        *inserted = true;
+        return new_entry->id;
+      }
+    }
+
+    // Wait for the entry to be published if another thread is creating it.
+    while (entry == kReservedFunctionEntry) {
+      base::PlatformThread::YieldCurrentThread();
+      entry = base::subtle::Acquire_Load(slot);
+    }
+
+    const FunctionEntry* function_entry =
+        reinterpret_cast<const FunctionEntry*>(entry);
+    if (function_entry->name == function_name)
+      return function_entry->id;
+  }
+
+  // The table is full.
+  base::AutoLock lock(lock_);
+  auto it = overflow_function_ids_.find(function_name);
+  if (it != overflow_function_ids_.end())
+    return it->second;
+  uint32_t id = static_cast<uint32_t>(
+      base::subtle::NoBarrier_AtomicIncrement(&next_function_id_, 1) - 1);
+  overflow_function_ids_.insert(std::make_pair(function_name, id));
+  *inserted = true;
+  return id;
+}
+
+bool FunctionCallLogger::LookupFunctionId(const std::string& function_name,
+                                          uint32_t* function_id) {
+  DCHECK_NE(static_cast<uint32_t*>(nullptr), function_id);
+
+  uint32_t hash = base::SuperFastHash(function_name.data(),
+                                      static_cast<int>(function_name.size()));
+  for (size_t i = 0; i < kFunctionTableSize; ++i) {
+    base::subtle::AtomicWord entry = base::subtle::Acquire_Load(
+        &function_table_[(hash + i) & (kFunctionTableSize - 1)]);
+    if (entry == 0)
+      return false;
+    if (entry == kReservedFunctionEntry)
+      continue;
+    const FunctionEntry* function_entry =
+        reinterpret_cast<const FunctionEntry*>(entry);
+    if (function_entry->name == function_name) {
+      *function_id = function_entry->id;
+      return true;
+    }
+  }
+
+  base::AutoLock lock(lock_);
+  auto it = overflow_function_ids_.find(function_name);
+  if (it == overflow_function_ids_.end())
+    return false;
+  *function_id = it->second;
+  return true;
+}
+
+bool FunctionCallLogger::InsertEmittedStackId(uint32_t stack_id) {
+  if (stack_id == 0) {
+    return base::subtle::NoBarrier_CompareAndSwap(
+        &zero_stack_id_emitted_, 0, 1) == 0;
+  }
+
+  base::subtle::Atomic32 value = static_cast<base::subtle::Atomic32>(stack_id);
+  size_t first_slot = GetStackIdSlot(stack_id);
+  for (size_t i = 0; i < kMaxStackIdProbes; ++i) {
+    base::subtle::Atomic32* slot =
+        &stack_id_table_[(first_slot + i) & (kStackIdTableSize - 1)];
+    base::subtle::Atomic32 existing = base::subtle::NoBarrier_Load(slot);
+    if (existing == 0) {
+      existing = base::subtle::NoBarrier_CompareAndSwap(slot, 0, value);
+      if (existing == 0)
+        return true;
+    }
+    if (existing == value)
+      return false;
+  }
+
+  // All of the probed slots are taken. As entries are never removed this
+  // stays true, so the overflow set is authoritative for this ID.
+  base::AutoLock lock(lock_);
+  return overflow_stack_ids_.insert(stack_id).second;
+}
+
+bool FunctionCallLogger::IsEmittedStackId(uint32_t stack_id) {
+  if (stack_id == 0)
+    return base::subtle::NoBarrier_Load(&zero_stack_id_emitted_) != 0;
+
+  base::subtle::Atomic32 value = static_cast<base::subtle::Atomic32>(stack_id);
+  size_t first_slot = GetStackIdSlot(stack_id);
+  for (size_t i = 0; i < kMaxStackIdProbes; ++i) {
+    base::subtle::Atomic32 existing = base::subtle::NoBarrier_Load(
+        &stack_id_table_[(first_slot + i) & (kStackIdTableSize - 1)]);
+    if (existing == 0)
+      return false;
+    if (existing == value)
+      return true;
+  }
+
+  base::AutoLock lock(lock_);
+  return overflow_stack_ids_.count(stack_id) != 0;
+}
+
 bool FunctionCallLogger::FlushSegment(TraceFileSegment* segment) {
   DCHECK_NE(static_cast<TraceFileSegment*>(nullptr), segment);
   return session_->ExchangeBuffer(segment);
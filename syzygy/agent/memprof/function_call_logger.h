@@ -18,14 +18,24 @@
 #ifndef SYZYGY_AGENT_MEMPROF_FUNCTION_CALL_LOGGER_H_
 #define SYZYGY_AGENT_MEMPROF_FUNCTION_CALL_LOGGER_H_
 
+#include <map>
+#include <memory>
 #include <set>
 
+#include "base/atomicops.h"
+#include "base/synchronization/lock.h"
 #include "syzygy/agent/memprof/parameters.h"
 #include "syzygy/trace/client/rpc_session.h"
 
 namespace agent {
 namespace memprof {
 
+// Emits detailed function call records to the trace segment of the calling
+// thread. The function name and stack trace IDs are interned in fixed size
+// open addressing hash tables that are accessed without taking a lock, so
+// that threads only contend when they emit a new name or stack trace at the
+// same time. Once a table is full the new entries go to an overflow
+// container under a lock.
 class FunctionCallLogger {
  public:
   // Forward declarations.
@@ -34,11 +44,26 @@ class FunctionCallLogger {
 
   typedef trace::client::TraceFileSegment TraceFileSegment;
 
+  // The number of slots in the function name table. This must be a power of
+  // two.
+  static const size_t kFunctionTableSize = 1024;
+
+  // The number of slots in the emitted stack trace ID table. This must be a
+  // power of two.
+  static const size_t kStackIdTableSize = 64 * 1024;
+
+  // The maximum number of slots that are probed in the stack trace ID table
+  // before falling back to the overflow set.
+  static const size_t kMaxStackIdProbes = 256;
+
   // Consructor.
   // @param session The call-trace session to log to.
   // @param segment The segment to write to.
   explicit FunctionCallLogger(trace::client::RpcSession* session);
 
+  // Destructor.
+  ~FunctionCallLogger();
+
   // Given a function name returns it's ID. If this is the first time seeing
   // a given function name then emits a record to the call-trace buffer.
   // @param function_name The name of the function.
@@ -97,6 +122,37 @@ class FunctionCallLogger {
   uint32_t serial() const { return serial_; }
 
  protected:
+  // An interned function name.
+  struct FunctionEntry {
+    std::string name;
+    uint32_t id;
+  };
+
+  // Looks up a function name, interning it if it's seen for the first time.
+  // @param function_name The name of the function.
+  // @param inserted Will be set to true if the name was interned by this
+  //     call, false otherwise.
+  // @returns the ID of the function.
+  uint32_t InternFunctionName(const std::string& function_name,
+                              bool* inserted);
+
+  // Looks up a function name.
+  // @param function_name The name of the function.
+  // @param function_id Will receive the ID of the function if found.
+  // @returns true if the function name is known, false otherwise.
+  bool LookupFunctionId(const std::string& function_name,
+                        uint32_t* function_id);
+
+  // Marks a stack trace ID as emitted.
+  // @param stack_id The stack trace ID.
+  // @returns true if the stack trace ID had not been emitted yet, false
+  //     otherwise.
+  bool InsertEmittedStackId(uint32_t stack_id);
+
+  // @param stack_id The stack trace ID.
+  // @returns true if the stack trace ID has been emitted.
+  bool IsEmittedStackId(uint32_t stack_id);
+
   // Flushes the provided segment, and gets a new one.
   bool FlushSegment(TraceFileSegment* segment);
 
@@ -109,22 +165,37 @@ class FunctionCallLogger {
   // The RPC session events are being written to.
   trace::client::RpcSession* session_;
 
-  // A lock that is used for synchronizing access to internals.
+  // A lock that is used for synchronizing access to the overflow
+  // containers.
   base::Lock lock_;
 
   // The counter to use for serialized timestamps. Only used if
-  // |serialized_timestamps_| is true.
-  uint64_t call_counter_;  // Under lock_.
+  // |serialized_timestamps_| is true. This is atomically incremented.
+  volatile LONGLONG call_counter_;
 
-  // A map of known function names and their IDs. This is used for making the
-  // call-trace format more compact.
+  // A hash table of known function names, used for making the call-trace
+  // format more compact. Each slot is null, kReservedFunctionEntry while the
+  // entry is being created, or a pointer to a FunctionEntry. Entries are
+  // never removed.
+  std::unique_ptr<base::subtle::AtomicWord[]> function_table_;
+
+  // The next function ID to be assigned. This is atomically incremented.
+  base::subtle::Atomic32 next_function_id_;
+
+  // The known function names that didn't fit in |function_table_|.
   typedef std::map<std::string, uint32_t> FunctionIdMap;
-  FunctionIdMap function_id_map_;  // Under lock_.
+  FunctionIdMap overflow_function_ids_;  // Under lock_.
+
+  // A hash table of the stack traces whose IDs have already been emitted.
+  // This is only maintained if stack_trace_tracking_ is set to
+  // 'kTrackingEmit'. The empty slots are zero, so the ID zero is tracked by
+  // |zero_stack_id_emitted_| instead.
+  std::unique_ptr<base::subtle::Atomic32[]> stack_id_table_;
+  base::subtle::Atomic32 zero_stack_id_emitted_;
 
-  // A set of stack traces whose IDs have already been emitted. This is only
-  // maintained if stack_trace_tracking_ is set to 'kTrackingEmit'.
+  // The emitted stack trace IDs that didn't fit in |stack_id_table_|.
   typedef std::set<uint32_t> StackIdSet;
-  StackIdSet emitted_stack_ids_;  // Under lock_.
+  StackIdSet overflow_stack_ids_;  // Under lock_.
 
   // A unique serial number generated at construction time. For unittesting.
   uint32_t serial_;
@@ -220,9 +291,8 @@ void FunctionCallLogger::EmitDetailedFunctionCall(TraceFileSegment* segment,
   data->argument_data_size = args_size;
 
   if (serialize_timestamps_) {
-    base::AutoLock lock(lock_);
-    data->timestamp = call_counter_;
-    ++call_counter_;
+    data->timestamp =
+        static_cast<uint64_t>(::InterlockedIncrement64(&call_counter_) - 1);
   } else {
     data->timestamp = ::trace::common::GetTsc();
   }
@@ -17,8 +17,11 @@
 #include "syzygy/agent/memprof/function_call_logger.h"
 
 #include "base/bind.h"
+#include "base/strings/stringprintf.h"
+#include "base/threading/simple_thread.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "syzygy/testing/thread_utils.h"
 
 namespace agent {
 namespace memprof {
@@ -109,8 +112,35 @@ class TestFunctionCallLogger : public FunctionCallLogger {
     test_session_.AllocateBuffer(&test_segment_);
   }
 
-  using FunctionCallLogger::function_id_map_;
-  using FunctionCallLogger::emitted_stack_ids_;
+  using FunctionCallLogger::InsertEmittedStackId;
+  using FunctionCallLogger::IsEmittedStackId;
+  using FunctionCallLogger::LookupFunctionId;
+  using FunctionCallLogger::overflow_function_ids_;
+  using FunctionCallLogger::overflow_stack_ids_;
+
+  // @returns the number of known function names.
+  size_t function_count() const {
+    return static_cast<size_t>(
+        base::subtle::NoBarrier_Load(&next_function_id_));
+  }
+
+  // @returns true if @p name is known with the ID @p id.
+  bool HasFunction(const std::string& name, uint32_t id) {
+    uint32_t function_id = 0;
+    return LookupFunctionId(name, &function_id) && function_id == id;
+  }
+
+  // @returns the number of emitted stack trace IDs.
+  size_t emitted_stack_id_count() const {
+    size_t count = overflow_stack_ids_.size();
+    if (base::subtle::NoBarrier_Load(&zero_stack_id_emitted_))
+      ++count;
+    for (size_t i = 0; i < kStackIdTableSize; ++i) {
+      if (base::subtle::NoBarrier_Load(&stack_id_table_[i]) != 0)
+        ++count;
+    }
+    return count;
+  }
 
   // The session and segment that are passed to the function call logger.
   TestRpcSession test_session_;
@@ -132,6 +162,43 @@ class TestFunctionCallLogger : public FunctionCallLogger {
   }
 };
 
+// Interns function names and stack trace IDs concurrently with other
+// threads, writing to its own segment.
+class InternRunner : public base::DelegateSimpleThread::Delegate {
+ public:
+  static const size_t kFunctionCount = 100;
+  static const uint32_t kStackIdCount = 1000;
+
+  InternRunner(TestFunctionCallLogger* fcl, size_t seed)
+      : fcl_(fcl), seed_(seed), function_ids_(kFunctionCount),
+        inserted_stack_ids_(0) {
+    fcl_->test_session_.AllocateBuffer(&segment_);
+  }
+
+  void Run() override {
+    // Each thread goes through the names in a different order.
+    for (size_t i = 0; i < kFunctionCount; ++i) {
+      size_t index = (i * 7 + seed_) % kFunctionCount;
+      function_ids_[index] = fcl_->GetFunctionId(
+          &segment_, base::StringPrintf("function_%d", index));
+    }
+    for (uint32_t i = 0; i < kStackIdCount; ++i) {
+      if (fcl_->InsertEmittedStackId((i + seed_ * 13) % kStackIdCount))
+        ++inserted_stack_ids_;
+    }
+  }
+
+  const std::vector<uint32_t>& function_ids() const { return function_ids_; }
+  size_t inserted_stack_ids() const { return inserted_stack_ids_; }
+
+ private:
+  TestFunctionCallLogger* fcl_;
+  size_t seed_;
+  TraceFileSegment segment_;
+  std::vector<uint32_t> function_ids_;
+  size_t inserted_stack_ids_;
+};
+
 void TestEmitDetailedFunctionCall(TestFunctionCallLogger* fcl) {
   ASSERT_NE(static_cast<TestFunctionCallLogger*>(nullptr), fcl);
   EMIT_DETAILED_FUNCTION_CALL(fcl, &fcl->test_segment_, fcl);
@@ -141,13 +208,12 @@ void TestEmitDetailedFunctionCall(TestFunctionCallLogger* fcl) {
 
 TEST(FunctionCallLoggerTest, TraceFunctionNameTableEntry) {
   TestFunctionCallLogger fcl;
-  EXPECT_EQ(0u, fcl.function_id_map_.size());
+  EXPECT_EQ(0u, fcl.function_count());
 
   std::string name("foo");
   EXPECT_EQ(0u, fcl.GetFunctionId(&fcl.test_segment_, name));
-  EXPECT_EQ(1u, fcl.function_id_map_.size());
-  EXPECT_THAT(fcl.function_id_map_,
-              testing::Contains(std::make_pair(name, 0)));
+  EXPECT_EQ(1u, fcl.function_count());
+  EXPECT_TRUE(fcl.HasFunction(name, 0));
   EXPECT_EQ(1u, fcl.allocation_infos.size());
 
   const auto& info = fcl.allocation_infos.front();
@@ -165,30 +231,30 @@ TEST(FunctionCallLoggerTest, TraceFunctionNameTableEntry) {
 
   // Adding the same name again should do nothing.
   EXPECT_EQ(0u, fcl.GetFunctionId(&fcl.test_segment_, "foo"));
-  EXPECT_EQ(1u, fcl.function_id_map_.size());
-  EXPECT_THAT(fcl.function_id_map_,
-              testing::Contains(std::make_pair(std::string("foo"), 0)));
+  EXPECT_EQ(1u, fcl.function_count());
+  EXPECT_TRUE(fcl.HasFunction("foo", 0));
   EXPECT_EQ(1u, fcl.allocation_infos.size());
 }
 
 TEST(FunctionCallLoggerTest, TraceStackTrace) {
   TestFunctionCallLogger fcl;
-  EXPECT_EQ(0u, fcl.emitted_stack_ids_.size());
+  EXPECT_EQ(0u, fcl.emitted_stack_id_count());
 
   fcl.set_stack_trace_tracking(kTrackingNone);
   EXPECT_EQ(0u, fcl.GetStackTraceId(&fcl.test_segment_));
-  EXPECT_EQ(0u, fcl.emitted_stack_ids_.size());
+  EXPECT_EQ(0u, fcl.emitted_stack_id_count());
   EXPECT_EQ(0u, fcl.allocation_infos.size());
 
   fcl.set_stack_trace_tracking(kTrackingTrack);
   EXPECT_NE(0u, fcl.GetStackTraceId(&fcl.test_segment_));
-  EXPECT_EQ(0u, fcl.emitted_stack_ids_.size());
+  EXPECT_EQ(0u, fcl.emitted_stack_id_count());
   EXPECT_EQ(0u, fcl.allocation_infos.size());
 
   fcl.set_stack_trace_tracking(kTrackingEmit);
   uint32_t stack_trace_id = fcl.GetStackTraceId(&fcl.test_segment_);
   EXPECT_NE(0u, stack_trace_id);
-  EXPECT_THAT(fcl.emitted_stack_ids_, testing::ElementsAre(stack_trace_id));
+  EXPECT_EQ(1u, fcl.emitted_stack_id_count());
+  EXPECT_TRUE(fcl.IsEmittedStackId(stack_trace_id));
   EXPECT_EQ(1u, fcl.allocation_infos.size());
   const auto& info = fcl.allocation_infos[0];
   EXPECT_EQ(TraceStackTrace::kTypeId, info.record_type);
@@ -204,14 +270,13 @@ TEST(FunctionCallLoggerTest, TraceStackTrace) {
 TEST(FunctionCallLoggerTest, TraceDetailedFunctionCall) {
   TestFunctionCallLogger fcl;
   fcl.set_stack_trace_tracking(kTrackingEmit);
-  EXPECT_EQ(0u, fcl.function_id_map_.size());
+  EXPECT_EQ(0u, fcl.function_count());
 
   std::string name("agent::memprof::`anonymous-namespace'::"
                    "TestEmitDetailedFunctionCall");
   TestEmitDetailedFunctionCall(&fcl);
-  EXPECT_EQ(1u, fcl.function_id_map_.size());
-  EXPECT_THAT(fcl.function_id_map_,
-              testing::Contains(std::make_pair(name, 0)));
+  EXPECT_EQ(1u, fcl.function_count());
+  EXPECT_TRUE(fcl.HasFunction(name, 0));
   EXPECT_EQ(3u, fcl.allocation_infos.size());
 
   // Validate that the name record was appropriately written.
@@ -280,15 +345,14 @@ TEST(FunctionCallLoggerTest, TraceDetailedFunctionCallSerializeTimestamps) {
   TestFunctionCallLogger fcl;
   fcl.set_stack_trace_tracking(kTrackingNone);
   fcl.set_serialize_timestamps(true);
-  EXPECT_EQ(0u, fcl.function_id_map_.size());
+  EXPECT_EQ(0u, fcl.function_count());
 
   std::string name("agent::memprof::`anonymous-namespace'::"
                    "TestEmitDetailedFunctionCall");
   for (size_t i = 0; i < 3; ++i)
     TestEmitDetailedFunctionCall(&fcl);
-  EXPECT_EQ(1u, fcl.function_id_map_.size());
-  EXPECT_THAT(fcl.function_id_map_,
-              testing::Contains(std::make_pair(name, 0)));
+  EXPECT_EQ(1u, fcl.function_count());
+  EXPECT_TRUE(fcl.HasFunction(name, 0));
   // 1 name, 3 calls.
   EXPECT_EQ(4u, fcl.allocation_infos.size());
 
@@ -316,5 +380,67 @@ TEST(FunctionCallLoggerTest, TraceDetailedFunctionCallSerializeTimestamps) {
   }
 }
 
+TEST(FunctionCallLoggerTest, ConcurrentInterning) {
+  static const size_t kThreadCount = 4;
+  TestFunctionCallLogger fcl;
+
+  std::vector<std::unique_ptr<InternRunner>> runners;
+  for (size_t i = 0; i < kThreadCount; ++i)
+    runners.push_back(std::unique_ptr<InternRunner>(new InternRunner(&fcl, i)));
+  testing::RunDelegatesConcurrently(runners);
+
+  // All of the threads should agree on the function IDs, and these should be
+  // dense.
+  EXPECT_EQ(InternRunner::kFunctionCount, fcl.function_count());
+  std::set<uint32_t> function_ids;
+  for (size_t i = 0; i < InternRunner::kFunctionCount; ++i) {
+    uint32_t function_id = runners[0]->function_ids()[i];
+    for (const auto& runner : runners)
+      EXPECT_EQ(function_id, runner->function_ids()[i]);
+    EXPECT_TRUE(fcl.HasFunction(base::StringPrintf("function_%d", i),
+                                function_id));
+    EXPECT_LT(function_id, InternRunner::kFunctionCount);
+    function_ids.insert(function_id);
+  }
+  EXPECT_EQ(InternRunner::kFunctionCount, function_ids.size());
+
+  // Each stack trace ID should have been inserted exactly once.
+  size_t inserted_stack_ids = 0;
+  for (const auto& runner : runners)
+    inserted_stack_ids += runner->inserted_stack_ids();
+  EXPECT_EQ(InternRunner::kStackIdCount, inserted_stack_ids);
+  EXPECT_EQ(InternRunner::kStackIdCount, fcl.emitted_stack_id_count());
+}
+
+TEST(FunctionCallLoggerTest, InterningOverflows) {
+  TestFunctionCallLogger fcl;
+
+  // Intern more names than the table can hold.
+  const size_t kFunctionCount = FunctionCallLogger::kFunctionTableSize + 10;
+  for (size_t i = 0; i < kFunctionCount; ++i) {
+    std::string name = base::StringPrintf("function_%d", i);
+    EXPECT_EQ(i, fcl.GetFunctionId(&fcl.test_segment_, name));
+  }
+  EXPECT_EQ(10u, fcl.overflow_function_ids_.size());
+  for (size_t i = 0; i < kFunctionCount; ++i) {
+    std::string name = base::StringPrintf("function_%d", i);
+    EXPECT_EQ(i, fcl.GetFunctionId(&fcl.test_segment_, name));
+  }
+  EXPECT_EQ(kFunctionCount, fcl.function_count());
+  EXPECT_EQ(kFunctionCount, fcl.allocation_infos.size());
+
+  // Same thing for the stack trace IDs, including the ID zero.
+  const uint32_t kStackIdCount = FunctionCallLogger::kStackIdTableSize + 10;
+  for (uint32_t i = 0; i <= kStackIdCount; ++i)
+    EXPECT_TRUE(fcl.InsertEmittedStackId(i));
+  EXPECT_FALSE(fcl.overflow_stack_ids_.empty());
+  for (uint32_t i = 0; i <= kStackIdCount; ++i) {
+    EXPECT_TRUE(fcl.IsEmittedStackId(i));
+    EXPECT_FALSE(fcl.InsertEmittedStackId(i));
+  }
+  EXPECT_FALSE(fcl.IsEmittedStackId(kStackIdCount + 1));
+  EXPECT_EQ(kStackIdCount + 1, fcl.emitted_stack_id_count());
+}
+
 }  // namespace memprof
 }  // namespace agent
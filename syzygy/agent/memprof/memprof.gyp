@@ -136,6 +136,7 @@
         '<(src)/syzygy/trace/service/service.gyp:call_trace_service_exe',
         '<(src)/syzygy/pe/pe.gyp:pe_lib',
         '<(src)/syzygy/pe/pe.gyp:pe_unittest_utils',
+        '<(src)/syzygy/testing/testing.gyp:testing_lib',
         '<(src)/testing/gtest.gyp:gtest',
         '<(src)/testing/gmock.gyp:gmock',
        ],
@@ -0,0 +1,94 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/profiler/parameters.h"
+
+#include <memory>
+
+#include "base/command_line.h"
+#include "base/environment.h"
+#include "base/logging.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/utf_string_conversions.h"
+
+namespace agent {
+namespace profiler {
+
+// The environment variable that is used for extracting parameters.
+const char kParametersEnvVar[] = "SYZYGY_PROFILER_OPTIONS";
+
+// Default parameter values.
+bool kDefaultAggregateInvocations = false;
+uint32_t kDefaultAggregationPeriodMs = 1000;
+
+// Parameter names for parsing.
+const char kParamAggregateInvocations[] = "aggregate-invocations";
+const char kParamAggregationPeriodMs[] = "aggregation-period-ms";
+
+void SetDefaultParameters(Parameters* parameters) {
+  DCHECK_NE(static_cast<Parameters*>(nullptr), parameters);
+  parameters->aggregate_invocations = kDefaultAggregateInvocations;
+  parameters->aggregation_period_ms = kDefaultAggregationPeriodMs;
+}
+
+bool ParseParameters(const base::StringPiece& param_string,
+                     Parameters* parameters) {
+  DCHECK_NE(static_cast<Parameters*>(nullptr), parameters);
+
+  // Prepends the flags with a dummy executable name to keep the
+  // base::CommandLine parser happy.
+  std::wstring str = base::UTF8ToWide(param_string);
+  str.insert(0, L" ");
+  str.insert(0, L"dummy.exe");
+  base::CommandLine cmd_line = base::CommandLine::FromString(str);
+
+  bool success = true;
+
+  if (cmd_line.HasSwitch(kParamAggregateInvocations))
+    parameters->aggregate_invocations = true;
+
+  // Parse the aggregation period.
+  std::string value = cmd_line.GetSwitchValueASCII(kParamAggregationPeriodMs);
+  if (!value.empty()) {
+    unsigned period_ms = 0;
+    if (base::StringToUint(value, &period_ms)) {
+      parameters->aggregation_period_ms = period_ms;
+    } else {
+      LOG(ERROR) << "Invalid value for --" << kParamAggregationPeriodMs
+                 << ": " << value;
+      success = false;
+    }
+  }
+
+  return success;
+}
+
+bool ParseParametersFromEnv(Parameters* parameters) {
+  DCHECK_NE(static_cast<Parameters*>(nullptr), parameters);
+
+  std::unique_ptr<base::Environment> env(base::Environment::Create());
+  DCHECK_NE(static_cast<base::Environment*>(nullptr), env.get());
+
+  std::string value;
+  if (!env->GetVar(kParametersEnvVar, &value))
+    return true;
+
+  if (!ParseParameters(value, parameters))
+    return false;
+
+  return true;
+}
+
+}  // namespace profiler
+}  // namespace agent
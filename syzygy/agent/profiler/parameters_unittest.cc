@@ -0,0 +1,95 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/profiler/parameters.h"
+
+#include <memory>
+
+#include "base/environment.h"
+#include "gtest/gtest.h"
+
+namespace agent {
+namespace profiler {
+
+TEST(ParametersTest, SetDefaults) {
+  Parameters p = {};
+  SetDefaultParameters(&p);
+  EXPECT_EQ(kDefaultAggregateInvocations, p.aggregate_invocations);
+  EXPECT_EQ(kDefaultAggregationPeriodMs, p.aggregation_period_ms);
+}
+
+TEST(ParametersTest, ParseInvalidAggregationPeriod) {
+  Parameters p = {};
+  SetDefaultParameters(&p);
+  std::string str("--aggregation-period-ms=foo");
+  EXPECT_FALSE(ParseParameters(str, &p));
+}
+
+TEST(ParametersTest, ParseMinimalCommandLine) {
+  Parameters p = {};
+  SetDefaultParameters(&p);
+  std::string str("");
+  EXPECT_TRUE(ParseParameters(str, &p));
+  EXPECT_EQ(kDefaultAggregateInvocations, p.aggregate_invocations);
+  EXPECT_EQ(kDefaultAggregationPeriodMs, p.aggregation_period_ms);
+}
+
+TEST(ParametersTest, ParseMaximalCommandLine) {
+  Parameters p = {};
+  SetDefaultParameters(&p);
+  std::string str("--aggregate-invocations "
+                  "--aggregation-period-ms=250");
+  EXPECT_TRUE(ParseParameters(str, &p));
+  EXPECT_TRUE(p.aggregate_invocations);
+  EXPECT_EQ(250u, p.aggregation_period_ms);
+}
+
+TEST(ParametersTest, ParseNoEnvironment) {
+  std::unique_ptr<base::Environment> env(base::Environment::Create());
+  ASSERT_NE(nullptr, env.get());
+  env->UnSetVar(kParametersEnvVar);
+
+  Parameters p = {};
+  SetDefaultParameters(&p);
+  EXPECT_TRUE(ParseParametersFromEnv(&p));
+  EXPECT_EQ(kDefaultAggregateInvocations, p.aggregate_invocations);
+  EXPECT_EQ(kDefaultAggregationPeriodMs, p.aggregation_period_ms);
+}
+
+TEST(ParametersTest, ParseInvalidEnvironment) {
+  std::unique_ptr<base::Environment> env(base::Environment::Create());
+  ASSERT_NE(nullptr, env.get());
+  env->SetVar(kParametersEnvVar, "--aggregation-period-ms=-1");
+
+  Parameters p = {};
+  SetDefaultParameters(&p);
+  EXPECT_FALSE(ParseParametersFromEnv(&p));
+  env->UnSetVar(kParametersEnvVar);
+}
+
+TEST(ParametersTest, ParseValidEnvironment) {
+  std::unique_ptr<base::Environment> env(base::Environment::Create());
+  ASSERT_NE(nullptr, env.get());
+  env->SetVar(kParametersEnvVar, "--aggregate-invocations");
+
+  Parameters p = {};
+  SetDefaultParameters(&p);
+  EXPECT_TRUE(ParseParametersFromEnv(&p));
+  EXPECT_TRUE(p.aggregate_invocations);
+  EXPECT_EQ(kDefaultAggregationPeriodMs, p.aggregation_period_ms);
+  env->UnSetVar(kParametersEnvVar);
+}
+
+}  // namespace profiler
+}  // namespace agent
@@ -17,6 +17,7 @@
 
 #include <windows.h>
 #include <algorithm>
+#include <limits>
 #include <memory>
 
 #include "base/at_exit.h"
@@ -26,6 +27,7 @@
 #include "base/logging.h"
 #include "base/strings/string_util.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/time/time.h"
 #include "base/win/pe_image.h"
 #include "base/win/scoped_handle.h"
 #include "syzygy/agent/common/agent.h"
@@ -72,8 +74,13 @@ struct InvocationValue {
   // The last observed move count for function_symbol.
   int32_t function_move_count;
 
-  // Points to the trace buffer entry for the respective function.
+  // Points to the trace buffer entry for the respective function or, when
+  // aggregating invocations, to |aggregate| below.
   InvocationInfo* info;
+
+  // The invocation data accumulated since the last write to the trace. This
+  // is only used when aggregating invocations.
+  InvocationInfo aggregate;
 };
 
 typedef std::unordered_map<InvocationKey, InvocationValue, HashInvocationKey>
@@ -337,6 +344,24 @@ class Profiler::ThreadState
   void ClearCache();
   bool FlushSegment();
 
+  // @name Invocation aggregation.
+  // @{
+  // Writes the accumulated invocations to the trace if the aggregation
+  // period has elapsed.
+  void MaybeFlushAggregates();
+  // Writes all the accumulated invocations to the trace, and discards the
+  // entries that haven't been invoked since the last flush.
+  void FlushAggregates();
+  // Writes the invocations accumulated in @p value to the trace, and resets
+  // them.
+  // @returns true on success, false if the trace buffer can't be allocated.
+  bool EmitAggregate(InvocationValue* value);
+  // @}
+
+  // The number of function exits between two checks of the aggregation
+  // period. This amortizes the cost of reading the clock.
+  static const size_t kAggregationCheckInterval = 4096;
+
   // The profiler we're attached to.
   Profiler* profiler_;
 
@@ -357,17 +382,40 @@ class Profiler::ThreadState
 
   // The set of modules we've logged.
   ModuleSet logged_modules_;
+
+  // If true, invocations_ persists across trace segments, and accumulates
+  // the invocations that are periodically written to the trace.
+  bool aggregate_invocations_;
+
+  // The minimum time between two writes of the accumulated invocations.
+  base::TimeDelta aggregation_period_;
+
+  // The time after which the accumulated invocations will next be written.
+  base::TimeTicks next_aggregation_flush_;
+
+  // The number of function exits since the aggregation period was checked.
+  size_t exits_since_flush_check_;
 };
 
 Profiler::ThreadState::ThreadState(Profiler* profiler)
     : profiler_(profiler),
       cycles_overhead_(0LL),
-      batch_(NULL) {
+      batch_(NULL),
+      aggregate_invocations_(profiler->parameters_.aggregate_invocations),
+      aggregation_period_(base::TimeDelta::FromMilliseconds(
+          profiler->parameters_.aggregation_period_ms)),
+      exits_since_flush_check_(0) {
+  if (aggregate_invocations_)
+    next_aggregation_flush_ = base::TimeTicks::Now() + aggregation_period_;
   Initialize();
 }
 
 Profiler::ThreadState::~ThreadState() {
+  // Write out whatever was accumulated since the last flush.
+  if (aggregate_invocations_ && segment_.write_ptr != NULL)
+    FlushAggregates();
   ClearCache();
+  invocations_.clear();
 
   // If we have an outstanding buffer, let's deallocate it now.
   if (segment_.write_ptr != NULL)
@@ -520,6 +568,12 @@ void Profiler::ThreadState::OnFunctionExit(const ThunkData* data,
     RecordInvocation(ret_data->function, data->function, cycles_executed);
   }
 
+  if (aggregate_invocations_ &&
+      ++exits_since_flush_check_ >= kAggregationCheckInterval) {
+    exits_since_flush_check_ = 0;
+    MaybeFlushAggregates();
+  }
+
   UpdateOverhead(cycles_exit);
 }
 
@@ -548,11 +602,12 @@ void Profiler::ThreadState::RecordInvocation(RetAddr caller,
       // The entry is still good, tally the new data.
       ++(value.info->num_calls);
       value.info->cycles_sum += duration_cycles;
-      if (duration_cycles < value.info->cycles_min) {
+      // Note that an aggregate that was just flushed has an empty range, so
+      // both bounds may need updating.
+      if (duration_cycles < value.info->cycles_min)
         value.info->cycles_min = duration_cycles;
-      } else if (duration_cycles > value.info->cycles_max) {
+      if (duration_cycles > value.info->cycles_max)
         value.info->cycles_max = duration_cycles;
-      }
 
       // Early out on success.
       return;
@@ -560,6 +615,12 @@ void Profiler::ThreadState::RecordInvocation(RetAddr caller,
       // The entry is not valid any more, discard it.
       DCHECK(value.caller_symbol != NULL || value.function_symbol != NULL);
 
+      // Don't lose what was accumulated under the old symbol addresses.
+      if (aggregate_invocations_ && value.aggregate.num_calls != 0) {
+        ScopedLastErrorKeeper keep_last_error;
+        EmitAggregate(&value);
+      }
+
       invocations_.erase(it);
     }
   }
@@ -591,7 +652,14 @@ void Profiler::ThreadState::RecordInvocation(RetAddr caller,
     LogSymbol(function_symbol.get());
   }
 
-  InvocationInfo* info = AllocateInvocationInfo();
+  // When aggregating, the invocation is tallied in the map entry itself.
+  // Otherwise it goes straight to the trace buffer, which must be allocated
+  // before the entry is created, as the allocation may clear the map.
+  InvocationInfo* info = NULL;
+  if (aggregate_invocations_)
+    info = &invocations_[key].aggregate;
+  else
+    info = AllocateInvocationInfo();
   if (info != NULL) {
     InvocationValue& value = invocations_[key];
     value.info = info;
@@ -687,7 +755,67 @@ bool Profiler::ThreadState::FlushSegment() {
 
 void Profiler::ThreadState::ClearCache() {
   batch_ = NULL;
-  invocations_.clear();
+
+  // The aggregated invocations live outside of the trace buffer, so they
+  // survive it.
+  if (!aggregate_invocations_)
+    invocations_.clear();
+}
+
+void Profiler::ThreadState::MaybeFlushAggregates() {
+  DCHECK(aggregate_invocations_);
+
+  base::TimeTicks now = base::TimeTicks::Now();
+  if (now < next_aggregation_flush_)
+    return;
+
+  FlushAggregates();
+  next_aggregation_flush_ = now + aggregation_period_;
+}
+
+void Profiler::ThreadState::FlushAggregates() {
+  DCHECK(aggregate_invocations_);
+
+  if (profiler_->session_.IsDisabled())
+    return;
+
+  // The code below may touch last error.
+  ScopedLastErrorKeeper keep_last_error;
+
+  InvocationMap::iterator it = invocations_.begin();
+  while (it != invocations_.end()) {
+    // Drop the entries that have been idle for a whole period, this keeps
+    // the map from growing without bounds.
+    if (it->second.aggregate.num_calls == 0) {
+      it = invocations_.erase(it);
+      continue;
+    }
+
+    if (!EmitAggregate(&it->second))
+      return;
+    ++it;
+  }
+}
+
+bool Profiler::ThreadState::EmitAggregate(InvocationValue* value) {
+  DCHECK(aggregate_invocations_);
+  DCHECK(value != NULL);
+  DCHECK_NE(0U, value->aggregate.num_calls);
+
+  // Note that this never clears invocations_, as we're aggregating.
+  InvocationInfo* info = AllocateInvocationInfo();
+  if (info == NULL)
+    return false;
+
+  *info = value->aggregate;
+
+  // Start a new delta. The caller and function details are kept.
+  value->aggregate.num_calls = 0;
+  value->aggregate.cycles_sum = 0;
+  value->aggregate.cycles_min = std::numeric_limits<uint64_t>::max();
+  value->aggregate.cycles_max = 0;
+
+  return true;
 }
 
 void Profiler::OnThreadDetach() {
@@ -833,6 +961,14 @@ void Profiler::OnDllEvent(agent::common::DllNotificationWatcher::EventType type,
 }
 
 Profiler::Profiler() : handler_registration_(NULL) {
+  // Parse the parameters before any thread state is created, as they
+  // determine how invocations are recorded.
+  SetDefaultParameters(&parameters_);
+  if (!ParseParametersFromEnv(&parameters_)) {
+    LOG(ERROR) << "Failed to parse profiler parameters, using defaults.";
+    SetDefaultParameters(&parameters_);
+  }
+
   // Create our RPC session and allocate our initial trace segment on creation,
   // aka at load time.
   ThreadState* data = CreateFirstThreadStateAndSession();
@@ -33,6 +33,7 @@
 #include "syzygy/agent/common/dll_notifications.h"
 #include "syzygy/agent/common/entry_frame.h"
 #include "syzygy/agent/common/thread_state.h"
+#include "syzygy/agent/profiler/parameters.h"
 #include "syzygy/agent/profiler/symbol_map.h"
 #include "syzygy/trace/client/rpc_session.h"
 
@@ -139,6 +140,9 @@ class Profiler {
   ThreadState* GetThreadState() const;
   void FreeThreadState();
 
+  // The runtime parameters, parsed from the environment on creation.
+  Parameters parameters_;
+
   // The RPC session we're logging to/through.
   trace::client::RpcSession session_;
 
@@ -19,8 +19,10 @@
 #include <psapi.h>
 
 #include <limits>
+#include <memory>
 
 #include "base/bind.h"
+#include "base/environment.h"
 #include "base/scoped_native_library.h"
 #include "base/files/file_enumerator.h"
 #include "base/files/file_util.h"
@@ -30,6 +32,7 @@
 #include "base/threading/thread.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "syzygy/agent/profiler/parameters.h"
 #include "syzygy/common/process_utils.h"
 #include "syzygy/core/unittest_util.h"
 #include "syzygy/pe/unittest_util.h"
@@ -565,6 +568,41 @@ TEST_F(ProfilerTest, RecordsOneEntryPerModuleAndFunction) {
   ASSERT_NO_FATAL_FAILURE(ReplayLogs());
 }
 
+TEST_F(ProfilerTest, AggregatesInvocations) {
+  ASSERT_NO_FATAL_FAILURE(StartService());
+
+  // The parameters are parsed when the profiler is loaded.
+  std::unique_ptr<base::Environment> env(base::Environment::Create());
+  ASSERT_TRUE(env->SetVar(kParametersEnvVar, "--aggregate-invocations"));
+  ASSERT_NO_FATAL_FAILURE(LoadDll());
+  ASSERT_TRUE(env->UnSetVar(kParametersEnvVar));
+
+  EXPECT_NO_FATAL_FAILURE(InvokeDllMainThunk(::GetModuleHandle(NULL)));
+  ASSERT_NO_FATAL_FAILURE(InvokeFunctionAThunk());
+  ASSERT_NO_FATAL_FAILURE(InvokeFunctionAThunk());
+  ASSERT_NO_FATAL_FAILURE(InvokeFunctionAThunk());
+
+  // The accumulated invocations are written out as the thread state is
+  // torn down.
+  ASSERT_NO_FATAL_FAILURE(UnloadDll());
+
+  EXPECT_CALL(handler_, OnProcessStarted(_, ::GetCurrentProcessId(), _));
+  EXPECT_CALL(handler_, OnProcessAttach(_,
+                                        ::GetCurrentProcessId(),
+                                        ::GetCurrentThreadId(),
+                                        _)).Times(testing::AnyNumber());
+
+  // There should be a single record per caller and function pair.
+  EXPECT_CALL(handler_, OnInvocationBatch(_,
+                                          ::GetCurrentProcessId(),
+                                          ::GetCurrentThreadId(),
+                                          2,
+                                          _));
+  EXPECT_CALL(handler_, OnProcessEnded(_, ::GetCurrentProcessId()));
+
+  ASSERT_NO_FATAL_FAILURE(ReplayLogs());
+}
+
 TEST_F(ProfilerTest, RecordsThreadName) {
   if (::IsDebuggerPresent()) {
     LOG(WARNING) << "This test fails under debugging.";
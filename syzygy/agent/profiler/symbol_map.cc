@@ -14,15 +14,44 @@
 
 #include "syzygy/agent/profiler/symbol_map.h"
 
+#include <algorithm>
+
 namespace agent {
 namespace profiler {
 
+namespace {
+
+// Orders an address and the snapshot entries by their start address.
+struct EntryStartLess {
+  template <typename EntryType>
+  bool operator()(const uint8_t* addr, const EntryType& entry) const {
+    return addr < entry.start;
+  }
+};
+
+}  // namespace
+
 base::subtle::Atomic32 SymbolMap::Symbol::next_symbol_id_ = 0;
 
-SymbolMap::SymbolMap() {
+SymbolMap::SymbolMap()
+    : version_(0), pending_count_(0), snapshot_(0), epoch_(0) {
+  reader_counts_[0] = 0;
+  reader_counts_[1] = 0;
+
+  Snapshot* snapshot = new Snapshot();
+  snapshot->version = 0;
+  snapshot_ = reinterpret_cast<base::subtle::AtomicWord>(snapshot);
 }
 
 SymbolMap::~SymbolMap() {
+  DCHECK_EQ(0, base::subtle::NoBarrier_Load(&reader_counts_[0]));
+  DCHECK_EQ(0, base::subtle::NoBarrier_Load(&reader_counts_[1]));
+
+  delete reinterpret_cast<Snapshot*>(base::subtle::NoBarrier_Load(&snapshot_));
+  for (auto& retired_snapshots : retired_snapshots_) {
+    for (Snapshot* snapshot : retired_snapshots)
+      delete snapshot;
+  }
 }
 
 void SymbolMap::AddSymbol(const void* start_addr,
@@ -41,6 +70,8 @@ void SymbolMap::AddSymbol(const void* start_addr,
   bool inserted = addr_space_.Insert(
       Range(reinterpret_cast<const uint8_t*>(start_addr), length), symbol);
   DCHECK(inserted);
+
+  OnUpdateUnlocked();
 }
 
 void SymbolMap::MoveSymbol(const void* old_addr, const void* new_addr) {
@@ -69,18 +100,42 @@ void SymbolMap::MoveSymbol(const void* old_addr, const void* new_addr) {
   bool inserted = addr_space_.Insert(
       Range(reinterpret_cast<const uint8_t*>(new_addr), length), symbol);
   DCHECK(inserted);
+
+  OnUpdateUnlocked();
 }
 
 scoped_refptr<SymbolMap::Symbol> SymbolMap::FindSymbol(const void* addr) {
-  base::AutoLock hold(lock_);
+  // Register as a reader for the duration of the lookup, so that the
+  // snapshot isn't freed from under us.
+  base::subtle::Atomic32 reader_index =
+      base::subtle::Acquire_Load(&epoch_) & 1;
+  base::subtle::Barrier_AtomicIncrement(&reader_counts_[reader_index], 1);
 
-  SymbolAddressSpace::RangeMapIter found = addr_space_.FindFirstIntersection(
-      Range(reinterpret_cast<const uint8_t*>(addr), 1));
+  const Snapshot* snapshot = reinterpret_cast<const Snapshot*>(
+      base::subtle::Acquire_Load(&snapshot_));
+  bool stale = snapshot->version != base::subtle::Acquire_Load(&version_);
+  scoped_refptr<Symbol> symbol;
+  if (!stale) {
+    const uint8_t* address = reinterpret_cast<const uint8_t*>(addr);
+    auto it = std::upper_bound(snapshot->entries.begin(),
+                               snapshot->entries.end(), address,
+                               EntryStartLess());
+    if (it != snapshot->entries.begin()) {
+      --it;
+      if (address < it->end)
+        symbol = it->symbol;
+    }
+  }
 
-  if (found == addr_space_.end())
-    return NULL;
+  base::subtle::Barrier_AtomicIncrement(&reader_counts_[reader_index], -1);
+  if (!stale)
+    return symbol;
 
-  return found->second;
+  // The snapshot is missing some updates, go to the address space instead.
+  base::AutoLock hold(lock_);
+  ++pending_count_;
+  MaybeRebuildSnapshotUnlocked();
+  return FindSymbolUnlocked(addr);
 }
 
 void SymbolMap::RetireRangeUnlocked(const Range& range) {
@@ -90,11 +145,92 @@ void SymbolMap::RetireRangeUnlocked(const Range& range) {
       addr_space_.FindIntersecting(range);
   SymbolAddressSpace::iterator it = found.first;
   for (; it != found.second; ++it)
-    found.first->second->Invalidate();
+    it->second->Invalidate();
 
   addr_space_.Remove(found);
 }
 
+void SymbolMap::OnUpdateUnlocked() {
+  lock_.AssertAcquired();
+  base::subtle::Barrier_AtomicIncrement(&version_, 1);
+  ++pending_count_;
+  MaybeRebuildSnapshotUnlocked();
+}
+
+void SymbolMap::MaybeRebuildSnapshotUnlocked() {
+  lock_.AssertAcquired();
+
+  const Snapshot* snapshot = reinterpret_cast<const Snapshot*>(
+      base::subtle::NoBarrier_Load(&snapshot_));
+  if (snapshot->version == base::subtle::NoBarrier_Load(&version_))
+    return;
+
+  size_t threshold = addr_space_.size() / kRebuildSizeDivisor;
+  if (threshold < kMinRebuildThreshold)
+    threshold = kMinRebuildThreshold;
+  if (pending_count_ >= threshold)
+    RebuildSnapshotUnlocked();
+}
+
+scoped_refptr<SymbolMap::Symbol> SymbolMap::FindSymbolUnlocked(
+    const void* addr) {
+  lock_.AssertAcquired();
+
+  SymbolAddressSpace::RangeMapIter found = addr_space_.FindFirstIntersection(
+      Range(reinterpret_cast<const uint8_t*>(addr), 1));
+
+  if (found == addr_space_.end())
+    return NULL;
+
+  return found->second;
+}
+
+void SymbolMap::RebuildSnapshotUnlocked() {
+  lock_.AssertAcquired();
+
+  Snapshot* snapshot = new Snapshot();
+  snapshot->version = base::subtle::NoBarrier_Load(&version_);
+  snapshot->entries.reserve(addr_space_.size());
+  for (const auto& range_and_symbol : addr_space_) {
+    Snapshot::Entry entry = {range_and_symbol.first.start(),
+                             range_and_symbol.first.end(),
+                             range_and_symbol.second};
+    snapshot->entries.push_back(entry);
+  }
+
+  // Publish the new snapshot, and retire the old one.
+  Snapshot* old_snapshot = reinterpret_cast<Snapshot*>(
+      base::subtle::NoBarrier_AtomicExchange(
+          &snapshot_, reinterpret_cast<base::subtle::AtomicWord>(snapshot)));
+  retired_snapshots_[0].push_back(old_snapshot);
+  pending_count_ = 0;
+
+  ReclaimSnapshotsUnlocked();
+}
+
+void SymbolMap::ReclaimSnapshotsUnlocked() {
+  lock_.AssertAcquired();
+
+  // Make sure the publication of the snapshot isn't reordered with the reads
+  // of the reader counts.
+  base::subtle::MemoryBarrier();
+
+  // Advance the epoch as many times as possible, up to the two advances that
+  // free all of the retired snapshots. An advance is only possible once the
+  // readers of the previous epoch are gone.
+  for (size_t i = 0; i < 2; ++i) {
+    base::subtle::Atomic32 epoch = base::subtle::NoBarrier_Load(&epoch_);
+    if (base::subtle::Acquire_Load(&reader_counts_[(epoch + 1) & 1]) != 0)
+      return;
+
+    for (Snapshot* snapshot : retired_snapshots_[1])
+      delete snapshot;
+    retired_snapshots_[1].clear();
+    retired_snapshots_[1].swap(retired_snapshots_[0]);
+    base::subtle::Barrier_AtomicIncrement(&epoch_, 1);
+  }
+}
+
 SymbolMap::Symbol::Symbol(const base::StringPiece& name, const void* address)
     : name_(name.begin(), name.end()),
       move_count_(0),
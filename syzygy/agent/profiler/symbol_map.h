@@ -15,6 +15,8 @@
 #ifndef SYZYGY_AGENT_PROFILER_SYMBOL_MAP_H_
 #define SYZYGY_AGENT_PROFILER_SYMBOL_MAP_H_
 
+#include <vector>
+
 #include "base/atomicops.h"
 
 #include "base/memory/ref_counted.h"
@@ -29,10 +31,25 @@ namespace profiler {
 // resolving addresses of dynamically generated, garbage collected code, to
 // names in a profiler. This is geared to allow entry/exit processing in a
 // profiler to execute as quickly as possible.
+//
+// Lookups are read-copy-update style: readers binary search an immutable
+// sorted snapshot of the map without taking any lock. Writers update the
+// authoritative address space under a lock, which makes the snapshot stale.
+// Lookups that find a stale snapshot fall back to the locked address space,
+// and the snapshot is only rebuilt once enough updates and stale lookups have
+// accumulated, so that bursts of updates are folded into a single rebuild.
+// Retired snapshots are freed once no reader can be using them anymore.
 class SymbolMap {
  public:
   class Symbol;
 
+  // The snapshot is rebuilt once the number of updates and stale lookups
+  // since it was built reaches the larger of kMinRebuildThreshold and the
+  // number of symbols divided by kRebuildSizeDivisor. This bounds the
+  // amortized cost of the rebuilds.
+  static const size_t kMinRebuildThreshold = 64;
+  static const size_t kRebuildSizeDivisor = 16;
+
   SymbolMap();
   ~SymbolMap();
 
@@ -59,12 +76,65 @@ class SymbolMap {
       SymbolAddressSpace;
   typedef SymbolAddressSpace::Range Range;
 
+  // An immutable copy of the address space, sorted by address.
+  struct Snapshot {
+    struct Entry {
+      const uint8_t* start;
+      const uint8_t* end;
+      scoped_refptr<Symbol> symbol;
+    };
+
+    // The value of |version_| this snapshot was built from.
+    base::subtle::Atomic32 version;
+
+    std::vector<Entry> entries;
+  };
+
   // Retire any symbols overlapping @p range.
   void RetireRangeUnlocked(const Range& range);
 
+  // Notes that the address space has changed, and rebuilds the snapshot if
+  // enough changes have accumulated.
+  void OnUpdateUnlocked();
+
+  // Rebuilds the snapshot if it's stale and enough updates and stale lookups
+  // have accumulated.
+  void MaybeRebuildSnapshotUnlocked();
+
+  // Finds the symbol covering @p addr in the address space.
+  scoped_refptr<Symbol> FindSymbolUnlocked(const void* addr);
+
+  // Publishes a new snapshot of the address space, and retires the current
+  // one.
+  void RebuildSnapshotUnlocked();
+
+  // Moves the retired snapshots along as the readers drain, freeing the ones
+  // that can't be in use anymore.
+  void ReclaimSnapshotsUnlocked();
+
   base::Lock lock_;
   SymbolAddressSpace addr_space_;  // Under lock_.
 
+  // Incremented on each change to |addr_space_|. Only written under lock_.
+  base::subtle::Atomic32 version_;
+
+  // The number of updates and stale lookups since the snapshot was built.
+  size_t pending_count_;  // Under lock_.
+
+  // The current snapshot. Never null.
+  base::subtle::AtomicWord snapshot_;
+
+  // Readers register in the counter selected by the parity of |epoch_| for
+  // the duration of a lookup. Advancing the epoch requires the counter of
+  // the previous epoch to have drained, and a retired snapshot is freed after
+  // two advances. Readers that registered before it was retired are gone by
+  // then, and the later ones can't have seen it.
+  base::subtle::Atomic32 epoch_;
+  base::subtle::Atomic32 reader_counts_[2];
+
+  // Snapshots waiting for one and for two more epoch advances.
+  std::vector<Snapshot*> retired_snapshots_[2];  // Under lock_.
+
  private:
   DISALLOW_COPY_AND_ASSIGN(SymbolMap);
 };
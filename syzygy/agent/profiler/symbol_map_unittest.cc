@@ -14,8 +14,15 @@
 
 #include "syzygy/agent/profiler/symbol_map.h"
 
+#include <memory>
+#include <vector>
+
+#include "base/strings/stringprintf.h"
+#include "base/threading/simple_thread.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "syzygy/testing/metrics.h"
+#include "syzygy/testing/thread_utils.h"
 
 namespace agent {
 namespace profiler {
@@ -26,7 +33,22 @@ class TestingSymbolMap : public SymbolMap {
  public:
   // Expose the address space for testing.
   using SymbolMap::addr_space_;
+  using SymbolMap::retired_snapshots_;
   typedef SymbolMap::SymbolAddressSpace SymbolAddressSpace;
+
+  // @returns true if lookups are served from the snapshot.
+  bool snapshot_is_current() const {
+    const Snapshot* snapshot = reinterpret_cast<const Snapshot*>(
+        base::subtle::NoBarrier_Load(&snapshot_));
+    return snapshot->version == base::subtle::NoBarrier_Load(&version_);
+  }
+
+  // @returns the number of symbols in the snapshot.
+  size_t snapshot_size() const {
+    const Snapshot* snapshot = reinterpret_cast<const Snapshot*>(
+        base::subtle::NoBarrier_Load(&snapshot_));
+    return snapshot->entries.size();
+  }
 };
 
 const uint8_t* ToPtr(intptr_t number) {
@@ -38,6 +60,80 @@ class SymbolMapTest : public testing::Test {
   TestingSymbolMap symbol_map_;
 };
 
+// Emulates a JIT: repeatedly adds symbols over a window of the address space
+// and moves some of them around, while other threads look them up.
+class SymbolChurnRunner : public base::DelegateSimpleThread::Delegate {
+ public:
+  static const intptr_t kBase = 0x100000;
+  static const size_t kSymbolCount = 4096;
+  static const size_t kSymbolSize = 0x40;
+
+  SymbolChurnRunner(SymbolMap* symbol_map, bool writer, size_t iterations)
+      : symbol_map_(symbol_map), writer_(writer), iterations_(iterations),
+        found_(0), bad_(0) {}
+
+  void Run() override {
+    for (size_t i = 0; i < iterations_; ++i) {
+      size_t index = (i * 7919) % kSymbolCount;
+      const uint8_t* addr = ToPtr(kBase + index * kSymbolSize);
+      if (writer_) {
+        if (i % 4 == 3) {
+          // Move the symbol over its neighbour, invalidating it.
+          size_t next_index = (index + 1) % kSymbolCount;
+          symbol_map_->MoveSymbol(addr,
+                                  ToPtr(kBase + next_index * kSymbolSize));
+        } else {
+          symbol_map_->AddSymbol(addr, kSymbolSize, "jitted");
+        }
+      } else {
+        scoped_refptr<SymbolMap::Symbol> symbol =
+            symbol_map_->FindSymbol(addr + 1);
+        if (symbol != NULL) {
+          ++found_;
+          if (symbol->name() != "jitted")
+            ++bad_;
+        }
+      }
+    }
+  }
+
+  size_t found() const { return found_; }
+  size_t bad() const { return bad_; }
+
+ private:
+  SymbolMap* symbol_map_;
+  bool writer_;
+  size_t iterations_;
+  size_t found_;
+  size_t bad_;
+};
+
+// Runs one writer and @p reader_count readers concurrently on @p symbol_map.
+// @returns the average number of cycles per lookup on each reader thread.
+uint64_t RunSymbolChurn(SymbolMap* symbol_map,
+                        size_t reader_count,
+                        size_t iterations) {
+  // Start with a populated map.
+  for (size_t i = 0; i < SymbolChurnRunner::kSymbolCount; ++i) {
+    symbol_map->AddSymbol(
+        ToPtr(SymbolChurnRunner::kBase + i * SymbolChurnRunner::kSymbolSize),
+        SymbolChurnRunner::kSymbolSize, "jitted");
+  }
+
+  std::vector<std::unique_ptr<SymbolChurnRunner>> runners;
+  for (size_t i = 0; i <= reader_count; ++i) {
+    runners.push_back(std::unique_ptr<SymbolChurnRunner>(
+        new SymbolChurnRunner(symbol_map, i == 0, iterations)));
+  }
+  uint64_t cycles = testing::RunDelegatesConcurrently(runners);
+
+  for (size_t i = 1; i < runners.size(); ++i) {
+    EXPECT_LT(0u, runners[i]->found());
+    EXPECT_EQ(0u, runners[i]->bad());
+  }
+  return cycles / iterations;
+}
+
 }  // namespace
 
 TEST_F(SymbolMapTest, AddSymbol) {
@@ -175,5 +271,59 @@ TEST_F(SymbolMapTest, SymbolLifeCycle) {
   EXPECT_EQ(ToPtr(NULL), symbol->address());
 }
 
+TEST_F(SymbolMapTest, SnapshotIsRebuilt) {
+  EXPECT_TRUE(symbol_map_.snapshot_is_current());
+
+  // Updates make the snapshot stale, and enough of them fold into a single
+  // rebuild.
+  symbol_map_.AddSymbol(ToPtr(0x1000), 0x10, "first");
+  EXPECT_FALSE(symbol_map_.snapshot_is_current());
+  for (size_t i = 1; i < SymbolMap::kMinRebuildThreshold; ++i)
+    symbol_map_.AddSymbol(ToPtr(0x1000 + i * 0x10), 0x10, "other");
+  EXPECT_TRUE(symbol_map_.snapshot_is_current());
+  EXPECT_EQ(SymbolMap::kMinRebuildThreshold, symbol_map_.snapshot_size());
+
+  // Lookups are now served by the snapshot.
+  scoped_refptr<SymbolMap::Symbol> first =
+      symbol_map_.FindSymbol(ToPtr(0x1008));
+  ASSERT_TRUE(first != NULL);
+  EXPECT_EQ("first", first->name());
+  EXPECT_EQ(first, symbol_map_.FindSymbol(ToPtr(0x1000)));
+  EXPECT_EQ(first, symbol_map_.FindSymbol(ToPtr(0x100F)));
+  EXPECT_TRUE(symbol_map_.FindSymbol(ToPtr(0xFFF)) == NULL);
+  EXPECT_TRUE(symbol_map_.FindSymbol(
+      ToPtr(0x1000 + SymbolMap::kMinRebuildThreshold * 0x10)) == NULL);
+
+  // Stale lookups also trigger a rebuild eventually.
+  symbol_map_.MoveSymbol(ToPtr(0x1000), ToPtr(0x10000));
+  EXPECT_FALSE(symbol_map_.snapshot_is_current());
+  for (size_t i = 0; i < SymbolMap::kMinRebuildThreshold; ++i) {
+    EXPECT_TRUE(symbol_map_.FindSymbol(ToPtr(0x1008)) == NULL);
+    EXPECT_EQ(first, symbol_map_.FindSymbol(ToPtr(0x10008)));
+  }
+  EXPECT_TRUE(symbol_map_.snapshot_is_current());
+
+  // There are no readers, so the retired snapshots have been freed.
+  EXPECT_TRUE(symbol_map_.retired_snapshots_[0].empty());
+  EXPECT_TRUE(symbol_map_.retired_snapshots_[1].empty());
+}
+
+TEST_F(SymbolMapTest, ConcurrentChurn) {
+  RunSymbolChurn(&symbol_map_, 4, 100000);
+}
+
+TEST(SymbolMapPerfTest, JitChurnPerfTest) {
+  // Emits the average number of cycles per lookup as the number of threads
+  // looking up symbols grows, while another thread keeps updating the map.
+  for (size_t reader_count = 1; reader_count <= 8; reader_count *= 2) {
+    SymbolMap symbol_map;
+    uint64_t cycles = RunSymbolChurn(&symbol_map, reader_count, 200000);
+    testing::EmitMetric(
+        base::StringPrintf("Syzygy.Profiler.SymbolMap.JitChurn.%uReaders",
+                           static_cast<uint32_t>(reader_count)),
+        cycles);
+  }
+}
+
 }  // namespace profiler
 }  // namespace agent
@@ -93,17 +93,6 @@ bool ParseArFileHeader(const ArFileHeader& header,
   return true;
 }
 
-template<typename Object>
-bool ReadObject(FILE* file, Object* object) {
-  DCHECK_NE(reinterpret_cast<FILE*>(NULL), file);
-  DCHECK_NE(reinterpret_cast<Object*>(NULL), object);
-  if (::fread(object, sizeof(Object), 1, file) != 1) {
-    LOG(ERROR) << "Failed to read from archive.";
-    return false;
-  }
-  return true;
-}
-
 bool ParseSecondarySymbolTable(size_t file_size,
                                const uint8_t* data,
                                size_t length,
@@ -203,41 +192,36 @@ bool ParseSecondarySymbolTable(size_t file_size,
 }  // namespace
 
 ArReader::ArReader()
-    : length_(0), offset_(0), index_(0), start_of_object_files_(0) {
+    : length_(0), index_(0), start_of_object_files_(0), filenames_(NULL),
+      filenames_size_(0) {
 }
 
 bool ArReader::Init(const base::FilePath& ar_path) {
   DCHECK(path_.empty());
 
   path_ = ar_path;
-  file_.reset(base::OpenFile(path_, "rb"));
-  if (file_.get() == NULL) {
-    LOG(ERROR) << "Failed to open file for reading: " << path_.value();
-    return false;
-  }
-
-  if (!base::GetFileSize(path_, reinterpret_cast<int64_t*>(&length_))) {
-    LOG(ERROR) << "Unable to get the archive file size.";
+  if (!mapped_file_.Initialize(path_)) {
+    LOG(ERROR) << "Failed to map file for reading: " << path_.value();
     return false;
   }
+  length_ = mapped_file_.length();
 
   // Parse the global header.
-  ArGlobalHeader global_header = {};
-  if (!ReadObject(file_.get(), &global_header))
-    return false;
-  if (::memcmp(global_header.magic,
+  if (length_ < sizeof(ArGlobalHeader) ||
+      ::memcmp(mapped_file_.data(),
                kArGlobalMagic,
                sizeof(kArGlobalMagic)) != 0) {
     LOG(ERROR) << "Invalid archive file global header.";
     return false;
   }
-  offset_ += sizeof(global_header);
+  uint64_t offset = sizeof(ArGlobalHeader);
 
-  // Read (and ignore) the primary symbol table. This needs to be present but
-  // it contains data that is also to be found in the secondary symbol table,
-  // with higher fidelity.
+  // Skip the primary symbol table. This needs to be present but it contains
+  // data that is also to be found in the secondary symbol table, with higher
+  // fidelity.
   ParsedArFileHeader header;
-  if (!ReadNextFile(&header, NULL)) {
+  const uint8_t* data = NULL;
+  if (!ParseFileAt(offset, &header, &data, &offset)) {
     LOG(ERROR) << "Failed to read primary symbol table.";
     return false;
   }
@@ -246,9 +230,8 @@ bool ArReader::Init(const base::FilePath& ar_path) {
     return false;
   }
 
-  // Read and parse the secondary symbol table.
-  DataBuffer data;
-  if (!ReadNextFile(&header, &data)) {
+  // Parse the secondary symbol table in place.
+  if (!ParseFileAt(offset, &header, &data, &offset)) {
     LOG(ERROR) << "Failed to read secondary symbol table.";
     return false;
   }
@@ -256,7 +239,7 @@ bool ArReader::Init(const base::FilePath& ar_path) {
     LOG(ERROR) << "Did not find secondary symbol table in archive.";
     return false;
   }
-  if (!ParseSecondarySymbolTable(length_, data.data(), data.size(),
+  if (!ParseSecondarySymbolTable(length_, data, header.size,
                                  &symbols_, &offsets_)) {
     LOG(ERROR) << "Failed to parse secondary symbol table.";
     return false;
@@ -264,21 +247,37 @@ bool ArReader::Init(const base::FilePath& ar_path) {
 
   // Remember where we are. The object files may start at this location, or we
   // may encounter an optional filename table.
-  start_of_object_files_ = offset_;
+  start_of_object_files_ = offset;
 
-  if (!ReadNextFile(&header, &data)) {
+  if (!ParseFileAt(offset, &header, &data, &offset)) {
     LOG(ERROR) << "Failed to read filename table or first archive member.";
     return false;
   }
   if (header.name == "//") {
-    std::swap(data, filenames_);
-    start_of_object_files_ = offset_;
+    filenames_ = reinterpret_cast<const char*>(data);
+    filenames_size_ = header.size;
+    start_of_object_files_ = offset;
   }
 
   // Create an inverse of the offsets_ vector.
   for (size_t i = 0; i < offsets_.size(); ++i)
     CHECK(offsets_inverse_.insert(std::make_pair(offsets_[i], i)).second);
 
+  // Parse the headers of all of the members up front, so that they can be
+  // accessed randomly later on.
+  members_.resize(offsets_.size());
+  for (size_t i = 0; i < offsets_.size(); ++i) {
+    File& file = members_[i];
+    uint64_t next_offset = 0;
+    if (!ParseFileAt(offsets_[i], &file.first, &file.second, &next_offset))
+      return false;
+
+    std::string filename;
+    if (!TranslateFilename(file.first.name, &filename))
+      return false;
+    file.first.name = filename;
+  }
+
   // Make sure we're at the beginning of the first file in the archive.
   if (!SeekIndex(0))
     return false;
@@ -290,28 +289,13 @@ bool ArReader::BuildFileIndex() {
   DCHECK(files_.empty());
   DCHECK(files_inverse_.empty());
 
-  size_t old_index = index_;
-
-  if (!SeekIndex(0))
-    return false;
-
-  files_.reserve(offsets_.size());
-
-  while (HasNext()) {
-    size_t index = index_;
-
-    // Read the file and get its translated name.
-    ParsedArFileHeader header;
-    if (!ExtractNext(&header, NULL))
-      return false;
-
-    files_.push_back(header.name);
-    CHECK(files_inverse_.insert(std::make_pair(header.name, index)).second);
+  files_.reserve(members_.size());
+  for (size_t i = 0; i < members_.size(); ++i) {
+    const std::string& name = members_[i].first.name;
+    files_.push_back(name);
+    CHECK(files_inverse_.insert(std::make_pair(name, i)).second);
   }
 
-  if (!SeekIndex(old_index))
-    return false;
-
   return true;
 }
 
@@ -319,16 +303,6 @@ bool ArReader::SeekIndex(size_t index) {
   if (index >= offsets_.size())
     return false;
 
-  size_t offset = offsets_[index];
-  if (offset_ == offset)
-    return true;
-
-  if (::fseek(file_.get(), offset, SEEK_SET) != 0) {
-    LOG(ERROR) << "Failed to seek to archive file " << index
-               << " at offset " << offset << ".";
-    return false;
-  }
-  offset_ = offset;
   index_ = index;
 
   return true;
@@ -345,35 +319,13 @@ bool ArReader::ExtractNext(ParsedArFileHeader* header,
   DCHECK_LT(index_, offsets_.size());
   DCHECK_NE(reinterpret_cast<ParsedArFileHeader*>(NULL), header);
 
-  // If all has gone well then the cursor should have been left at the
-  // beginning of a valid archive file, or the end of the file.
-  if (offset_ < length_) {
-    OffsetIndexMap::const_iterator index_it = offsets_inverse_.find(offset_);
-    if (index_it == offsets_inverse_.end()) {
-      LOG(ERROR) << "Encoded file offsets do not match archive contents.";
-      return false;
-    }
-  }
-
-  // Seek to the beginning of the next archive file if we're not already there.
-  if (offset_ != offsets_[index_]) {
-    if (::fseek(file_.get(), offsets_[index_], SEEK_SET) != 0) {
-      LOG(ERROR) << "Failed to seek to file " << index_ << ".";
-      return false;
-    }
-    offset_ = offsets_[index_];
-  }
-  DCHECK_LT(offset_, length_);
-
-  if (!ReadNextFile(header, data))
+  const uint8_t* contents = NULL;
+  if (!GetFile(index_, header, &contents))
     return false;
   ++index_;
 
-  // Store the actual filename in the header.
-  std::string filename;
-  if (!TranslateFilename(header->name, &filename))
-    return false;
-  header->name = filename;
+  if (data != NULL)
+    data->assign(contents, contents + header->size);
 
   return true;
 }
@@ -383,65 +335,68 @@ bool ArReader::Extract(size_t index,
                        DataBuffer* data) {
   DCHECK_NE(reinterpret_cast<ParsedArFileHeader*>(NULL), header);
 
-  if (index >= offsets_.size())
+  if (!SeekIndex(index))
     return false;
 
-  // Seek to the file in question.
-  if (::fseek(file_.get(), offsets_[index], SEEK_SET) != 0) {
-    LOG(ERROR) << "Failed to seek to file " << index << ".";
-    return false;
-  }
-  offset_ = offsets_[index];
-  index_ = index;
-
   if (!ExtractNext(header, data))
     return false;
 
   return true;
 }
 
-bool ArReader::ReadNextFile(ParsedArFileHeader* header,
-                            DataBuffer* data) {
+bool ArReader::GetFile(size_t index,
+                       ParsedArFileHeader* header,
+                       const uint8_t** data) const {
   DCHECK_NE(reinterpret_cast<ParsedArFileHeader*>(NULL), header);
+  DCHECK_NE(reinterpret_cast<const uint8_t**>(NULL), data);
 
-  // Read and parse the file header.
-  ArFileHeader raw_header = {};
-  if (!ReadObject(file_.get(), &raw_header))
+  if (index >= members_.size())
     return false;
-  if (!ParseArFileHeader(raw_header, header))
+
+  *header = members_[index].first;
+  *data = members_[index].second;
+
+  return true;
+}
+
+bool ArReader::ParseFileAt(uint64_t offset,
+                           ParsedArFileHeader* header,
+                           const uint8_t** data,
+                           uint64_t* next_offset) const {
+  DCHECK_NE(reinterpret_cast<ParsedArFileHeader*>(NULL), header);
+  DCHECK_NE(reinterpret_cast<const uint8_t**>(NULL), data);
+  DCHECK_NE(reinterpret_cast<uint64_t*>(NULL), next_offset);
+
+  // Parse the file header.
+  if (offset > length_ || length_ - offset < sizeof(ArFileHeader)) {
+    LOG(ERROR) << "Failed to read file header at offset " << offset
+               << " of archive \"" << path_.value() << "\".";
     return false;
-  offset_ += sizeof(raw_header);
-
-  uint64_t aligned_size = common::AlignUp64(header->size, kArFileAlignment);
-  uint64_t seek_size = aligned_size;
-
-  // Read the actual file contents if necessary.
-  if (data != NULL) {
-    seek_size = aligned_size - header->size;
-    data->resize(header->size);
-    if (::fread(data->data(), 1, header->size, file_.get()) !=
-            header->size) {
-      LOG(ERROR) << "Failed to read file \"" << header->name
-                 << "\" at offset " << offset_ << " of archive \""
-                 << path_.value() << "\".";
-      return false;
-    }
-    offset_ += header->size;
   }
+  const ArFileHeader* raw_header = reinterpret_cast<const ArFileHeader*>(
+      mapped_file_.data() + offset);
+  if (!ParseArFileHeader(*raw_header, header))
+    return false;
+  offset += sizeof(*raw_header);
 
-  // Seek to the beginning of the next file.
-  if (seek_size > 0 && ::fseek(file_.get(), seek_size, SEEK_CUR) != 0) {
-    LOG(ERROR) << "Failed to seek to next file at offset " << offset_
-               << " of archive \"" << path_.value() << "\".";
+  // Ensure the contents lie entirely within the archive.
+  if (length_ - offset < header->size) {
+    LOG(ERROR) << "Failed to read file \"" << header->name
+               << "\" at offset " << offset << " of archive \""
+               << path_.value() << "\".";
     return false;
   }
-  offset_ += seek_size;
+  *data = mapped_file_.data() + offset;
+
+  // The following file starts at the next aligned offset. This may lie
+  // beyond the end of the archive for the last file.
+  *next_offset = offset + common::AlignUp64(header->size, kArFileAlignment);
 
   return true;
 }
 
 bool ArReader::TranslateFilename(const std::string& internal_name,
-                                 std::string* full_name) {
+                                 std::string* full_name) const {
   DCHECK_NE(reinterpret_cast<std::string*>(NULL), full_name);
 
   if (internal_name.empty()) {
@@ -467,15 +422,14 @@ bool ArReader::TranslateFilename(const std::string& internal_name,
     return false;
   }
 
-  if (filename_offset >= filenames_.size()) {
+  if (filename_offset >= filenames_size_) {
     LOG(ERROR) << "Invalid filename offset: " << filename_offset;
     return false;
   }
 
-  const char* data = reinterpret_cast<char*>(filenames_.data());
-  size_t filename_length = ::strnlen(data + filename_offset,
-                                     filenames_.size() - filename_offset);
-  *full_name = std::string(data + filename_offset, filename_length);
+  size_t filename_length = ::strnlen(filenames_ + filename_offset,
+                                     filenames_size_ - filename_offset);
+  *full_name = std::string(filenames_ + filename_offset, filename_length);
 
   return true;
 }
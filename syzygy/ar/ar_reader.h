@@ -75,6 +75,11 @@
 // important when reading files from one archive and writing them into another;
 // to maintain proper symbol information we must ensure we iterate over the
 // files in the order they are specified in the offset table.
+//
+// The archive is memory mapped in its entirety. The symbol table, the
+// filename table and the headers of all archive members are parsed once
+// during initialization, after which the contents of any member can be
+// accessed without copying, in any order and from any number of threads.
 
 #ifndef SYZYGY_AR_AR_READER_H_
 #define SYZYGY_AR_AR_READER_H_
@@ -83,13 +88,17 @@
 #include <vector>
 
 #include "base/files/file_path.h"
-#include "base/files/file_util.h"
+#include "base/files/memory_mapped_file.h"
 #include "syzygy/ar/ar_common.h"
 
 namespace ar {
 
 // Class for extracting files from archive files. This currently does not
 // expose the parsed symbol information in any meaningful way.
+//
+// The cursor based accessors (SeekIndex, HasNext, ExtractNext and Extract)
+// are not thread safe. GetFile may be called concurrently from multiple
+// threads once Init has succeeded.
 class ArReader {
  public:
   // Stores the offsets of each file object, by their index.
@@ -101,6 +110,10 @@ class ArReader {
   typedef std::set<std::pair<std::string, size_t>> FileNameMap;
   // Stores filenames indexed by the file number.
   typedef std::vector<std::string> FileNameVector;
+  // A parsed archive member, and a pointer to its contents in the mapped
+  // archive. The header contains the translated filename.
+  typedef std::pair<ParsedArFileHeader, const uint8_t*> File;
+  typedef std::vector<File> FileVector;
 
   ArReader();
 
@@ -113,7 +126,7 @@ class ArReader {
 
   // Determines the full names of all files in the archive, populating the
   // file-name map. This must be called in order to find a file by name. This
-  // incurs a linear scan of the entire archive.
+  // only touches the headers that were parsed by Init.
   // @returns true on success, false otherwise.
   // @note Can only be called after a successful call to Init. This should only
   //     be called once.
@@ -165,23 +178,41 @@ class ArReader {
                ParsedArFileHeader* header,
                DataBuffer* data);
 
+  // Gets the specified file without copying its contents. This does not
+  // move the cursor, and is safe to call concurrently.
+  // @param index The index of the file to be retrieved.
+  // @param header The header to be populated.
+  // @param data Will be set to point to the contents of the file, which
+  //     are @p header->size bytes long. The contents remain valid for the
+  //     lifetime of the reader.
+  // @returns true on success, false otherwise.
+  bool GetFile(size_t index,
+               ParsedArFileHeader* header,
+               const uint8_t** data) const;
+
  protected:
-  // Reads the next file from the archive, advancing the cursor. Returns true
-  // on success, false otherwise. Does not translate the internal name to an
-  // external filename. Doesn't update 'index_'.
-  bool ReadNextFile(ParsedArFileHeader* header, DataBuffer* data);
+  // Parses the archive member located at the given offset in the archive.
+  // Does not translate the internal name to an external filename.
+  // @param offset The offset of the member's header.
+  // @param header The header to be populated.
+  // @param data Will be set to point to the contents of the member.
+  // @param next_offset Will be set to the offset of the following member.
+  // @returns true on success, false otherwise.
+  bool ParseFileAt(uint64_t offset,
+                   ParsedArFileHeader* header,
+                   const uint8_t** data,
+                   uint64_t* next_offset) const;
 
   // Translates an archive internal filename to the full extended filename.
   bool TranslateFilename(const std::string& internal_name,
-                         std::string* full_name);
+                         std::string* full_name) const;
 
-  // The file that is being read.
+  // The file that is being read, and its contents.
   base::FilePath path_;
-  base::ScopedFILE file_;
+  base::MemoryMappedFile mapped_file_;
 
   // Data regarding the archive.
   uint64_t length_;
-  uint64_t offset_;  // The cursor in the archive's byte stream.
   size_t index_;  // The index of the archive member the cursor points at.
   uint64_t start_of_object_files_;
 
@@ -189,8 +220,12 @@ class ArReader {
   SymbolIndexMap symbols_;
   FileOffsetVector offsets_;
   OffsetIndexMap offsets_inverse_;
-  // The raw file names, concatenated into a single buffer.
-  DataBuffer filenames_;
+  // The raw file names, concatenated into a single buffer. This points into
+  // the mapped archive.
+  const char* filenames_;
+  size_t filenames_size_;
+  // The parsed archive members, by their index. This is populated by Init.
+  FileVector members_;
   // Maps filenames to their indices in the archive. This is populated by
   // BuildFileIndex.
   FileNameVector files_;
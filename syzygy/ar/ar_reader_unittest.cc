@@ -14,10 +14,15 @@
 
 #include "syzygy/ar/ar_reader.h"
 
+#include <algorithm>
+#include <memory>
+
+#include "base/threading/simple_thread.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "syzygy/ar/unittest_util.h"
 #include "syzygy/core/unittest_util.h"
+#include "syzygy/testing/thread_utils.h"
 
 namespace ar {
 
@@ -40,6 +45,37 @@ class ArReaderTest : public testing::Test {
   base::FilePath lib_path_;
 };
 
+// Repeatedly gets all of the files from an archive, and compares them to
+// their expected contents.
+class GetFileRunner : public base::DelegateSimpleThread::Delegate {
+ public:
+  GetFileRunner(const ArReader* reader,
+                const std::vector<DataBuffer>* expected)
+      : reader_(reader), expected_(expected), mismatches_(0) {
+  }
+
+  void Run() override {
+    for (size_t j = 0; j < 10; ++j) {
+      for (size_t i = 0; i < expected_->size(); ++i) {
+        ParsedArFileHeader header;
+        const uint8_t* data = NULL;
+        if (!reader_->GetFile(i, &header, &data) ||
+            header.size != (*expected_)[i].size() ||
+            !std::equal(data, data + header.size, (*expected_)[i].begin())) {
+          ++mismatches_;
+        }
+      }
+    }
+  }
+
+  size_t mismatches() const { return mismatches_; }
+
+ private:
+  const ArReader* reader_;
+  const std::vector<DataBuffer>* expected_;
+  size_t mismatches_;
+};
+
 }  // namespace
 
 TEST_F(ArReaderTest, InitAndBuildFileIndex) {
@@ -135,6 +171,56 @@ TEST_F(ArReaderTest, InitAndBuildFileIndex) {
   EXPECT_TRUE(reader.HasNext());
 }
 
+TEST_F(ArReaderTest, GetFile) {
+  ArReader reader;
+  EXPECT_TRUE(reader.Init(lib_path_));
+
+  ParsedArFileHeader header;
+  const uint8_t* data = NULL;
+  EXPECT_FALSE(reader.GetFile(reader.offsets().size(), &header, &data));
+
+  // GetFile should agree with Extract, and shouldn't move the cursor.
+  for (size_t i = 0; i < reader.offsets().size(); ++i) {
+    ParsedArFileHeader extracted_header;
+    DataBuffer extracted_data;
+    EXPECT_TRUE(reader.Extract(i, &extracted_header, &extracted_data));
+
+    EXPECT_TRUE(reader.GetFile(0, &header, &data));
+    EXPECT_TRUE(reader.GetFile(i, &header, &data));
+    EXPECT_EQ(extracted_header.name, header.name);
+    EXPECT_EQ(extracted_header.size, header.size);
+    EXPECT_EQ(extracted_data, DataBuffer(data, data + header.size));
+
+    if (i + 1 < reader.offsets().size()) {
+      EXPECT_TRUE(reader.HasNext());
+      EXPECT_TRUE(reader.ExtractNext(&extracted_header, NULL));
+      EXPECT_TRUE(reader.GetFile(i + 1, &header, &data));
+      EXPECT_EQ(extracted_header.name, header.name);
+    }
+  }
+}
+
+TEST_F(ArReaderTest, ConcurrentGetFile) {
+  ArReader reader;
+  EXPECT_TRUE(reader.Init(lib_path_));
+
+  std::vector<DataBuffer> expected(reader.offsets().size());
+  for (size_t i = 0; i < expected.size(); ++i) {
+    ParsedArFileHeader header;
+    EXPECT_TRUE(reader.ExtractNext(&header, &expected[i]));
+  }
+
+  std::vector<std::unique_ptr<GetFileRunner>> runners;
+  for (size_t i = 0; i < 4; ++i) {
+    runners.push_back(std::unique_ptr<GetFileRunner>(
+        new GetFileRunner(&reader, &expected)));
+  }
+  testing::RunDelegatesConcurrently(runners);
+
+  for (size_t i = 0; i < runners.size(); ++i)
+    EXPECT_EQ(0u, runners[i]->mismatches());
+}
+
 TEST_F(ArReaderTest, NoFilenameTable) {
   base::FilePath lib = testing::GetSrcRelativePath(
       testing::kWeakSymbolArchiveFile);
@@ -149,14 +149,13 @@ bool UpdateSymbolTable(uint32_t file_index,
 // using those classes is a little overkill for our purposes.
 bool ExtractSymbolsCoff(uint32_t file_index,
                         const ParsedArFileHeader& header,
-                        const DataBuffer& file_contents,
+                        const uint8_t* file_contents,
                         SymbolIndexMap* symbols,
                         SymbolIndexMap* weak_symbols) {
   DCHECK_NE(reinterpret_cast<SymbolIndexMap*>(NULL), symbols);
   DCHECK_NE(reinterpret_cast<SymbolIndexMap*>(NULL), weak_symbols);
 
-  common::BinaryBufferReader reader(file_contents.data(),
-                                    file_contents.size());
+  common::BinaryBufferReader reader(file_contents, header.size);
   const IMAGE_FILE_HEADER* file_header = NULL;
   if (!reader.Read(&file_header))
     return false;
@@ -202,15 +201,14 @@ bool ExtractSymbolsCoff(uint32_t file_index,
       const char* s = NULL;
       size_t max_len = 0;
       if (symbol->N.Name.Short == 0) {
-        if (symbol->N.Name.Long >= file_contents.size()) {
+        if (symbol->N.Name.Long >= header.size) {
           LOG(ERROR) << "Invalid symbol name pointer in object file: "
                      << header.name;
           return false;
         }
         size_t offset = string_table_offset + symbol->N.Name.Long;
-        s = reinterpret_cast<const char*>(file_contents.data()) +
-            offset;
-        max_len = file_contents.size() - offset;
+        s = reinterpret_cast<const char*>(file_contents) + offset;
+        max_len = header.size - offset;
       } else {
         s = reinterpret_cast<const char*>(symbol->N.ShortName);
         max_len = sizeof(symbol->N.ShortName);
@@ -237,14 +235,13 @@ bool ExtractSymbolsCoff(uint32_t file_index,
 // |symbols|. Returns true on success, false otherwise.
 bool ExtractSymbolsImportDef(uint32_t file_index,
                              const ParsedArFileHeader& header,
-                             const DataBuffer& file_contents,
+                             const uint8_t* file_contents,
                              SymbolIndexMap* symbols,
                              SymbolIndexMap* weak_symbols) {
   DCHECK_NE(reinterpret_cast<SymbolIndexMap*>(NULL), symbols);
   DCHECK_NE(reinterpret_cast<SymbolIndexMap*>(NULL), weak_symbols);
 
-  common::BinaryBufferReader reader(file_contents.data(),
-                                    file_contents.size());
+  common::BinaryBufferReader reader(file_contents, header.size);
   const IMPORT_OBJECT_HEADER* import = NULL;
   if (!reader.Read(&import))
     return false;
@@ -275,12 +272,11 @@ bool ExtractSymbolsImportDef(uint32_t file_index,
 // type, then this does nothing.
 bool ExtractSymbols(uint32_t file_index,
                     const ParsedArFileHeader& header,
-                    const DataBuffer& file_contents,
+                    const uint8_t* file_contents,
                     SymbolIndexMap* symbols,
                     SymbolIndexMap* weak_symbols) {
   core::FileType file_type = core::kUnknownFileType;
-  if (!core::GuessFileType(file_contents.data(), file_contents.size(),
-                           &file_type)) {
+  if (!core::GuessFileType(file_contents, header.size, &file_type)) {
     LOG(ERROR) << "Unable to determine file type: " << header.name;
     return false;
   }
@@ -377,7 +373,8 @@ bool PopulateArFileHeader(const ParsedArFileHeader& parsed_header,
 
 // Writes the given file to an archive, prepended by its header.
 bool WriteFile(const ArFileHeader& header,
-               const DataBuffer& contents,
+               const uint8_t* contents,
+               size_t size,
                FILE* file) {
   DCHECK_NE(reinterpret_cast<FILE*>(NULL), file);
 
@@ -388,8 +385,7 @@ bool WriteFile(const ArFileHeader& header,
   }
 
   // Write the contents.
-  if (::fwrite(contents.data(), 1, contents.size(), file) !=
-               contents.size()) {
+  if (size > 0 && ::fwrite(contents, 1, size, file) != size) {
     LOG(ERROR) << "Failed to write file contents.";
     return false;
   }
@@ -397,6 +393,12 @@ bool WriteFile(const ArFileHeader& header,
   return true;
 }
 
+bool WriteFile(const ArFileHeader& header,
+               const DataBuffer& contents,
+               FILE* file) {
+  return WriteFile(header, contents.data(), contents.size(), file);
+}
+
 // Writes a primary symbol table using the legacy symbol table format.
 bool WritePrimarySymbolTable(const base::Time& timestamp,
                              const SymbolIndexMap& symbols,
@@ -529,8 +531,16 @@ bool ArWriter::AddFile(const base::StringPiece& filename,
                        uint32_t mode,
                        const DataBuffer* contents) {
   DCHECK_NE(reinterpret_cast<DataBuffer*>(NULL), contents);
+  return AddFile(filename, timestamp, mode, contents->data(),
+                 contents->size());
+}
 
-  if (contents->size() == 0) {
+bool ArWriter::AddFile(const base::StringPiece& filename,
+                       const base::Time& timestamp,
+                       uint32_t mode,
+                       const uint8_t* contents,
+                       size_t size) {
+  if (size == 0) {
     LOG(ERROR) << "Unable to add empty file to archive: " << filename;
     return false;
   }
@@ -548,13 +558,13 @@ bool ArWriter::AddFile(const base::StringPiece& filename,
   header.name = name;
   header.timestamp = timestamp;
   header.mode = mode;
-  header.size = contents->size();
+  header.size = size;
 
   // Try to parse the symbols from the file. We keep a copy of the
   // symbol tables so as not to corrupt them if the operation fails.
   SymbolIndexMap symbols = symbols_;
   SymbolIndexMap weak_symbols = weak_symbols_;
-  if (!ExtractSymbols(files_.size(), header, *contents, &symbols,
+  if (!ExtractSymbols(files_.size(), header, contents, &symbols,
                       &weak_symbols)) {
     return false;
   }
@@ -665,12 +675,14 @@ bool ArWriter::Write(const base::FilePath& path) {
 
   // Write the files, keeping track of their offsets.
   for (size_t i = 0; i < files_.size(); ++i) {
-    const DataBuffer& buffer = *files_[i].second;
+    const File& archive_file = files_[i];
     const ArFileHeader& raw_header = raw_headers[i];
 
     offsets[i] = AlignAndGetPosition(file.get());
-    if (!WriteFile(raw_header, buffer, file.get()))
+    if (!WriteFile(raw_header, archive_file.second,
+                   archive_file.first.size, file.get())) {
       return false;
+    }
   }
 
   // Rewrite the symbol streams using the actual file offsets this time around.
@@ -31,7 +31,9 @@ namespace ar {
 // the first definition being the one that is exported to the symbol table.
 class ArWriter {
  public:
-  typedef std::pair<ParsedArFileHeader, const DataBuffer*> File;
+  // A file and a pointer to its contents, which are |header.size| bytes
+  // long. The contents are not owned by the writer.
+  typedef std::pair<ParsedArFileHeader, const uint8_t*> File;
   typedef std::vector<File> FileVector;
 
   ArWriter();
@@ -48,7 +50,10 @@ class ArWriter {
   // @param mode The mode to be associated with the file. In the same format
   //     as ST_MODE from _wstat.
   // @param contents The contents of the file. The lifetime of this object
-  //     must exceed the lifetime of the writer.
+  //     must exceed the lifetime of the writer. This may point directly into
+  //     an archive mapped by an ArReader, in which case the contents are
+  //     streamed from there to the output without being copied.
+  // @param size The size of @p contents, in bytes.
   // @param path The file to be added; the filename as specified in @p path
   //     will be used, and the contents read from disk. Uses the timestamp and
   //     mode of the file on disk.
@@ -57,6 +62,11 @@ class ArWriter {
                const base::Time& timestamp,
                uint32_t mode,
                const DataBuffer* contents);
+  bool AddFile(const base::StringPiece& filename,
+               const base::Time& timestamp,
+               uint32_t mode,
+               const uint8_t* contents,
+               size_t size);
   bool AddFile(const base::FilePath& path);
 
   // Writes the current set of files to an archive at the specified @p path.
@@ -196,6 +196,38 @@ TEST_F(ArWriterTest, TestArWriterRoundTripWeakSymbols) {
   EXPECT_THAT(reader2.symbols(), testing::ContainerEq(reader1.symbols()));
 }
 
+TEST_F(ArWriterTest, TestArWriterRoundTripFromMappedArchive) {
+  base::FilePath lib1 = testing::GetSrcRelativePath(testing::kArchiveFile);
+  ArReader reader1;
+  ASSERT_TRUE(reader1.Init(lib1));
+
+  // Stream the files directly from the mapped archive.
+  base::FilePath lib2 = temp_dir_.Append(L"zlib.lib");
+  ArWriter writer;
+  for (size_t i = 0; i < reader1.offsets().size(); ++i) {
+    ParsedArFileHeader header;
+    const uint8_t* contents = NULL;
+    ASSERT_TRUE(reader1.GetFile(i, &header, &contents));
+    EXPECT_TRUE(writer.AddFile(header.name, header.timestamp, header.mode,
+                               contents, header.size));
+  }
+  EXPECT_THAT(writer.symbols(), testing::ContainerEq(reader1.symbols()));
+  EXPECT_TRUE(writer.Write(lib2));
+
+  ArReader reader2;
+  EXPECT_TRUE(reader2.Init(lib2));
+  EXPECT_THAT(reader2.symbols(), testing::ContainerEq(reader1.symbols()));
+  ASSERT_EQ(reader1.offsets().size(), reader2.offsets().size());
+  for (size_t i = 0; i < reader1.offsets().size(); ++i) {
+    ParsedArFileHeader header1, header2;
+    DataBuffer contents1, contents2;
+    EXPECT_TRUE(reader1.Extract(i, &header1, &contents1));
+    EXPECT_TRUE(reader2.Extract(i, &header2, &contents2));
+    EXPECT_EQ(header1.name, header2.name);
+    EXPECT_EQ(contents1, contents2);
+  }
+}
+
 TEST_F(ArWriterTest, TestArWriterRoundTripRepeatedFileNames) {
   base::FilePath lib1 = testing::GetSrcRelativePath(
       testing::kDuplicatesArchiveFile);
@@ -14,6 +14,7 @@
 
 #include "syzygy/block_graph/analysis/memory_access_analysis.h"
 
+#include <algorithm>
 #include <queue>
 #include <set>
 #include <vector>
@@ -37,6 +38,20 @@ typedef assm::RegisterId RegisterId;
 typedef block_graph::BasicBlockSubGraph::BasicBlock BasicBlock;
 typedef block_graph::BasicBlockSubGraph::BasicBlock::Instructions Instructions;
 
+// The largest access (in bytes) that we keep track of. This is larger than any
+// general purpose or SSE memory operand, and bounds the range of entries that
+// need to be looked at when checking if an access is covered.
+const size_t kMaxTrackedAccessSize = 16;
+
+// Returns the size in bytes of the memory operand @p op, or zero if it is
+// unknown or too large to be tracked.
+size_t GetTrackedAccessSize(const _Operand& op) {
+  size_t size = op.size / 8;
+  if (size > kMaxTrackedAccessSize)
+    return 0;
+  return size;
+}
+
 }  // namespace
 
 MemoryAccessAnalysis::MemoryAccessAnalysis() {
@@ -100,21 +115,26 @@ bool MemoryAccessAnalysis::Intersect(const block_graph::BasicBlock* bb,
   bool changed = false;
   // Subtract non redundant memory accesses.
   for (size_t r = 0; r < assm::kRegister32Count; ++r) {
-    const std::set<int32_t>& from = state.active_memory_accesses_[r];
-    std::set<int32_t>& to = bbentry_state->second.active_memory_accesses_[r];
+    const State::AccessMap& from = state.active_memory_accesses_[r];
+    State::AccessMap& to = bbentry_state->second.active_memory_accesses_[r];
 
-    // In-place intersection. Remove unknown accesses of the destination set.
-    std::set<int32_t>::iterator it1 = to.begin();
-    std::set<int32_t>::const_iterator it2 = from.begin();
+    // In-place intersection. Remove unknown accesses of the destination set,
+    // and only keep the smallest size for accesses found in both.
+    State::AccessMap::iterator it1 = to.begin();
+    State::AccessMap::const_iterator it2 = from.begin();
     while (it1 != to.end()) {
-      if (it2 == from.end() || *it1 < *it2) {
-        std::set<int32_t>::iterator old = it1;
+      if (it2 == from.end() || it1->first < it2->first) {
+        State::AccessMap::iterator old = it1;
         ++it1;
         to.erase(old);
         changed = true;
-      } else if (*it2 < *it1) {
+      } else if (it2->first < it1->first) {
         ++it2;
-      } else {  // *it1 == *it2
+      } else {  // it1->first == it2->first
+        if (it2->second < it1->second) {
+          it1->second = it2->second;
+          changed = true;
+        }
         ++it1;
         ++it2;
       }
@@ -249,8 +269,12 @@ bool MemoryAccessAnalysis::State::HasNonRedundantAccess(
         if (instr.FindOperandReference(op_id, &reference))
           return true;
 
-        const std::set<int32_t>& accesses = active_memory_accesses_[base_reg];
-        if (accesses.find(repr.disp) == accesses.end())
+        size_t size = GetTrackedAccessSize(op);
+        if (size == 0)
+          return true;
+
+        int32_t displ = static_cast<int32_t>(repr.disp);
+        if (!IsCovered(active_memory_accesses_[base_reg], displ, size))
           return true;
       }
       break;
@@ -291,8 +315,44 @@ void MemoryAccessAnalysis::State::Execute(const Instruction& instr) {
     if (instr.FindOperandReference(op_id, &reference))
       continue;
 
-    active_memory_accesses_[base_reg].insert(repr.disp);
+    size_t size = GetTrackedAccessSize(op);
+    if (size == 0)
+      continue;
+
+    // Keep the largest access done at this displacement.
+    size_t& accessed = active_memory_accesses_[base_reg][
+        static_cast<int32_t>(repr.disp)];
+    accessed = std::max(accessed, size);
+  }
+}
+
+bool MemoryAccessAnalysis::State::IsCovered(const AccessMap& accesses,
+                                            int32_t displ,
+                                            size_t size) {
+  DCHECK_LT(0U, size);
+  DCHECK_GE(kMaxTrackedAccessSize, size);
+
+  // The Asan probes only check the shadow of the first byte of an access, so
+  // an earlier access must start at the same displacement for the first byte
+  // of this one to have been checked.
+  if (accesses.find(displ) == accesses.end())
+    return false;
+
+  // Accesses are sorted by displacement. Walk the ones that may overlap the
+  // range [displ, displ + size) and extend the covered prefix of the range for
+  // as long as they are contiguous.
+  int64_t covered = displ;
+  int64_t end = static_cast<int64_t>(displ) + size;
+  AccessMap::const_iterator it = accesses.lower_bound(
+      static_cast<int32_t>(std::max<int64_t>(
+          INT32_MIN, static_cast<int64_t>(displ) - kMaxTrackedAccessSize)));
+  for (; it != accesses.end() && it->first <= covered; ++it) {
+    covered = std::max(covered, static_cast<int64_t>(it->first) + it->second);
+    if (covered >= end)
+      return true;
   }
+
+  return false;
 }
 
 void MemoryAccessAnalysis::State::Clear() {
@@ -30,6 +30,8 @@
 #ifndef SYZYGY_BLOCK_GRAPH_ANALYSIS_MEMORY_ACCESS_ANALYSIS_H_
 #define SYZYGY_BLOCK_GRAPH_ANALYSIS_MEMORY_ACCESS_ANALYSIS_H_
 
+#include <map>
+
 #include "syzygy/block_graph/basic_block.h"
 #include "syzygy/block_graph/basic_block_assembler.h"
 #include "syzygy/block_graph/basic_block_subgraph.h"
@@ -147,7 +149,13 @@ class MemoryAccessAnalysis {
 // This class contains the memory access information at a given program point.
 // The implementation only supports memory access through a single base register
 // (e.g. [eax] or [esi+12]). For each general purpose register (eax, ebx, ecx,
-// edx, esi, edi, esp, ebp) we keep a set of offsets accessed via the base.
+// edx, esi, edi, esp, ebp) we keep the offsets accessed via the base, along
+// with the size of the access. An access is redundant when an access was
+// already done at the same displacement, and every byte it touches is covered
+// by the union of the accesses already done; e.g. after reading [eax] and
+// [eax+4] as 32-bit values, a 64-bit read of [eax] is redundant but a 32-bit
+// read of [eax+2] isn't. The first condition is required because the Asan
+// probes only check the shadow of the first byte of an access.
 class MemoryAccessAnalysis::State {
  public:
   // On creation, a state is assumed to be empty.
@@ -171,9 +179,22 @@ class MemoryAccessAnalysis::State {
   // @param instr Instruction to analyze.
   void State::Execute(const Instruction& instr);
 
+  // Maps the displacement of an access to the largest number of bytes known
+  // to be accessed at this displacement.
+  typedef std::map<int32_t, size_t> AccessMap;
+
+  // Check whether an access in @p accesses starts at @p displ, and the range
+  // [@p displ, @p displ + @p size) is covered by their union.
+  // @param accesses The accesses done via a base register.
+  // @param displ The displacement of the access to check.
+  // @param size The size of the access to check, in bytes.
+  // @returns true if every byte of the access is covered, false otherwise.
+  static bool IsCovered(const AccessMap& accesses, int32_t displ, size_t size);
+
   // Contains active memory accesses. For each 32-bit base register, we keep a
-  // set of distances (displacements) done via the base register.
-  std::set<int32_t> active_memory_accesses_[assm::kRegister32Count];
+  // map of distances (displacements) done via the base register to the size
+  // of the access.
+  AccessMap active_memory_accesses_[assm::kRegister32Count];
 
   friend class MemoryAccessAnalysis;
 };
@@ -48,6 +48,19 @@ const uint8_t kLeaEax[] = {0x8D, 0x08};
 // _asm lea ecx, [eax + 42]
 const uint8_t kLeaEax42[] = {0x8D, 0x48, 0x2A};
 
+// _asm add cl, [eax]
+const uint8_t kReadByteEax[] = {0x02, 0x08};
+// _asm add ecx, [eax + 2]
+const uint8_t kReadEax2[] = {0x03, 0x48, 0x02};
+// _asm add ecx, [eax + 4]
+const uint8_t kReadEax4[] = {0x03, 0x48, 0x04};
+// _asm add ecx, [eax + 6]
+const uint8_t kReadEax6[] = {0x03, 0x48, 0x06};
+// _asm add cx, [eax + 2]
+const uint8_t kReadWordEax2[] = {0x66, 0x03, 0x48, 0x02};
+// _asm movq xmm0, qword ptr [eax]
+const uint8_t kReadQwordEax[] = {0xF3, 0x0F, 0x7E, 0x00};
+
 // _asm repnz movsb
 const uint8_t kRepMovsb[] = {0xF2, 0xA4};
 
@@ -138,7 +151,7 @@ bool TestMemoryAccessAnalysisState::IsEmpty() const {
 
 bool TestMemoryAccessAnalysisState::Contains(const assm::Register32& reg,
                                              int32_t displ) const {
-  const std::set<int32_t>& offsets =
+  const AccessMap& offsets =
       active_memory_accesses_[reg.id() - assm::kRegister32Min];
   return offsets.find(displ) != offsets.end();
 }
@@ -278,6 +291,46 @@ TEST(MemoryAccessAnalysisStateTest, HasNonRedundantAccess) {
   EXPECT_FALSE(redundant_write2);
 }
 
+TEST(MemoryAccessAnalysisStateTest, HasNonRedundantAccessWithSize) {
+  TestMemoryAccessAnalysisState state;
+
+  // A byte read of [eax] does not cover a 32-bit read of [eax].
+  state.Execute(kReadByteEax);
+  EXPECT_TRUE(state.Contains(assm::eax, 0));
+  EXPECT_FALSE(state.HasNonRedundantAccess(kReadByteEax));
+  EXPECT_TRUE(state.HasNonRedundantAccess(kReadEax));
+
+  // A 32-bit read of [eax] covers both. It doesn't cover a 16-bit read of
+  // [eax + 2], as the probe of [eax] only checked its first byte.
+  state.Execute(kReadEax);
+  EXPECT_FALSE(state.HasNonRedundantAccess(kReadByteEax));
+  EXPECT_FALSE(state.HasNonRedundantAccess(kReadEax));
+  EXPECT_TRUE(state.HasNonRedundantAccess(kReadWordEax2));
+  EXPECT_TRUE(state.HasNonRedundantAccess(kReadEax2));
+}
+
+TEST(MemoryAccessAnalysisStateTest, HasNonRedundantAccessAdjacent) {
+  TestMemoryAccessAnalysisState state;
+
+  // Two adjacent reads cover the range [eax, eax + 8), but only the accesses
+  // that start where one of them started.
+  state.Execute(kReadEax);
+  state.Execute(kReadEax4);
+  EXPECT_FALSE(state.HasNonRedundantAccess(kReadQwordEax));
+  EXPECT_TRUE(state.HasNonRedundantAccess(kReadEax2));
+  EXPECT_FALSE(state.HasNonRedundantAccess(kReadEax4));
+  EXPECT_TRUE(state.HasNonRedundantAccess(kReadEax6));
+
+  // Reads with a gap between them do not cover the gap.
+  TestMemoryAccessAnalysisState state2;
+  state2.Execute(kReadEax);
+  state2.Execute(kReadEax6);
+  EXPECT_TRUE(state2.HasNonRedundantAccess(kReadQwordEax));
+  EXPECT_TRUE(state2.HasNonRedundantAccess(kReadEax2));
+  EXPECT_TRUE(state2.HasNonRedundantAccess(kReadEax4));
+  EXPECT_FALSE(state2.HasNonRedundantAccess(kReadEax6));
+}
+
 TEST(MemoryAccessAnalysisStateTest, HasNonRedundantAccessOperandKind) {
   TestMemoryAccessAnalysisState state;
 
@@ -384,6 +437,24 @@ TEST_F(MemoryAccessAnalysisTest, IntersectStates) {
   EXPECT_TRUE(state_.IsEmpty());
 }
 
+TEST_F(MemoryAccessAnalysisTest, IntersectStatesWithSize) {
+  // A 32-bit read of [eax].
+  TestMemoryAccessAnalysisState state1;
+  state1.Execute(kReadEax);
+  Intersect(bb_, state1);
+
+  // A byte read of [eax].
+  TestMemoryAccessAnalysisState state2;
+  state2.Execute(kReadByteEax);
+  Intersect(bb_, state2);
+
+  // Only the byte read is known to happen on every path.
+  GetStateAtEntryOf(bb_, &state_);
+  EXPECT_TRUE(state_.Contains(assm::eax, 0));
+  EXPECT_FALSE(state_.HasNonRedundantAccess(kReadByteEax));
+  EXPECT_TRUE(state_.HasNonRedundantAccess(kReadEax));
+}
+
 TEST_F(MemoryAccessAnalysisTest, PropagateForwardSimple) {
   ASSERT_NO_FATAL_FAILURE(PropagateForward(kReadEax10));
   EXPECT_TRUE(state_.Contains(assm::eax, 10));
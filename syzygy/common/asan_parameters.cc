@@ -132,6 +132,11 @@ const char kAsanParametersSectionName[] = ".syzyaro";
 const uint32_t kAsanParametersSectionCharacteristics =
     IMAGE_SCN_CNT_INITIALIZED_DATA | IMAGE_SCN_MEM_READ;
 
+// SYZYgy Asan Sampling Table.
+const char kAsanSamplingTableSectionName[] = ".syzyast";
+const uint32_t kAsanSamplingTableSectionCharacteristics =
+    IMAGE_SCN_CNT_INITIALIZED_DATA | IMAGE_SCN_MEM_READ | IMAGE_SCN_MEM_WRITE;
+
 // Default values of HeapProxy parameters
 const uint32_t kDefaultQuarantineBlockSize = 4 * 1024 * 1024;
 const uint32_t kDefaultTrailerPaddingSize = 0;
@@ -142,6 +147,7 @@ const uint32_t kDefaultReportingPeriod = 0;
 const uint32_t kDefaultBottomFramesToSkip = 0;
 
 // Default values of StackCapture parameters.
+const bool kDefaultEnableFastStackCapture = false;
 // From http://msdn.microsoft.com/en-us/library/bb204633.aspx,
 // The maximum number of frames which CaptureStackBackTrace can be asked
 // to traverse must be less than 63, so this can't be any larger than 62.
@@ -154,10 +160,12 @@ const bool kDefaultDisableBreakpadReporting = false;
 const bool kDefaultFeatureRandomization = false;
 const bool kDefaultReportInvalidAccesses = false;
 const bool kDefaultDeferCrashReporterInitialization = false;
+const float kDefaultCheckAccessSamplingRate = 1.0f;
 
 // Default values of AsanLogger parameters.
 const bool kDefaultMiniDumpOnFailure = false;
 const bool kDefaultLogAsText = true;
+const bool kDefaultEnableAsyncLogging = false;
 
 // Default values of ZebraBlockHeap parameters.
 const uint32_t kDefaultZebraBlockHeapSize = 16 * 1024 * 1024;
@@ -177,6 +185,11 @@ extern const bool kDefaultEnableLargeBlockHeap = true;
 // 2 / 0.45 = 4.44 < 5 page minimum.
 extern const size_t kDefaultLargeAllocationThreshold = 5 * 4096;
 
+// Default values of the block checksum parameters. These correspond to a
+// SuperFastHash of the entire block.
+const uint32_t kDefaultBlockChecksumAlgorithm = 0;
+const uint32_t kDefaultBlockChecksumBodySampleSize = 0;
+
 const char kSyzyAsanOptionsEnvVar[] = "SYZYGY_ASAN_OPTIONS";
 
 // String names of HeapProxy parameters.
@@ -191,6 +204,7 @@ const char kParamBottomFramesToSkip[] = "bottom_frames_to_skip";
 
 // String names of StackCapture parameters.
 const char kParamMaxNumFrames[] = "max_num_frames";
+const char kParamEnableFastStackCapture[] = "fast_stack_capture";
 
 // String names of AsanRuntime parameters.
 const char kParamIgnoredStackIds[] = "ignored_stack_ids";
@@ -201,10 +215,12 @@ const char kParamFeatureRandomization[] = "feature_randomization";
 const char kParamReportInvalidAccesses[] = "report_invalid_accesses";
 const char kParamDeferCrashReporterInitialization[] =
     "defer_crash_reporter_initialization";
+const char kParamCheckAccessSamplingRate[] = "check_access_sampling_rate";
 
 // String names of AsanLogger parameters.
 const char kParamMiniDumpOnFailure[] = "minidump_on_failure";
 const char kParamNoLogAsText[] = "no_log_as_text";
+const char kParamEnableAsyncLogging[] = "async_logging";
 
 // String names of ZebraBlockHeap parameters.
 const char kParamZebraBlockHeapSize[] = "zebra_block_heap_size";
@@ -223,6 +239,11 @@ const char kParamPreventDuplicateCorruptionCrashes[] =
 const char kParamDisableLargeBlockHeap[] = "disable_large_block_heap";
 const char kParamLargeAllocationThreshold[] = "large_allocation_threshold";
 
+// String names of the block checksum parameters.
+const char kParamBlockChecksumAlgorithm[] = "block_checksum_algorithm";
+const char kParamBlockChecksumBodySampleSize[] =
+    "block_checksum_body_sample_size";
+
 InflatedAsanParameters::InflatedAsanParameters() {
   // Clear the AsanParameters portion of ourselves.
   ::memset(this, 0, sizeof(AsanParameters));
@@ -279,6 +300,8 @@ void SetDefaultAsanParameters(AsanParameters* asan_parameters) {
   asan_parameters->reporting_period = kDefaultReportingPeriod;
   asan_parameters->bottom_frames_to_skip = kDefaultBottomFramesToSkip;
   asan_parameters->max_num_frames = kDefaultMaxNumFrames;
+  asan_parameters->enable_fast_stack_capture = kDefaultEnableFastStackCapture;
+  asan_parameters->enable_async_logging = kDefaultEnableAsyncLogging;
   asan_parameters->trailer_padding_size = kDefaultTrailerPaddingSize;
   asan_parameters->ignored_stack_ids = NULL;
   asan_parameters->quarantine_block_size = kDefaultQuarantineBlockSize;
@@ -307,13 +330,19 @@ void SetDefaultAsanParameters(AsanParameters* asan_parameters) {
   asan_parameters->report_invalid_accesses = kDefaultReportInvalidAccesses;
   asan_parameters->defer_crash_reporter_initialization =
       kDefaultDeferCrashReporterInitialization;
+  asan_parameters->check_access_sampling_rate =
+      kDefaultCheckAccessSamplingRate;
+  asan_parameters->block_checksum_algorithm = kDefaultBlockChecksumAlgorithm;
+  asan_parameters->block_checksum_body_sample_size =
+      kDefaultBlockChecksumBodySampleSize;
 }
 
 bool InflateAsanParameters(const AsanParameters* pod_params,
                            InflatedAsanParameters* inflated_params) {
   // This must be kept up to date with AsanParameters as it evolves.
   static const size_t kSizeOfAsanParametersByVersion[] = {
-      40, 44, 48, 52, 52, 52, 56, 56, 56, 56, 60, 60, 60, 60, 60, 60};
+      40, 44, 48, 52, 52, 52, 56, 56, 56, 56, 60, 60, 60, 60, 60, 60, 64, 72,
+      72, 72};
   static_assert(
       arraysize(kSizeOfAsanParametersByVersion) == kAsanParametersVersion + 1,
       "Size of parameters version out of date.");
@@ -493,6 +522,27 @@ bool ParseAsanParameters(const base::StringPiece16& param_string,
     return false;
   }
 
+  // Parse the check access sampling rate.
+  if (UpdateFloatFromCommandLine::Do(cmd_line,
+          kParamCheckAccessSamplingRate,
+          &asan_parameters->check_access_sampling_rate) == kFlagError) {
+    return false;
+  }
+
+  // Parse the block checksum algorithm.
+  if (UpdateUint32FromCommandLine::Do(cmd_line,
+          kParamBlockChecksumAlgorithm,
+          &asan_parameters->block_checksum_algorithm) == kFlagError) {
+    return false;
+  }
+
+  // Parse the block checksum body sample size.
+  if (UpdateUint32FromCommandLine::Do(cmd_line,
+          kParamBlockChecksumBodySampleSize,
+          &asan_parameters->block_checksum_body_sample_size) == kFlagError) {
+    return false;
+  }
+
   // Parse the other (boolean) flags.
   // TODO(chrisha): Transition these all to new style flags.
   if (cmd_line.HasSwitch(kParamMiniDumpOnFailure))
@@ -526,6 +576,10 @@ bool ParseAsanParameters(const base::StringPiece16& param_string,
   bool value = false;
   if (ParseBooleanFlag(kParamFeatureRandomization, cmd_line, &value))
     asan_parameters->feature_randomization = value;
+  if (ParseBooleanFlag(kParamEnableFastStackCapture, cmd_line, &value))
+    asan_parameters->enable_fast_stack_capture = value;
+  if (ParseBooleanFlag(kParamEnableAsyncLogging, cmd_line, &value))
+    asan_parameters->enable_async_logging = value;
 
   return true;
 }
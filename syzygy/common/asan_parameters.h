@@ -36,7 +36,7 @@ namespace common {
 // the StackCaptureCache.
 typedef uint32_t AsanStackId;
 
-static const size_t kAsanParametersReserved1Bits = 19;
+static const size_t kAsanParametersReserved1Bits = 17;
 
 // This data structure is injected into an instrumented image in a read-only
 // section. It is initialized by the instrumenter, and will be looked up at
@@ -119,6 +119,14 @@ struct AsanParameters {
       // Runtime: Defer the crash reporter initialization, the client has to
       // manually call the crash reporter initialization function.
       unsigned defer_crash_reporter_initialization : 1;
+      // StackCapture: If true, the stack walker keeps a small cache of the
+      // stacks recently walked by each thread, and uses it to speed up the
+      // walks of stacks that share their innermost frames with one of them.
+      unsigned enable_fast_stack_capture : 1;
+      // AsanLogger: If true, log messages are queued and sent to the logger in
+      // batches by a background thread, rather than synchronously by the
+      // thread that emits them.
+      unsigned enable_async_logging : 1;
 
       // Add new flags here!
 
@@ -148,27 +156,47 @@ struct AsanParameters {
   // 0.0 corresponds to this being disabled entirely.
   float quarantine_flood_fill_rate;
 
+  // Runtime: The base fraction of the executions of the sampled access checks
+  // of the instrumented images that are actually checked. These are the checks
+  // guarded by an entry of the sampling table of their image. The runtime
+  // checks the rarely executed sites on every execution, lowers the rate
+  // further for the hottest sites, and raises it back in the images where
+  // errors are found. A value in the range 0.0 to 1.0, inclusive. A value of
+  // 1.0 checks every execution. This only takes effect once the client calls
+  // asan_EnableCheckAccessSampler.
+  float check_access_sampling_rate;
+
+  // Block: The algorithm used to compute the block checksums. This is one of
+  // the agent::asan::BlockChecksumAlgorithm values.
+  uint32_t block_checksum_algorithm;
+
+  // Block: If non-zero, the bodies of the quarantined blocks larger than this
+  // are only partially covered by their checksum. Evenly spaced windows of
+  // the body are hashed, roughly this many bytes in total. A value of 0 means
+  // that the whole block is always hashed.
+  uint32_t block_checksum_body_sample_size;
+
   // Add new parameters here!
 
   // When laid out in memory the ignored_stack_ids are present here as a NULL
   // terminated vector.
 };
 #ifndef _WIN64
-COMPILE_ASSERT_IS_POD_OF_SIZE(AsanParameters, 60);
+COMPILE_ASSERT_IS_POD_OF_SIZE(AsanParameters, 72);
 #else
-COMPILE_ASSERT_IS_POD_OF_SIZE(AsanParameters, 64);
+COMPILE_ASSERT_IS_POD_OF_SIZE(AsanParameters, 76);
 #endif
 
 // The current version of the Asan parameters structure. This must be updated
 // if any changes are made to the above structure! This is defined in the header
 // file to allow compile time assertions against this version number.
-const uint32_t kAsanParametersVersion = 15;
+const uint32_t kAsanParametersVersion = 19;
 
 // If the number of free bits in the parameters struct changes, then the
 // version has to change as well. This is simply here to make sure that
 // everything changes in lockstep.
-static_assert(kAsanParametersReserved1Bits == 19 &&
-                  kAsanParametersVersion == 15,
+static_assert(kAsanParametersReserved1Bits == 17 &&
+                  kAsanParametersVersion == 19,
               "Version must change if reserved bits changes.");
 
 // The name of the section that will be injected into an instrumented image,
@@ -181,6 +209,26 @@ static_assert(kAsanParametersReserved1Bits == 19 &&
 extern const char kAsanParametersSectionName[];
 extern const uint32_t kAsanParametersSectionCharacteristics;
 
+// The name of the section that contains the sampling table of an instrumented
+// image. This is an array of AsanSamplingTableEntry, one per sampled access
+// check. The instrumenter zero-initializes the entries, and the RTL updates
+// them according to the check_access_sampling_rate parameter.
+extern const char kAsanSamplingTableSectionName[];
+extern const uint32_t kAsanSamplingTableSectionCharacteristics;
+
+// An entry of the sampling table of an instrumented image. Every execution of
+// a sampled access decrements |countdown|, and the access is only checked
+// when the countdown becomes negative. The check then reloads |countdown|
+// from |reload| and increments |check_count|. A sampled access is therefore
+// checked once every |reload| + 1 executions. These updates aren't atomic,
+// so concurrent executions can perturb the sampling slightly.
+struct AsanSamplingTableEntry {
+  int32_t countdown;
+  uint32_t reload;
+  uint32_t check_count;
+};
+COMPILE_ASSERT_IS_POD_OF_SIZE(AsanSamplingTableEntry, 12);
+
 #pragma pack(pop)
 
 // An inflated version of AsanParameters for dynamically parsing into. This can
@@ -234,6 +282,7 @@ extern const uint32_t kDefaultReportingPeriod;
 extern const uint32_t kDefaultMaxNumFrames;
 // Default values of StackCapture parameters.
 extern const uint32_t kDefaultBottomFramesToSkip;
+extern const bool kDefaultEnableFastStackCapture;
 // Default values of AsanRuntime parameters.
 extern const bool kDefaultExitOnFailure;
 extern const bool kDefaultCheckHeapOnFailure;
@@ -241,9 +290,11 @@ extern const bool kDefaultDisableBreakpadReporting;
 extern const bool kDefaultFeatureRandomization;
 extern const bool kDefaultReportInvalidAccesses;
 extern const bool kDefaultDeferCrashReporterInitialization;
+extern const float kDefaultCheckAccessSamplingRate;
 // Default values of AsanLogger parameters.
 extern const bool kDefaultMiniDumpOnFailure;
 extern const bool kDefaultLogAsText;
+extern const bool kDefaultEnableAsyncLogging;
 // Default values of ZebraBlockHeap parameters.
 extern const uint32_t kDefaultZebraBlockHeapSize;
 extern const float kDefaultZebraBlockHeapQuarantineRatio;
@@ -256,6 +307,9 @@ extern const bool kDefaultPreventDuplicateCorruptionCrashes;
 extern const bool kDefaultEnableLargeBlockHeap;
 extern const size_t kDefaultLargeAllocationThreshold;
 extern const bool kDefaultEnableRateTargetedHeaps;
+// Default values of the block checksum parameters.
+extern const uint32_t kDefaultBlockChecksumAlgorithm;
+extern const uint32_t kDefaultBlockChecksumBodySampleSize;
 
 // The name of the environment variable containing the SyzyAsan command-line.
 extern const char kSyzyAsanOptionsEnvVar[];
@@ -270,6 +324,7 @@ extern const char kParamReportingPeriod[];
 extern const char kParamBottomFramesToSkip[];
 // String names of StackCapture parameters.
 extern const char kParamMaxNumFrames[];
+extern const char kParamEnableFastStackCapture[];
 // String names of AsanRuntime parameters.
 extern const char kParamIgnoredStackIds[];
 extern const char kParamExitOnFailure[];
@@ -277,9 +332,11 @@ extern const char kParamDisableBreakpadReporting[];
 extern const char kParamFeatureRandomization[];
 extern const char kParamReportInvalidAccesses[];
 extern const char kParamDeferCrashReporterInitialization[];
+extern const char kParamCheckAccessSamplingRate[];
 // String names of AsanLogger parameters.
 extern const char kParamMiniDumpOnFailure[];
 extern const char kParamLogAsText[];
+extern const char kParamEnableAsyncLogging[];
 // String names of ZebraBlockHeap parameters.
 extern const char kParamZebraBlockHeapSize[];
 extern const char kParamZebraBlockHeapQuarantineRatio[];
@@ -292,6 +349,9 @@ extern const char kParamPreventDuplicateCorruptionCrashes[];
 // String names of LargeBlockHeap parameters.
 extern const char kParamDisableLargeBlockHeap[];
 extern const char kParamLargeAllocationThreshold[];
+// String names of the block checksum parameters.
+extern const char kParamBlockChecksumAlgorithm[];
+extern const char kParamBlockChecksumBodySampleSize[];
 
 // Initializes an AsanParameters struct with default values.
 // @param asan_parameters The AsanParameters struct to be initialized.
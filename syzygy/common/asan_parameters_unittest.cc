@@ -98,6 +98,15 @@ TEST(AsanParametersTest, SetDefaultAsanParameters) {
             static_cast<bool>(aparams.report_invalid_accesses));
   EXPECT_EQ(kDefaultDeferCrashReporterInitialization,
             static_cast<bool>(aparams.defer_crash_reporter_initialization));
+  EXPECT_EQ(kDefaultEnableFastStackCapture,
+            static_cast<bool>(aparams.enable_fast_stack_capture));
+  EXPECT_EQ(kDefaultEnableAsyncLogging,
+            static_cast<bool>(aparams.enable_async_logging));
+  EXPECT_EQ(kDefaultCheckAccessSamplingRate,
+            aparams.check_access_sampling_rate);
+  EXPECT_EQ(kDefaultBlockChecksumAlgorithm, aparams.block_checksum_algorithm);
+  EXPECT_EQ(kDefaultBlockChecksumBodySampleSize,
+            aparams.block_checksum_body_sample_size);
 }
 
 TEST(AsanParametersTest, InflateAsanParametersStackIdsPastEnd) {
@@ -255,6 +264,15 @@ TEST(AsanParametersTest, ParseAsanParametersMinimal) {
             static_cast<bool>(iparams.report_invalid_accesses));
   EXPECT_EQ(kDefaultDeferCrashReporterInitialization,
             static_cast<bool>(iparams.defer_crash_reporter_initialization));
+  EXPECT_EQ(kDefaultEnableFastStackCapture,
+            static_cast<bool>(iparams.enable_fast_stack_capture));
+  EXPECT_EQ(kDefaultEnableAsyncLogging,
+            static_cast<bool>(iparams.enable_async_logging));
+  EXPECT_EQ(kDefaultCheckAccessSamplingRate,
+            iparams.check_access_sampling_rate);
+  EXPECT_EQ(kDefaultBlockChecksumAlgorithm, iparams.block_checksum_algorithm);
+  EXPECT_EQ(kDefaultBlockChecksumBodySampleSize,
+            iparams.block_checksum_body_sample_size);
 }
 
 TEST(AsanParametersTest, ParseAsanParametersMaximal) {
@@ -283,7 +301,12 @@ TEST(AsanParametersTest, ParseAsanParametersMaximal) {
       L"--enable_feature_randomization "
       L"--prevent_duplicate_corruption_crashes "
       L"--report_invalid_accesses "
-      L"--defer_crash_reporter_initialization";
+      L"--defer_crash_reporter_initialization "
+      L"--enable_fast_stack_capture "
+      L"--enable_async_logging "
+      L"--check_access_sampling_rate=0.125 "
+      L"--block_checksum_algorithm=1 "
+      L"--block_checksum_body_sample_size=4096";
 
   InflatedAsanParameters iparams;
   SetDefaultAsanParameters(&iparams);
@@ -320,6 +343,11 @@ TEST(AsanParametersTest, ParseAsanParametersMaximal) {
   EXPECT_EQ(true, static_cast<bool>(iparams.report_invalid_accesses));
   EXPECT_EQ(true,
             static_cast<bool>(iparams.defer_crash_reporter_initialization));
+  EXPECT_EQ(true, static_cast<bool>(iparams.enable_fast_stack_capture));
+  EXPECT_EQ(true, static_cast<bool>(iparams.enable_async_logging));
+  EXPECT_EQ(0.125f, iparams.check_access_sampling_rate);
+  EXPECT_EQ(1u, iparams.block_checksum_algorithm);
+  EXPECT_EQ(4096u, iparams.block_checksum_body_sample_size);
 }
 
 }  // namespace common
@@ -51,6 +51,8 @@
         'process_utils.h',
         'recursive_lock.cc',
         'recursive_lock.h',
+        'thread_pool_util.cc',
+        'thread_pool_util.h',
       ],
       'defines': [
         # This is required for ATL to use XP-safe versions of its functions.
@@ -84,6 +86,7 @@
         'path_util_unittest.cc',
         'process_utils_unittest.cc',
         'recursive_lock_unittest.cc',
+        'thread_pool_util_unittest.cc',
         'unittest_util_unittest.cc',
         '<(src)/syzygy/testing/run_all_unittests.cc',
       ],
@@ -0,0 +1,39 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/common/thread_pool_util.h"
+
+#include <algorithm>
+
+namespace common {
+
+void RunDelegatesOnThreadPool(
+    const std::string& name_prefix,
+    size_t jobs,
+    const std::vector<base::DelegateSimpleThread::Delegate*>& delegates) {
+  size_t threads = std::min(jobs, delegates.size());
+  if (threads <= 1) {
+    for (size_t i = 0; i < delegates.size(); ++i)
+      delegates[i]->Run();
+    return;
+  }
+
+  base::DelegateSimpleThreadPool pool(name_prefix, static_cast<int>(threads));
+  pool.Start();
+  for (size_t i = 0; i < delegates.size(); ++i)
+    pool.AddWork(delegates[i]);
+  pool.JoinAll();
+}
+
+}  // namespace common
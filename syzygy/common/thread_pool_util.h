@@ -0,0 +1,53 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares a utility for running independent pieces of work on a pool of
+// threads.
+
+#ifndef SYZYGY_COMMON_THREAD_POOL_UTIL_H_
+#define SYZYGY_COMMON_THREAD_POOL_UTIL_H_
+
+#include <string>
+#include <vector>
+
+#include "base/threading/simple_thread.h"
+
+namespace common {
+
+// Runs each of the given delegates once, on a pool of at most @p jobs
+// threads, and waits for all of them to complete. When a single thread would
+// be used the delegates are run in order on the calling thread instead.
+// @param name_prefix The prefix of the names of the threads of the pool.
+// @param jobs The maximum number of delegates to run concurrently.
+// @param delegates The delegates to run.
+void RunDelegatesOnThreadPool(
+    const std::string& name_prefix,
+    size_t jobs,
+    const std::vector<base::DelegateSimpleThread::Delegate*>& delegates);
+
+// Convenience overload for vectors of a type derived from
+// base::DelegateSimpleThread::Delegate.
+// @tparam DelegateType The type of the delegates.
+template <typename DelegateType>
+void RunDelegatesOnThreadPool(const std::string& name_prefix,
+                              size_t jobs,
+                              const std::vector<DelegateType*>& delegates) {
+  std::vector<base::DelegateSimpleThread::Delegate*> raw_delegates(
+      delegates.begin(), delegates.end());
+  RunDelegatesOnThreadPool(name_prefix, jobs, raw_delegates);
+}
+
+}  // namespace common
+
+#endif  // SYZYGY_COMMON_THREAD_POOL_UTIL_H_
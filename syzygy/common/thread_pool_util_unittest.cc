@@ -0,0 +1,78 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/common/thread_pool_util.h"
+
+#include "base/memory/scoped_vector.h"
+#include "base/threading/platform_thread.h"
+#include "gtest/gtest.h"
+
+namespace common {
+
+namespace {
+
+// Records the thread it was run on.
+class TestDelegate : public base::DelegateSimpleThread::Delegate {
+ public:
+  TestDelegate() : run_count_(0), thread_id_(0) {}
+
+  void Run() override {
+    ++run_count_;
+    thread_id_ = base::PlatformThread::CurrentId();
+  }
+
+  size_t run_count() const { return run_count_; }
+  base::PlatformThreadId thread_id() const { return thread_id_; }
+
+ private:
+  size_t run_count_;
+  base::PlatformThreadId thread_id_;
+
+  DISALLOW_COPY_AND_ASSIGN(TestDelegate);
+};
+
+}  // namespace
+
+TEST(ThreadPoolUtilTest, RunsInlineWithOneJob) {
+  ScopedVector<TestDelegate> delegates;
+  for (size_t i = 0; i < 4; ++i)
+    delegates.push_back(new TestDelegate());
+
+  RunDelegatesOnThreadPool("Test", 1, delegates.get());
+
+  for (size_t i = 0; i < delegates.size(); ++i) {
+    EXPECT_EQ(1U, delegates[i]->run_count());
+    EXPECT_EQ(base::PlatformThread::CurrentId(), delegates[i]->thread_id());
+  }
+}
+
+TEST(ThreadPoolUtilTest, RunsOnPoolWithSeveralJobs) {
+  ScopedVector<TestDelegate> delegates;
+  for (size_t i = 0; i < 16; ++i)
+    delegates.push_back(new TestDelegate());
+
+  RunDelegatesOnThreadPool("Test", 4, delegates.get());
+
+  for (size_t i = 0; i < delegates.size(); ++i) {
+    EXPECT_EQ(1U, delegates[i]->run_count());
+    EXPECT_NE(base::PlatformThread::CurrentId(), delegates[i]->thread_id());
+  }
+}
+
+TEST(ThreadPoolUtilTest, NoDelegates) {
+  std::vector<base::DelegateSimpleThread::Delegate*> delegates;
+  RunDelegatesOnThreadPool("Test", 4, delegates);
+}
+
+}  // namespace common
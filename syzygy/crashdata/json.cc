@@ -17,9 +17,10 @@
 // We use standard dependencies only, as we don't want to introduce a
 // dependency on base into the backend crash processing code.
 #include <assert.h>
-#include <iomanip>
-#include <iostream>
-#include <sstream>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits>
 
 namespace crashdata {
 
@@ -27,6 +28,57 @@ namespace {
 
 const size_t kIndentSize = 2;
 
+// Buffers the JSON output and forwards it to a JsonSink in fixed-size blocks.
+// This keeps the memory used for serialization constant, no matter the size of
+// the value being serialized, while avoiding tiny writes to the sink.
+class JsonWriter {
+ public:
+  explicit JsonWriter(JsonSink* sink)
+      : sink_(sink), buffer_size_(0), failed_(false) {
+    assert(sink != nullptr);
+  }
+
+  void push_back(char c) {
+    if (buffer_size_ == sizeof(buffer_))
+      Flush();
+    buffer_[buffer_size_++] = c;
+  }
+
+  void append(const char* data, size_t length) {
+    assert(data != nullptr);
+    while (length > 0) {
+      if (buffer_size_ == sizeof(buffer_))
+        Flush();
+      size_t chunk = sizeof(buffer_) - buffer_size_;
+      if (chunk > length)
+        chunk = length;
+      ::memcpy(buffer_ + buffer_size_, data, chunk);
+      buffer_size_ += chunk;
+      data += chunk;
+      length -= chunk;
+    }
+  }
+
+  void append(const char* s) { append(s, ::strlen(s)); }
+  void append(const std::string& s) { append(s.data(), s.size()); }
+
+  // Forwards any buffered output to the sink.
+  // @returns false if any write to the sink has failed.
+  bool Flush() {
+    if (!failed_ && buffer_size_ > 0 && !sink_->Write(buffer_, buffer_size_))
+      failed_ = true;
+    buffer_size_ = 0;
+    return !failed_;
+  }
+
+ private:
+  JsonSink* sink_;
+  char buffer_[4096];
+  size_t buffer_size_;
+  // Set when a write to the sink fails. Subsequent output is discarded.
+  bool failed_;
+};
+
 void IncreaseIndent(std::string* indent) {
   if (!indent)
     return;
@@ -39,56 +91,68 @@ void DecreaseIndent(std::string* indent) {
   indent->resize(indent->size() - kIndentSize);
 }
 
-void EmitIndent(std::string* indent, std::string* output) {
+void EmitIndent(std::string* indent, JsonWriter* output) {
   assert(output != nullptr);
   if (!indent)
     return;
   output->append(*indent);
 }
 
-void EmitHexValue8(unsigned char value, std::string* output) {
+// The numeric emitters format into a small stack buffer rather than using
+// string streams, as they are invoked for every element of stack traces and
+// blobs.
+
+void EmitHexValue8(unsigned char value, JsonWriter* output) {
   assert(output != nullptr);
-  output->push_back('"');
-  std::ostringstream oss;
-  oss << "0x" << std::hex << std::setfill('0') << std::setw(2)
-      << std::uppercase << static_cast<unsigned int>(value);
-  output->append(oss.str());
-  output->push_back('"');
+  char buffer[8];
+  int length = ::snprintf(buffer, sizeof(buffer), "\"0x%02X\"",
+                          static_cast<unsigned int>(value));
+  assert(length > 0 && static_cast<size_t>(length) < sizeof(buffer));
+  output->append(buffer, length);
 }
 
-void EmitHexValue32(google::protobuf::uint64 value, std::string* output) {
+void EmitHexValue32(google::protobuf::uint64 value, JsonWriter* output) {
   assert(output != nullptr);
-  output->push_back('"');
-  std::ostringstream oss;
-  oss << "0x" << std::hex << std::setfill('0') << std::setw(8)
-      << std::uppercase << value;
-  output->append(oss.str());
-  output->push_back('"');
+  char buffer[24];
+  int length = ::snprintf(buffer, sizeof(buffer), "\"0x%08" PRIX64 "\"",
+                          static_cast<uint64_t>(value));
+  assert(length > 0 && static_cast<size_t>(length) < sizeof(buffer));
+  output->append(buffer, length);
 }
 
-template <typename IntType>
-void EmitDecValue(IntType value, std::string* output) {
+void EmitDecValue(google::protobuf::int64 value, JsonWriter* output) {
   assert(output != nullptr);
-  std::ostringstream oss;
-  oss << std::dec << std::setw(0) << value;
-  output->append(oss.str());
+  char buffer[24];
+  int length = ::snprintf(buffer, sizeof(buffer), "%" PRId64,
+                          static_cast<int64_t>(value));
+  assert(length > 0 && static_cast<size_t>(length) < sizeof(buffer));
+  output->append(buffer, length);
 }
 
-void EmitDouble(double value, std::string* output) {
+void EmitDecValue(google::protobuf::uint64 value, JsonWriter* output) {
   assert(output != nullptr);
-  std::ostringstream oss;
-  oss << std::scientific << std::setprecision(16) << std::uppercase << value;
-  output->append(oss.str());
+  char buffer[24];
+  int length = ::snprintf(buffer, sizeof(buffer), "%" PRIu64,
+                          static_cast<uint64_t>(value));
+  assert(length > 0 && static_cast<size_t>(length) < sizeof(buffer));
+  output->append(buffer, length);
 }
 
-void EmitNull(std::string* output) {
+void EmitDouble(double value, JsonWriter* output) {
+  assert(output != nullptr);
+  char buffer[32];
+  int length = ::snprintf(buffer, sizeof(buffer), "%.16E", value);
+  assert(length > 0 && static_cast<size_t>(length) < sizeof(buffer));
+  output->append(buffer, length);
+}
+
+void EmitNull(JsonWriter* output) {
   assert(output != nullptr);
   output->append("null");
 }
 
-void EmitString(const std::string& s, std::string* output) {
+void EmitString(const std::string& s, JsonWriter* output) {
   assert(output != nullptr);
-  output->reserve(output->size() + 2 + s.size());
   output->push_back('"');
   for (size_t i = 0; i < s.size(); ++i) {
     if (s[i] == '"') {
@@ -111,7 +175,7 @@ bool EmitJsonList(char open_bracket,
                   size_t item_count,
                   YieldFunctor& yield,
                   std::string* indent,
-                  std::string* output) {
+                  JsonWriter* output) {
   assert(items_per_line > 0);
   assert(output != nullptr);
 
@@ -155,7 +219,7 @@ bool EmitJsonList(char open_bracket,
 // for the value.
 void EmitDictKey(const std::string& key,
                  std::string* indent,
-                 std::string* output) {
+                 JsonWriter* output) {
   assert(output != nullptr);
   EmitString(key, output);
   output->push_back(':');
@@ -165,9 +229,9 @@ void EmitDictKey(const std::string& key,
 
 // Forward declaration of this, as it's the common container type for other
 // values.
-bool ToJson(const Value* value, std::string* indent, std::string* output);
+bool ToJson(const Value* value, std::string* indent, JsonWriter* output);
 
-bool ToJson(const Address* address, std::string* indent, std::string* output) {
+bool ToJson(const Address* address, std::string* indent, JsonWriter* output) {
   assert(address != nullptr);
   assert(output != nullptr);
   EmitHexValue32(address->address(), output);
@@ -180,7 +244,7 @@ struct StackTraceYieldFunctor {
     assert(stack_trace != nullptr);
   }
 
-  bool operator()(size_t index, std::string* indent, std::string* output) {
+  bool operator()(size_t index, std::string* indent, JsonWriter* output) {
     assert(output != nullptr);
     assert(index <= std::numeric_limits<int>::max());
     EmitHexValue32(stack_trace_->frames().Get(static_cast<int>(index)), output);
@@ -192,7 +256,7 @@ struct StackTraceYieldFunctor {
 
 bool ToJson(const StackTrace* stack_trace,
             std::string* indent,
-            std::string* output) {
+            JsonWriter* output) {
   assert(stack_trace != nullptr);
   assert(output != nullptr);
   StackTraceYieldFunctor yield(stack_trace);
@@ -210,7 +274,7 @@ struct BlobDataYieldFunctor {
     assert(blob != nullptr);
   }
 
-  bool operator()(size_t index, std::string* indent, std::string* output) {
+  bool operator()(size_t index, std::string* indent, JsonWriter* output) {
     EmitHexValue8(static_cast<unsigned char>(blob_->data()[index]), output);
     return true;
   }
@@ -225,7 +289,7 @@ struct BlobYieldFunctor {
     assert(blob != nullptr);
   }
 
-  bool operator()(size_t index, std::string* indent, std::string* output) {
+  bool operator()(size_t index, std::string* indent, JsonWriter* output) {
     assert(output != nullptr);
     switch (index) {
       case 0: {
@@ -247,7 +311,8 @@ struct BlobYieldFunctor {
       case 2: {
         EmitDictKey("size", indent, output);
         if (blob_->has_size()) {
-          EmitDecValue(blob_->size(), output);
+          EmitDecValue(static_cast<google::protobuf::uint64>(blob_->size()),
+                       output);
         } else {
           EmitNull(output);
         }
@@ -278,7 +343,7 @@ struct BlobYieldFunctor {
   bool need_comma_;
 };
 
-bool ToJson(const Blob* blob, std::string* indent, std::string* output) {
+bool ToJson(const Blob* blob, std::string* indent, JsonWriter* output) {
   assert(blob != nullptr);
   assert(output != nullptr);
   BlobYieldFunctor yield(blob);
@@ -288,7 +353,7 @@ bool ToJson(const Blob* blob, std::string* indent, std::string* output) {
   return true;
 }
 
-bool ToJson(const Leaf* leaf, std::string* indent, std::string* output) {
+bool ToJson(const Leaf* leaf, std::string* indent, JsonWriter* output) {
   assert(leaf != nullptr);
   assert(output != nullptr);
 
@@ -361,7 +426,7 @@ bool ToJson(const Leaf* leaf, std::string* indent, std::string* output) {
 struct ValueListYieldFunctor {
   explicit ValueListYieldFunctor(const ValueList* list) : list_(list) {}
 
-  bool operator()(size_t index, std::string* indent, std::string* output) {
+  bool operator()(size_t index, std::string* indent, JsonWriter* output) {
     assert(output != nullptr);
     assert(index <= std::numeric_limits<int>::max());
     if (!ToJson(&list_->values().Get(static_cast<int>(index)), indent, output))
@@ -372,7 +437,7 @@ struct ValueListYieldFunctor {
   const ValueList* list_;
 };
 
-bool ToJson(const ValueList* list, std::string* indent, std::string* output) {
+bool ToJson(const ValueList* list, std::string* indent, JsonWriter* output) {
   assert(list != nullptr);
   assert(output != nullptr);
   ValueListYieldFunctor yield(list);
@@ -382,7 +447,7 @@ bool ToJson(const ValueList* list, std::string* indent, std::string* output) {
 }
 
 bool ToJson(
-    const KeyValue* key_value, std::string* indent, std::string* output) {
+    const KeyValue* key_value, std::string* indent, JsonWriter* output) {
   assert(key_value != nullptr);
   assert(output != nullptr);
   if (!key_value->has_key())
@@ -401,7 +466,7 @@ struct DictYieldFunctor {
 
   bool operator()(size_t index,
                   std::string* indent,
-                  std::string* output) {
+                  JsonWriter* output) {
     assert(output != nullptr);
     assert(index <= std::numeric_limits<int>::max());
     if (!ToJson(&dict_->values().Get(static_cast<int>(index)), indent, output))
@@ -412,7 +477,7 @@ struct DictYieldFunctor {
   const Dictionary* dict_;
 };
 
-bool ToJson(const Dictionary* dict, std::string* indent, std::string* output) {
+bool ToJson(const Dictionary* dict, std::string* indent, JsonWriter* output) {
   assert(dict != nullptr);
   assert(output != nullptr);
   DictYieldFunctor yield(dict);
@@ -421,7 +486,7 @@ bool ToJson(const Dictionary* dict, std::string* indent, std::string* output) {
   return true;
 }
 
-bool ToJson(const Value* value, std::string* indent, std::string* output) {
+bool ToJson(const Value* value, std::string* indent, JsonWriter* output) {
   assert(value != nullptr);
   assert(output != nullptr);
   if (!value->has_type())
@@ -463,9 +528,26 @@ bool ToJson(const Value* value, std::string* indent, std::string* output) {
 
 }  // namespace
 
-bool ToJson(bool pretty_print, const Value* value, std::string* output) {
-  assert(value != nullptr);
+StringJsonSink::StringJsonSink(std::string* output) : output_(output) {
   assert(output != nullptr);
+}
+
+bool StringJsonSink::Write(const char* data, size_t length) {
+  output_->append(data, length);
+  return true;
+}
+
+FileJsonSink::FileJsonSink(FILE* file) : file_(file) {
+  assert(file != nullptr);
+}
+
+bool FileJsonSink::Write(const char* data, size_t length) {
+  return ::fwrite(data, 1, length, file_) == length;
+}
+
+bool ToJson(bool pretty_print, const Value* value, JsonSink* sink) {
+  assert(value != nullptr);
+  assert(sink != nullptr);
   std::string* indent = nullptr;
   std::string indent_content;
   if (pretty_print) {
@@ -473,10 +555,23 @@ bool ToJson(bool pretty_print, const Value* value, std::string* output) {
     indent = &indent_content;
   }
 
+  JsonWriter writer(sink);
+  bool succeeded = ToJson(value, indent, &writer);
+  // Flush regardless of the outcome, so that partial output is visible.
+  if (!writer.Flush())
+    return false;
+  return succeeded;
+}
+
+bool ToJson(bool pretty_print, const Value* value, std::string* output) {
+  assert(value != nullptr);
+  assert(output != nullptr);
+
   // Produce the output to a temp variable, as partial output may be produced
   // in case of error.
   std::string temp;
-  if (!ToJson(value, indent, &temp))
+  StringJsonSink sink(&temp);
+  if (!ToJson(pretty_print, value, &sink))
     return false;
 
   // Place the output in the desired string as efficiently as possible.
@@ -489,4 +584,11 @@ bool ToJson(bool pretty_print, const Value* value, std::string* output) {
   return true;
 }
 
+bool ToJson(bool pretty_print, const Value* value, FILE* file) {
+  assert(value != nullptr);
+  assert(file != nullptr);
+  FileJsonSink sink(file);
+  return ToJson(pretty_print, value, &sink);
+}
+
 }  // namespace crashdata
@@ -18,10 +18,51 @@
 #ifndef SYZYGY_CRASHDATA_JSON_H_
 #define SYZYGY_CRASHDATA_JSON_H_
 
+#include <stdio.h>
+#include <string>
+
 #include "syzygy/crashdata/crashdata.h"
 
 namespace crashdata {
 
+// A destination for streamed JSON output.
+class JsonSink {
+ public:
+  virtual ~JsonSink() {}
+
+  // Writes a block of output.
+  // @param data The data to be written.
+  // @param length The number of bytes to be written.
+  // @returns true on success, false otherwise.
+  virtual bool Write(const char* data, size_t length) = 0;
+};
+
+// A JsonSink that appends to a string.
+class StringJsonSink : public JsonSink {
+ public:
+  // @param output The string to append to. Must outlive this object.
+  explicit StringJsonSink(std::string* output);
+
+  // JsonSink implementation.
+  bool Write(const char* data, size_t length) override;
+
+ private:
+  std::string* output_;
+};
+
+// A JsonSink that writes to a stdio file.
+class FileJsonSink : public JsonSink {
+ public:
+  // @param file The file to write to. Must outlive this object.
+  explicit FileJsonSink(FILE* file);
+
+  // JsonSink implementation.
+  bool Write(const char* data, size_t length) override;
+
+ private:
+  FILE* file_;
+};
+
 // Converts the provided crashdata protobuf to an equivalent JSON
 // representation.
 // @param pretty_print If true the resulting JSON will be pretty-printed.
@@ -30,6 +71,24 @@ namespace crashdata {
 // @returns true on success, false otherwise.
 bool ToJson(bool pretty_print, const Value* value, std::string* output);
 
+// Streams the JSON representation of the provided crashdata protobuf to a
+// sink. Output is staged in a small fixed-size buffer, so the memory used is
+// independent of the size of @p value. Partial output may have been written to
+// the sink when this fails.
+// @param pretty_print If true the resulting JSON will be pretty-printed.
+// @param value A value object containing crash metadata.
+// @param sink The destination of the output.
+// @returns true on success, false otherwise.
+bool ToJson(bool pretty_print, const Value* value, JsonSink* sink);
+
+// Streams the JSON representation of the provided crashdata protobuf to a
+// file. See the JsonSink overload for details.
+// @param pretty_print If true the resulting JSON will be pretty-printed.
+// @param value A value object containing crash metadata.
+// @param file The destination file.
+// @returns true on success, false otherwise.
+bool ToJson(bool pretty_print, const Value* value, FILE* file);
+
 }  // namespace crashdata
 
 #endif  // SYZYGY_CRASHDATA_JSON_H_
@@ -14,18 +14,45 @@
 
 #include "syzygy/crashdata/json.h"
 
+#include <stdio.h>
+
 #include "gtest/gtest.h"
 
 namespace crashdata {
 
 namespace {
 
+// A sink that records the size of each block it receives, and that can be
+// configured to fail.
+class TestJsonSink : public JsonSink {
+ public:
+  TestJsonSink() : fail_(false), largest_write_(0) {}
+
+  bool Write(const char* data, size_t length) override {
+    if (fail_)
+      return false;
+    output_.append(data, length);
+    if (length > largest_write_)
+      largest_write_ = length;
+    return true;
+  }
+
+  bool fail_;
+  std::string output_;
+  size_t largest_write_;
+};
+
 void TestConversion(bool pretty_print,
                     const Value& value,
                     const char* expected_json) {
   std::string json;
   EXPECT_TRUE(ToJson(pretty_print, &value, &json));
   EXPECT_EQ(json, expected_json);
+
+  // The streaming variant must produce identical output.
+  TestJsonSink sink;
+  EXPECT_TRUE(ToJson(pretty_print, &value, &sink));
+  EXPECT_EQ(sink.output_, expected_json);
 }
 
 }  // namespace
@@ -291,4 +318,44 @@ TEST(CrashDataJsonTest, AllTypes) {
   TestConversion(false, value, kExpectedCompact);
 }
 
+TEST(CrashDataJsonTest, StreamsLargeValueInBoundedBlocks) {
+  Value value;
+  Blob* blob = LeafGetBlob(ValueGetLeaf(&value));
+  blob->mutable_data()->assign(64 * 1024, '\x42');
+
+  std::string json;
+  ASSERT_TRUE(ToJson(true, &value, &json));
+
+  TestJsonSink sink;
+  ASSERT_TRUE(ToJson(true, &value, &sink));
+  EXPECT_EQ(json, sink.output_);
+  // The output is far larger than the streaming buffer, which must never be
+  // handed to the sink in one piece.
+  EXPECT_LT(sink.largest_write_, json.size() / 16);
+}
+
+TEST(CrashDataJsonTest, SinkFailurePropagates) {
+  Value value;
+  LeafSetInt(42, ValueGetLeaf(&value));
+
+  TestJsonSink sink;
+  sink.fail_ = true;
+  EXPECT_FALSE(ToJson(true, &value, &sink));
+}
+
+TEST(CrashDataJsonTest, StreamsToFile) {
+  Value value;
+  LeafSetInt(-42, ValueGetLeaf(&value));
+
+  FILE* file = ::tmpfile();
+  ASSERT_NE(static_cast<FILE*>(nullptr), file);
+  EXPECT_TRUE(ToJson(false, &value, file));
+
+  ::rewind(file);
+  char buffer[16] = {};
+  size_t length = ::fread(buffer, 1, sizeof(buffer) - 1, file);
+  ::fclose(file);
+  EXPECT_EQ("-42", std::string(buffer, length));
+}
+
 }  // namespace crashdata
@@ -58,6 +58,10 @@ static const char kUsageFormatStr[] =
     "                            Equivalent to --mode=calltrace\n"
     "                                 --agent=<path>.\n"
     "  General options (applicable in all modes):\n"
+    "    --archive-jobs=<N>      When instrumenting an archive, the maximum\n"
+    "                            number of object files to instrument\n"
+    "                            concurrently. Defaults to the number of\n"
+    "                            processors.\n"
     "    --agent=<path>          If specified indicates exactly which DLL to\n"
     "                            use when instrumenting the provided module.\n"
     "                            If not specified a default agent library\n"
@@ -103,6 +107,9 @@ static const char kUsageFormatStr[] =
     "                            analysis.\n"
     "    --no-redundancy-analysis\n"
     "                            Disables redundant memory access analysis.\n"
+    "    --runtime-sampling      Allow the runtime to sample the memory\n"
+    "                            access checks, according to its\n"
+    "                            check_access_sampling_rate parameter.\n"
     "  branch mode options:\n"
     "    --buffering             Enable per-thread buffering of events.\n"
     "    --fs-slot=<slot>        Specify which FS slot to use for thread\n"
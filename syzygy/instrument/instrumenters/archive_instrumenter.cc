@@ -15,13 +15,23 @@
 // Instrumentation adapter that adds archive support to any existing
 // instrumenter. Takes care of instantiating a new instance of the
 // underlying instrumenter for each file in the archive. When not processing
-// an archive simply passes through the original instrumenter.
+// an archive simply passes through the original instrumenter. Object files
+// are instrumented concurrently on a pool of worker threads.
 
 #include "syzygy/instrument/instrumenters/archive_instrumenter.h"
 
-#include "base/bind.h"
+#include <algorithm>
+#include <vector>
+
 #include "base/files/file_util.h"
-#include "syzygy/ar/ar_transform.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/memory/scoped_vector.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/stringprintf.h"
+#include "base/sys_info.h"
+#include "base/threading/simple_thread.h"
+#include "syzygy/ar/ar_reader.h"
+#include "syzygy/ar/ar_writer.h"
 #include "syzygy/core/file_util.h"
 
 namespace instrument {
@@ -31,15 +41,121 @@ namespace {
 
 const char kInputImage[] = "input-image";
 const char kOutputImage[] = "output-image";
+const char kArchiveJobs[] = "archive-jobs";
+
+// Instruments a single object file extracted from an archive. The contents
+// of the object are replaced in place by their instrumented version. Each
+// instance is run at most once, possibly on a worker thread.
+class ObjectFileInstrumenter : public base::DelegateSimpleThread::Delegate {
+ public:
+  typedef ArchiveInstrumenter::InstrumenterFactoryFunction
+      InstrumenterFactoryFunction;
+
+  // @param factory The factory used to create the underlying instrumenter.
+  // @param command_line The command-line to pass to the instrumenter. This
+  //     must outlive this object, and must not be modified while it runs.
+  // @param temp_dir The directory in which to produce the temporary files.
+  // @param index The index of the object file in the archive. Used to
+  //     produce unique temporary file names.
+  // @param contents The contents of the object file. This must outlive
+  //     this object.
+  ObjectFileInstrumenter(
+      InstrumenterFactoryFunction factory,
+      const base::CommandLine* command_line,
+      const base::FilePath& temp_dir,
+      size_t index,
+      ar::DataBuffer* contents)
+      : factory_(factory), command_line_(command_line), temp_dir_(temp_dir),
+        index_(index), contents_(contents), succeeded_(false) {
+    DCHECK_NE(reinterpret_cast<InstrumenterFactoryFunction>(NULL), factory);
+    DCHECK_NE(reinterpret_cast<const base::CommandLine*>(NULL), command_line);
+    DCHECK_NE(reinterpret_cast<ar::DataBuffer*>(NULL), contents);
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  virtual void Run() override { succeeded_ = InstrumentObjectFile(); }
+  // @}
+
+  // @returns true if the object file was successfully instrumented.
+  bool succeeded() const { return succeeded_; }
+
+ private:
+  bool InstrumentObjectFile();
+
+  InstrumenterFactoryFunction factory_;
+  const base::CommandLine* command_line_;
+  base::FilePath temp_dir_;
+  size_t index_;
+  ar::DataBuffer* contents_;
+  bool succeeded_;
+
+  DISALLOW_COPY_AND_ASSIGN(ObjectFileInstrumenter);
+};
+
+bool ObjectFileInstrumenter::InstrumentObjectFile() {
+  // The underlying instrumenters only know how to work with files on disk,
+  // so the object is round-tripped through a pair of temporary files. These
+  // live in a directory that is cleaned up once the archive is processed.
+  base::FilePath input_path = temp_dir_.Append(
+      base::StringPrintf(L"input-%04Iu.obj", index_));
+  base::FilePath output_path = temp_dir_.Append(
+      base::StringPrintf(L"output-%04Iu.obj", index_));
+
+  if (base::WriteFile(input_path,
+                      reinterpret_cast<const char*>(contents_->data()),
+                      contents_->size()) !=
+          static_cast<int>(contents_->size())) {
+    LOG(ERROR) << "Unable to write file: " << input_path.value();
+    return false;
+  }
+
+  // Create the command-line for the child instrumenter.
+  base::CommandLine command_line(*command_line_);
+  command_line.AppendSwitchPath(kInputImage, input_path);
+  command_line.AppendSwitchPath(kOutputImage, output_path);
+
+  // Create, initialize and run an instrumenter.
+  std::unique_ptr<InstrumenterInterface> instrumenter(factory_());
+  DCHECK_NE(reinterpret_cast<InstrumenterInterface*>(NULL),
+            instrumenter.get());
+  if (!instrumenter->ParseCommandLine(&command_line))
+    return false;
+  if (!instrumenter->Instrument())
+    return false;
+
+  // Read the instrumented object back into memory.
+  int64_t size = 0;
+  if (!base::GetFileSize(output_path, &size)) {
+    LOG(ERROR) << "Unable to read size of file: " << output_path.value();
+    return false;
+  }
+  contents_->resize(size);
+  if (base::ReadFile(output_path,
+                     reinterpret_cast<char*>(contents_->data()),
+                     contents_->size()) !=
+          static_cast<int>(contents_->size())) {
+    LOG(ERROR) << "Unable to read file: " << output_path.value();
+    return false;
+  }
+
+  // Eagerly clean up, as archives can contain a great many objects.
+  base::DeleteFile(input_path, false);
+  base::DeleteFile(output_path, false);
+
+  return true;
+}
 
 }  // namespace
 
 ArchiveInstrumenter::ArchiveInstrumenter()
-    : factory_(NULL), overwrite_(false) {
+    : factory_(NULL), overwrite_(false),
+      jobs_(base::SysInfo::NumberOfProcessors()) {
 }
 
 ArchiveInstrumenter::ArchiveInstrumenter(InstrumenterFactoryFunction factory)
-    : factory_(factory), overwrite_(false) {
+    : factory_(factory), overwrite_(false),
+      jobs_(base::SysInfo::NumberOfProcessors()) {
   DCHECK_NE(reinterpret_cast<InstrumenterFactoryFunction>(NULL), factory);
 }
 
@@ -55,6 +171,17 @@ bool ArchiveInstrumenter::ParseCommandLine(
   output_image_ = command_line_->GetSwitchValuePath(kOutputImage);
   overwrite_ = command_line_->HasSwitch("overwrite");
 
+  if (command_line_->HasSwitch(kArchiveJobs)) {
+    std::string jobs_str = command_line_->GetSwitchValueASCII(kArchiveJobs);
+    size_t jobs = 0;
+    if (!base::StringToSizeT(jobs_str, &jobs) || jobs == 0) {
+      LOG(ERROR) << "Invalid value for --" << kArchiveJobs << ": "
+                 << jobs_str;
+      return false;
+    }
+    jobs_ = jobs;
+  }
+
   return true;
 }
 
@@ -114,59 +241,94 @@ bool ArchiveInstrumenter::InstrumentArchive() {
 
   LOG(INFO) << "Instrumenting archive: " << input_image_.value();
 
-  // Configure and run an archive transform.
-  ar::OnDiskArTransformAdapter::TransformFileOnDiskCallback callback =
-      base::Bind(&ArchiveInstrumenter::InstrumentFile, base::Unretained(this));
-  ar::OnDiskArTransformAdapter on_disk_adapter(callback);
-  ar::ArTransform ar_transform;
-  ar_transform.set_callback(on_disk_adapter.outer_callback());
-  ar_transform.set_input_archive(input_image_);
-  ar_transform.set_output_archive(output_image_);
-  if (!ar_transform.Transform())
+  ar::ArReader reader;
+  if (!reader.Init(input_image_))
     return false;
+  LOG(INFO) << "Read " << reader.symbols().size() << " symbols.";
 
-  return true;
-}
-
-bool ArchiveInstrumenter::InstrumentFile(const base::FilePath& input_path,
-                                         const base::FilePath& output_path,
-                                         ar::ParsedArFileHeader* header,
-                                         bool* remove) {
-  DCHECK_NE(reinterpret_cast<InstrumenterFactoryFunction>(NULL), factory_);
-  DCHECK_NE(reinterpret_cast<ar::ParsedArFileHeader*>(NULL), header);
-  DCHECK_NE(reinterpret_cast<bool*>(NULL), remove);
-
-  // We don't want to delete the file from the archive.
-  *remove = false;
-
-  // Filter anything that isn't a known and recognized COFF file.
-  core::FileType file_type = core::kUnknownFileType;
-  if (!core::GuessFileType(input_path, &file_type)) {
-    LOG(ERROR) << "Unable to determine file type.";
+  base::ScopedTempDir temp_dir;
+  if (!temp_dir.CreateUniqueTempDir()) {
+    LOG(ERROR) << "Unable to create temporary directory.";
     return false;
   }
-  if (file_type != core::kCoffFileType) {
-    LOG(INFO) << "Not processing non-object file.";
-    if (!base::CopyFile(input_path, output_path)) {
-      LOG(ERROR) << "Unable to write output file: " << output_path.value();
+
+  // Gather all of the files up front. Object files are copied to buffers
+  // that are instrumented in place, while anything else is carried over to
+  // the output directly from the mapped input archive. The buffers must
+  // outlive the instrumenters and the ArWriter below.
+  size_t file_count = reader.offsets().size();
+  std::vector<ar::ParsedArFileHeader> headers(file_count);
+  std::vector<const uint8_t*> contents(file_count);
+  std::vector<ar::DataBuffer*> object_buffers(file_count);
+  ScopedVector<ar::DataBuffer> buffers;
+  ScopedVector<ObjectFileInstrumenter> instrumenters;
+  for (size_t i = 0; i < file_count; ++i) {
+    if (!reader.GetFile(i, &headers[i], &contents[i]))
+      return false;
+
+    // Filter anything that isn't a known and recognized COFF file.
+    core::FileType file_type = core::kUnknownFileType;
+    if (!core::GuessFileType(contents[i], headers[i].size, &file_type)) {
+      LOG(ERROR) << "Unable to determine file type of " << headers[i].name;
       return false;
     }
-    return true;
+    if (file_type != core::kCoffFileType) {
+      LOG(INFO) << "Not processing non-object file: " << headers[i].name;
+      continue;
+    }
+
+    std::unique_ptr<ar::DataBuffer> buffer(
+        new ar::DataBuffer(contents[i], contents[i] + headers[i].size));
+    instrumenters.push_back(new ObjectFileInstrumenter(
+        factory_, command_line_.get(), temp_dir.path(), i, buffer.get()));
+    object_buffers[i] = buffer.get();
+    buffers.push_back(buffer.release());
   }
 
-  // Create the command-line for the child instrumenter.
-  base::CommandLine command_line(*command_line_.get());
-  command_line.AppendSwitchPath(kInputImage, input_path);
-  command_line.AppendSwitchPath(kOutputImage, output_path);
+  // Instrument the object files. When running with a single job this is
+  // done on the current thread, to keep things simple to debug.
+  size_t jobs = std::min(jobs_, instrumenters.size());
+  LOG(INFO) << "Instrumenting " << instrumenters.size() << " of "
+            << file_count << " files using " << jobs << " job(s).";
+  if (jobs <= 1) {
+    for (size_t i = 0; i < instrumenters.size(); ++i)
+      instrumenters[i]->Run();
+  } else {
+    base::DelegateSimpleThreadPool pool("ArchiveInstrumenter", jobs);
+    pool.Start();
+    for (size_t i = 0; i < instrumenters.size(); ++i)
+      pool.AddWork(instrumenters[i]);
+    pool.JoinAll();
+  }
 
-  // Create, initialize and run an instrumenter.
-  std::unique_ptr<InstrumenterInterface> instrumenter(factory_());
-  DCHECK_NE(reinterpret_cast<InstrumenterInterface*>(NULL),
-            instrumenter.get());
-  if (!instrumenter->ParseCommandLine(&command_line))
+  bool succeeded = true;
+  for (size_t i = 0; i < instrumenters.size(); ++i) {
+    if (!instrumenters[i]->succeeded())
+      succeeded = false;
+  }
+  if (!succeeded) {
+    LOG(ERROR) << "Failed to instrument one or more object files.";
     return false;
-  if (!instrumenter->Instrument())
+  }
+
+  // Reassemble the archive, preserving the original order of the files.
+  ar::ArWriter writer;
+  for (size_t i = 0; i < file_count; ++i) {
+    bool added = false;
+    if (object_buffers[i] != NULL) {
+      added = writer.AddFile(headers[i].name, headers[i].timestamp,
+                             headers[i].mode, object_buffers[i]);
+    } else {
+      added = writer.AddFile(headers[i].name, headers[i].timestamp,
+                             headers[i].mode, contents[i], headers[i].size);
+    }
+    if (!added)
+      return false;
+  }
+
+  if (!writer.Write(output_image_))
     return false;
+  LOG(INFO) << "Wrote " << writer.symbols().size() << " symbols.";
 
   return true;
 }
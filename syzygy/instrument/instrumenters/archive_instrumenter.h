@@ -17,6 +17,12 @@
 // underlying instrumenter for each file in the archive. When not processing
 // an archive simply passes through the original instrumenter.
 //
+// The object files of an archive are instrumented concurrently on a pool of
+// worker threads, and are then reassembled in their original order. Each
+// object file gets its own instance of the underlying instrumenter, so the
+// underlying instrumenters need not be thread safe. They must however not
+// share any mutable global state.
+//
 // This presumes that the underlying instrumenter uses --input-image and
 // --output-image for configuring which files are operated on.
 
@@ -46,6 +52,9 @@ class ArchiveInstrumenter : public InstrumenterInterface {
   // @returns the factory function being used by this instrumenter
   //     adapter.
   InstrumenterFactoryFunction factory() const { return factory_; }
+  // @returns the maximum number of object files that will be instrumented
+  //     concurrently when processing an archive.
+  size_t jobs() const { return jobs_; }
   // @}
 
   // @name Mutators.
@@ -54,6 +63,12 @@ class ArchiveInstrumenter : public InstrumenterInterface {
     DCHECK_NE(reinterpret_cast<InstrumenterFactoryFunction>(NULL), factory);
     factory_ = factory;
   }
+  // @param jobs The maximum number of object files to instrument
+  //     concurrently. Must be at least 1.
+  void set_jobs(size_t jobs) {
+    DCHECK_LT(0u, jobs);
+    jobs_ = jobs;
+  }
   // @}
 
   // @name InstrumenterInterface implementation.
@@ -68,12 +83,6 @@ class ArchiveInstrumenter : public InstrumenterInterface {
   bool InstrumentPassthrough();
   // Instruments an archive.
   bool InstrumentArchive();
-  // Callback for the ArTransform object. This is invoked for each file in an
-  // archive.
-  bool InstrumentFile(const base::FilePath& input_path,
-                      const base::FilePath& output_path,
-                      ar::ParsedArFileHeader* header,
-                      bool* remove);
 
   // The factory function that is used to produce instrumenter instances.
   InstrumenterFactoryFunction factory_;
@@ -85,6 +94,7 @@ class ArchiveInstrumenter : public InstrumenterInterface {
   base::FilePath input_image_;
   base::FilePath output_image_;
   bool overwrite_;
+  size_t jobs_;
 
   DISALLOW_COPY_AND_ASSIGN(ArchiveInstrumenter);
 };
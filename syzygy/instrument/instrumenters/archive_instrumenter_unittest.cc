@@ -15,6 +15,7 @@
 #include "syzygy/instrument/instrumenters/archive_instrumenter.h"
 
 #include "base/files/file_util.h"
+#include "base/synchronization/lock.h"
 #include "gtest/gtest.h"
 #include "syzygy/ar/unittest_util.h"
 #include "syzygy/core/unittest_util.h"
@@ -26,10 +27,12 @@ namespace instrumenters {
 
 namespace {
 
-// Some global state that is updated by IdentityInstrumenter.
-// NOTE: Because of these this unittest is not thread safe! We could do this
-//       with a complicate usage of gmock, but that's overkill for this
-//       scenario.
+// Some global state that is updated by IdentityInstrumenter. This is
+// protected by |lock| as the archive instrumenter uses worker threads.
+// NOTE: Because of these the tests themselves can't be run concurrently! We
+//       could do this with a complicate usage of gmock, but that's overkill
+//       for this scenario.
+base::Lock lock;
 size_t constructor_count = 0;
 size_t parse_count = 0;
 size_t instrument_count = 0;
@@ -40,11 +43,13 @@ std::set<base::FilePath> output_images;
 class IdentityInstrumenter : public InstrumenterInterface {
  public:
   IdentityInstrumenter() {
+    base::AutoLock auto_lock(lock);
     ++constructor_count;
   }
 
   virtual bool ParseCommandLine(
       const base::CommandLine* command_line) override {
+    base::AutoLock auto_lock(lock);
     ++parse_count;
     input_image_ = command_line->GetSwitchValuePath("input-image");
     output_image_ = command_line->GetSwitchValuePath("output-image");
@@ -54,7 +59,10 @@ class IdentityInstrumenter : public InstrumenterInterface {
   }
 
   virtual bool Instrument() override {
-    ++instrument_count;
+    {
+      base::AutoLock auto_lock(lock);
+      ++instrument_count;
+    }
     base::CopyFile(input_image_, output_image_);
     return true;
   }
@@ -138,6 +146,42 @@ TEST_F(ArchiveInstrumenterTest, IteratesOverArchiveFiles) {
   EXPECT_TRUE(base::PathExists(output_image_));
 }
 
+TEST_F(ArchiveInstrumenterTest, ParseArchiveJobs) {
+  ArchiveInstrumenter inst(&IdentityInstrumenterFactory);
+  command_line_->AppendSwitchPath("input-image", zlib_lib_);
+  command_line_->AppendSwitchASCII("archive-jobs", "3");
+  EXPECT_TRUE(inst.ParseCommandLine(command_line_.get()));
+  EXPECT_EQ(3u, inst.jobs());
+
+  command_line_->AppendSwitchASCII("archive-jobs", "0");
+  EXPECT_FALSE(inst.ParseCommandLine(command_line_.get()));
+}
+
+TEST_F(ArchiveInstrumenterTest, ParallelOutputMatchesSerialOutput) {
+  base::FilePath serial_output = temp_dir_.Append(L"serial.lib");
+  base::FilePath parallel_output = temp_dir_.Append(L"parallel.lib");
+
+  {
+    ArchiveInstrumenter inst(&IdentityInstrumenterFactory);
+    command_line_->AppendSwitchPath("input-image", zlib_lib_);
+    command_line_->AppendSwitchPath("output-image", serial_output);
+    EXPECT_TRUE(inst.ParseCommandLine(command_line_.get()));
+    inst.set_jobs(1);
+    EXPECT_TRUE(inst.Instrument());
+  }
+
+  {
+    ArchiveInstrumenter inst(&IdentityInstrumenterFactory);
+    command_line_->AppendSwitchPath("output-image", parallel_output);
+    EXPECT_TRUE(inst.ParseCommandLine(command_line_.get()));
+    inst.set_jobs(4);
+    EXPECT_TRUE(inst.Instrument());
+  }
+
+  EXPECT_EQ(2 * testing::kArchiveFileCount, instrument_count);
+  EXPECT_TRUE(base::ContentsEqual(serial_output, parallel_output));
+}
+
 TEST_F(ArchiveInstrumenterTest, AsanInstrumentArchive) {
   ArchiveInstrumenter inst(&AsanInstrumenterFactory);
   command_line_->AppendSwitchPath("input-image", zlib_lib_);
@@ -32,6 +32,8 @@ AsanInstrumenter::AsanInstrumenter()
     : use_interceptors_(true),
       remove_redundant_checks_(true),
       use_liveness_analysis_(true),
+      inline_fast_path_(false),
+      runtime_sampling_(false),
       instrumentation_rate_(1.0),
       asan_rtl_options_(false),
       hot_patching_(false) {
@@ -71,6 +73,8 @@ bool AsanInstrumenter::InstrumentImpl() {
   asan_transform_->set_use_interceptors(use_interceptors_);
   asan_transform_->set_use_liveness_analysis(use_liveness_analysis_);
   asan_transform_->set_remove_redundant_checks(remove_redundant_checks_);
+  asan_transform_->set_inline_fast_path(inline_fast_path_);
+  asan_transform_->set_runtime_sampling(runtime_sampling_);
   asan_transform_->set_instrumentation_rate(instrumentation_rate_);
   asan_transform_->set_hot_patching(hot_patching_);
 
@@ -110,6 +114,8 @@ bool AsanInstrumenter::DoCommandLineParse(
   filter_path_ = command_line->GetSwitchValuePath("filter");
   use_liveness_analysis_ = !command_line->HasSwitch("no-liveness-analysis");
   remove_redundant_checks_ = !command_line->HasSwitch("no-redundancy-analysis");
+  inline_fast_path_ = command_line->HasSwitch("inline-fast-path");
+  runtime_sampling_ = command_line->HasSwitch("runtime-sampling");
   use_interceptors_ = !command_line->HasSwitch("no-interceptors");
   hot_patching_ = command_line->HasSwitch("hot-patching");
 
@@ -56,6 +56,8 @@ class AsanInstrumenter : public InstrumenterWithAgent {
   bool use_interceptors_;
   bool remove_redundant_checks_;
   bool use_liveness_analysis_;
+  bool inline_fast_path_;
+  bool runtime_sampling_;
   double instrumentation_rate_;
   bool asan_rtl_options_;
   bool hot_patching_;
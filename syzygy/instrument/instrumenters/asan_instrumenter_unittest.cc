@@ -41,6 +41,7 @@ class TestAsanInstrumenter : public AsanInstrumenter {
   using AsanInstrumenter::debug_friendly_;
   using AsanInstrumenter::filter_path_;
   using AsanInstrumenter::hot_patching_;
+  using AsanInstrumenter::inline_fast_path_;
   using AsanInstrumenter::input_image_path_;
   using AsanInstrumenter::input_pdb_path_;
   using AsanInstrumenter::instrumentation_rate_;
@@ -49,6 +50,7 @@ class TestAsanInstrumenter : public AsanInstrumenter {
   using AsanInstrumenter::output_image_path_;
   using AsanInstrumenter::output_pdb_path_;
   using AsanInstrumenter::remove_redundant_checks_;
+  using AsanInstrumenter::runtime_sampling_;
   using AsanInstrumenter::use_interceptors_;
   using AsanInstrumenter::use_liveness_analysis_;
   using InstrumenterWithAgent::CreateRelinker;
@@ -157,6 +159,8 @@ TEST_F(AsanInstrumenterTest, ParseMinimalAsan) {
   EXPECT_TRUE(instrumenter_.use_interceptors_);
   EXPECT_TRUE(instrumenter_.use_liveness_analysis_);
   EXPECT_TRUE(instrumenter_.remove_redundant_checks_);
+  EXPECT_FALSE(instrumenter_.inline_fast_path_);
+  EXPECT_FALSE(instrumenter_.runtime_sampling_);
   EXPECT_EQ(1.0, instrumenter_.instrumentation_rate_);
   EXPECT_FALSE(instrumenter_.asan_rtl_options_);
   EXPECT_FALSE(instrumenter_.hot_patching_);
@@ -176,6 +180,8 @@ TEST_F(AsanInstrumenterTest, ParseFullAsan) {
   cmd_line_.AppendSwitch("overwrite");
   cmd_line_.AppendSwitch("no-liveness-analysis");
   cmd_line_.AppendSwitch("no-redundancy-analysis");
+  cmd_line_.AppendSwitch("inline-fast-path");
+  cmd_line_.AppendSwitch("runtime-sampling");
   cmd_line_.AppendSwitchASCII("instrumentation-rate", "0.5");
   cmd_line_.AppendSwitchASCII("asan-rtl-options",
       "\"--quarantine_size=1024 --quarantine_block_size=512 --ignored\"");
@@ -195,6 +201,8 @@ TEST_F(AsanInstrumenterTest, ParseFullAsan) {
   EXPECT_FALSE(instrumenter_.use_interceptors_);
   EXPECT_FALSE(instrumenter_.use_liveness_analysis_);
   EXPECT_FALSE(instrumenter_.remove_redundant_checks_);
+  EXPECT_TRUE(instrumenter_.inline_fast_path_);
+  EXPECT_TRUE(instrumenter_.runtime_sampling_);
   EXPECT_EQ(0.5, instrumenter_.instrumentation_rate_);
   EXPECT_TRUE(instrumenter_.asan_rtl_options_);
   EXPECT_TRUE(instrumenter_.hot_patching_);
@@ -44,6 +44,7 @@ namespace instrument {
 namespace transforms {
 namespace {
 
+using common::AsanSamplingTableEntry;
 using block_graph::BasicBlock;
 using block_graph::BasicCodeBlock;
 using block_graph::BasicBlockAssembler;
@@ -55,6 +56,7 @@ using block_graph::Displacement;
 using block_graph::Immediate;
 using block_graph::Instruction;
 using block_graph::Operand;
+using block_graph::Successor;
 using block_graph::TransformPolicyInterface;
 using block_graph::TypedBlock;
 using block_graph::analysis::LivenessAnalysis;
@@ -313,6 +315,172 @@ void InjectAsanHook(BasicBlockAssembler* bb_asm,
   }
 }
 
+// Finds two registers that are not alive in @p state and can be used as
+// temporaries by an inlined fast path.
+// @param state The liveness information before the instrumented instruction.
+// @param first Receives the first free register.
+// @param second Receives the second free register.
+// @returns true if two free registers were found, false otherwise.
+bool FindFreeRegisters(const LivenessAnalysis::State& state,
+                       const Register32** first,
+                       const Register32** second) {
+  DCHECK_NE(static_cast<const Register32**>(nullptr), first);
+  DCHECK_NE(static_cast<const Register32**>(nullptr), second);
+
+  *first = nullptr;
+  *second = nullptr;
+  for (size_t i = 0; i < assm::kRegister32Count; ++i) {
+    const Register32& reg = assm::kRegisters32[i];
+    if (reg.id() == assm::kRegisterEsp || reg.id() == assm::kRegisterEbp)
+      continue;
+    if (state.IsLive(reg))
+      continue;
+
+    if (*first == nullptr) {
+      *first = &reg;
+    } else {
+      *second = &reg;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Inlines before @p where the fast path of the check of the access to the
+// address stored in the operand @p op. This emits the following sequence:
+//
+//     mov  second, [shadow_info_import]
+//     lea  first, op
+//     shr  first, 3
+//     cmp  first, [second + 4]  ; Compare to the shadow length.
+//     (jae slow_path)
+//   second_half:
+//     add  first, [second]      ; Add the shadow address.
+//     movzx first, byte ptr [first]
+//     test first, first
+//     (jnz slow_path)
+//
+// The branches are not emitted here as they are successors of the basic
+// blocks that are created when splitting at @p second_half. A shadow length
+// of zero, as used until the runtime is loaded, sends every check to the slow
+// path.
+// @param where The position of the access in @p instructions.
+// @param instructions The instructions of the basic block being instrumented.
+// @param source_range The source range to assign to the instructions of the
+//     fast path.
+// @param op The operand of the access.
+// @param shadow_info_ref The import entry of the shadow memory information.
+// @param first The first free register.
+// @param second The second free register.
+// @param second_half Receives the position of the first instruction of the
+//     second half of the fast path.
+void InjectInlinedFastPath(
+    const BasicBlock::Instructions::iterator& where,
+    BasicBlock::Instructions* instructions,
+    const BlockGraph::Block::SourceRange& source_range,
+    const BasicBlockAssembler::Operand& op,
+    const BlockGraph::Reference& shadow_info_ref,
+    const Register32& first,
+    const Register32& second,
+    BasicBlock::Instructions::iterator* second_half) {
+  DCHECK_NE(static_cast<BasicBlock::Instructions*>(nullptr), instructions);
+  DCHECK_NE(static_cast<BasicBlock::Instructions::iterator*>(nullptr),
+            second_half);
+
+  BasicBlockAssembler first_asm(where, instructions);
+  first_asm.set_source_range(source_range);
+  first_asm.mov(second, Operand(Displacement(shadow_info_ref.referenced(),
+                                             shadow_info_ref.offset())));
+  first_asm.lea(first, op);
+  first_asm.shr(first, Immediate(3));
+  first_asm.cmp(first, Operand(second, Displacement(4)));
+
+  // The last instruction of the first half is just before the access.
+  BasicBlock::Instructions::iterator first_half_end = where;
+  --first_half_end;
+
+  BasicBlockAssembler second_asm(where, instructions);
+  second_asm.set_source_range(source_range);
+  second_asm.add(first, Operand(second));
+  second_asm.movzx_b(first, Operand(first));
+  second_asm.test(first, first);
+
+  *second_half = first_half_end;
+  ++(*second_half);
+}
+
+// Uses @p bb_asm to inject a sampling guard for a check, using a new entry of
+// @p sampling_table. This emits:
+//
+//     sub dword ptr [entry.countdown], 1
+//     (jns access)
+//
+// The branch is not emitted here as it is a successor of the basic block that
+// is created when splitting the check out.
+// @param bb_asm The assembler to use.
+// @param sampling_table The table of the sampling guards. It is grown by one
+//     zero-initialized entry, which initially checks every execution.
+// @returns the offset of the new entry in @p sampling_table.
+BlockGraph::Offset InjectSamplingGuard(BasicBlockAssembler* bb_asm,
+                                       BlockGraph::Block* sampling_table) {
+  DCHECK_NE(static_cast<BasicBlockAssembler*>(nullptr), bb_asm);
+  DCHECK_NE(static_cast<BlockGraph::Block*>(nullptr), sampling_table);
+
+  BlockGraph::Offset entry = sampling_table->size();
+  size_t new_size = sampling_table->size() + sizeof(AsanSamplingTableEntry);
+  sampling_table->set_size(new_size);
+  sampling_table->ResizeData(new_size);
+  uint8_t* data = sampling_table->GetMutableData();
+  DCHECK_NE(static_cast<uint8_t*>(nullptr), data);
+  ::memset(data + entry, 0, sizeof(AsanSamplingTableEntry));
+
+  bb_asm->sub(Operand(Displacement(
+                  sampling_table,
+                  entry + offsetof(AsanSamplingTableEntry, countdown))),
+              Immediate(1));
+  return entry;
+}
+
+// Uses @p bb_asm to inject the bookkeeping of a sampled check, at the start of
+// the check. This emits:
+//
+//     push dword ptr [entry.reload]
+//     pop dword ptr [entry.countdown]
+//     add dword ptr [entry.check_count], 1
+//
+// @param bb_asm The assembler to use.
+// @param sampling_table The table of the sampling guards.
+// @param entry The offset of the entry of the check in @p sampling_table.
+void InjectSamplingReload(BasicBlockAssembler* bb_asm,
+                          BlockGraph::Block* sampling_table,
+                          BlockGraph::Offset entry) {
+  DCHECK_NE(static_cast<BasicBlockAssembler*>(nullptr), bb_asm);
+  DCHECK_NE(static_cast<BlockGraph::Block*>(nullptr), sampling_table);
+
+  // The countdown is reloaded through the stack, as there might not be any
+  // free register.
+  bb_asm->push(Operand(Displacement(
+      sampling_table, entry + offsetof(AsanSamplingTableEntry, reload))));
+  bb_asm->pop(Operand(Displacement(
+      sampling_table, entry + offsetof(AsanSamplingTableEntry, countdown))));
+  bb_asm->add(Operand(Displacement(
+                  sampling_table,
+                  entry + offsetof(AsanSamplingTableEntry, check_count))),
+              Immediate(1));
+}
+
+void AddSuccessorBetween(Successor::Condition condition,
+                         BasicCodeBlock* from,
+                         BasicCodeBlock* to) {
+  from->successors().push_back(
+      Successor(condition,
+                BasicBlockReference(BlockGraph::RELATIVE_REF,
+                                    BlockGraph::Reference::kMaximumSize,
+                                    to),
+                0));
+}
+
 // Get the name of an asan check access function for an @p access_mode access.
 // @param info The memory access information, e.g. the size on a load/store,
 //     the instruction opcode and the kind of access.
@@ -1204,6 +1372,23 @@ bool AsanBasicBlockTransform::InstrumentBasicBlock(
     // hook so we can call a dry run without hooks present.
     instrumentation_happened_ = true;
 
+    // Inline the fast path of read/write checks when the flags are dead and
+    // there are enough free registers to hold its temporaries.
+    const Register32* first_free_reg = nullptr;
+    const Register32* second_free_reg = nullptr;
+    bool inline_check = inline_fast_path_ && shadow_info_ref_.IsValid() &&
+        use_liveness_analysis_ && image_format == BlockGraph::PE_IMAGE &&
+        (info.mode == kReadAccess || info.mode == kWriteAccess) &&
+        !info.save_flags &&
+        FindFreeRegisters(state, &first_free_reg, &second_free_reg);
+
+    // Guard the read/write checks by a sampling table entry when the flags are
+    // dead, as the guard clobbers them.
+    bool sample_check = sampling_table_ != nullptr &&
+        use_liveness_analysis_ && image_format == BlockGraph::PE_IMAGE &&
+        (info.mode == kReadAccess || info.mode == kWriteAccess) &&
+        !info.save_flags;
+
     if (!dry_run_) {
       // Insert hook for standard instructions.
       AsanHookMap::iterator hook = check_access_hooks_->find(info);
@@ -1213,9 +1398,53 @@ bool AsanBasicBlockTransform::InstrumentBasicBlock(
         return false;
       }
 
-      // Instrument this instruction.
-      InjectAsanHook(
-          &bb_asm, info, operand, &hook->second, state, image_format);
+      SplitCheck* check = nullptr;
+      if (sample_check || inline_check) {
+        split_checks_.push_back(SplitCheck());
+        check = &split_checks_.back();
+        check->basic_block = basic_block;
+        check->access = iter_inst;
+        check->sampled = sample_check;
+        check->inlined = inline_check;
+      }
+
+      // The check itself starts right after the sampling guard.
+      BasicBlock::Instructions::iterator guard_end = iter_inst;
+      if (sample_check) {
+        BlockGraph::Offset entry = InjectSamplingGuard(&bb_asm,
+                                                       sampling_table_);
+        guard_end = iter_inst;
+        --guard_end;
+        InjectSamplingReload(&bb_asm, sampling_table_, entry);
+      }
+
+      if (inline_check) {
+        // Inline the fast path, and put the call to the hook in a slow path
+        // that is moved to its own basic block by SplitChecks.
+        InjectInlinedFastPath(iter_inst,
+                              &basic_block->instructions(),
+                              bb_asm.source_range(),
+                              operand,
+                              shadow_info_ref_,
+                              *first_free_reg,
+                              *second_free_reg,
+                              &check->second_half);
+
+        BasicBlockAssembler slow_asm(check->slow_path.end(),
+                                     &check->slow_path);
+        slow_asm.set_source_range(bb_asm.source_range());
+        InjectAsanHook(
+            &slow_asm, info, operand, &hook->second, state, image_format);
+      } else {
+        // Instrument this instruction.
+        InjectAsanHook(
+            &bb_asm, info, operand, &hook->second, state, image_format);
+      }
+
+      if (sample_check) {
+        check->check_begin = guard_end;
+        ++check->check_begin;
+      }
     }
   }
 
@@ -1253,6 +1482,7 @@ bool AsanBasicBlockTransform::TransformBasicBlockSubGraph(
     stack_mode = kSafeStackAccess;
 
   // Iterates through each basic block and instruments it.
+  split_checks_.clear();
   BasicBlockSubGraph::BBCollection::iterator it =
       subgraph->basic_blocks().begin();
   for (; it != subgraph->basic_blocks().end(); ++it) {
@@ -1262,6 +1492,103 @@ bool AsanBasicBlockTransform::TransformBasicBlockSubGraph(
       return false;
     }
   }
+
+  // Make the branches of the sampled and inlined checks explicit.
+  if (!SplitChecks(subgraph))
+    return false;
+
+  return true;
+}
+
+bool AsanBasicBlockTransform::SplitChecks(BasicBlockSubGraph* subgraph) {
+  DCHECK_NE(static_cast<BasicBlockSubGraph*>(nullptr), subgraph);
+
+  // Process the checks in reverse order, so that splitting a basic block
+  // leaves the earlier checks of that basic block in its head.
+  std::list<SplitCheck>::reverse_iterator check_it = split_checks_.rbegin();
+  for (; check_it != split_checks_.rend(); ++check_it) {
+    SplitCheck& check = *check_it;
+    BasicCodeBlock* head = check.basic_block;
+
+    // Find the position of the basic block in the layout.
+    BasicBlockSubGraph::BasicBlockOrdering* order = nullptr;
+    BasicBlockSubGraph::BasicBlockOrdering::iterator order_it;
+    BasicBlockSubGraph::BlockDescriptionList::iterator desc_it =
+        subgraph->block_descriptions().begin();
+    for (; desc_it != subgraph->block_descriptions().end(); ++desc_it) {
+      order_it = std::find(desc_it->basic_block_order.begin(),
+                           desc_it->basic_block_order.end(),
+                           head);
+      if (order_it != desc_it->basic_block_order.end()) {
+        order = &desc_it->basic_block_order;
+        break;
+      }
+    }
+    if (order == nullptr) {
+      LOG(ERROR) << "Basic block \"" << head->name() << "\" is not laid out.";
+      return false;
+    }
+
+    // The tail starts with the instrumented access, and inherits the original
+    // successors.
+    BasicBlock::Instructions& instructions = head->instructions();
+    BasicCodeBlock* tail = subgraph->AddBasicCodeBlock(head->name());
+    DCHECK_NE(static_cast<BasicCodeBlock*>(nullptr), tail);
+    tail->instructions().splice(tail->instructions().end(), instructions,
+                                check.access, instructions.end());
+    tail->successors().swap(head->successors());
+
+    BasicCodeBlock* second_half = nullptr;
+    BasicCodeBlock* slow_path = nullptr;
+    if (check.inlined) {
+      second_half = subgraph->AddBasicCodeBlock(head->name());
+      slow_path = subgraph->AddBasicCodeBlock(head->name());
+      DCHECK_NE(static_cast<BasicCodeBlock*>(nullptr), second_half);
+      DCHECK_NE(static_cast<BasicCodeBlock*>(nullptr), slow_path);
+      second_half->instructions().splice(second_half->instructions().end(),
+                                         instructions, check.second_half,
+                                         instructions.end());
+      slow_path->instructions().swap(check.slow_path);
+    }
+
+    // A sampled check skips to the access while its countdown is not
+    // exhausted. The check itself is in its own basic block.
+    BasicCodeBlock* check_bb = head;
+    if (check.sampled) {
+      check_bb = subgraph->AddBasicCodeBlock(head->name());
+      DCHECK_NE(static_cast<BasicCodeBlock*>(nullptr), check_bb);
+      check_bb->instructions().splice(check_bb->instructions().end(),
+                                      instructions, check.check_begin,
+                                      instructions.end());
+      AddSuccessorBetween(Successor::kConditionNotSigned, head, tail);
+      AddSuccessorBetween(Successor::kConditionSigned, head, check_bb);
+    }
+
+    if (check.inlined) {
+      AddSuccessorBetween(Successor::kConditionAboveOrEqual, check_bb,
+                          slow_path);
+      AddSuccessorBetween(Successor::kConditionBelow, check_bb, second_half);
+      AddSuccessorBetween(Successor::kConditionNotEqual, second_half,
+                          slow_path);
+      AddSuccessorBetween(Successor::kConditionEqual, second_half, tail);
+      AddSuccessorBetween(Successor::kConditionTrue, slow_path, tail);
+    } else {
+      DCHECK(check.sampled);
+      AddSuccessorBetween(Successor::kConditionTrue, check_bb, tail);
+    }
+
+    // Keep the fast path contiguous, and move the slow path out of the way.
+    ++order_it;
+    if (check.sampled)
+      order->insert(order_it, check_bb);
+    if (check.inlined)
+      order->insert(order_it, second_half);
+    order->insert(order_it, tail);
+    if (check.inlined)
+      order->push_back(slow_path);
+  }
+
+  split_checks_.clear();
   return true;
 }
 
@@ -1305,6 +1632,10 @@ const char AsanTransform::kTransformName[] = "SyzyAsanTransform";
 
 const char AsanTransform::kAsanHookStubName[] = "asan_hook_stub";
 
+const char AsanTransform::kAsanShadowInfoName[] = "asan_shadow_memory_info";
+
+const char AsanTransform::kAsanSamplingTableName[] = "asan_sampling_table";
+
 const char AsanTransform::kSyzyAsanDll[] = "syzyasan_rtl.dll";
 
 const char AsanTransform::kSyzyAsanHpDll[] = "syzyasan_hp.dll";
@@ -1314,9 +1645,12 @@ AsanTransform::AsanTransform()
       use_liveness_analysis_(false),
       remove_redundant_checks_(false),
       use_interceptors_(false),
+      inline_fast_path_(false),
+      runtime_sampling_(false),
       instrumentation_rate_(1.0),
       asan_parameters_(nullptr),
       check_access_hooks_ref_(),
+      sampling_table_block_(nullptr),
       asan_parameters_block_(nullptr),
       hot_patching_(false) {
 }
@@ -1355,6 +1689,16 @@ bool AsanTransform::PreBlockGraphIteration(
   if (block_graph->image_format() == BlockGraph::PE_IMAGE)
     PeFindStaticallyLinkedFunctionsToIntercept(kAsanIntercepts, block_graph);
 
+  // The inlined fast paths refer to the shadow memory information exported by
+  // the runtime. Its import is added along with the hooks.
+  bool import_shadow_info = inline_fast_path_ && use_liveness_analysis_ &&
+      !hot_patching_ && block_graph->image_format() == BlockGraph::PE_IMAGE;
+  size_t shadow_info_index = 0;
+  if (import_shadow_info) {
+    shadow_info_index = import_module.AddSymbol(kAsanShadowInfoName,
+                                                ImportedModule::kAlwaysImport);
+  }
+
   // We don't need to import any hooks in hot patching mode.
   if (!hot_patching_) {
     if (!ImportAsanCheckAccessHooks(kAsanHookStubName,
@@ -1368,6 +1712,45 @@ bool AsanTransform::PreBlockGraphIteration(
     }
   }
 
+  if (import_shadow_info) {
+    if (!import_module.GetSymbolReference(shadow_info_index,
+                                          &shadow_info_ref_)) {
+      LOG(ERROR) << "Unable to get import reference for "
+                 << kAsanShadowInfoName << ".";
+      return false;
+    }
+
+    // As with the hooks, the import entry may be used before the imports are
+    // resolved. Make it point to an empty description of the shadow memory
+    // until then, which sends all the inlined checks to their slow path.
+    BlockGraph::Section* thunk_section = block_graph->FindOrAddSection(
+        common::kThunkSectionName, pe::kCodeCharacteristics);
+    DCHECK_NE(static_cast<BlockGraph::Section*>(nullptr), thunk_section);
+    BlockGraph::Block* empty_shadow_info = block_graph->AddBlock(
+        BlockGraph::DATA_BLOCK, 2 * sizeof(uint32_t),
+        base::StringPrintf("%s_stub", kAsanShadowInfoName));
+    DCHECK_NE(static_cast<BlockGraph::Block*>(nullptr), empty_shadow_info);
+    empty_shadow_info->set_section(thunk_section->id());
+    shadow_info_ref_.referenced()->SetReference(
+        shadow_info_ref_.offset(),
+        BlockGraph::Reference(BlockGraph::ABSOLUTE_REF, sizeof(uint32_t),
+                              empty_shadow_info, 0, 0));
+  }
+
+  // The sampling guards of the checks live in their own section, so that the
+  // runtime can find and update them.
+  if (runtime_sampling_ && use_liveness_analysis_ && !hot_patching_ &&
+      block_graph->image_format() == BlockGraph::PE_IMAGE) {
+    BlockGraph::Section* sampling_section = block_graph->FindOrAddSection(
+        common::kAsanSamplingTableSectionName,
+        common::kAsanSamplingTableSectionCharacteristics);
+    DCHECK_NE(static_cast<BlockGraph::Section*>(nullptr), sampling_section);
+    sampling_table_block_ = block_graph->AddBlock(
+        BlockGraph::DATA_BLOCK, 0, kAsanSamplingTableName);
+    DCHECK_NE(static_cast<BlockGraph::Block*>(nullptr), sampling_table_block_);
+    sampling_table_block_->set_section(sampling_section->id());
+  }
+
   // Redirect DllMain entry thunk in hot patching mode.
   if (hot_patching_) {
     EntryThunkTransform entry_thunk_tx;
@@ -1401,6 +1784,9 @@ bool AsanTransform::OnBlock(const TransformPolicyInterface* policy,
   transform.set_debug_friendly(debug_friendly());
   transform.set_use_liveness_analysis(use_liveness_analysis());
   transform.set_remove_redundant_checks(remove_redundant_checks());
+  transform.set_inline_fast_path(inline_fast_path());
+  transform.set_shadow_info_ref(shadow_info_ref_);
+  transform.set_sampling_table(sampling_table_block_);
   transform.set_filter(filter());
   transform.set_instrumentation_rate(instrumentation_rate_);
 
@@ -1440,6 +1826,12 @@ bool AsanTransform::PostBlockGraphIteration(
   DCHECK(block_graph != NULL);
   DCHECK(header_block != NULL);
 
+  // Avoid emitting an empty sampling table section.
+  if (sampling_table_block_ != nullptr && sampling_table_block_->size() == 0) {
+    sampling_table_block_->set_size(sizeof(AsanSamplingTableEntry));
+    sampling_table_block_->ResizeData(sizeof(AsanSamplingTableEntry));
+  }
+
   if (block_graph->image_format() == BlockGraph::PE_IMAGE) {
     if (!PeInterceptFunctions(kAsanIntercepts, policy, block_graph,
                               header_block)) {
@@ -1678,7 +2070,7 @@ bool AsanTransform::PeInjectAsanParameters(
   params_block->CopyData(fparams.data().size(), fparams.data().data());
 
   // Wire up any references that are required.
-  static_assert(15 == common::kAsanParametersVersion,
+  static_assert(19 == common::kAsanParametersVersion,
                 "Pointers in the params must be linked up here.");
   block_graph::TypedBlock<common::AsanParameters> params;
   CHECK(params.Init(0, params_block));
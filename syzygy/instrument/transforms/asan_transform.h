@@ -17,6 +17,7 @@
 #ifndef SYZYGY_INSTRUMENT_TRANSFORMS_ASAN_TRANSFORM_H_
 #define SYZYGY_INSTRUMENT_TRANSFORMS_ASAN_TRANSFORM_H_
 
+#include <list>
 #include <map>
 #include <set>
 #include <string>
@@ -87,7 +88,9 @@ class AsanBasicBlockTransform
       instrumentation_happened_(false),
       instrumentation_rate_(1.0),
       remove_redundant_checks_(false),
-      use_liveness_analysis_(false) {
+      use_liveness_analysis_(false),
+      inline_fast_path_(false),
+      sampling_table_(nullptr) {
     DCHECK(check_access_hooks != NULL);
   }
 
@@ -110,6 +113,35 @@ class AsanBasicBlockTransform
   double instrumentation_rate() const { return instrumentation_rate_; }
   void set_instrumentation_rate(double instrumentation_rate);
 
+  // When the fast path is inlined, the shadow byte of read/write accesses is
+  // checked in the instrumented code, and the check access hooks are only
+  // called when it is non-zero. This requires the liveness analysis to find
+  // two free registers and dead arithmetic flags; other accesses fall back to
+  // calling the hooks. It is only supported for PE images.
+  bool inline_fast_path() const { return inline_fast_path_; }
+  void set_inline_fast_path(bool inline_fast_path) {
+    inline_fast_path_ = inline_fast_path;
+  }
+
+  // The reference to the import entry of the runtime's shadow memory
+  // information. This must be valid for the fast path to be inlined.
+  const BlockGraph::Reference& shadow_info_ref() const {
+    return shadow_info_ref_;
+  }
+  void set_shadow_info_ref(const BlockGraph::Reference& shadow_info_ref) {
+    shadow_info_ref_ = shadow_info_ref;
+  }
+
+  // When a sampling table is provided, each read/write check whose flags are
+  // dead is guarded by its own entry in the table, and only runs when the
+  // countdown of this entry is exhausted. The table is grown by one
+  // zero-initialized common::AsanSamplingTableEntry for each guarded check.
+  // This requires the liveness analysis, and is only supported for PE images.
+  BlockGraph::Block* sampling_table() const { return sampling_table_; }
+  void set_sampling_table(BlockGraph::Block* sampling_table) {
+    sampling_table_ = sampling_table;
+  }
+
   // Instead of instrumenting the basic blocks, in dry run mode the instrumenter
   // only signals if any instrumentation would have happened on the block.
   // @returns true iff the instrumenter is in dry run mode.
@@ -150,6 +182,43 @@ class AsanBasicBlockTransform
                             StackAccessMode stack_mode,
                             BlockGraph::ImageFormat image_format);
 
+  // Splits the basic blocks containing sampled checks or inlined fast paths so
+  // that their branches become explicit successors.
+  // @param subgraph The subgraph containing the instrumented basic blocks.
+  // @returns true on success, false otherwise.
+  bool SplitChecks(BasicBlockSubGraph* subgraph);
+
+  // Describes an access whose check must be split out of its basic block by
+  // SplitChecks, because it is sampled, inlined, or both. The instructions of
+  // the check are already in the basic block, before @p access.
+  //   - A sampled check starts with a decrement of the countdown of its
+  //     sampling table entry, which must be followed by a branch to @p access
+  //     when not negative. The rest of the check starts at @p check_begin.
+  //   - An inlined fast path forms two halves, each of which must end with a
+  //     conditional branch to the slow path: the first half ends before
+  //     @p second_half, and the second half ends before @p access.
+  struct SplitCheck {
+    typedef block_graph::BasicBlock::Instructions Instructions;
+
+    // The basic block containing the access.
+    block_graph::BasicCodeBlock* basic_block;
+    // True iff the check is guarded by a sampling table entry.
+    bool sampled;
+    // The first instruction following the sampling guard. Only valid if
+    // |sampled| is true.
+    Instructions::iterator check_begin;
+    // True iff the fast path of the check is inlined.
+    bool inlined;
+    // The first instruction of the second half of the fast path. Only valid
+    // if |inlined| is true.
+    Instructions::iterator second_half;
+    // The instrumented instruction.
+    Instructions::iterator access;
+    // The instructions calling the check access hook. Only used if |inlined|
+    // is true.
+    Instructions slow_path;
+  };
+
  private:
   // Liveness analysis and liveness information for this subgraph.
   block_graph::analysis::LivenessAnalysis liveness_;
@@ -182,6 +251,21 @@ class AsanBasicBlockTransform
   // Set iff we should use the liveness analysis to do smarter instrumentation.
   bool use_liveness_analysis_;
 
+  // Set iff we should inline the fast path of the read/write checks.
+  bool inline_fast_path_;
+
+  // The import entry of the shadow memory information, used by the inlined
+  // fast paths.
+  BlockGraph::Reference shadow_info_ref_;
+
+  // The table holding the sampling guards of the checks, or nullptr if the
+  // checks are not sampled.
+  BlockGraph::Block* sampling_table_;
+
+  // The checks of the subgraph being transformed that need to be split, in
+  // instrumentation order.
+  std::list<SplitCheck> split_checks_;
+
   DISALLOW_COPY_AND_ASSIGN(AsanBasicBlockTransform);
 };
 
@@ -283,6 +367,22 @@ class AsanTransform
     remove_redundant_checks_ = remove_redundant_checks;
   }
 
+  // The fast path is only inlined in PE images, and requires the liveness
+  // analysis.
+  bool inline_fast_path() const { return inline_fast_path_; }
+  void set_inline_fast_path(bool inline_fast_path) {
+    inline_fast_path_ = inline_fast_path;
+  }
+
+  // When runtime sampling is enabled, the runtime controls how often each
+  // read/write check runs, according to its check_access_sampling_rate
+  // parameter. Only checks whose flags are dead are sampled. This is only
+  // supported for PE images, and requires the liveness analysis.
+  bool runtime_sampling() const { return runtime_sampling_; }
+  void set_runtime_sampling(bool runtime_sampling) {
+    runtime_sampling_ = runtime_sampling;
+  }
+
   // The instrumentation rate must be in the range [0, 1], inclusive.
   double instrumentation_rate() const { return instrumentation_rate_; }
   void set_instrumentation_rate(double instrumentation_rate);
@@ -322,6 +422,12 @@ class AsanTransform
   // The hooks stub name.
   static const char kAsanHookStubName[];
 
+  // The name of the shadow memory information exported by the runtime.
+  static const char kAsanShadowInfoName[];
+
+  // The name of the block holding the sampling guards of the checks.
+  static const char kAsanSamplingTableName[];
+
  protected:
   // PreBlockGraphIteration uses this to find the block of the _heap_init
   // function and the data block of _crtheap. This information is used by
@@ -400,6 +506,12 @@ class AsanTransform
   // Set iff we should use the functions interceptors.
   bool use_interceptors_;
 
+  // Set iff we should inline the fast path of the read/write checks.
+  bool inline_fast_path_;
+
+  // Set iff the read/write checks can be sampled at runtime.
+  bool runtime_sampling_;
+
   // Controls the rate at which reads/writes are instrumented. This is
   // implemented using random sampling.
   double instrumentation_rate_;
@@ -415,6 +527,14 @@ class AsanTransform
   // successful PreBlockGraphIteration.
   AsanBasicBlockTransform::AsanHookMap check_access_hooks_ref_;
 
+  // Reference to the import entry of the shadow memory information. Valid
+  // after successful PreBlockGraphIteration when inlining the fast path.
+  BlockGraph::Reference shadow_info_ref_;
+
+  // Block holding the sampling guards of the checks. Valid in PE mode after
+  // successful PreBlockGraphIteration when runtime sampling is enabled.
+  BlockGraph::Block* sampling_table_block_;
+
   // Block containing any injected runtime parameters. Valid in PE mode after
   // a successful PostBlockGraphIteration. This is a unittesting seam.
   block_graph::BlockGraph::Block* asan_parameters_block_;
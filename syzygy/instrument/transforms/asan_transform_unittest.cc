@@ -82,6 +82,7 @@ class TestAsanTransform : public AsanTransform {
   using AsanTransform::asan_parameters_block_;
   using AsanTransform::heap_init_blocks_;
   using AsanTransform::hot_patched_blocks_;
+  using AsanTransform::sampling_table_block_;
   using AsanTransform::static_intercepted_blocks_;
   using AsanTransform::use_interceptors_;
   using AsanTransform::use_liveness_analysis_;
@@ -355,6 +356,193 @@ TEST_F(AsanTransformTest, SetUseLivenessFlag) {
   EXPECT_FALSE(bb_transform.use_liveness_analysis());
 }
 
+TEST_F(AsanTransformTest, SetInlineFastPathFlag) {
+  EXPECT_FALSE(asan_transform_.inline_fast_path());
+  asan_transform_.set_inline_fast_path(true);
+  EXPECT_TRUE(asan_transform_.inline_fast_path());
+  asan_transform_.set_inline_fast_path(false);
+  EXPECT_FALSE(asan_transform_.inline_fast_path());
+
+  TestAsanBasicBlockTransform bb_transform(&hooks_check_access_ref_);
+  EXPECT_FALSE(bb_transform.inline_fast_path());
+  bb_transform.set_inline_fast_path(true);
+  EXPECT_TRUE(bb_transform.inline_fast_path());
+  bb_transform.set_inline_fast_path(false);
+  EXPECT_FALSE(bb_transform.inline_fast_path());
+}
+
+TEST_F(AsanTransformTest, InlineFastPath) {
+  // The access is followed by instructions killing eax, ecx and the flags,
+  // which leaves enough room to inline its fast path.
+  bb_asm_->mov(assm::eax, block_graph::Operand(assm::ebx));
+  bb_asm_->mov(assm::ecx, block_graph::Immediate(1));
+  bb_asm_->add(assm::ecx, assm::eax);
+  bb_asm_->ret();
+
+  InitHooksRefs();
+  BlockGraph::Block* shadow_info = block_graph_.AddBlock(
+      BlockGraph::DATA_BLOCK, 4, AsanTransform::kAsanShadowInfoName);
+  block_graph_.set_image_format(BlockGraph::PE_IMAGE);
+
+  TestAsanBasicBlockTransform bb_transform(&hooks_check_access_ref_);
+  bb_transform.set_use_liveness_analysis(true);
+  bb_transform.set_inline_fast_path(true);
+  bb_transform.set_shadow_info_ref(
+      BlockGraph::Reference(BlockGraph::ABSOLUTE_REF, 4, shadow_info, 0, 0));
+  ASSERT_TRUE(bb_transform.TransformBasicBlockSubGraph(
+      &pe_policy_, &block_graph_, &subgraph_));
+  EXPECT_TRUE(bb_transform.instrumentation_happened());
+
+  // The basic block is split into the two halves of the fast path, the
+  // instrumented access and the slow path.
+  ASSERT_EQ(4U, subgraph_.basic_blocks().size());
+  const BasicBlockSubGraph::BasicBlockOrdering& order =
+      subgraph_.block_descriptions().front().basic_block_order;
+  ASSERT_EQ(4U, order.size());
+  BasicBlockSubGraph::BasicBlockOrdering::const_iterator order_it =
+      order.begin();
+  BasicCodeBlock* head = BasicCodeBlock::Cast(*order_it++);
+  BasicCodeBlock* second_half = BasicCodeBlock::Cast(*order_it++);
+  BasicCodeBlock* tail = BasicCodeBlock::Cast(*order_it++);
+  BasicCodeBlock* slow_path = BasicCodeBlock::Cast(*order_it++);
+  ASSERT_EQ(basic_block_, head);
+  ASSERT_NE(static_cast<BasicCodeBlock*>(nullptr), second_half);
+  ASSERT_NE(static_cast<BasicCodeBlock*>(nullptr), tail);
+  ASSERT_NE(static_cast<BasicCodeBlock*>(nullptr), slow_path);
+
+  EXPECT_EQ(4U, head->instructions().size());
+  EXPECT_EQ(3U, second_half->instructions().size());
+  EXPECT_EQ(4U, tail->instructions().size());
+  EXPECT_FALSE(slow_path->instructions().empty());
+
+  // The fast path uses the free registers and refers to the shadow memory
+  // information.
+  const Instruction& load_info = head->instructions().front();
+  EXPECT_EQ(I_MOV, load_info.representation().opcode);
+  EXPECT_EQ(R_ECX, load_info.representation().ops[0].index);
+  ASSERT_EQ(1U, load_info.references().size());
+  EXPECT_EQ(shadow_info, load_info.references().begin()->second.block());
+
+  // The branches to the slow path are explicit.
+  ASSERT_EQ(2U, head->successors().size());
+  EXPECT_EQ(slow_path, head->successors().front().reference().basic_block());
+  EXPECT_EQ(second_half, head->successors().back().reference().basic_block());
+  ASSERT_EQ(2U, second_half->successors().size());
+  EXPECT_EQ(slow_path,
+            second_half->successors().front().reference().basic_block());
+  EXPECT_EQ(tail, second_half->successors().back().reference().basic_block());
+  ASSERT_EQ(1U, slow_path->successors().size());
+  EXPECT_EQ(tail, slow_path->successors().front().reference().basic_block());
+  EXPECT_TRUE(tail->successors().empty());
+}
+
+TEST_F(AsanTransformTest, InlineFastPathWithoutFreeRegisters) {
+  // Only eax is dead at the access and the flags are alive, so the fast path
+  // can't be inlined.
+  bb_asm_->mov(assm::eax, block_graph::Operand(assm::ebx));
+  bb_asm_->ret();
+
+  InitHooksRefs();
+  BlockGraph::Block* shadow_info = block_graph_.AddBlock(
+      BlockGraph::DATA_BLOCK, 4, AsanTransform::kAsanShadowInfoName);
+  block_graph_.set_image_format(BlockGraph::PE_IMAGE);
+
+  TestAsanBasicBlockTransform bb_transform(&hooks_check_access_ref_);
+  bb_transform.set_use_liveness_analysis(true);
+  bb_transform.set_inline_fast_path(true);
+  bb_transform.set_shadow_info_ref(
+      BlockGraph::Reference(BlockGraph::ABSOLUTE_REF, 4, shadow_info, 0, 0));
+  ASSERT_TRUE(bb_transform.TransformBasicBlockSubGraph(
+      &pe_policy_, &block_graph_, &subgraph_));
+  EXPECT_TRUE(bb_transform.instrumentation_happened());
+  EXPECT_EQ(1U, subgraph_.basic_blocks().size());
+}
+
+TEST_F(AsanTransformTest, SetRuntimeSamplingFlag) {
+  EXPECT_FALSE(asan_transform_.runtime_sampling());
+  asan_transform_.set_runtime_sampling(true);
+  EXPECT_TRUE(asan_transform_.runtime_sampling());
+  asan_transform_.set_runtime_sampling(false);
+  EXPECT_FALSE(asan_transform_.runtime_sampling());
+
+  TestAsanBasicBlockTransform bb_transform(&hooks_check_access_ref_);
+  EXPECT_EQ(nullptr, bb_transform.sampling_table());
+}
+
+TEST_F(AsanTransformTest, SampledCheck) {
+  // The flags are dead at the access, so its check can be guarded.
+  bb_asm_->mov(assm::eax, block_graph::Operand(assm::ebx));
+  bb_asm_->mov(assm::ecx, block_graph::Immediate(1));
+  bb_asm_->add(assm::ecx, assm::eax);
+  bb_asm_->ret();
+
+  InitHooksRefs();
+  BlockGraph::Block* sampling_table = block_graph_.AddBlock(
+      BlockGraph::DATA_BLOCK, 0, AsanTransform::kAsanSamplingTableName);
+  block_graph_.set_image_format(BlockGraph::PE_IMAGE);
+
+  TestAsanBasicBlockTransform bb_transform(&hooks_check_access_ref_);
+  bb_transform.set_use_liveness_analysis(true);
+  bb_transform.set_sampling_table(sampling_table);
+  ASSERT_TRUE(bb_transform.TransformBasicBlockSubGraph(
+      &pe_policy_, &block_graph_, &subgraph_));
+  EXPECT_TRUE(bb_transform.instrumentation_happened());
+
+  // The check got a zero-initialized entry in the sampling table, which
+  // checks every execution.
+  ASSERT_EQ(sizeof(common::AsanSamplingTableEntry), sampling_table->size());
+  ASSERT_EQ(sizeof(common::AsanSamplingTableEntry),
+            sampling_table->data_size());
+  const common::AsanSamplingTableEntry* entry =
+      reinterpret_cast<const common::AsanSamplingTableEntry*>(
+          sampling_table->data());
+  EXPECT_EQ(0, entry->countdown);
+  EXPECT_EQ(0U, entry->reload);
+  EXPECT_EQ(0U, entry->check_count);
+
+  // The basic block is split into the guard, the check and the instrumented
+  // access.
+  ASSERT_EQ(3U, subgraph_.basic_blocks().size());
+  const BasicBlockSubGraph::BasicBlockOrdering& order =
+      subgraph_.block_descriptions().front().basic_block_order;
+  ASSERT_EQ(3U, order.size());
+  BasicBlockSubGraph::BasicBlockOrdering::const_iterator order_it =
+      order.begin();
+  BasicCodeBlock* head = BasicCodeBlock::Cast(*order_it++);
+  BasicCodeBlock* check = BasicCodeBlock::Cast(*order_it++);
+  BasicCodeBlock* tail = BasicCodeBlock::Cast(*order_it++);
+  ASSERT_EQ(basic_block_, head);
+  ASSERT_NE(static_cast<BasicCodeBlock*>(nullptr), check);
+  ASSERT_NE(static_cast<BasicCodeBlock*>(nullptr), tail);
+
+  ASSERT_EQ(1U, head->instructions().size());
+  EXPECT_FALSE(check->instructions().empty());
+  EXPECT_EQ(4U, tail->instructions().size());
+
+  const Instruction& guard = head->instructions().front();
+  EXPECT_EQ(I_SUB, guard.representation().opcode);
+  ASSERT_EQ(1U, guard.references().size());
+  EXPECT_EQ(sampling_table, guard.references().begin()->second.block());
+
+  // The check starts by reloading the countdown, and counting itself.
+  ASSERT_LE(3U, check->instructions().size());
+  BasicBlock::Instructions::const_iterator inst_it =
+      check->instructions().begin();
+  EXPECT_EQ(I_PUSH, (inst_it++)->representation().opcode);
+  EXPECT_EQ(I_POP, (inst_it++)->representation().opcode);
+  EXPECT_EQ(I_ADD, (inst_it++)->representation().opcode);
+
+  // The check is skipped while the countdown isn't exhausted.
+  ASSERT_EQ(2U, head->successors().size());
+  EXPECT_EQ(block_graph::Successor::kConditionNotSigned,
+            head->successors().front().condition());
+  EXPECT_EQ(tail, head->successors().front().reference().basic_block());
+  EXPECT_EQ(check, head->successors().back().reference().basic_block());
+  ASSERT_EQ(1U, check->successors().size());
+  EXPECT_EQ(tail, check->successors().front().reference().basic_block());
+  EXPECT_TRUE(tail->successors().empty());
+}
+
 TEST_F(AsanTransformTest, ApplyAsanTransformPE) {
   ASSERT_NO_FATAL_FAILURE(DecomposeTestDll());
 
@@ -363,6 +551,26 @@ TEST_F(AsanTransformTest, ApplyAsanTransformPE) {
       &asan_transform_, policy_, &block_graph_, header_block_));
 }
 
+TEST_F(AsanTransformTest, ApplyAsanTransformPEWithRuntimeSampling) {
+  ASSERT_NO_FATAL_FAILURE(DecomposeTestDll());
+
+  asan_transform_.use_interceptors_ = true;
+  asan_transform_.use_liveness_analysis_ = true;
+  asan_transform_.set_runtime_sampling(true);
+  ASSERT_TRUE(block_graph::ApplyBlockGraphTransform(
+      &asan_transform_, policy_, &block_graph_, header_block_));
+
+  BlockGraph::Block* sampling_table = asan_transform_.sampling_table_block_;
+  ASSERT_NE(static_cast<BlockGraph::Block*>(nullptr), sampling_table);
+  EXPECT_LT(0U, sampling_table->size());
+  EXPECT_EQ(0U,
+            sampling_table->size() % sizeof(common::AsanSamplingTableEntry));
+  BlockGraph::Section* section =
+      block_graph_.GetSectionById(sampling_table->section());
+  ASSERT_NE(static_cast<BlockGraph::Section*>(nullptr), section);
+  EXPECT_EQ(common::kAsanSamplingTableSectionName, section->name());
+}
+
 TEST_F(AsanTransformTest, ApplyAsanTransformCoff) {
   ASSERT_NO_FATAL_FAILURE(DecomposeTestDllObj());
 
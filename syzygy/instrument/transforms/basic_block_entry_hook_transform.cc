@@ -21,6 +21,7 @@
 #include "base/strings/stringprintf.h"
 #include "syzygy/block_graph/block_builder.h"
 #include "syzygy/block_graph/block_util.h"
+#include "syzygy/block_graph/analysis/liveness_analysis.h"
 #include "syzygy/common/defs.h"
 #include "syzygy/common/indexed_frequency_data.h"
 #include "syzygy/instrument/transforms/entry_thunk_transform.h"
@@ -43,6 +44,8 @@ using block_graph::Immediate;
 using block_graph::Operand;
 using block_graph::Successor;
 using block_graph::TransformPolicyInterface;
+using block_graph::analysis::LivenessAnalysis;
+using common::IndexedFrequencyData;
 using common::kBasicBlockEntryAgentId;
 using common::ThreadLocalIndexedFrequencyData;
 using pe::transforms::PEAddImportsTransform;
@@ -53,6 +56,9 @@ typedef pe::transforms::ImportedModule ImportedModule;
 const char kDefaultModuleName[] = "basic_block_entry_client.dll";
 const char kBasicBlockEnter[] = "_increment_indexed_freq_data";
 
+const BlockGraph::Offset kFrequencyDataOffset =
+    offsetof(IndexedFrequencyData, frequency_data);
+
 // Compares two relative address ranges to see if they overlap. Assumes they
 // are already sorted. This is used to validate basic-block ranges.
 struct RelativeAddressRangesOverlapFunctor {
@@ -103,6 +109,80 @@ bool SetupEntryHooks(const TransformPolicyInterface* policy,
   return true;
 }
 
+// Injects an inlined increment of the counter of the basic block
+// @p basic_block_id in the frequency data array. The array is the statically
+// allocated one until the agent redirects the frequency data to its trace
+// buffer, which is committed when the agent shuts down.
+//
+// When the arithmetic flags are dead this emits:
+//     mov  reg, [data.frequency_data]
+//     add  dword ptr [reg + 4 * basic_block_id], 1
+// Otherwise, a flag-safe sequence using a second register is emitted:
+//     mov  reg, [data.frequency_data]
+//     mov  reg2, [reg + 4 * basic_block_id]
+//     lea  reg2, [reg2 + 1]
+//     mov  [reg + 4 * basic_block_id], reg2
+// Registers that are not proven dead by @p state are saved on the stack.
+// @param state The liveness information at the entry of the basic block.
+// @param frequency_data_block The block holding the frequency data.
+// @param basic_block_id The index of the counter to increment.
+// @param bb_asm The assembler used to inject the instructions.
+void InjectCounterIncrement(const LivenessAnalysis::State& state,
+                            BlockGraph::Block* frequency_data_block,
+                            size_t basic_block_id,
+                            BasicBlockAssembler* bb_asm) {
+  DCHECK_NE(static_cast<BlockGraph::Block*>(nullptr), frequency_data_block);
+  DCHECK_NE(static_cast<BasicBlockAssembler*>(nullptr), bb_asm);
+
+  size_t needed = state.AreArithmeticFlagsLive() ? 2 : 1;
+
+  // Prefer dead registers, and fill in with registers that must be saved.
+  const assm::Register32* regs[2] = {};
+  bool saved[2] = {};
+  size_t count = 0;
+  for (size_t i = 0; i < assm::kRegister32Count && count < needed; ++i) {
+    const assm::Register32& reg = assm::kRegisters32[i];
+    if (reg.id() == assm::kRegisterEsp || reg.id() == assm::kRegisterEbp)
+      continue;
+    if (!state.IsLive(reg))
+      regs[count++] = &reg;
+  }
+  for (size_t i = 0; i < assm::kRegister32Count && count < needed; ++i) {
+    const assm::Register32& reg = assm::kRegisters32[i];
+    if (reg.id() == assm::kRegisterEsp || reg.id() == assm::kRegisterEbp)
+      continue;
+    if (count == 1 && regs[0] == &reg)
+      continue;
+    if (state.IsLive(reg)) {
+      saved[count] = true;
+      regs[count++] = &reg;
+    }
+  }
+  DCHECK_EQ(needed, count);
+
+  for (size_t i = 0; i < count; ++i) {
+    if (saved[i])
+      bb_asm->push(*regs[i]);
+  }
+
+  auto counter(Operand(*regs[0], Displacement(basic_block_id *
+                                              sizeof(uint32_t))));
+  bb_asm->mov(*regs[0], Operand(Displacement(frequency_data_block,
+                                             kFrequencyDataOffset)));
+  if (count == 1) {
+    bb_asm->add(counter, Immediate(1));
+  } else {
+    bb_asm->mov(*regs[1], counter);
+    bb_asm->lea(*regs[1], Operand(*regs[1], Displacement(1)));
+    bb_asm->mov(counter, *regs[1]);
+  }
+
+  for (size_t i = count; i > 0; --i) {
+    if (saved[i - 1])
+      bb_asm->pop(*regs[i - 1]);
+  }
+}
+
 void AddSuccessorBetween(Successor::Condition condition,
                          BasicCodeBlock* from,
                          BasicCodeBlock* to) {
@@ -206,8 +286,14 @@ bool BasicBlockEntryHookTransform::TransformBasicBlockSubGraph(
   DCHECK(bb_entry_hook_ref_.IsValid());
   DCHECK(add_frequency_data_.frequency_data_block() != NULL);
 
-  // Insert a call to the basic-block entry hook at the top of each code
-  // basic-block.
+  // The inlined counter increments use the registers and flags that are dead
+  // at the entry of the basic blocks.
+  LivenessAnalysis liveness;
+  if (set_inline_fast_path_)
+    liveness.Analyze(subgraph);
+
+  // Insert a call to the basic-block entry hook, or an inlined counter
+  // increment, at the top of each code basic-block.
   BasicBlockSubGraph::BBCollection::iterator it =
       subgraph->basic_blocks().begin();
   for (; it != subgraph->basic_blocks().end(); ++it) {
@@ -223,6 +309,20 @@ bool BasicBlockEntryHookTransform::TransformBasicBlockSubGraph(
       return false;
     }
 
+    // Assemble entry hook instrumentation into the instruction stream.
+    BasicBlockAssembler bb_asm(bb->instructions().begin(), &bb->instructions());
+
+    if (set_inline_fast_path_) {
+      LivenessAnalysis::State state;
+      liveness.GetStateAtEntryOf(bb, &state);
+      InjectCounterIncrement(state,
+                             add_frequency_data_.frequency_data_block(),
+                             bb_ranges_.size(),
+                             &bb_asm);
+      bb_ranges_.push_back(source_range);
+      continue;
+    }
+
     // We use the location/index in the bb_ranges vector of the current
     // basic-block range as the basic_block_id, and we pass a pointer to
     // the frequency data block as the module_data parameter. We then make
@@ -232,9 +332,6 @@ bool BasicBlockEntryHookTransform::TransformBasicBlockSubGraph(
     auto bb_entry_hook(Operand(Displacement(bb_entry_hook_ref_.referenced(),
                                             bb_entry_hook_ref_.offset())));
 
-    // Assemble entry hook instrumentation into the instruction stream.
-    BasicBlockAssembler bb_asm(bb->instructions().begin(), &bb->instructions());
-
     bb_asm.push(basic_block_id);
     bb_asm.push(module_data);
     bb_asm.call(bb_entry_hook);
@@ -72,11 +72,14 @@ class BasicBlockEntryHookTransform
   }
 
   // Returns a flag denoting whether or not the instrumented application should
-  // call the fast-path hook.
+  // increment the basic-block counters inline instead of calling the hook.
   bool inline_fast_path() { return set_inline_fast_path_; }
 
   // Set a flag denoting whether or not the instrumented application should
-  // call the fast-path hook.
+  // increment the basic-block counters inline instead of calling the hook.
+  // The inlined increments are not atomic, so concurrent executions of a basic
+  // block may lose counts. Non-decomposable blocks are still thunked to the
+  // hook.
   void set_inline_fast_path(bool value) {
     set_inline_fast_path_ = value;
   }
@@ -175,8 +178,8 @@ class BasicBlockEntryHookTransform
   // code; otherwise, the thunks will not have src ranges set.
   bool set_src_ranges_for_thunks_;
 
-  // If true, the instrumented application calls a fast injected hook before
-  // falling back to the hook in the agent.
+  // If true, the instrumented application increments the basic-block counters
+  // inline rather than calling the hook in the agent.
   bool set_inline_fast_path_;
 
   // The name of this transform.
@@ -162,14 +162,26 @@ void BasicBlockEntryHookTransformTest::CheckBasicBlockInstrumentation(
         BasicBlock::Instructions::const_iterator inst_iter =
             bb->instructions().begin();
 
-        // Instruction 1 should push the basic block id.
-        const Instruction& inst1 = *inst_iter;
-        EXPECT_EQ(I_PUSH, inst1.representation().opcode);
+        // Skip the registers that are saved.
+        while (inst_iter != bb->instructions().end() &&
+               inst_iter->representation().opcode == I_PUSH) {
+          ++inst_iter;
+        }
+        ASSERT_TRUE(inst_iter != bb->instructions().end());
 
-        // Instruction 2 should be a call to the fast bb entry hook.
-        const Instruction& inst2 = *(++inst_iter);
-        EXPECT_EQ(I_CALL, inst2.representation().opcode);
-        ASSERT_EQ(1U, inst2.references().size());
+        // The first instruction should load the frequency data pointer.
+        const Instruction& inst1 = *inst_iter;
+        EXPECT_EQ(I_MOV, inst1.representation().opcode);
+        ASSERT_EQ(1U, inst1.references().size());
+        EXPECT_EQ(tx_.frequency_data_block(),
+                  inst1.references().begin()->second.block());
+
+        // The counter is then updated, without calling the agent.
+        ASSERT_TRUE(++inst_iter != bb->instructions().end());
+        const Instruction& inst2 = *inst_iter;
+        EXPECT_TRUE(inst2.representation().opcode == I_ADD ||
+                    inst2.representation().opcode == I_MOV);
+        EXPECT_TRUE(inst2.references().empty());
       }
     }
     EXPECT_NE(0U, num_basic_blocks);
@@ -223,5 +235,27 @@ TEST_F(BasicBlockEntryHookTransformTest, ApplyAgentInstrumentation) {
   CheckBasicBlockInstrumentation(kAgentInstrumentation);
 }
 
+TEST_F(BasicBlockEntryHookTransformTest, ApplyFastPathInstrumentation) {
+  ASSERT_NO_FATAL_FAILURE(DecomposeTestDll());
+
+  // Apply the transform.
+  tx_.set_src_ranges_for_thunks(true);
+  tx_.set_inline_fast_path(true);
+  ASSERT_TRUE(block_graph::ApplyBlockGraphTransform(
+      &tx_, policy_, &block_graph_, header_block_));
+  ASSERT_TRUE(tx_.frequency_data_block() != NULL);
+  ASSERT_TRUE(tx_.thunk_section_ != NULL);
+  ASSERT_LT(0u, tx_.bb_ranges().size());
+
+  // The counters are 32-bit, as when calling the agent.
+  block_graph::ConstTypedBlock<IndexedFrequencyData> frequency_data;
+  ASSERT_TRUE(frequency_data.Init(0, tx_.frequency_data_block()));
+  EXPECT_EQ(tx_.bb_ranges().size(), frequency_data->num_entries);
+  EXPECT_EQ(sizeof(uint32_t), frequency_data->frequency_size);
+
+  // Validate that all basic block have been instrumented.
+  CheckBasicBlockInstrumentation(kFastPathInstrumentation);
+}
+
 }  // namespace transforms
 }  // namespace instrument
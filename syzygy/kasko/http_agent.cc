@@ -0,0 +1,49 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/kasko/http_agent.h"
+
+#include "base/logging.h"
+#include "syzygy/kasko/http_request_body.h"
+#include "syzygy/kasko/http_response.h"
+
+namespace kasko {
+
+std::unique_ptr<HttpResponse> HttpAgent::PostStream(
+    const base::string16& host,
+    uint16_t port,
+    const base::string16& path,
+    bool secure,
+    const base::string16& extra_headers,
+    HttpRequestBody* body) {
+  DCHECK(body);
+
+  std::string buffered_body(body->length(), '\0');
+  size_t offset = 0;
+  while (offset < buffered_body.size()) {
+    size_t count = buffered_body.size() - offset;
+    if (!body->ReadData(&buffered_body[offset], &count))
+      return std::unique_ptr<HttpResponse>();
+    if (count == 0) {
+      LOG(ERROR) << "Request body ended after " << offset << " of "
+                 << buffered_body.size() << " bytes.";
+      return std::unique_ptr<HttpResponse>();
+    }
+    offset += count;
+  }
+
+  return Post(host, port, path, secure, extra_headers, buffered_body);
+}
+
+}  // namespace kasko
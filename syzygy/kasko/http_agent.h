@@ -23,6 +23,7 @@
 
 namespace kasko {
 
+class HttpRequestBody;
 class HttpResponse;
 
 // Defines an interface for issuing HTTP requests.
@@ -47,6 +48,19 @@ class HttpAgent {
       bool secure,
       const base::string16& extra_headers,
       const std::string& body) = 0;
+
+  // Issues an HTTP POST request whose body is read incrementally from |body|.
+  // The default implementation reads the entire body into memory and invokes
+  // Post(); implementations should override it to send the body in bounded
+  // chunks. Parameters are as for Post().
+  // @param body The request body. Will be read from start to end.
+  virtual std::unique_ptr<HttpResponse> PostStream(
+      const base::string16& host,
+      uint16_t port,
+      const base::string16& path,
+      bool secure,
+      const base::string16& extra_headers,
+      HttpRequestBody* body);
 };
 
 }  // namespace kasko
@@ -17,8 +17,11 @@
 #include <windows.h>
 #include <winhttp.h>
 
+#include <algorithm>
+#include <limits>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "base/file_version_info.h"
 #include "base/logging.h"
@@ -28,6 +31,7 @@
 #include "base/win/scoped_handle.h"
 #include "base/win/windows_version.h"
 #include "syzygy/common/com_utils.h"
+#include "syzygy/kasko/http_request_body.h"
 #include "syzygy/kasko/http_response.h"
 #include "syzygy/kasko/internet_helpers.h"
 #include "syzygy/kasko/user_agent.h"
@@ -36,6 +40,32 @@ namespace kasko {
 
 namespace {
 
+// The maximum number of request body bytes handed to WinHTTP at once. Bounds
+// the memory used to send a request, regardless of the size of its body.
+const size_t kRequestChunkSize = 64 * 1024;
+
+// Implements HttpRequestBody for a body that is already held in memory.
+class StringRequestBody : public HttpRequestBody {
+ public:
+  explicit StringRequestBody(const std::string& body)
+      : body_(body), offset_(0) {}
+
+  // HttpRequestBody implementation.
+  size_t length() const override { return body_.size(); }
+  bool ReadData(char* buffer, size_t* count) override {
+    *count = std::min(*count, body_.size() - offset_);
+    body_.copy(buffer, *count, offset_);
+    offset_ += *count;
+    return true;
+  }
+
+ private:
+  const std::string& body_;
+  size_t offset_;
+
+  DISALLOW_COPY_AND_ASSIGN(StringRequestBody);
+};
+
 class WinHttpHandleTraits {
  public:
   typedef HINTERNET Handle;
@@ -211,7 +241,8 @@ class HttpResponseImpl : public HttpResponse {
 
   // Issues the request defined by its parameters and, if successful, returns an
   // HttpResponse that may be used to access the response. See HttpAgent::Post
-  // for a description of the parameters.
+  // for a description of the parameters. The body is sent in chunks of at most
+  // kRequestChunkSize bytes.
   static std::unique_ptr<HttpResponse> Create(
       const base::string16& user_agent,
       const base::string16& host,
@@ -219,7 +250,7 @@ class HttpResponseImpl : public HttpResponse {
       const base::string16& path,
       bool secure,
       const base::string16& extra_headers,
-      const std::string& body);
+      HttpRequestBody* body);
 
   // HttpResponse implementation.
   bool GetStatusCode(uint16_t* status_code) override;
@@ -260,7 +291,17 @@ std::unique_ptr<HttpResponse> HttpResponseImpl::Create(
     const base::string16& path,
     bool secure,
     const base::string16& extra_headers,
-    const std::string& body) {
+    HttpRequestBody* body) {
+  DCHECK(body);
+
+  // WinHttpSendRequest only accepts a 32-bit total length.
+  if (body->length() > std::numeric_limits<DWORD>::max()) {
+    LOG(ERROR) << "Request body of " << body->length()
+               << " bytes is too large.";
+    return std::unique_ptr<HttpResponse>();
+  }
+  DWORD total_length = static_cast<DWORD>(body->length());
+
   // Retrieve the user's proxy configuration.
   AutoWinHttpProxyConfig proxy_config;
   if (!proxy_config.Load())
@@ -330,17 +371,41 @@ std::unique_ptr<HttpResponse> HttpResponseImpl::Create(
     }
   }
 
-  // Send the request.
+  // Send the request headers, announcing the total length of the body.
   if (!::WinHttpSendRequest(instance->request_.Get(), extra_headers.c_str(),
-                            static_cast<DWORD>(-1),
-                            const_cast<char*>(body.data()),
-                            static_cast<DWORD>(body.size()),
-                            static_cast<DWORD>(body.size()), NULL)) {
+                            static_cast<DWORD>(-1), WINHTTP_NO_REQUEST_DATA, 0,
+                            total_length, NULL)) {
     LOG(ERROR) << "Failed to send HTTP request to host " << host << " and port "
                << port << ": " << ::common::LogWe();
     return std::unique_ptr<HttpResponse>();
   }
 
+  // Send the body, one bounded chunk at a time.
+  std::vector<char> chunk(std::min<size_t>(kRequestChunkSize, total_length));
+  DWORD bytes_sent = 0;
+  while (bytes_sent < total_length) {
+    size_t chunk_length = std::min<size_t>(chunk.size(),
+                                           total_length - bytes_sent);
+    if (!body->ReadData(chunk.data(), &chunk_length))
+      return std::unique_ptr<HttpResponse>();
+    if (chunk_length == 0) {
+      LOG(ERROR) << "Request body ended after " << bytes_sent << " of "
+                 << total_length << " bytes.";
+      return std::unique_ptr<HttpResponse>();
+    }
+
+    DWORD chunk_written = 0;
+    if (!::WinHttpWriteData(instance->request_.Get(), chunk.data(),
+                            static_cast<DWORD>(chunk_length), &chunk_written) ||
+        chunk_written != chunk_length) {
+      LOG(ERROR) << "Failed to send HTTP request body to host " << host
+                 << " and port " << port << " after " << bytes_sent
+                 << " bytes: " << ::common::LogWe();
+      return std::unique_ptr<HttpResponse>();
+    }
+    bytes_sent += chunk_written;
+  }
+
   // This seems to read at least all headers from the response. The remainder of
   // the body, if any, may be read during subsequent calls to WinHttpReadData().
   if (!::WinHttpReceiveResponse(instance->request_.Get(), 0)) {
@@ -510,6 +575,18 @@ std::unique_ptr<HttpResponse> HttpAgentImpl::Post(
     bool secure,
     const base::string16& extra_headers,
     const std::string& body) {
+  StringRequestBody string_body(body);
+  return HttpResponseImpl::Create(user_agent_, host, port, path, secure,
+                                  extra_headers, &string_body);
+}
+
+std::unique_ptr<HttpResponse> HttpAgentImpl::PostStream(
+    const base::string16& host,
+    uint16_t port,
+    const base::string16& path,
+    bool secure,
+    const base::string16& extra_headers,
+    HttpRequestBody* body) {
   return HttpResponseImpl::Create(user_agent_, host, port, path, secure,
                                   extra_headers, body);
 }
@@ -40,6 +40,13 @@ class HttpAgentImpl : public HttpAgent {
       bool secure,
       const base::string16& extra_headers,
       const std::string& body) override;
+  std::unique_ptr<HttpResponse> PostStream(
+      const base::string16& host,
+      uint16_t port,
+      const base::string16& path,
+      bool secure,
+      const base::string16& extra_headers,
+      HttpRequestBody* body) override;
 
  private:
   base::string16 user_agent_;
@@ -17,6 +17,9 @@
 #include <map>
 #include <string>
 
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
 #include "base/strings/string_number_conversions.h"
 #include "gtest/gtest.h"
 #include "syzygy/kasko/upload.h"
@@ -41,4 +44,48 @@ TEST(HttpAgentImplTest, SimpleUpload) {
   EXPECT_EQ(200, response_code);
 }
 
+TEST(HttpAgentImplTest, StreamingUpload) {
+  testing::TestServer server;
+  ASSERT_TRUE(server.Start());
+
+  // Use a file that spans several request chunks and does not end on a chunk
+  // boundary.
+  std::string file_contents;
+  for (size_t i = 0; file_contents.size() < 300 * 1024; ++i)
+    file_contents.append(base::SizeTToString(i)).append(1, '\0');
+
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  base::FilePath file_path = temp_dir.path().Append(L"upload.dmp");
+  ASSERT_EQ(static_cast<int>(file_contents.size()),
+            base::WriteFile(file_path, file_contents.data(),
+                            file_contents.size()));
+
+  // The test server stores uploads to /crash in its incoming directory rather
+  // than echoing them back.
+  base::string16 url =
+      L"http://localhost:" + base::UintToString16(server.port()) + L"/crash";
+  HttpAgentImpl agent_impl(L"test", L"0.0");
+  base::string16 response_body;
+  uint16_t response_code = 0;
+  std::map<base::string16, base::string16> parameters;
+  parameters[L"param"] = L"value";
+  ASSERT_TRUE(SendHttpUploadFromFile(&agent_impl, url, parameters, file_path,
+                                     L"file_name", &response_body,
+                                     &response_code));
+  EXPECT_EQ(200, response_code);
+  EXPECT_FALSE(response_body.empty());
+
+  base::FilePath report_directory =
+      server.incoming_directory().Append(response_body);
+  std::string uploaded_contents;
+  ASSERT_TRUE(base::ReadFileToString(report_directory.Append(L"file_name"),
+                                     &uploaded_contents));
+  EXPECT_EQ(file_contents, uploaded_contents);
+  std::string uploaded_parameter;
+  ASSERT_TRUE(base::ReadFileToString(report_directory.Append(L"param"),
+                                     &uploaded_parameter));
+  EXPECT_EQ("value", uploaded_parameter);
+}
+
 }  // namespace kasko
@@ -0,0 +1,43 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SYZYGY_KASKO_HTTP_REQUEST_BODY_H_
+#define SYZYGY_KASKO_HTTP_REQUEST_BODY_H_
+
+#include <stddef.h>
+
+namespace kasko {
+
+// Supplies the body of an HTTP request incrementally, allowing arbitrarily
+// large bodies to be sent without holding them in memory.
+class HttpRequestBody {
+ public:
+  virtual ~HttpRequestBody() {}
+
+  // @returns the total length of the body, in bytes. This must not change
+  //     while the body is being read.
+  virtual size_t length() const = 0;
+
+  // Reads the next portion of the body.
+  // @param buffer The location into which data will be read.
+  // @param count On invocation, the maximum length to read into buffer. Upon
+  //     successful return, the number of bytes read. Zero indicates that the
+  //     end of the body has been reached.
+  // @returns true if successful.
+  virtual bool ReadData(char* buffer, size_t* count) = 0;
+};
+
+}  // namespace kasko
+
+#endif  // SYZYGY_KASKO_HTTP_REQUEST_BODY_H_
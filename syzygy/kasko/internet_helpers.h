@@ -86,6 +86,26 @@ std::string GenerateMultipartHttpRequestBody(
     const base::string16& file_part_name,
     const base::string16& boundary);
 
+// Generates the portion of a multipart HTTP message body that precedes the
+// file contents. Concatenating the result, the file contents, and the result of
+// GenerateMultipartHttpRequestBodySuffix produces the same message as
+// GenerateMultipartHttpRequestBody.
+// @param parameters HTTP request parameters to be encoded in the body.
+// @param file_part_name The parameter name to be assigned to the file part.
+// @param boundary The MIME boundary to use.
+// @returns The leading portion of a multipart HTTP message body.
+std::string GenerateMultipartHttpRequestBodyPrefix(
+    const std::map<base::string16, base::string16>& parameters,
+    const base::string16& file_part_name,
+    const base::string16& boundary);
+
+// Generates the portion of a multipart HTTP message body that follows the file
+// contents. See GenerateMultipartHttpRequestBodyPrefix.
+// @param boundary The MIME boundary to use.
+// @returns The trailing portion of a multipart HTTP message body.
+std::string GenerateMultipartHttpRequestBodySuffix(
+    const base::string16& boundary);
+
 }  // namespace kasko
 
 #endif  // SYZYGY_KASKO_INTERNET_HELPERS_H_
@@ -225,4 +225,22 @@ TEST(InternetHelpersTest, GenerateMultipartHttpRequestBody) {
                                         base::WideToUTF8(file_part_name), body);
 }
 
+TEST(InternetHelpersTest, GenerateMultipartHttpRequestBodyPrefixAndSuffix) {
+  std::map<base::string16, base::string16> parameters;
+  parameters[L"param"] = L"value";
+  base::string16 boundary = GenerateMultipartHttpRequestBoundary();
+  std::string file = "file contents";
+  base::string16 file_part_name = L"file_name";
+
+  std::string body =
+      GenerateMultipartHttpRequestBodyPrefix(parameters, file_part_name,
+                                             boundary) +
+      file + GenerateMultipartHttpRequestBodySuffix(boundary);
+  EXPECT_EQ(GenerateMultipartHttpRequestBody(parameters, file, file_part_name,
+                                             boundary),
+            body);
+  ExpectMultipartMimeMessageIsPlausible(boundary, parameters, file,
+                                        base::WideToUTF8(file_part_name), body);
+}
+
 }  // namespace kasko
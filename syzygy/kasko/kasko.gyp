@@ -96,9 +96,11 @@
         'crash_keys_serialization.h',
         'dll_lifetime.cc',
         'dll_lifetime.h',
+        'http_agent.cc',
         'http_agent.h',
         'http_agent_impl.cc',
         'http_agent_impl.h',
+        'http_request_body.h',
         'http_response.h',
         'internet_helpers.cc',
         'internet_helpers.h',
@@ -41,6 +41,12 @@
 // upload, those in "Retry" and "Retry 2" are eligible when their last-modified
 // date is older than the configured retry interval.
 //
+// Each upload attempt indexes the repository with a single enumeration of each
+// subdirectory, and may upload a batch of reports from that index. Uploads in
+// a batch may run concurrently, but reports are only ever moved or deleted by
+// the thread that started the batch. The repository may be shared with other
+// processes storing reports, so the index is not persisted.
+//
 // Orphaned report files (minidumps without crash keys and vice-versa) may be
 // detected during upload attempts. When receiving new minidumps, we first write
 // the crash keys to "Incoming" before moving the minidump file in. As a result,
@@ -51,9 +57,15 @@
 
 #include "syzygy/kasko/report_repository.h"
 
+#include <algorithm>
+#include <memory>
+#include <utility>
+
 #include "base/logging.h"
 #include "base/files/file_enumerator.h"
 #include "base/files/file_util.h"
+#include "base/threading/simple_thread.h"
+#include "syzygy/common/thread_pool_util.h"
 #include "syzygy/kasko/crash_keys_serialization.h"
 
 namespace kasko {
@@ -154,79 +166,99 @@ base::FilePath GetDumpFileForCrashKeysFile(
   return crash_keys_path.ReplaceExtension(kDumpFileExtension);
 }
 
-// Returns a minidump that is eligible for upload from the given directory, if
-// any are.
+// A report that is eligible for upload, as a pair of minidump path and
+// failure destination (empty if the next failure is permanent).
+typedef std::pair<base::FilePath, base::FilePath> PendingReport;
+
+// Indexes the reports in a directory with a single enumeration, appending
+// those that are eligible for upload to |pending_reports|. Orphaned minidump
+// files are deleted immediately, and orphaned crash keys files once they are
+// more than a day old.
 // @param directory The directory to scan.
-// @param maximum_timestamp_for_retries The cutoff for the most most recent
-//     upload attempt of eligible minidumps. If null, there is no cutoff.
-// @returns The path to a minidump that is eligible for upload, if any.
-base::FilePath GetPendingReportFromDirectory(
-    const base::FilePath& directory,
-    const base::Time& maximum_timestamp_for_retries) {
-  base::FileEnumerator file_enumerator(
-      directory, false, base::FileEnumerator::FILES,
-      base::string16(L"*") + kDumpFileExtension);
-  // Visit all files in this directory until we find an eligible one.
+// @param now The current time.
+// @param maximum_timestamp_for_retries The cutoff for the most recent upload
+//     attempt of eligible minidumps. If null, there is no cutoff.
+// @param failure_destination The directory where reports are moved after a
+//     failed upload attempt (empty if the next failure is permanent).
+// @param pending_reports Receives the eligible reports.
+void IndexDirectory(const base::FilePath& directory,
+                    const base::Time& now,
+                    const base::Time& maximum_timestamp_for_retries,
+                    const base::FilePath& failure_destination,
+                    std::vector<PendingReport>* pending_reports) {
+  DCHECK(pending_reports);
+
+  // Report files keyed by their path without extension, along with their
+  // last-modified time.
+  typedef std::map<base::FilePath, std::pair<base::FilePath, base::Time>>
+      ReportFiles;
+  ReportFiles minidumps;
+  ReportFiles crash_keys;
+
+  base::FileEnumerator file_enumerator(directory, false,
+                                       base::FileEnumerator::FILES);
   for (base::FilePath candidate = file_enumerator.Next(); !candidate.empty();
        candidate = file_enumerator.Next()) {
+    ReportFiles* files = nullptr;
+    if (base::FilePath::CompareEqualIgnoreCase(candidate.Extension(),
+                                               kDumpFileExtension)) {
+      files = &minidumps;
+    } else if (base::FilePath::CompareEqualIgnoreCase(
+                   candidate.Extension(), kCrashKeysFileExtension)) {
+      files = &crash_keys;
+    } else {
+      continue;
+    }
+    (*files)[candidate.RemoveExtension()] = std::make_pair(
+        candidate, file_enumerator.GetInfo().GetLastModifiedTime());
+  }
+
+  // We write crash keys files before moving dump files, so there is a brief
+  // period where an orphan might be expected. Only delete orphans that are
+  // more than a day old.
+  base::Time one_day_ago(now - base::TimeDelta::FromDays(1));
+  for (const auto& entry : crash_keys) {
+    if (minidumps.count(entry.first) != 0)
+      continue;
+    if (entry.second.second >= one_day_ago)
+      continue;
+
+    LOG(ERROR) << "Deleting a crash keys file with missing minidump: "
+               << entry.second.first.value();
+    LoggedDeleteFile(entry.second.first);
+  }
+
+  for (const auto& entry : minidumps) {
     // Skip dumps with missing crash keys.
-    if (!base::PathExists(GetCrashKeysFileForDumpFile(candidate))) {
+    if (crash_keys.count(entry.first) == 0) {
       LOG(ERROR) << "Deleting a minidump file with missing crash keys: "
-                 << candidate.value();
-      LoggedDeleteFile(candidate);
+                 << entry.second.first.value();
+      LoggedDeleteFile(entry.second.first);
       continue;
     }
-    if (maximum_timestamp_for_retries.is_null())
-      return candidate;
 
     // Check if this file is eligible for retry.
-    base::FileEnumerator::FileInfo file_info = file_enumerator.GetInfo();
-    if (file_info.GetLastModifiedTime() <= maximum_timestamp_for_retries)
-      return candidate;
-  }
-  return base::FilePath();
-}
-
-void CleanOrphanedCrashKeysFiles(
-    const base::FilePath& repository_path,
-    const base::Time& now) {
-  base::Time one_day_ago(now - base::TimeDelta::FromDays(1));
-  const base::char16* subdirs[] = {
-      kIncomingReportsSubdir, kFailedOnceSubdir, kFailedTwiceSubdir};
-
-  for (size_t i = 0; i < arraysize(subdirs); ++i) {
-    base::FileEnumerator file_enumerator(
-        repository_path.Append(subdirs[i]), false, base::FileEnumerator::FILES,
-        base::string16(L"*") + kCrashKeysFileExtension);
-    for (base::FilePath candidate = file_enumerator.Next(); !candidate.empty();
-         candidate = file_enumerator.Next()) {
-      if (base::PathExists(GetDumpFileForCrashKeysFile(candidate)))
-        continue;
-
-      // We write crash keys files before moving dump files, so there is a brief
-      // period where an orphan might be expected. Only delete orphans that are
-      // more than a day old.
-      if (file_enumerator.GetInfo().GetLastModifiedTime() >= one_day_ago)
-        continue;
-
-      LOG(ERROR) << "Deleting a crash keys file with missing minidump: "
-                 << candidate.value();
-      LoggedDeleteFile(candidate);
+    if (maximum_timestamp_for_retries.is_null() ||
+        entry.second.second <= maximum_timestamp_for_retries) {
+      pending_reports->push_back(
+          std::make_pair(entry.second.first, failure_destination));
     }
   }
 }
 
-// Returns a minidump that is eligible for upload, if any are.
+// Indexes the reports that are eligible for upload, in the order in which
+// they should be attempted.
 // @param repository_path The directory where this repository stores reports.
 // @param now The current time.
 // @param retry_interval The minimum interval between upload attempts for a
 //     given report.
-// @returns A pair of mindump path (empty if none) and failure destination
-//     (empty if the next failure is permanent).
-std::pair<base::FilePath, base::FilePath> GetPendingReport(
-    const base::FilePath& repository_path,
-    const base::Time& now,
-    const base::TimeDelta& retry_interval) {
+// @param pending_reports Receives the eligible reports.
+void GetPendingReports(const base::FilePath& repository_path,
+                       const base::Time& now,
+                       const base::TimeDelta& retry_interval,
+                       std::vector<PendingReport>* pending_reports) {
+  DCHECK(pending_reports);
+
   struct {
     const base::char16* subdir;
     const base::char16* failure_subdir;
@@ -237,17 +269,14 @@ std::pair<base::FilePath, base::FilePath> GetPendingReport(
       {kFailedTwiceSubdir, nullptr, now - retry_interval}};
 
   for (size_t i = 0; i < arraysize(directories); ++i) {
-    base::FilePath result = GetPendingReportFromDirectory(
-        repository_path.Append(directories[i].subdir),
-        directories[i].retry_cutoff);
-    if (!result.empty()) {
-      if (!directories[i].failure_subdir)
-        return std::make_pair(result, base::FilePath());
-      return std::make_pair(
-          result, repository_path.Append(directories[i].failure_subdir));
-    }
+    base::FilePath failure_destination;
+    if (directories[i].failure_subdir)
+      failure_destination = repository_path.Append(
+          directories[i].failure_subdir);
+    IndexDirectory(repository_path.Append(directories[i].subdir), now,
+                   directories[i].retry_cutoff, failure_destination,
+                   pending_reports);
   }
-  return std::pair<base::FilePath, base::FilePath>();
 }
 
 // Handles a non-permanent failure by moving the report files to a new queue.
@@ -292,6 +321,116 @@ void HandlePermanentFailure(const base::FilePath& minidump_path,
     LoggedDeleteFile(crash_keys_path);
 }
 
+// Computes the duplicate signature of a report.
+// @param signature_keys The names of the crash keys making up the signature.
+// @param crash_keys The crash keys of the report.
+// @returns the signature, or an empty string if the report has none.
+base::string16 GetDuplicateSignature(
+    const std::vector<base::string16>& signature_keys,
+    const std::map<base::string16, base::string16>& crash_keys) {
+  base::string16 signature;
+  for (const auto& key : signature_keys) {
+    auto it = crash_keys.find(key);
+    if (it == crash_keys.end())
+      return base::string16();
+    signature.append(key);
+    signature.push_back(L'=');
+    signature.append(it->second);
+    signature.push_back(L'\0');
+  }
+  return signature;
+}
+
+// An upload attempt for a single report in a batch. The report files are owned
+// by this object, and deleted when it is destroyed unless they have been moved
+// by HandleFailure.
+class ReportUpload : public base::DelegateSimpleThread::Delegate {
+ public:
+  // @param report The report to upload.
+  // @param uploader The uploader to use.
+  ReportUpload(const PendingReport& report,
+               const ReportRepository::Uploader* uploader)
+      : minidump_file_(report.first),
+        crash_keys_file_(GetCrashKeysFileForDumpFile(report.first)),
+        failure_destination_(report.second),
+        uploader_(uploader),
+        has_crash_keys_(false),
+        duplicate_of_(nullptr),
+        succeeded_(false) {
+    DCHECK(uploader);
+  }
+
+  // Renews the report file timestamps and reads the crash keys. If we are
+  // unable to renew the timestamps, no upload attempt should be made (since
+  // that would potentially lead to a hot loop of upload attempts).
+  // @param now The current time.
+  // @returns true if an upload attempt may be made.
+  bool Prepare(const base::Time& now) {
+    if (!minidump_file_.UpdateTimestamp(now) ||
+        !crash_keys_file_.UpdateTimestamp(now)) {
+      return false;
+    }
+    has_crash_keys_ = ReadCrashKeysFromFile(crash_keys_file_.Get(),
+                                            &crash_keys_);
+    return true;
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  void Run() override {
+    DCHECK(has_crash_keys_);
+    DCHECK(!duplicate_of_);
+    succeeded_ = uploader_->Run(minidump_file_.Get(), crash_keys_);
+  }
+  // @}
+
+  // Moves the report to its failure destination, or hands it to
+  // @p permanent_failure_handler if the failure is permanent.
+  void HandleFailure(const ReportRepository::PermanentFailureHandler&
+                         permanent_failure_handler) {
+    if (!failure_destination_.empty()) {
+      HandleNonpermanentFailure(&minidump_file_, &crash_keys_file_,
+                                failure_destination_);
+    } else {
+      HandlePermanentFailure(minidump_file_.Take(), crash_keys_file_.Take(),
+                             permanent_failure_handler);
+    }
+  }
+
+  // @returns true if the report was uploaded, either by this attempt or by
+  //     the one it was coalesced with.
+  bool succeeded() const {
+    if (duplicate_of_)
+      return duplicate_of_->succeeded();
+    return succeeded_;
+  }
+
+  // @returns true if this report should be uploaded by this attempt.
+  bool needs_upload() const { return has_crash_keys_ && !duplicate_of_; }
+
+  // Coalesces this report with another one, having the same signature.
+  // @param upload The attempt that uploads the other report.
+  void set_duplicate_of(const ReportUpload* upload) { duplicate_of_ = upload; }
+
+  // @returns the crash keys of the report, if they were read.
+  bool has_crash_keys() const { return has_crash_keys_; }
+  const std::map<base::string16, base::string16>& crash_keys() const {
+    return crash_keys_;
+  }
+
+ private:
+  ScopedReportFile minidump_file_;
+  ScopedReportFile crash_keys_file_;
+  base::FilePath failure_destination_;
+  const ReportRepository::Uploader* uploader_;
+  bool has_crash_keys_;
+  std::map<base::string16, base::string16> crash_keys_;
+  const ReportUpload* duplicate_of_;
+  bool succeeded_;
+
+  DISALLOW_COPY_AND_ASSIGN(ReportUpload);
+};
+
 }  // namespace
 
 ReportRepository::ReportRepository(
@@ -304,7 +443,8 @@ ReportRepository::ReportRepository(
       retry_interval_(retry_interval),
       time_source_(time_source),
       uploader_(uploader),
-      permanent_failure_handler_(permanent_failure_handler) {
+      permanent_failure_handler_(permanent_failure_handler),
+      upload_concurrency_(1) {
 }
 
 ReportRepository::~ReportRepository() {
@@ -345,51 +485,83 @@ void ReportRepository::StoreReport(
 }
 
 bool ReportRepository::UploadPendingReport() {
-  base::Time now = time_source_.Run();
+  return UploadPendingReports(1);
+}
 
-  // Do a bit of opportunistic cleanup.
-  CleanOrphanedCrashKeysFiles(repository_path_, now);
+bool ReportRepository::UploadPendingReports(size_t max_reports) {
+  base::Time now = time_source_.Run();
 
-  std::pair<base::FilePath, base::FilePath> entry =
-      GetPendingReport(repository_path_, now, retry_interval_);
-  ScopedReportFile minidump_file(entry.first);
-  base::FilePath failure_destination = entry.second;
+  // Index the repository once for the whole batch. This also does a bit of
+  // opportunistic cleanup.
+  std::vector<PendingReport> pending_reports;
+  GetPendingReports(repository_path_, now, retry_interval_, &pending_reports);
+  if (pending_reports.size() > max_reports)
+    pending_reports.resize(max_reports);
 
-  if (minidump_file.Get().empty())
+  if (pending_reports.empty())
     return true;  // Successful no-op.
 
-  ScopedReportFile crash_keys_file(
-      GetCrashKeysFileForDumpFile(minidump_file.Get()));
-
-  // Renew the file timestamps before attempting upload. If we are unable to do
-  // this, make no upload attempt (since that would potentially lead to a hot
-  // loop of upload attempts).
-  if (minidump_file.UpdateTimestamp(now)) {
-    if (crash_keys_file.UpdateTimestamp(now)) {
-      // Attempt the upload.
-      std::map<base::string16, base::string16> crash_keys;
-      if (ReadCrashKeysFromFile(crash_keys_file.Get(), &crash_keys)) {
-        if (uploader_.Run(minidump_file.Get(), crash_keys))
-          return true;
-      }
+  // Prepare the upload attempts, coalescing the duplicate reports. The
+  // reports whose timestamps can't be renewed are discarded.
+  bool succeeded = true;
+  std::vector<std::unique_ptr<ReportUpload>> uploads;
+  std::map<base::string16, const ReportUpload*> uploads_by_signature;
+  for (const auto& pending_report : pending_reports) {
+    std::unique_ptr<ReportUpload> upload(
+        new ReportUpload(pending_report, &uploader_));
+    if (!upload->Prepare(now)) {
+      succeeded = false;
+      continue;
+    }
 
-      // We failed.
-      if (!failure_destination.empty()) {
-        HandleNonpermanentFailure(&minidump_file, &crash_keys_file,
-                                  failure_destination);
-      } else {
-        HandlePermanentFailure(minidump_file.Take(), crash_keys_file.Take(),
-                               permanent_failure_handler_);
+    if (upload->has_crash_keys()) {
+      base::string16 signature =
+          GetDuplicateSignature(duplicate_signature_keys_,
+                                upload->crash_keys());
+      if (!signature.empty()) {
+        auto result = uploads_by_signature.insert(
+            std::make_pair(signature, upload.get()));
+        if (!result.second)
+          upload->set_duplicate_of(result.first->second);
       }
     }
+
+    uploads.push_back(std::move(upload));
+  }
+
+  // Upload the reports. When running with a single upload at a time this is
+  // done on the current thread.
+  std::vector<ReportUpload*> attempts;
+  for (const auto& upload : uploads) {
+    if (upload->needs_upload())
+      attempts.push_back(upload.get());
+  }
+  common::RunDelegatesOnThreadPool("ReportRepository", upload_concurrency_,
+                                   attempts);
+
+  // Handle the failures. The files of the uploaded reports are deleted along
+  // with |uploads|.
+  size_t coalesced = 0;
+  for (const auto& upload : uploads) {
+    if (upload->succeeded()) {
+      if (!upload->needs_upload())
+        ++coalesced;
+      continue;
+    }
+    succeeded = false;
+    upload->HandleFailure(permanent_failure_handler_);
   }
+  LOG_IF(INFO, coalesced > 0) << "Coalesced " << coalesced
+                              << " duplicate report(s).";
 
-  return false;
+  return succeeded;
 }
 
 bool ReportRepository::HasPendingReports() {
-  return !GetPendingReport(repository_path_, time_source_.Run(),
-                           retry_interval_).first.empty();
+  std::vector<PendingReport> pending_reports;
+  GetPendingReports(repository_path_, time_source_.Run(), retry_interval_,
+                    &pending_reports);
+  return !pending_reports.empty();
 }
 
 }  // namespace kasko
@@ -16,6 +16,7 @@
 #define SYZYGY_KASKO_REPORT_REPOSITORY_H_
 
 #include <map>
+#include <vector>
 #include "base/callback.h"
 #include "base/macros.h"
 #include "base/files/file_path.h"
@@ -30,12 +31,13 @@ namespace kasko {
 //
 // Any number of ReportRepository instances may be used to store reports (via
 // StoreReport). Only a single instance should be used for uploading (via
-// UploadPendingReport). It's the client's responsibility to enforce this
-// requirement.
+// UploadPendingReport or UploadPendingReports). It's the client's
+// responsibility to enforce this requirement.
 class ReportRepository {
  public:
   // Attempts to upload the minidump at the specified file path with the given
-  // crash keys. Returns true if successful.
+  // crash keys. Returns true if successful. If the upload concurrency is
+  // greater than one this may be invoked concurrently from several threads.
   typedef base::Callback<bool(
       const base::FilePath&,
       const std::map<base::string16, base::string16>&)> Uploader;
@@ -81,15 +83,51 @@ class ReportRepository {
   //     uploaded.
   bool UploadPendingReport();
 
+  // Attempts to upload a batch of pending reports, in the order in which
+  // successive calls to UploadPendingReport would. The repository is indexed
+  // once for the whole batch, and up to upload_concurrency() uploads are in
+  // flight at any time. Pending reports having the same duplicate signature
+  // are coalesced: only the first of them is uploaded, and the others share
+  // its outcome.
+  // @param max_reports The maximum number of reports to attempt to upload.
+  // @returns true if there are no pending reports or all of the attempted
+  //     reports were successfully uploaded.
+  bool UploadPendingReports(size_t max_reports);
+
   // @returns true if UploadPendingReport would attempt to upload a report.
   bool HasPendingReports();
 
+  // @name Accessors.
+  // @{
+  size_t upload_concurrency() const { return upload_concurrency_; }
+  const std::vector<base::string16>& duplicate_signature_keys() const {
+    return duplicate_signature_keys_;
+  }
+  // @}
+
+  // Sets the maximum number of concurrent uploads performed by
+  // UploadPendingReports. Defaults to 1.
+  // @param upload_concurrency The maximum number of concurrent uploads.
+  void set_upload_concurrency(size_t upload_concurrency) {
+    upload_concurrency_ = upload_concurrency;
+  }
+
+  // Sets the names of the crash keys making up the duplicate signature of a
+  // report. Reports missing any of these keys are never coalesced. Empty by
+  // default, which disables coalescing.
+  // @param keys The names of the crash keys making up the signature.
+  void set_duplicate_signature_keys(const std::vector<base::string16>& keys) {
+    duplicate_signature_keys_ = keys;
+  }
+
  private:
   base::FilePath repository_path_;
   base::TimeDelta retry_interval_;
   TimeSource time_source_;
   Uploader uploader_;
   PermanentFailureHandler permanent_failure_handler_;
+  size_t upload_concurrency_;
+  std::vector<base::string16> duplicate_signature_keys_;
 
   DISALLOW_COPY_AND_ASSIGN(ReportRepository);
 };
@@ -15,7 +15,9 @@
 #include "syzygy/kasko/report_repository.h"
 
 #include <algorithm>
+#include <cstring>
 #include <map>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
@@ -29,9 +31,14 @@
 #include "base/strings/string16.h"
 #include "base/strings/string_number_conversions.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/synchronization/lock.h"
+#include "base/threading/platform_thread.h"
 #include "base/time/time.h"
 #include "gtest/gtest.h"
 #include "syzygy/kasko/crash_keys_serialization.h"
+#include "syzygy/kasko/http_agent.h"
+#include "syzygy/kasko/http_response.h"
+#include "syzygy/kasko/upload.h"
 
 namespace kasko {
 
@@ -55,7 +62,10 @@ class ReportRepositoryTest : public testing::Test {
   // The mock time must not start at 0, as we cannot update a file timestamp to
   // that value.
   ReportRepositoryTest()
-      : remainder_expected_(false), time_(base::Time::Now()) {}
+      : concurrent_uploads_(0),
+        max_concurrent_uploads_(0),
+        remainder_expected_(false),
+        time_(base::Time::Now()) {}
 
  protected:
   typedef std::pair<std::string, std::map<base::string16, base::string16>>
@@ -148,6 +158,26 @@ class ReportRepositoryTest : public testing::Test {
     StoreReport(report);
   }
 
+  // Creates a report with the given duplicate signature. Such reports always
+  // succeed, and the number of uploads for each signature is recorded.
+  void InjectWithSignature(const base::string16& signature) {
+    Report report = GenerateReport();
+    report.second[kSignatureKey] = signature;
+    StoreReport(report);
+  }
+
+  // @returns the number of reports with the given signature that were
+  //     uploaded.
+  size_t GetUploadCount(const base::string16& signature) {
+    return upload_counts_[signature];
+  }
+
+  // @returns the greatest number of concurrent upload attempts observed.
+  size_t max_concurrent_uploads() const { return max_concurrent_uploads_; }
+
+  // The crash key holding the duplicate signature of reports.
+  static const base::char16 kSignatureKey[];
+
   // Returns the instance under test.
   ReportRepository* repository() { return repository_.get(); }
 
@@ -184,9 +214,21 @@ class ReportRepositoryTest : public testing::Test {
     return report;
   }
 
-  // Implements the UploadHandler.
+  // Implements the UploadHandler. This may be invoked concurrently.
   bool Upload(const base::FilePath& minidump_path,
               const std::map<base::string16, base::string16>& crash_keys) {
+    {
+      base::AutoLock auto_lock(lock_);
+      ++concurrent_uploads_;
+      max_concurrent_uploads_ =
+          std::max(max_concurrent_uploads_, concurrent_uploads_);
+    }
+    // Give the other upload attempts a chance to overlap with this one.
+    base::PlatformThread::Sleep(base::TimeDelta::FromMilliseconds(10));
+
+    base::AutoLock auto_lock(lock_);
+    --concurrent_uploads_;
+
     Report report;
     bool success = base::ReadFileToString(minidump_path, &report.first);
     EXPECT_TRUE(success);
@@ -195,6 +237,12 @@ class ReportRepositoryTest : public testing::Test {
 
     report.second = crash_keys;
 
+    auto signature = crash_keys.find(kSignatureKey);
+    if (signature != crash_keys.end()) {
+      ++upload_counts_[signature->second];
+      return true;
+    }
+
     // Check to see if this report is destined to eventually succeed. If it's in
     // successful_reports_[0] it succeeds this round. If it's in [1] or higher
     // it will fail this round but be advanced to a lower index to eventually
@@ -250,6 +298,18 @@ class ReportRepositoryTest : public testing::Test {
     }
   }
 
+  // Protects the expectations and counters below, as reports may be uploaded
+  // concurrently.
+  base::Lock lock_;
+
+  // The number of upload attempts in progress, and the greatest number
+  // observed.
+  size_t concurrent_uploads_;
+  size_t max_concurrent_uploads_;
+
+  // The number of uploaded reports by duplicate signature.
+  std::map<base::string16, size_t> upload_counts_;
+
   // If true, exactly one report should never have been sent (because we
   // corrupted it).
   bool remainder_expected_;
@@ -279,6 +339,99 @@ class ReportRepositoryTest : public testing::Test {
 const uint16_t ReportRepositoryTest::kHalfRetryIntervalInSeconds = 10;
 const uint16_t ReportRepositoryTest::kRetryIntervalInSeconds =
     ReportRepositoryTest::kHalfRetryIntervalInSeconds * 2;
+const base::char16 ReportRepositoryTest::kSignatureKey[] = L"signature";
+
+// A local stand-in for an HTTP server, which accepts every upload and
+// responds with a report ID. Requests may be issued concurrently.
+class StandInHttpAgent : public HttpAgent {
+ public:
+  StandInHttpAgent() : request_count_(0) {}
+
+  // HttpAgent implementation.
+  std::unique_ptr<HttpResponse> Post(const base::string16& host,
+                                     uint16_t port,
+                                     const base::string16& path,
+                                     bool secure,
+                                     const base::string16& extra_headers,
+                                     const std::string& body) override {
+    EXPECT_EQ(L"localhost", host);
+    EXPECT_EQ(L"/crash", path);
+    EXPECT_FALSE(body.empty());
+    base::AutoLock auto_lock(lock_);
+    ++request_count_;
+    return std::unique_ptr<HttpResponse>(new Response());
+  }
+
+  size_t request_count() {
+    base::AutoLock auto_lock(lock_);
+    return request_count_;
+  }
+
+ private:
+  // A successful response with a plain text report ID.
+  class Response : public HttpResponse {
+   public:
+    Response() : data_("report_id") {}
+
+    // HttpResponse implementation.
+    bool GetStatusCode(uint16_t* status_code) override {
+      *status_code = 200;
+      return true;
+    }
+    bool GetContentLength(bool* has_content_length,
+                          size_t* content_length) override {
+      *has_content_length = false;
+      return true;
+    }
+    bool GetContentType(bool* has_content_type,
+                        base::string16* content_type) override {
+      *has_content_type = false;
+      return true;
+    }
+    bool HasData(bool* has_data) override {
+      *has_data = !data_.empty();
+      return true;
+    }
+    bool ReadData(char* buffer, size_t* count) override {
+      *count = std::min(*count, data_.length());
+      ::memcpy(buffer, data_.data(), *count);
+      data_.erase(0, *count);
+      return true;
+    }
+
+   private:
+    std::string data_;
+
+    DISALLOW_COPY_AND_ASSIGN(Response);
+  };
+
+  base::Lock lock_;
+  size_t request_count_;
+
+  DISALLOW_COPY_AND_ASSIGN(StandInHttpAgent);
+};
+
+// Uploads a report through |agent|.
+bool UploadThroughAgent(
+    StandInHttpAgent* agent,
+    const base::FilePath& minidump_path,
+    const std::map<base::string16, base::string16>& crash_keys) {
+  std::string dump_contents;
+  if (!base::ReadFileToString(minidump_path, &dump_contents))
+    return false;
+  base::string16 report_id;
+  uint16_t response_code = 0;
+  return SendHttpUpload(agent, L"http://localhost:8080/crash", crash_keys,
+                        dump_contents, L"upload_file_minidump", &report_id,
+                        &response_code) &&
+         report_id == L"report_id";
+}
+
+// A PermanentFailureHandler that expects never to be invoked.
+void UnexpectedPermanentFailure(const base::FilePath& minidump_path,
+                                const base::FilePath& crash_keys_path) {
+  ADD_FAILURE() << "Unexpected permanent failure: " << minidump_path.value();
+}
 
 }  // namespace
 
@@ -508,4 +661,100 @@ TEST_F(ReportRepositoryTest, CorruptionTest) {
   }
 }
 
+TEST_F(ReportRepositoryTest, BatchTest) {
+  EXPECT_FALSE(repository()->HasPendingReports());
+
+  InjectForSuccessAfterRetries(0);
+  InjectForSuccessAfterRetries(0);
+  InjectForSuccessAfterRetries(0);
+
+  // Batches are limited to the requested size.
+  EXPECT_TRUE(repository()->UploadPendingReports(2));  // Succeeds
+  EXPECT_TRUE(repository()->HasPendingReports());
+  EXPECT_TRUE(repository()->UploadPendingReports(2));  // Succeeds
+  EXPECT_FALSE(repository()->HasPendingReports());
+  EXPECT_TRUE(repository()->UploadPendingReports(2));  // No-op
+}
+
+TEST_F(ReportRepositoryTest, ConcurrentBatchTestWithFailures) {
+  repository()->set_upload_concurrency(4);
+
+  for (size_t i = 0; i < 8; ++i)
+    InjectForSuccessAfterRetries(0);
+  InjectForSuccessAfterRetries(1);
+  InjectForFailure();
+
+  // A single failure fails the batch.
+  EXPECT_FALSE(repository()->UploadPendingReports(100));
+  EXPECT_FALSE(repository()->HasPendingReports());
+  EXPECT_LT(1u, max_concurrent_uploads());
+  EXPECT_GE(4u, max_concurrent_uploads());
+
+  IncrementTime(base::TimeDelta::FromSeconds(kRetryIntervalInSeconds));
+  EXPECT_FALSE(repository()->UploadPendingReports(100));  // 1 fails.
+  IncrementTime(base::TimeDelta::FromSeconds(kRetryIntervalInSeconds));
+  EXPECT_FALSE(repository()->UploadPendingReports(100));  // Permanent.
+  EXPECT_FALSE(repository()->HasPendingReports());
+}
+
+TEST_F(ReportRepositoryTest, CoalesceDuplicatesTest) {
+  repository()->set_duplicate_signature_keys(
+      std::vector<base::string16>(1, kSignatureKey));
+
+  InjectWithSignature(L"foo");
+  InjectWithSignature(L"foo");
+  InjectWithSignature(L"foo");
+  InjectWithSignature(L"bar");
+  InjectForSuccessAfterRetries(0);
+
+  // A single report is uploaded for each signature. The duplicates are
+  // dropped along with it.
+  EXPECT_TRUE(repository()->UploadPendingReports(100));
+  EXPECT_FALSE(repository()->HasPendingReports());
+  EXPECT_EQ(1u, GetUploadCount(L"foo"));
+  EXPECT_EQ(1u, GetUploadCount(L"bar"));
+
+  // Without coalescing, every report is uploaded.
+  repository()->set_duplicate_signature_keys(std::vector<base::string16>());
+  InjectWithSignature(L"baz");
+  InjectWithSignature(L"baz");
+  EXPECT_TRUE(repository()->UploadPendingReports(100));
+  EXPECT_EQ(2u, GetUploadCount(L"baz"));
+}
+
+TEST(ReportRepositoryHttpTest, ConcurrentUploadsThroughHttpAgent) {
+  base::ScopedTempDir repository_temp_dir;
+  ASSERT_TRUE(repository_temp_dir.CreateUniqueTempDir());
+  StandInHttpAgent agent;
+  ReportRepository repository(
+      repository_temp_dir.path(), base::TimeDelta::FromSeconds(1),
+      base::Bind(&base::Time::Now),
+      base::Bind(&UploadThroughAgent, base::Unretained(&agent)),
+      base::Bind(&UnexpectedPermanentFailure));
+  repository.set_upload_concurrency(8);
+
+  const size_t kReportCount = 50;
+  for (size_t i = 0; i < kReportCount; ++i) {
+    base::FilePath minidump_file;
+    ASSERT_TRUE(base::CreateTemporaryFileInDir(repository_temp_dir.path(),
+                                               &minidump_file));
+    std::string contents = base::SizeTToString(i);
+    ASSERT_TRUE(
+        base::WriteFile(minidump_file, contents.data(), contents.length()));
+    std::map<base::string16, base::string16> crash_keys;
+    crash_keys[L"id"] = base::SizeTToString16(i);
+    repository.StoreReport(minidump_file, crash_keys);
+  }
+
+  EXPECT_TRUE(repository.HasPendingReports());
+  EXPECT_TRUE(repository.UploadPendingReports(kReportCount));
+  EXPECT_FALSE(repository.HasPendingReports());
+  EXPECT_EQ(kReportCount, agent.request_count());
+
+  // Nothing is left behind.
+  EXPECT_EQ(base::FilePath(),
+            base::FileEnumerator(repository_temp_dir.path(), true,
+                                 base::FileEnumerator::FILES).Next());
+}
+
 }  // namespace kasko
@@ -26,8 +26,10 @@
 #include "base/logging.h"
 #include "base/files/file_util.h"
 #include "base/memory/ptr_util.h"
+#include "base/memory/ref_counted.h"
 #include "base/process/process.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/synchronization/lock.h"
 #include "base/threading/platform_thread.h"
 #include "base/time/time.h"
 #include "syzygy/kasko/http_agent_impl.h"
@@ -50,6 +52,39 @@ const base::char16* const kRpcProtocol = L"ncalrpc";
 // The subdirectory where minidumps are generated.
 const base::char16* const kTemporarySubdir = L"Temporary";
 
+// The maximum number of reports uploaded each time the upload thread wakes up.
+const size_t kUploadBatchSize = 32;
+
+// The maximum number of reports uploaded concurrently.
+const size_t kUploadConcurrency = 4;
+
+// Serializes the invocations of an OnUploadCallback, as reports may be uploaded
+// concurrently.
+class SerializedUploadCallback
+    : public base::RefCountedThreadSafe<SerializedUploadCallback> {
+ public:
+  explicit SerializedUploadCallback(
+      const Reporter::OnUploadCallback& callback)
+      : callback_(callback) {}
+
+  void Run(const base::string16& report_id,
+           const base::FilePath& minidump_path,
+           const std::map<base::string16, base::string16>& crash_keys) {
+    base::AutoLock auto_lock(lock_);
+    callback_.Run(report_id, minidump_path, crash_keys);
+  }
+
+ private:
+  friend class base::RefCountedThreadSafe<SerializedUploadCallback>;
+
+  ~SerializedUploadCallback() {}
+
+  base::Lock lock_;
+  Reporter::OnUploadCallback callback_;
+
+  DISALLOW_COPY_AND_ASSIGN(SerializedUploadCallback);
+};
+
 // Moves |minidump_path| and |crash_keys_path| to |permanent_failure_directory|.
 // The destination filenames have the filename from |minidump_path| and the
 // extensions Reporter::kPermanentFailureMinidumpExtension and
@@ -177,18 +212,27 @@ std::unique_ptr<Reporter> Reporter::Create(
     return std::unique_ptr<Reporter>();
   }
 
+  OnUploadCallback serialized_on_upload_callback;
+  if (!on_upload_callback.is_null()) {
+    serialized_on_upload_callback = base::Bind(
+        &SerializedUploadCallback::Run,
+        make_scoped_refptr(new SerializedUploadCallback(on_upload_callback)));
+  }
+
   std::unique_ptr<ReportRepository> report_repository(new ReportRepository(
       data_directory, retry_interval, base::Bind(&base::Time::Now),
-      base::Bind(&UploadCrashReport, on_upload_callback, url),
+      base::Bind(&UploadCrashReport, serialized_on_upload_callback, url),
       base::Bind(&HandlePermanentFailure, permanent_failure_directory)));
+  report_repository->set_upload_concurrency(kUploadConcurrency);
 
   // It's safe to pass an Unretained reference to |report_repository| because
   // the Reporter instance will shut down |upload_thread| before destroying
   // |report_repository|.
   std::unique_ptr<UploadThread> upload_thread = UploadThread::Create(
       data_directory, std::move(waitable_timer),
-      base::Bind(base::IgnoreResult(&ReportRepository::UploadPendingReport),
-                 base::Unretained(report_repository.get())));
+      base::Bind(base::IgnoreResult(&ReportRepository::UploadPendingReports),
+                 base::Unretained(report_repository.get()),
+                 kUploadBatchSize));
 
   if (!upload_thread) {
     LOG(ERROR) << "Failed to initialize background upload process.";
@@ -232,13 +276,6 @@ bool Reporter::UploadCrashReport(
     const base::string16& upload_url,
     const base::FilePath& minidump_path,
     const std::map<base::string16, base::string16>& crash_keys) {
-  std::string dump_contents;
-  if (!base::ReadFileToString(minidump_path, &dump_contents)) {
-    LOG(ERROR) << "Failed to read the minidump file at "
-               << minidump_path.value();
-    return false;
-  }
-
   HttpAgentImpl http_agent(
       L"Kasko", base::ASCIIToUTF16(KASKO_VERSION_STRING));
   base::string16 remote_dump_id;
@@ -246,9 +283,11 @@ bool Reporter::UploadCrashReport(
   std::map<base::string16, base::string16> augmented_crash_keys(crash_keys);
   augmented_crash_keys[Reporter::kKaskoUploadedByVersion] =
       base::ASCIIToUTF16(KASKO_VERSION_STRING);
-  if (!SendHttpUpload(&http_agent, upload_url, augmented_crash_keys,
-                      dump_contents, Reporter::kMinidumpUploadFilePart,
-                      &remote_dump_id, &response_code)) {
+  // The minidump is streamed from disk so that memory usage does not grow with
+  // the size of the dump.
+  if (!SendHttpUploadFromFile(&http_agent, upload_url, augmented_crash_keys,
+                              minidump_path, Reporter::kMinidumpUploadFilePart,
+                              &remote_dump_id, &response_code)) {
     LOG(ERROR) << "Failed to upload the minidump file to " << upload_url;
     return false;
   } else if (!on_upload_callback.is_null()) {
@@ -79,9 +79,12 @@ class Reporter {
   // @param permanent_failure_directory The directory where crash reports that
   //     have exceeded retry limits will be moved to.
   // @param upload_interval The minimum interval between two upload operations.
+  //     Each operation uploads a batch of pending reports.
   // @param retry_interval The minimum interval between upload attempts for a
   //     single crash report.
   // @param on_upload_callback The callback to notify when an upload completes.
+  //     Reports may be uploaded concurrently, but invocations of the callback
+  //     are serialized.
   // @returns a Reporter instance if successful.
   static std::unique_ptr<Reporter> Create(
       const base::string16& endpoint_name,
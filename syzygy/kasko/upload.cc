@@ -12,12 +12,19 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include "syzygy/kasko/upload.h"
+
+#include <algorithm>
+#include <limits>
+
 #include "base/logging.h"
+#include "base/files/file.h"
 #include "base/strings/string_util.h"
 #include "base/strings/utf_string_conversions.h"
 
 #include "syzygy/common/com_utils.h"
 #include "syzygy/kasko/http_agent.h"
+#include "syzygy/kasko/http_request_body.h"
 #include "syzygy/kasko/http_response.h"
 #include "syzygy/kasko/internet_helpers.h"
 
@@ -151,42 +158,113 @@ bool ReadResponse(HttpResponse* response, base::string16 *response_body) {
   return true;
 }
 
-}  // namespace
+// Implements HttpRequestBody for a multipart message whose file part is read
+// from disk as the body is consumed.
+class MultipartFileRequestBody : public HttpRequestBody {
+ public:
+  // @param prefix The portion of the message preceding the file contents.
+  // @param file The file to be embedded. Must be open for reading.
+  // @param file_length The length of @p file.
+  // @param suffix The portion of the message following the file contents.
+  MultipartFileRequestBody(const std::string& prefix,
+                           base::File file,
+                           size_t file_length,
+                           const std::string& suffix)
+      : prefix_(prefix),
+        file_(std::move(file)),
+        file_length_(file_length),
+        suffix_(suffix),
+        offset_(0) {
+    DCHECK(file_.IsValid());
+  }
 
-bool SendHttpUpload(HttpAgent* agent,
-                    const base::string16& url,
-                    const std::map<base::string16, base::string16>& parameters,
-                    const std::string& upload_file,
-                    const base::string16& file_part_name,
-                    base::string16* response_body,
-                    uint16_t* response_code) {
-  DCHECK(response_body);
-  DCHECK(response_code);
+  // HttpRequestBody implementation.
+  size_t length() const override {
+    return prefix_.size() + file_length_ + suffix_.size();
+  }
 
-  base::string16 scheme, host, path;
-  uint16_t port = 0;
-  if (!DecomposeUrl(url, &scheme, &host, &port, &path)) {
+  bool ReadData(char* buffer, size_t* count) override {
+    DCHECK(buffer);
+    DCHECK(count);
+
+    size_t requested = *count;
+    *count = 0;
+
+    // Serve whatever remains of the prefix.
+    if (offset_ < prefix_.size()) {
+      *count = prefix_.copy(buffer, requested, offset_);
+      offset_ += *count;
+      return true;
+    }
+
+    // Then the file contents.
+    size_t file_offset = offset_ - prefix_.size();
+    if (file_offset < file_length_) {
+      size_t chunk = std::min(requested, file_length_ - file_offset);
+      chunk = std::min<size_t>(chunk, std::numeric_limits<int>::max());
+      int bytes_read =
+          file_.ReadAtCurrentPos(buffer, static_cast<int>(chunk));
+      if (bytes_read <= 0) {
+        LOG(ERROR) << "Failed to read upload file at offset " << file_offset
+                   << " of " << file_length_ << ".";
+        return false;
+      }
+      *count = static_cast<size_t>(bytes_read);
+      offset_ += *count;
+      return true;
+    }
+
+    // Finally the suffix.
+    size_t suffix_offset = file_offset - file_length_;
+    if (suffix_offset < suffix_.size()) {
+      *count = suffix_.copy(buffer, requested, suffix_offset);
+      offset_ += *count;
+    }
+    return true;
+  }
+
+ private:
+  std::string prefix_;
+  base::File file_;
+  size_t file_length_;
+  std::string suffix_;
+
+  // The number of bytes of the body that have been read so far.
+  size_t offset_;
+
+  DISALLOW_COPY_AND_ASSIGN(MultipartFileRequestBody);
+};
+
+// Decomposes |url| into the parameters expected by HttpAgent. Returns true if
+// |url| is a valid HTTP or HTTPS URL.
+bool ParseUploadUrl(const base::string16& url,
+                    base::string16* host,
+                    uint16_t* port,
+                    base::string16* path,
+                    bool* secure) {
+  base::string16 scheme;
+  if (!DecomposeUrl(url, &scheme, host, port, path)) {
     LOG(ERROR) << "Failed to decompose URL: " << url;
     return false;
   }
 
-  bool secure = false;
+  *secure = false;
   if (scheme == L"https") {
-    secure = true;
+    *secure = true;
   } else if (scheme != L"http") {
     LOG(ERROR) << "Invalid scheme in URL: " << url;
     return false;
   }
 
-  base::string16 boundary = GenerateMultipartHttpRequestBoundary();
-  base::string16 content_type_header =
-      GenerateMultipartHttpRequestContentTypeHeader(boundary);
-
-  std::string request_body = GenerateMultipartHttpRequestBody(
-      parameters, upload_file, file_part_name, boundary);
+  return true;
+}
 
-  std::unique_ptr<HttpResponse> response =
-      agent->Post(host, port, path, secure, content_type_header, request_body);
+// Extracts the status code and response body from the response to an upload
+// request to |url|. Returns true if the upload succeeded.
+bool HandleUploadResponse(const base::string16& url,
+                          HttpResponse* response,
+                          base::string16* response_body,
+                          uint16_t* response_code) {
   if (!response) {
     LOG(ERROR) << "Request to " << url << " failed.";
     return false;
@@ -204,7 +282,7 @@ bool SendHttpUpload(HttpAgent* agent,
     return false;
   }
 
-  if (!ReadResponse(response.get(), response_body)) {
+  if (!ReadResponse(response, response_body)) {
     if (response_body->length()) {
       LOG(ERROR) << "Failure while reading response body. Possibly truncated "
                     "response body: " << *response_body;
@@ -217,4 +295,88 @@ bool SendHttpUpload(HttpAgent* agent,
   return true;
 }
 
+}  // namespace
+
+bool SendHttpUpload(HttpAgent* agent,
+                    const base::string16& url,
+                    const std::map<base::string16, base::string16>& parameters,
+                    const std::string& upload_file,
+                    const base::string16& file_part_name,
+                    base::string16* response_body,
+                    uint16_t* response_code) {
+  DCHECK(response_body);
+  DCHECK(response_code);
+
+  base::string16 host, path;
+  uint16_t port = 0;
+  bool secure = false;
+  if (!ParseUploadUrl(url, &host, &port, &path, &secure))
+    return false;
+
+  base::string16 boundary = GenerateMultipartHttpRequestBoundary();
+  base::string16 content_type_header =
+      GenerateMultipartHttpRequestContentTypeHeader(boundary);
+
+  std::string request_body = GenerateMultipartHttpRequestBody(
+      parameters, upload_file, file_part_name, boundary);
+
+  std::unique_ptr<HttpResponse> response =
+      agent->Post(host, port, path, secure, content_type_header, request_body);
+  return HandleUploadResponse(url, response.get(), response_body,
+                              response_code);
+}
+
+bool SendHttpUploadFromFile(
+    HttpAgent* agent,
+    const base::string16& url,
+    const std::map<base::string16, base::string16>& parameters,
+    const base::FilePath& upload_file_path,
+    const base::string16& file_part_name,
+    base::string16* response_body,
+    uint16_t* response_code) {
+  DCHECK(response_body);
+  DCHECK(response_code);
+
+  base::string16 host, path;
+  uint16_t port = 0;
+  bool secure = false;
+  if (!ParseUploadUrl(url, &host, &port, &path, &secure))
+    return false;
+
+  base::File upload_file(upload_file_path,
+                         base::File::FLAG_OPEN | base::File::FLAG_READ);
+  if (!upload_file.IsValid()) {
+    LOG(ERROR) << "Failed to open " << upload_file_path.value()
+               << " for upload: "
+               << base::File::ErrorToString(upload_file.error_details());
+    return false;
+  }
+
+  // Don't upload a truncated report if the length can't be determined, the
+  // report will be retried later.
+  int64_t upload_file_length = upload_file.GetLength();
+  if (upload_file_length < 0 ||
+      static_cast<uint64_t>(upload_file_length) >
+          std::numeric_limits<size_t>::max()) {
+    LOG(ERROR) << "Failed to get the length of " << upload_file_path.value()
+               << " for upload.";
+    return false;
+  }
+
+  base::string16 boundary = GenerateMultipartHttpRequestBoundary();
+  base::string16 content_type_header =
+      GenerateMultipartHttpRequestContentTypeHeader(boundary);
+
+  MultipartFileRequestBody request_body(
+      GenerateMultipartHttpRequestBodyPrefix(parameters, file_part_name,
+                                             boundary),
+      std::move(upload_file), static_cast<size_t>(upload_file_length),
+      GenerateMultipartHttpRequestBodySuffix(boundary));
+
+  std::unique_ptr<HttpResponse> response = agent->PostStream(
+      host, port, path, secure, content_type_header, &request_body);
+  return HandleUploadResponse(url, response.get(), response_body,
+                              response_code);
+}
+
 }  // namespace kasko
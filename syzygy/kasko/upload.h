@@ -19,6 +19,7 @@
 #include <map>
 #include <string>
 
+#include "base/files/file_path.h"
 #include "base/strings/string16.h"
 
 namespace kasko {
@@ -42,6 +43,27 @@ bool SendHttpUpload(HttpAgent* agent,
                     base::string16* response_body,
                     uint16_t* response_code);
 
+// POSTs a multipart MIME message via HTTP(S), streaming the file part from
+// disk. The file is never held in memory in its entirety; |agent| receives the
+// message body incrementally via HttpAgent::PostStream.
+// @param agent The HTTP implementation to use.
+// @param url The resource to which to POST.
+// @param parameters HTTP request parameters to be encoded in the body.
+// @param upload_file_path The file whose contents are to be encoded in the
+//     body.
+// @param file_part_name The parameter name to be assigned to the file part.
+// @param response_body Receives the HTTP response body.
+// @param response_code Receives the HTTP response status code.
+// @returns true if successful.
+bool SendHttpUploadFromFile(
+    HttpAgent* agent,
+    const base::string16& url,
+    const std::map<base::string16, base::string16>& parameters,
+    const base::FilePath& upload_file_path,
+    const base::string16& file_part_name,
+    base::string16* response_body,
+    uint16_t* response_code);
+
 }  // namespace kasko
 
 #endif  // SYZYGY_KASKO_UPLOAD_H_
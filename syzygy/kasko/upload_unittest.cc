@@ -23,6 +23,9 @@
 #include <vector>
 
 #include "base/macros.h"
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
 #include "base/strings/string16.h"
 #include "base/strings/string_tokenizer.h"
 #include "base/strings/string_util.h"
@@ -621,4 +624,50 @@ TEST_F(UploadTest, WideResponse) {
   EXPECT_EQ(kResponse, response_body);
 }
 
+TEST_F(UploadTest, PostFromFileSucceeds) {
+  const std::string kResponse = "hello world";
+
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  base::FilePath file_path = temp_dir.path().Append(L"upload.dmp");
+  const std::string& file = agent().expectations().file;
+  ASSERT_EQ(static_cast<int>(file.size()),
+            base::WriteFile(file_path, file.data(), file.size()));
+
+  std::unique_ptr<MockHttpResponse> mock_response(new MockHttpResponse);
+  std::vector<std::string> data;
+  data.push_back(kResponse);
+  data.push_back(std::string());
+  mock_response->set_data(data);
+  agent().set_response(std::move(mock_response));
+
+  // MockHttpAgent relies on the default PostStream implementation, which
+  // reassembles the streamed body and validates it in Post.
+  base::string16 response_body;
+  uint16_t response_code = 0;
+  EXPECT_TRUE(SendHttpUploadFromFile(
+      &agent(), L"http://" + agent().expectations().host +
+                    agent().expectations().path,
+      agent().expectations().parameters, file_path,
+      agent().expectations().file_name, &response_body, &response_code));
+  EXPECT_EQ(200, response_code);
+  EXPECT_EQ(base::UTF8ToWide(kResponse), response_body);
+}
+
+TEST_F(UploadTest, PostFromMissingFile) {
+  agent().set_expect_invocation(false);
+
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+
+  base::string16 response_body;
+  uint16_t response_code = 0;
+  EXPECT_FALSE(SendHttpUploadFromFile(
+      &agent(), L"http://" + agent().expectations().host +
+                    agent().expectations().path,
+      agent().expectations().parameters,
+      temp_dir.path().Append(L"missing.dmp"),
+      agent().expectations().file_name, &response_body, &response_code));
+}
+
 }  // namespace kasko
@@ -68,6 +68,9 @@ class MsfFileStreamImpl : public MsfStreamImpl<T> {
 
   // MsfStreamImpl implementation.
   bool ReadBytesAt(size_t pos, size_t count, void* dest) override;
+  bool GetFilePages(RefCountedFILE** file,
+                    const std::vector<uint32_t>** pages,
+                    size_t* page_size) override;
 
  protected:
   // Protected to enforce reference counted pointers at compile time.
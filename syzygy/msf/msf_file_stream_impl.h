@@ -65,6 +65,20 @@ bool MsfFileStreamImpl<T>::ReadBytesAt(size_t pos, size_t count, void* dest) {
   return true;
 }
 
+template <MsfFileType T>
+bool MsfFileStreamImpl<T>::GetFilePages(RefCountedFILE** file,
+                                        const std::vector<uint32_t>** pages,
+                                        size_t* page_size) {
+  DCHECK_NE(reinterpret_cast<RefCountedFILE**>(NULL), file);
+  DCHECK_NE(reinterpret_cast<const std::vector<uint32_t>**>(NULL), pages);
+  DCHECK_NE(reinterpret_cast<size_t*>(NULL), page_size);
+
+  *file = file_.get();
+  *pages = &pages_;
+  *page_size = page_size_;
+  return true;
+}
+
 template <MsfFileType T>
 bool MsfFileStreamImpl<T>::ReadFromPage(void* dest,
                                         uint32_t page_num,
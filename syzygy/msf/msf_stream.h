@@ -15,12 +15,18 @@
 #ifndef SYZYGY_MSF_MSF_STREAM_H_
 #define SYZYGY_MSF_MSF_STREAM_H_
 
+#include <vector>
+
 #include "base/logging.h"
 #include "base/memory/ref_counted.h"
 #include "syzygy/common/buffer_writer.h"
 #include "syzygy/msf/msf_decl.h"
 
 namespace msf {
+
+// Forward declaration.
+class RefCountedFILE;
+
 namespace detail {
 
 // Forward declaration.
@@ -68,6 +74,19 @@ class MsfStreamImpl : public base::RefCounted<MsfStreamImpl<T>> {
     return scoped_refptr<WritableMsfStreamImpl<T>>();
   }
 
+  // Returns the location of the stream's contents if it is read directly from
+  // the pages of an MSF file on disk. This allows a writer to leave such a
+  // stream in place when updating the file it was read from.
+  // @param file will receive the file housing the stream.
+  // @param pages will receive the indices of the pages housing the stream.
+  // @param page_size will receive the size of the pages, in bytes.
+  // @returns true if the stream is backed by an MSF file, false otherwise.
+  virtual bool GetFilePages(RefCountedFILE** file,
+                            const std::vector<uint32_t>** pages,
+                            size_t* page_size) {
+    return false;
+  }
+
   // Gets the stream's length.
   // @returns the total number of bytes in the stream.
   uint32_t length() const { return length_; }
@@ -29,7 +29,9 @@ namespace detail {
 
 // This class is used to write an MSF file to disk given a list of MsfStreams.
 // It will create a header and directory inside the MSF file that describe
-// the page layout of the streams in the file.
+// the page layout of the streams in the file. The pages of every stream are
+// assigned up front, and the streams are then copied concurrently into a
+// memory mapping of the output file.
 template <MsfFileType T>
 class MsfWriterImpl {
  public:
@@ -42,7 +44,42 @@ class MsfWriterImpl {
   // @returns true on success, false otherwise.
   bool Write(const base::FilePath& msf_path, const MsfFileImpl<T>& msf_file);
 
+  // Writes the given MsfFileImpl to disk by updating a copy of the MSF file it
+  // was read from. Streams that are still read unmodified from the pages of
+  // the original file are left in place; only the remaining streams, the
+  // directory and the free page map are written. This falls back to Write if
+  // the original file can't be updated: if it can't be read, doesn't have a
+  // valid header, uses a different page size, or can't be copied to
+  // @p msf_path.
+  // @param original_msf_path the path of the MSF file @p msf_file was read
+  //     from.
+  // @param msf_path the path of the MSF file to write. This must differ from
+  //     @p original_msf_path.
+  // @param msf_file the MSF file to be written.
+  // @returns true on success, false otherwise.
+  bool WriteIncremental(const base::FilePath& original_msf_path,
+                        const base::FilePath& msf_path,
+                        const MsfFileImpl<T>& msf_file);
+
+  // @name Accessors for the number of streams copied concurrently by Write.
+  // Defaults to the number of processors. Streams read from a file are copied
+  // with positional reads through a handle of their own, so they are copied
+  // concurrently too.
+  // @{
+  size_t jobs() const { return jobs_; }
+  void set_jobs(size_t jobs) { jobs_ = jobs; }
+  // @}
+
  protected:
+  // Writes the given MsfFileImpl to disk one stream at a time, through
+  // file_. This is used when the output file can't be mapped in memory, and
+  // produces the same file as Write.
+  // @param msf_path the path of the MSF file to write.
+  // @param msf_file the MSF file to be written.
+  // @returns true on success, false otherwise.
+  bool WriteSequentially(const base::FilePath& msf_path,
+                         const MsfFileImpl<T>& msf_file);
+
   // Append the contents of the stream onto the file handle at the offset. The
   // contents of the file are padded to reach the next page boundary in the
   // output stream. The indices of the written pages are appended to
@@ -61,6 +98,9 @@ class MsfWriterImpl {
   base::ScopedFILE file_;
 
  private:
+  // The maximum number of streams copied concurrently.
+  size_t jobs_;
+
   DISALLOW_COPY_AND_ASSIGN(MsfWriterImpl);
 };
 
@@ -15,13 +15,23 @@
 #ifndef SYZYGY_MSF_MSF_WRITER_IMPL_H_
 #define SYZYGY_MSF_MSF_WRITER_IMPL_H_
 
+#include <io.h>
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
+#include <limits>
+#include <map>
 #include <vector>
 
 #include "base/logging.h"
+#include "base/memory/scoped_vector.h"
+#include "base/sys_info.h"
+#include "base/threading/simple_thread.h"
+#include "base/win/scoped_handle.h"
+#include "syzygy/common/thread_pool_util.h"
 #include "syzygy/msf/msf_constants.h"
 #include "syzygy/msf/msf_data.h"
+#include "syzygy/msf/msf_file_stream.h"
 
 namespace msf {
 namespace detail {
@@ -205,10 +215,271 @@ bool WriteFreePageBitMap(const FreePageBitMap& free, FILE* file) {
   return true;
 }
 
+// Copies the free page map to the pages reserved for it in a mapped MSF
+// file. This produces the same bytes as WriteFreePageBitMap.
+void CopyFreePageBitMap(const FreePageBitMap& free, uint8_t* image) {
+  DCHECK(image != NULL);
+
+  const uint8_t* data = free.data().data();
+  size_t bytes_left = free.data().size();
+  size_t page_index = 1;
+  while (bytes_left > 0) {
+    uint8_t* page = image + page_index * kMsfPageSize;
+    size_t bytes_to_copy = std::min<size_t>(bytes_left, kMsfPageSize);
+    ::memcpy(page, data, bytes_to_copy);
+
+    // Flush out the rest of a partial page with ones.
+    if (bytes_to_copy < kMsfPageSize)
+      ::memset(page + bytes_to_copy, 0xFF, kMsfPageSize - bytes_to_copy);
+
+    bytes_left -= bytes_to_copy;
+    data += bytes_to_copy;
+    page_index += kMsfPageSize;
+  }
+}
+
+// @returns the number of pages needed to store @p length bytes.
+uint32_t GetPageCount(uint32_t length) {
+  return (length + kMsfPageSize - 1) / kMsfPageSize;
+}
+
+// Assigns @p count pages at the end of an MSF file made of @p *page_count
+// pages, appending their indices to @p pages. The pages reserved for the free
+// page map are skipped exactly as AppendPage does, so that the resulting
+// layout is the same as that of a file written sequentially.
+void AllocatePages(uint32_t count,
+                   std::vector<uint32_t>* pages,
+                   uint32_t* page_count) {
+  DCHECK(pages != NULL);
+  DCHECK(page_count != NULL);
+
+  for (uint32_t i = 0; i < count; ++i) {
+    if ((*page_count % kMsfPageSize) == 1)
+      *page_count += 2;
+    pages->push_back(*page_count);
+    ++(*page_count);
+  }
+}
+
+// Initializes an MSF header.
+// @param root_directory_pages the pages housing the root directory.
+// @param directory_size the size of the directory, in bytes.
+// @param page_count the total number of pages in the file.
+// @param header the header to initialize.
+// @returns true on success, false if there are too many root directory pages.
+bool InitializeHeader(const std::vector<uint32_t>& root_directory_pages,
+                      uint32_t directory_size,
+                      uint32_t page_count,
+                      MsfHeader* header) {
+  DCHECK(header != NULL);
+
+  // Make sure the root directory pointers won't overflow.
+  if (root_directory_pages.size() > arraysize(header->root_pages)) {
+    LOG(ERROR) << "Too many root directory pages for header ("
+               << root_directory_pages.size() << " > "
+               << arraysize(header->root_pages) << ").";
+    return false;
+  }
+
+  ::memset(header, 0, sizeof(*header));
+  ::memcpy(header->magic_string, kMsfHeaderMagicString,
+           sizeof(kMsfHeaderMagicString));
+  header->page_size = kMsfPageSize;
+  header->free_page_map = 1;
+  header->num_pages = page_count;
+  header->directory_size = directory_size;
+  header->reserved = 0;
+  ::memcpy(header->root_pages, root_directory_pages.data(),
+           sizeof(root_directory_pages[0]) * root_directory_pages.size());
+
+  return true;
+}
+
+// Reads @p count bytes at offset @p pos of a stream stored in the pages
+// @p file_pages of a file, into @p dest. This uses positional reads through
+// @p handle, so it neither uses nor moves the position of the FILE the stream
+// is read from, and runs concurrently with the reads made through other
+// handles. Each run of consecutive pages of the file is read at once.
+// @param handle a handle to the file housing the stream.
+// @param file_pages the pages of the file that make up the stream.
+// @param page_size the size of the pages of the file.
+// @param pos the offset of the first byte to read in the stream.
+// @param count the number of bytes to read.
+// @param dest the buffer receiving the bytes.
+// @returns true on success, false otherwise.
+bool ReadFilePagesAt(HANDLE handle,
+                     const std::vector<uint32_t>& file_pages,
+                     size_t page_size,
+                     size_t pos,
+                     size_t count,
+                     uint8_t* dest) {
+  DCHECK(handle != INVALID_HANDLE_VALUE);
+  DCHECK_LT(0U, page_size);
+  DCHECK(dest != NULL);
+
+  while (count > 0) {
+    size_t page_index = pos / page_size;
+    size_t offset = pos % page_size;
+    if (page_index >= file_pages.size())
+      return false;
+
+    // Extend the read over the pages that follow in the file.
+    size_t chunk = std::min(count, page_size - offset);
+    size_t run = 1;
+    while (chunk < count && page_index + run < file_pages.size() &&
+           file_pages[page_index + run] == file_pages[page_index] + run &&
+           chunk <= std::numeric_limits<DWORD>::max() - page_size) {
+      chunk += std::min(count - chunk, page_size);
+      ++run;
+    }
+
+    uint64_t file_offset =
+        static_cast<uint64_t>(file_pages[page_index]) * page_size + offset;
+    OVERLAPPED overlapped = {};
+    overlapped.Offset = static_cast<DWORD>(file_offset);
+    overlapped.OffsetHigh = static_cast<DWORD>(file_offset >> 32);
+    DWORD bytes_read = 0;
+    if (!::ReadFile(handle, dest, static_cast<DWORD>(chunk), &bytes_read,
+                    &overlapped) ||
+        bytes_read != chunk) {
+      LOG(ERROR) << "Failed to read " << chunk << " bytes at offset "
+                 << file_offset << " of MSF file.";
+      return false;
+    }
+
+    count -= chunk;
+    pos += chunk;
+    dest += chunk;
+  }
+
+  return true;
+}
+
+// Copies the contents of a stream to the pages assigned to it in a mapped MSF
+// file. Each run of consecutive pages is filled with a single read.
+//
+// Streams read from a file are read through a handle of their own, with
+// positional reads, so that the streams of a single file are copied
+// concurrently. The other streams are read through ReadBytesAt.
+template <MsfFileType T>
+class StreamPageWriter : public base::DelegateSimpleThread::Delegate {
+ public:
+  // @param stream the stream to copy.
+  // @param pages the pages assigned to @p stream.
+  // @param image the mapped MSF file.
+  StreamPageWriter(MsfStreamImpl<T>* stream,
+                   const uint32_t* pages,
+                   uint8_t* image)
+      : stream_(stream), pages_(pages), image_(image), succeeded_(false) {
+    DCHECK(stream != NULL);
+    DCHECK(pages != NULL);
+    DCHECK(image != NULL);
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  void Run() override { succeeded_ = CopyStream(); }
+  // @}
+
+  // @returns true if the stream was successfully copied.
+  bool succeeded() const { return succeeded_; }
+
+ private:
+  bool CopyStream() {
+    RefCountedFILE* file = NULL;
+    const std::vector<uint32_t>* file_pages = NULL;
+    size_t page_size = 0;
+    FILE* shared_file = NULL;
+    base::win::ScopedHandle handle;
+    if (stream_->GetFilePages(&file, &file_pages, &page_size)) {
+      shared_file = file->file();
+
+      // A handle reopened from the one of the FILE has its own file object,
+      // so its reads aren't serialized with those made through other handles.
+      HANDLE file_handle =
+          reinterpret_cast<HANDLE>(::_get_osfhandle(::_fileno(shared_file)));
+      if (file_handle != INVALID_HANDLE_VALUE) {
+        handle.Set(::ReOpenFile(
+            file_handle, GENERIC_READ,
+            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, 0));
+      }
+    }
+
+    uint32_t length = stream_->length();
+    uint32_t page_count = GetPageCount(length);
+    size_t pos = 0;
+    uint32_t i = 0;
+    while (i < page_count) {
+      uint32_t run = 1;
+      while (i + run < page_count && pages_[i + run] == pages_[i] + run)
+        ++run;
+      size_t count =
+          std::min<size_t>(run * static_cast<size_t>(kMsfPageSize),
+                           length - pos);
+      uint8_t* dest = image_ + pages_[i] * static_cast<size_t>(kMsfPageSize);
+
+      bool read = false;
+      if (handle.IsValid()) {
+        read = ReadFilePagesAt(handle.Get(), *file_pages, page_size, pos,
+                               count, dest);
+      } else {
+        // Streams read from a file share its position, so a file that can't
+        // be reopened is read with the FILE locked. These reads are
+        // serialized with those of the other streams of the file.
+        if (shared_file != NULL)
+          ::_lock_file(shared_file);
+        read = stream_->ReadBytesAt(pos, count, dest);
+        if (shared_file != NULL)
+          ::_unlock_file(shared_file);
+      }
+      if (!read) {
+        LOG(ERROR) << "Failed to read " << count << " bytes at offset " << pos
+                   << " of MSF stream.";
+        return false;
+      }
+
+      pos += count;
+      i += run;
+    }
+    DCHECK_EQ(length, pos);
+
+    return true;
+  }
+
+  MsfStreamImpl<T>* stream_;
+  const uint32_t* pages_;
+  uint8_t* image_;
+  bool succeeded_;
+
+  DISALLOW_COPY_AND_ASSIGN(StreamPageWriter);
+};
+
+// Gets the volume serial number and file index identifying the file on disk
+// that @p file refers to.
+bool GetFileId(FILE* file, BY_HANDLE_FILE_INFORMATION* file_info) {
+  DCHECK(file != NULL);
+  DCHECK(file_info != NULL);
+
+  HANDLE handle = reinterpret_cast<HANDLE>(::_get_osfhandle(::_fileno(file)));
+  if (handle == INVALID_HANDLE_VALUE)
+    return false;
+  if (!::GetFileInformationByHandle(handle, file_info))
+    return false;
+  return true;
+}
+
+// Returns true if page @p page_index is reserved for the header or the free
+// page map of an MSF file.
+bool IsReservedPage(uint32_t page_index) {
+  return page_index == 0 || (page_index % kMsfPageSize) == 1 ||
+         (page_index % kMsfPageSize) == 2;
+}
+
 }  // namespace
 
 template <MsfFileType T>
-MsfWriterImpl<T>::MsfWriterImpl() {
+MsfWriterImpl<T>::MsfWriterImpl()
+    : jobs_(base::SysInfo::NumberOfProcessors()) {
 }
 
 template <MsfFileType T>
@@ -218,6 +489,148 @@ MsfWriterImpl<T>::~MsfWriterImpl() {
 template <MsfFileType T>
 bool MsfWriterImpl<T>::Write(const base::FilePath& msf_path,
                              const MsfFileImpl<T>& msf_file) {
+  // Initialize the directory with stream count and lengths.
+  std::vector<uint32_t> directory;
+  directory.push_back(static_cast<uint32_t>(msf_file.StreamCount()));
+  for (uint32_t i = 0; i < msf_file.StreamCount(); ++i) {
+    // Null streams have an implicit zero length.
+    MsfStreamImpl<T>* stream = msf_file.GetStream(i).get();
+    if (stream == NULL)
+      directory.push_back(0);
+    else
+      directory.push_back(static_cast<uint32_t>(stream->length()));
+  }
+
+  // Assign the pages of all the streams, past the 4 preamble pages, exactly
+  // as WriteSequentially would. The offset in the directory of the pages of
+  // each stream is kept, along with the range of those of stream 0.
+  uint32_t page_count = 4;
+  std::vector<std::pair<MsfStreamImpl<T>*, size_t>> stream_pages;
+  size_t stream0_start = directory.size();
+  size_t stream0_end = 0;
+  for (uint32_t i = 0; i < msf_file.StreamCount(); ++i) {
+    if (i == 1)
+      stream0_end = directory.size();
+
+    // Null streams are treated as empty streams.
+    MsfStreamImpl<T>* stream = msf_file.GetStream(i).get();
+    if (stream == NULL || stream->length() == 0)
+      continue;
+
+    stream_pages.push_back(std::make_pair(stream, directory.size()));
+    AllocatePages(GetPageCount(stream->length()), &directory, &page_count);
+  }
+  DCHECK_LE(stream0_start, stream0_end);
+
+  uint32_t directory_size =
+      static_cast<uint32_t>(sizeof(directory[0]) * directory.size());
+  std::vector<uint32_t> directory_pages;
+  AllocatePages(GetPageCount(directory_size), &directory_pages, &page_count);
+  uint32_t root_directory_size = static_cast<uint32_t>(
+      sizeof(directory_pages[0]) * directory_pages.size());
+  std::vector<uint32_t> root_directory_pages;
+  AllocatePages(GetPageCount(root_directory_size), &root_directory_pages,
+                &page_count);
+
+  MsfHeader header = {0};
+  if (!InitializeHeader(root_directory_pages, directory_size, page_count,
+                        &header)) {
+    LOG(ERROR) << "Failed to write MSF header.";
+    return false;
+  }
+
+  // The pages corresponding to stream 0 are always marked as free, as well as
+  // page 3 which is part of the preamble.
+  FreePageBitMap free_page;
+  free_page.SetPageCount(page_count);
+  free_page.SetFree(3);
+  for (size_t i = stream0_start; i < stream0_end; ++i)
+    free_page.SetFree(directory[i]);
+  free_page.Finalize();
+
+  // Create the output file with its final size and map it in memory. Its
+  // contents are initially zero, which takes care of all the padding.
+  uint64_t file_size = static_cast<uint64_t>(page_count) * kMsfPageSize;
+  if (file_size > std::numeric_limits<size_t>::max())
+    return WriteSequentially(msf_path, msf_file);
+  base::win::ScopedHandle file_handle(
+      ::CreateFile(msf_path.value().c_str(), GENERIC_READ | GENERIC_WRITE, 0,
+                   NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL));
+  if (!file_handle.IsValid()) {
+    LOG(ERROR) << "Failed to create '" << msf_path.value() << "'.";
+    return false;
+  }
+  LARGE_INTEGER end_of_file = {};
+  end_of_file.QuadPart = file_size;
+  if (!::SetFilePointerEx(file_handle.Get(), end_of_file, NULL, FILE_BEGIN) ||
+      !::SetEndOfFile(file_handle.Get())) {
+    LOG(ERROR) << "Failed to allocate " << file_size << " bytes for '"
+               << msf_path.value() << "'.";
+    return false;
+  }
+  base::win::ScopedHandle mapping(::CreateFileMapping(
+      file_handle.Get(), NULL, PAGE_READWRITE, 0, 0, NULL));
+  uint8_t* image = NULL;
+  if (mapping.IsValid()) {
+    image = reinterpret_cast<uint8_t*>(::MapViewOfFile(
+        mapping.Get(), FILE_MAP_WRITE, 0, 0, static_cast<size_t>(file_size)));
+  }
+  if (image == NULL) {
+    // This happens when the address space is too fragmented to map a very
+    // large file.
+    VLOG(1) << "Unable to map '" << msf_path.value()
+            << "', writing it sequentially.";
+    mapping.Close();
+    file_handle.Close();
+    return WriteSequentially(msf_path, msf_file);
+  }
+
+  // Copy the streams. They occupy disjoint pages, so they can be copied
+  // concurrently.
+  ScopedVector<StreamPageWriter<T>> writers;
+  for (size_t i = 0; i < stream_pages.size(); ++i) {
+    writers.push_back(new StreamPageWriter<T>(
+        stream_pages[i].first, directory.data() + stream_pages[i].second,
+        image));
+  }
+  common::RunDelegatesOnThreadPool("MsfWriter", jobs_, writers.get());
+
+  bool succeeded = true;
+  for (size_t i = 0; i < writers.size(); ++i) {
+    if (!writers[i]->succeeded())
+      succeeded = false;
+  }
+  if (!succeeded)
+    LOG(ERROR) << "Failed to write one or more streams.";
+
+  // Write the directory, the root directory, the header and the free page
+  // map.
+  if (succeeded) {
+    scoped_refptr<MsfStreamImpl<T>> directory_stream(
+        new ReadOnlyMsfStream<T>(directory.data(), directory_size));
+    scoped_refptr<MsfStreamImpl<T>> root_directory_stream(
+        new ReadOnlyMsfStream<T>(directory_pages.data(), root_directory_size));
+    StreamPageWriter<T> directory_writer(directory_stream.get(),
+                                         directory_pages.data(), image);
+    StreamPageWriter<T> root_directory_writer(
+        root_directory_stream.get(), root_directory_pages.data(), image);
+    directory_writer.Run();
+    root_directory_writer.Run();
+    DCHECK(directory_writer.succeeded());
+    DCHECK(root_directory_writer.succeeded());
+
+    ::memcpy(image, &header, sizeof(header));
+    CopyFreePageBitMap(free_page, image);
+  }
+
+  CHECK(::UnmapViewOfFile(image));
+
+  return succeeded;
+}
+
+template <MsfFileType T>
+bool MsfWriterImpl<T>::WriteSequentially(const base::FilePath& msf_path,
+                                         const MsfFileImpl<T>& msf_file) {
   file_.reset(base::OpenFile(msf_path, "wb"));
   if (!file_.get()) {
     LOG(ERROR) << "Failed to create '" << msf_path.value() << "'.";
@@ -324,6 +737,218 @@ bool MsfWriterImpl<T>::Write(const base::FilePath& msf_path,
   return true;
 }
 
+template <MsfFileType T>
+bool MsfWriterImpl<T>::WriteIncremental(const base::FilePath& original_msf_path,
+                                        const base::FilePath& msf_path,
+                                        const MsfFileImpl<T>& msf_file) {
+  // Read the header of the original file, and get its identity so that we can
+  // recognize the streams that are still read from it. If any of this fails
+  // the original file can't be updated, and the file is rewritten entirely.
+  MsfHeader original_header = {0};
+  BY_HANDLE_FILE_INFORMATION original_id = {0};
+  {
+    base::ScopedFILE original_file(base::OpenFile(original_msf_path, "rb"));
+    if (!original_file.get()) {
+      LOG(WARNING) << "Failed to open '" << original_msf_path.value()
+                   << "', rewriting it entirely.";
+      return Write(msf_path, msf_file);
+    }
+    if (::fread(&original_header, sizeof(original_header), 1,
+                original_file.get()) != 1 ||
+        ::memcmp(original_header.magic_string, kMsfHeaderMagicString,
+                 sizeof(kMsfHeaderMagicString)) != 0) {
+      LOG(WARNING) << "Invalid MSF header in '" << original_msf_path.value()
+                   << "', rewriting it entirely.";
+      return Write(msf_path, msf_file);
+    }
+    if (!GetFileId(original_file.get(), &original_id)) {
+      LOG(WARNING) << "Failed to get file information for '"
+                   << original_msf_path.value() << "', rewriting it entirely.";
+      return Write(msf_path, msf_file);
+    }
+  }
+
+  // Pages are only reused as is if they have the size we write.
+  if (original_header.page_size != kMsfPageSize) {
+    VLOG(1) << "Original MSF file has a page size of "
+            << original_header.page_size << ", rewriting it entirely.";
+    return Write(msf_path, msf_file);
+  }
+
+  // Find the streams that are still stored unmodified in the original file.
+  // The identity of each distinct file housing a stream is only looked up
+  // once.
+  std::vector<const std::vector<uint32_t>*> original_pages(
+      msf_file.StreamCount(), NULL);
+  std::map<RefCountedFILE*, bool> is_original_file;
+  size_t reused_stream_count = 0;
+  for (uint32_t i = 0; i < msf_file.StreamCount(); ++i) {
+    MsfStreamImpl<T>* stream = msf_file.GetStream(i).get();
+    if (stream == NULL || stream->length() == 0)
+      continue;
+
+    RefCountedFILE* file = NULL;
+    const std::vector<uint32_t>* pages = NULL;
+    size_t page_size = 0;
+    if (!stream->GetFilePages(&file, &pages, &page_size) ||
+        page_size != kMsfPageSize) {
+      continue;
+    }
+
+    auto it = is_original_file.find(file);
+    if (it == is_original_file.end()) {
+      BY_HANDLE_FILE_INFORMATION id = {0};
+      bool is_original =
+          GetFileId(file->file(), &id) &&
+          id.dwVolumeSerialNumber == original_id.dwVolumeSerialNumber &&
+          id.nFileIndexHigh == original_id.nFileIndexHigh &&
+          id.nFileIndexLow == original_id.nFileIndexLow;
+      it = is_original_file.insert(std::make_pair(file, is_original)).first;
+    }
+    if (!it->second)
+      continue;
+
+    // Only reuse pages that lie within the original file.
+    bool pages_valid = true;
+    for (uint32_t page : *pages) {
+      if (page >= original_header.num_pages || IsReservedPage(page)) {
+        pages_valid = false;
+        break;
+      }
+    }
+    if (!pages_valid)
+      continue;
+
+    original_pages[i] = pages;
+    ++reused_stream_count;
+  }
+
+  // Start from a copy of the original file. New pages are appended at its
+  // end. Nothing has been written yet, so the file can still be rewritten
+  // entirely if the copy isn't usable.
+  if (!base::CopyFile(original_msf_path, msf_path)) {
+    LOG(WARNING) << "Failed to copy '" << original_msf_path.value()
+                 << "' to '" << msf_path.value()
+                 << "', rewriting it entirely.";
+    return Write(msf_path, msf_file);
+  }
+  file_.reset(base::OpenFile(msf_path, "r+b"));
+  if (!file_.get()) {
+    LOG(WARNING) << "Failed to open '" << msf_path.value()
+                 << "', rewriting it entirely.";
+    return Write(msf_path, msf_file);
+  }
+  uint32_t page_count = original_header.num_pages;
+  if (::fseek(file_.get(), 0, SEEK_END) != 0 ||
+      static_cast<uint32_t>(::ftell(file_.get())) !=
+          page_count * kMsfPageSize) {
+    LOG(WARNING) << "Size of '" << original_msf_path.value()
+                 << "' doesn't match its header, rewriting it entirely.";
+    file_.reset();
+    return Write(msf_path, msf_file);
+  }
+
+  // Initialize the directory with stream count and lengths.
+  std::vector<uint32_t> directory;
+  directory.push_back(static_cast<uint32_t>(msf_file.StreamCount()));
+  for (uint32_t i = 0; i < msf_file.StreamCount(); ++i) {
+    // Null streams have an implicit zero length.
+    MsfStreamImpl<T>* stream = msf_file.GetStream(i).get();
+    if (stream == NULL)
+      directory.push_back(0);
+    else
+      directory.push_back(static_cast<uint32_t>(stream->length()));
+  }
+
+  // Build the directory, appending the streams that aren't reused. We keep
+  // track of which pages host stream 0 for the free page map.
+  size_t stream0_start = directory.size();
+  size_t stream0_end = 0;
+  for (uint32_t i = 0; i < msf_file.StreamCount(); ++i) {
+    if (i == 1)
+      stream0_end = directory.size();
+
+    // Null streams are treated as empty streams.
+    MsfStreamImpl<T>* stream = msf_file.GetStream(i).get();
+    if (stream == NULL || stream->length() == 0)
+      continue;
+
+    if (original_pages[i] != NULL) {
+      directory.insert(directory.end(), original_pages[i]->begin(),
+                       original_pages[i]->end());
+      continue;
+    }
+
+    if (!AppendStream(stream, &directory, &page_count)) {
+      LOG(ERROR) << "Failed to write stream " << i << ".";
+      return false;
+    }
+  }
+  DCHECK_LE(stream0_start, stream0_end);
+
+  // Write the directory and the root directory.
+  std::vector<uint32_t> directory_pages;
+  scoped_refptr<MsfStreamImpl<T>> directory_stream(new ReadOnlyMsfStream<T>(
+      directory.data(),
+      static_cast<uint32_t>(sizeof(directory[0]) * directory.size())));
+  if (!AppendStream(directory_stream.get(), &directory_pages, &page_count)) {
+    LOG(ERROR) << "Failed to write directory.";
+    return false;
+  }
+
+  std::vector<uint32_t> root_directory_pages;
+  scoped_refptr<MsfStreamImpl<T>> root_directory_stream(
+      new ReadOnlyMsfStream<T>(
+          directory_pages.data(),
+          sizeof(directory_pages[0]) *
+              static_cast<uint32_t>(directory_pages.size())));
+  if (!AppendStream(root_directory_stream.get(), &root_directory_pages,
+                    &page_count)) {
+    LOG(ERROR) << "Failed to write root directory.";
+    return false;
+  }
+
+  if (!WriteHeader(root_directory_pages,
+                   static_cast<uint32_t>(
+                       sizeof(directory[0]) * directory.size()),
+                   page_count)) {
+    LOG(ERROR) << "Failed to write MSF header.";
+    return false;
+  }
+
+  // Every page of the original file is free unless it houses a reused stream
+  // or is reserved for the header and the free page map. Appended pages are
+  // used, except for those of stream 0.
+  FreePageBitMap free_page;
+  free_page.SetPageCount(page_count);
+  for (uint32_t i = 0; i < original_header.num_pages; ++i) {
+    if (!IsReservedPage(i))
+      free_page.SetFree(i);
+  }
+  for (uint32_t i = 1; i < msf_file.StreamCount(); ++i) {
+    if (original_pages[i] == NULL)
+      continue;
+    for (uint32_t page : *original_pages[i])
+      free_page.SetUsed(page);
+  }
+  for (size_t i = stream0_start; i < stream0_end; ++i)
+    free_page.SetFree(directory[i]);
+  free_page.Finalize();
+
+  if (!WriteFreePageBitMap(free_page, file_.get())) {
+    LOG(ERROR) << "Failed to write free page bitmap.";
+    return false;
+  }
+
+  // On success we want the file to be closed right away.
+  file_.reset();
+
+  VLOG(1) << "Reused " << reused_stream_count << " of "
+          << msf_file.StreamCount() << " streams in place.";
+
+  return true;
+}
+
 template <MsfFileType T>
 bool MsfWriterImpl<T>::AppendStream(MsfStreamImpl<T>* stream,
                                     std::vector<uint32_t>* pages_written,
@@ -385,12 +1010,8 @@ bool MsfWriterImpl<T>::WriteHeader(
   VLOG(1) << "Writing MSF Header ...";
 
   MsfHeader header = {0};
-
-  // Make sure the root directory pointers won't overflow.
-  if (root_directory_pages.size() > arraysize(header.root_pages)) {
-    LOG(ERROR) << "Too many root directory pages for header ("
-               << root_directory_pages.size() << " > "
-               << arraysize(header.root_pages) << ").";
+  if (!InitializeHeader(root_directory_pages, directory_size, page_count,
+                        &header)) {
     return false;
   }
 
@@ -400,16 +1021,6 @@ bool MsfWriterImpl<T>::WriteHeader(
     return false;
   }
 
-  ::memcpy(header.magic_string, kMsfHeaderMagicString,
-           sizeof(kMsfHeaderMagicString));
-  header.page_size = kMsfPageSize;
-  header.free_page_map = 1;
-  header.num_pages = page_count;
-  header.directory_size = directory_size;
-  header.reserved = 0;
-  ::memcpy(header.root_pages, root_directory_pages.data(),
-           sizeof(root_directory_pages[0]) * root_directory_pages.size());
-
   if (::fwrite(&header, sizeof(header), 1, file_.get()) != 1) {
     LOG(ERROR) << "Failed to write header.";
     return false;
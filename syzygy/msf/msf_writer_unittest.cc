@@ -17,6 +17,8 @@
 #include <algorithm>
 #include <vector>
 
+#include "base/files/file_util.h"
+#include "base/time/time.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "syzygy/core/unittest_util.h"
@@ -24,6 +26,7 @@
 #include "syzygy/msf/msf_data.h"
 #include "syzygy/msf/msf_reader.h"
 #include "syzygy/msf/unittest_util.h"
+#include "syzygy/testing/metrics.h"
 
 namespace msf {
 
@@ -52,6 +55,7 @@ class TestMsfWriter : public MsfWriter {
 
   using MsfWriter::AppendStream;
   using MsfWriter::WriteHeader;
+  using MsfWriter::WriteSequentially;
 
   base::FilePath path_;
 };
@@ -84,6 +88,26 @@ class TestMsfStream : public MsfStream {
   std::vector<uint8_t> data_;
 };
 
+// A stream whose contents are generated on the fly, used to write very large
+// MSF files without holding them in memory.
+class SyntheticMsfStream : public MsfStream {
+ public:
+  explicit SyntheticMsfStream(uint32_t length) : MsfStream(length) {}
+
+  bool ReadBytesAt(size_t pos, size_t count, void* dest) override {
+    DCHECK(dest != NULL);
+
+    if (count > length() - pos)
+      return false;
+
+    uint8_t* bytes = reinterpret_cast<uint8_t*>(dest);
+    for (size_t i = 0; i < count; ++i)
+      bytes[i] = static_cast<uint8_t>((pos + i) * 31);
+
+    return true;
+  }
+};
+
 void EnsureMsfContentsAreIdentical(const MsfFile& msf_file,
                                    const MsfFile& msf_file_read) {
   ASSERT_EQ(msf_file.StreamCount(), msf_file_read.StreamCount());
@@ -216,4 +240,158 @@ TEST(MsfWriterTest, WriteMsfFile) {
       testing::EnsureMsfContentsAreIdentical(msf_file, msf_file_read));
 }
 
+TEST(MsfWriterTest, WriteIncremental) {
+  MsfFile msf_file;
+  for (uint32_t i = 0; i < 4; ++i)
+    msf_file.AppendStream(new TestMsfStream(1 << (12 + i), (i << 24)));
+
+  testing::ScopedTempFile original_file;
+  {
+    TestMsfWriter writer;
+    EXPECT_TRUE(writer.Write(original_file.path(), msf_file));
+  }
+
+  // Read the file back and replace one of its streams.
+  MsfFile msf_file_read;
+  MsfReader reader;
+  ASSERT_TRUE(reader.Read(original_file.path(), &msf_file_read));
+  msf_file_read.ReplaceStream(2, new TestMsfStream(1 << 15, 0xFF000000));
+  msf_file.ReplaceStream(2, new TestMsfStream(1 << 15, 0xFF000000));
+
+  testing::ScopedTempFile file;
+  {
+    TestMsfWriter writer;
+    EXPECT_TRUE(writer.WriteIncremental(original_file.path(), file.path(),
+                                        msf_file_read));
+  }
+
+  MsfFile msf_file_updated;
+  ASSERT_TRUE(reader.Read(file.path(), &msf_file_updated));
+  ASSERT_NO_FATAL_FAILURE(
+      testing::EnsureMsfContentsAreIdentical(msf_file, msf_file_updated));
+
+  // The unmodified streams should have been left in place, while the
+  // replaced stream should have been moved to new pages.
+  for (uint32_t i = 0; i < msf_file_read.StreamCount(); ++i) {
+    RefCountedFILE* file = NULL;
+    const std::vector<uint32_t>* pages = NULL;
+    size_t page_size = 0;
+    ASSERT_TRUE(msf_file_updated.GetStream(i)->GetFilePages(
+        &file, &pages, &page_size));
+    std::vector<uint32_t> updated_pages(*pages);
+
+    if (i == 2) {
+      EXPECT_FALSE(msf_file_read.GetStream(i)->GetFilePages(
+          &file, &pages, &page_size));
+      continue;
+    }
+
+    ASSERT_TRUE(msf_file_read.GetStream(i)->GetFilePages(
+        &file, &pages, &page_size));
+    EXPECT_EQ(*pages, updated_pages);
+  }
+}
+
+TEST(MsfWriterTest, WriteIncrementalFallsBackToWrite) {
+  MsfFile msf_file;
+  for (uint32_t i = 0; i < 4; ++i)
+    msf_file.AppendStream(new TestMsfStream(1 << (12 + i), (i << 24)));
+
+  // The original file isn't a valid MSF file, so it can't be updated.
+  testing::ScopedTempFile original_file;
+  ASSERT_EQ(0, base::WriteFile(original_file.path(), "", 0));
+
+  testing::ScopedTempFile file;
+  {
+    TestMsfWriter writer;
+    EXPECT_TRUE(writer.WriteIncremental(original_file.path(), file.path(),
+                                        msf_file));
+  }
+
+  MsfFile msf_file_read;
+  MsfReader reader;
+  ASSERT_TRUE(reader.Read(file.path(), &msf_file_read));
+  ASSERT_NO_FATAL_FAILURE(
+      testing::EnsureMsfContentsAreIdentical(msf_file, msf_file_read));
+}
+
+TEST(MsfWriterTest, WriteMatchesWriteSequentially) {
+  // Create an MSF file with a stream read from disk, an empty stream, a null
+  // stream, and enough data to require more than one free page map.
+  testing::ScopedTempFile original_file;
+  {
+    MsfFile msf_file;
+    for (uint32_t i = 0; i < 4; ++i)
+      msf_file.AppendStream(new TestMsfStream(1 << (10 + i), (i << 24)));
+    TestMsfWriter writer;
+    ASSERT_TRUE(writer.WriteSequentially(original_file.path(), msf_file));
+  }
+  MsfFile msf_file;
+  MsfReader reader;
+  ASSERT_TRUE(reader.Read(original_file.path(), &msf_file));
+  msf_file.AppendStream(new TestMsfStream(0, 0));
+  msf_file.AppendStream(NULL);
+  msf_file.AppendStream(
+      new TestMsfStream(5000 * kMsfPageSize + 12, 0x05000000));
+  msf_file.AppendStream(new TestMsfStream(3 * kMsfPageSize, 0x06000000));
+
+  testing::ScopedTempFile sequential_file;
+  testing::ScopedTempFile parallel_file;
+  {
+    TestMsfWriter writer;
+    EXPECT_TRUE(writer.WriteSequentially(sequential_file.path(), msf_file));
+  }
+  {
+    TestMsfWriter writer;
+    writer.set_jobs(4);
+    EXPECT_TRUE(writer.Write(parallel_file.path(), msf_file));
+  }
+
+  std::string sequential_contents;
+  std::string parallel_contents;
+  ASSERT_TRUE(base::ReadFileToString(sequential_file.path(),
+                                     &sequential_contents));
+  ASSERT_TRUE(base::ReadFileToString(parallel_file.path(),
+                                     &parallel_contents));
+  ASSERT_EQ(sequential_contents.size(), parallel_contents.size());
+  EXPECT_TRUE(sequential_contents == parallel_contents);
+}
+
+// Writes a 1 GB MSF file. This is disabled by default as it's slow and uses a
+// lot of disk space; run it with --gtest_also_run_disabled_tests.
+TEST(MsfWriterTest, DISABLED_WriteLargeMsfFilePerfTest) {
+  const uint32_t kStreamCount = 64;
+  const uint32_t kStreamLength = 16 * 1024 * 1024;
+
+  MsfFile msf_file;
+  for (uint32_t i = 0; i < kStreamCount; ++i)
+    msf_file.AppendStream(new SyntheticMsfStream(kStreamLength));
+
+  testing::ScopedTempFile file;
+  {
+    TestMsfWriter writer;
+    base::TimeTicks t0 = base::TimeTicks::Now();
+    EXPECT_TRUE(writer.WriteSequentially(file.path(), msf_file));
+    base::TimeDelta elapsed = base::TimeTicks::Now() - t0;
+    testing::EmitMetric("Syzygy.Msf.Writer.WriteSequentially",
+                        elapsed.InMillisecondsF());
+  }
+  {
+    TestMsfWriter writer;
+    writer.set_jobs(1);
+    base::TimeTicks t0 = base::TimeTicks::Now();
+    EXPECT_TRUE(writer.Write(file.path(), msf_file));
+    base::TimeDelta elapsed = base::TimeTicks::Now() - t0;
+    testing::EmitMetric("Syzygy.Msf.Writer.Write.1",
+                        elapsed.InMillisecondsF());
+  }
+  {
+    TestMsfWriter writer;
+    base::TimeTicks t0 = base::TimeTicks::Now();
+    EXPECT_TRUE(writer.Write(file.path(), msf_file));
+    base::TimeDelta elapsed = base::TimeTicks::Now() - t0;
+    testing::EmitMetric("Syzygy.Msf.Writer.Write", elapsed.InMillisecondsF());
+  }
+}
+
 }  // namespace msf
@@ -16,13 +16,18 @@
 
 #include <windows.h>
 #include <winnt.h>
-#include <imagehlp.h>  // NOLINT
+
+#include <algorithm>
 
 #include "base/logging.h"
 #include "base/files/file_util.h"
+#include "base/memory/scoped_vector.h"
+#include "base/sys_info.h"
+#include "base/threading/simple_thread.h"
 #include "base/win/scoped_handle.h"
 #include "syzygy/common/buffer_parser.h"
 #include "syzygy/common/com_utils.h"
+#include "syzygy/common/thread_pool_util.h"
 #include "syzygy/pe/pe_utils.h"
 
 namespace pe {
@@ -107,8 +112,80 @@ size_t GetSectionOffset(const ImageLayout& image_layout,
   return rel_addr - section_info.addr;
 }
 
+// Calculates the checksum of an image, using the same algorithm as
+// CheckSumMappedFile: a 16-bit one's complement sum of the image, to which the
+// image size is added. The checksum field of the image must be zero. As 2^16
+// is congruent to 1 modulo 2^16 - 1, whole 32-bit words can be accumulated
+// into a wide sum that is only folded at the end. This keeps the main loop
+// free of dependencies so that the compiler can vectorize it.
+uint32_t CalculateImageChecksum(const uint8_t* image, size_t image_size) {
+  DCHECK(image != NULL);
+
+  const uint32_t* words = reinterpret_cast<const uint32_t*>(image);
+  size_t word_count = image_size / sizeof(uint32_t);
+  uint64_t sum = 0;
+  for (size_t i = 0; i < word_count; ++i)
+    sum += words[i];
+
+  // Add the trailing bytes, as if the image were zero padded.
+  for (size_t i = word_count * sizeof(uint32_t); i < image_size; ++i)
+    sum += static_cast<uint64_t>(image[i]) << (8 * (i % sizeof(uint32_t)));
+
+  // Fold the sum down to 16 bits.
+  while ((sum >> 16) != 0)
+    sum = (sum & 0xFFFF) + (sum >> 16);
+
+  return static_cast<uint32_t>(sum) + static_cast<uint32_t>(image_size);
+}
+
 }  // namespace
 
+// Writes a run of blocks that all belong to the same section.
+class PEFileWriter::SectionWriter
+    : public base::DelegateSimpleThread::Delegate {
+ public:
+  SectionWriter(const PEFileWriter* writer,
+                AbsoluteAddress image_base,
+                size_t section_index,
+                std::vector<uint8_t>* buffer)
+      : writer_(writer), image_base_(image_base),
+        section_index_(section_index), buffer_(buffer), succeeded_(false) {
+    DCHECK(writer != NULL);
+    DCHECK(buffer != NULL);
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  virtual void Run() override {
+    for (size_t i = 0; i < blocks_.size(); ++i) {
+      if (!writer_->WriteOneBlock(image_base_, section_index_, blocks_[i],
+                                  buffer_)) {
+        LOG(ERROR) << "Failed to write block \"" << blocks_[i]->name()
+                   << "\".";
+        return;
+      }
+    }
+    succeeded_ = true;
+  }
+  // @}
+
+  // Adds a block to be written.
+  void AddBlock(const BlockGraph::Block* block) { blocks_.push_back(block); }
+
+  // @returns true if all of the blocks were successfully written.
+  bool succeeded() const { return succeeded_; }
+
+ private:
+  const PEFileWriter* writer_;
+  AbsoluteAddress image_base_;
+  size_t section_index_;
+  std::vector<uint8_t>* buffer_;
+  std::vector<const BlockGraph::Block*> blocks_;
+  bool succeeded_;
+
+  DISALLOW_COPY_AND_ASSIGN(SectionWriter);
+};
+
 PEFileWriter::PEFileWriter(const ImageLayout& image_layout)
     : image_layout_(image_layout), nt_headers_(NULL) {
 }
@@ -132,12 +209,6 @@ bool PEFileWriter::WriteImage(const base::FilePath& path) {
 
   nt_headers_ = NULL;
 
-  // Close the file.
-  file.reset();
-
-  if (success)
-    success = UpdateFileChecksum(path);
-
   return success;
 }
 
@@ -177,26 +248,44 @@ bool PEFileWriter::UpdateFileChecksum(const base::FilePath& path) {
     return false;
   }
 
-  // Calculate the image checksum.
-  DWORD original_checksum = 0;
-  DWORD new_checksum = 0;
-  IMAGE_NT_HEADERS* nt_headers = ::CheckSumMappedFile(image_ptr,
-                                                      file_size,
-                                                      &original_checksum,
-                                                      &new_checksum);
-
-  if (nt_headers == NULL) {
-    DWORD error = ::GetLastError();
-    LOG(ERROR) << "CheckSumMappedFile failed: " << common::LogWe(error);
-  }
+  bool success = UpdateImageChecksum(static_cast<uint8_t*>(image_ptr),
+                                     file_size);
+  CHECK(::UnmapViewOfFile(image_ptr));
+
+  return success;
+}
+
+bool PEFileWriter::UpdateImageChecksum(uint8_t* image, size_t image_size) {
+  DCHECK(image != NULL);
 
-  // On success, we write the checksum back to the file header.
-  if (nt_headers != NULL) {
-    nt_headers->OptionalHeader.CheckSum = new_checksum;
+  // Find and validate the headers.
+  if (image_size < sizeof(IMAGE_DOS_HEADER)) {
+    LOG(ERROR) << "Image too small to contain a DOS header.";
+    return false;
+  }
+  const IMAGE_DOS_HEADER* dos_header =
+      reinterpret_cast<const IMAGE_DOS_HEADER*>(image);
+  if (dos_header->e_magic != IMAGE_DOS_SIGNATURE ||
+      dos_header->e_lfanew < 0 ||
+      image_size < sizeof(IMAGE_NT_HEADERS) ||
+      static_cast<size_t>(dos_header->e_lfanew) >
+          image_size - sizeof(IMAGE_NT_HEADERS)) {
+    LOG(ERROR) << "Invalid DOS header.";
+    return false;
+  }
+  IMAGE_NT_HEADERS* nt_headers = reinterpret_cast<IMAGE_NT_HEADERS*>(
+      image + dos_header->e_lfanew);
+  if (nt_headers->Signature != IMAGE_NT_SIGNATURE) {
+    LOG(ERROR) << "Invalid NT headers.";
+    return false;
   }
-  CHECK(::UnmapViewOfFile(image_ptr));
 
-  return nt_headers != NULL;
+  // The checksum field isn't itself part of the checksum.
+  nt_headers->OptionalHeader.CheckSum = 0;
+  nt_headers->OptionalHeader.CheckSum =
+      CalculateImageChecksum(image, image_size);
+
+  return true;
 }
 
 bool PEFileWriter::ValidateHeaders() {
@@ -330,45 +419,62 @@ bool PEFileWriter::WriteBlocks(FILE* file) {
 
   AbsoluteAddress image_base(nt_headers_->OptionalHeader.ImageBase);
 
-  // Create the output buffer, reserving enough room for the whole file.
+  // Create the output buffer, sized to contain the whole file, and fill in
+  // the padding of each section up front. The blocks are then written
+  // directly to their final locations.
   DCHECK(!image_layout_.sections.empty());
   size_t last_section_index = image_layout_.sections.size() - 1;
-  size_t image_size = section_file_range_map_[last_section_index].end().value();
-  std::vector<uint8_t> buffer;
-  buffer.reserve(image_size);
-
-  // Iterate through all blocks in the address space writing them as we go.
+  size_t image_size = GetSectionFileRange(last_section_index).end().value();
+  std::vector<uint8_t> buffer(image_size);
+  FillPadding(BlockGraph::kInvalidSectionId, &buffer);
+  for (size_t i = 0; i < image_layout_.sections.size(); ++i)
+    FillPadding(i, &buffer);
+
+  // Iterate through all blocks in the address space, distributing them to
+  // the writer for their section.
   BlockGraph::AddressSpace::RangeMap::const_iterator block_it(
       image_layout_.blocks.address_space_impl().ranges().begin());
   BlockGraph::AddressSpace::RangeMap::const_iterator block_end(
       image_layout_.blocks.address_space_impl().ranges().end());
 
-  // Write all of the blocks. We take care of writing the padding at the
-  // end of each section. Note that the section index is not the same thing as
-  // the section_id stored in the block; the section IDs are relative to the
-  // section data stored in the block-graph, not the ordered section infos
-  // stored in the image layout.
+  // Note that the section index is not the same thing as the section_id
+  // stored in the block; the section IDs are relative to the section data
+  // stored in the block-graph, not the ordered section infos stored in the
+  // image layout.
+  ScopedVector<SectionWriter> section_writers;
   BlockGraph::SectionId section_id = BlockGraph::kInvalidSectionId;
   size_t section_index = BlockGraph::kInvalidSectionId;
+  section_writers.push_back(
+      new SectionWriter(this, image_base, section_index, &buffer));
   for (; block_it != block_end; ++block_it) {
-    BlockGraph::Block* block = const_cast<BlockGraph::Block*>(block_it->second);
+    const BlockGraph::Block* block = block_it->second;
 
-    // If we're jumping to a new section output the necessary padding.
+    // If we're jumping to a new section then start a new writer.
     if (block->section() != section_id) {
-      FlushSection(section_index, &buffer);
       section_id = block->section();
       section_index++;
       DCHECK_GT(image_layout_.sections.size(), section_index);
+      section_writers.push_back(
+          new SectionWriter(this, image_base, section_index, &buffer));
     }
 
-    if (!WriteOneBlock(image_base, section_index, block, &buffer)) {
-      LOG(ERROR) << "Failed to write block \"" << block->name() << "\".";
+    section_writers.back()->AddBlock(block);
+  }
+
+  // Write the sections. The sections occupy disjoint ranges of the buffer,
+  // so they can be written concurrently.
+  common::RunDelegatesOnThreadPool(
+      "PEFileWriter",
+      static_cast<size_t>(base::SysInfo::NumberOfProcessors()),
+      section_writers.get());
+  for (size_t i = 0; i < section_writers.size(); ++i) {
+    if (!section_writers[i]->succeeded())
       return false;
-    }
   }
 
-  FlushSection(last_section_index, &buffer);
-  DCHECK_EQ(image_size, buffer.size());
+  // Checksum the image while it's still in memory.
+  if (!UpdateImageChecksum(buffer.data(), buffer.size()))
+    return false;
 
   // Write the whole image to disk in one go.
   if (::fwrite(&buffer[0], sizeof(buffer[0]), buffer.size(), file) !=
@@ -380,29 +486,36 @@ bool PEFileWriter::WriteBlocks(FILE* file) {
   return true;
 }
 
-void PEFileWriter::FlushSection(size_t section_index,
-                                std::vector<uint8_t>* buffer) {
+void PEFileWriter::FillPadding(size_t section_index,
+                               std::vector<uint8_t>* buffer) const {
   DCHECK(buffer != NULL);
 
-  size_t section_file_end =
-      section_file_range_map_[section_index].end().value();
-
   // We've already sanity checked this in CalculateSectionFileRanges, so this
   // should be true.
-  DCHECK_GE(section_file_end, buffer->size());
-  if (section_file_end == buffer->size())
-    return;
+  const FileRange& section_file_range = GetSectionFileRange(section_index);
+  DCHECK_GE(buffer->size(), section_file_range.end().value());
 
   uint8_t padding_byte = GetSectionPaddingByte(image_layout_, section_index);
-  buffer->resize(section_file_end, padding_byte);
+  if (padding_byte == 0)
+    return;
 
-  return;
+  ::memset(buffer->data() + section_file_range.start().value(),
+           padding_byte,
+           section_file_range.size());
+}
+
+const PEFileWriter::FileRange& PEFileWriter::GetSectionFileRange(
+    size_t section_index) const {
+  SectionIndexFileRangeMap::const_iterator it =
+      section_file_range_map_.find(section_index);
+  DCHECK(it != section_file_range_map_.end());
+  return it->second;
 }
 
 bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
                                  size_t section_index,
                                  const BlockGraph::Block* block,
-                                 std::vector<uint8_t>* buffer) {
+                                 std::vector<uint8_t>* buffer) const {
   // This function walks through the data referred by the input block, and
   // patches it to reflect the addresses and offsets of the blocks
   // referenced before writing the block's data to the file.
@@ -415,11 +528,9 @@ bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
     return false;
   }
 
-  // Get the start address of the section containing this block as well as the
-  // padding byte we need to use.
+  // Get the start address of the section containing this block.
   RelativeAddress section_start(0);
   RelativeAddress section_end(image_layout_.sections[0].addr);
-  uint8_t padding_byte = GetSectionPaddingByte(image_layout_, section_index);
   if (section_index != BlockGraph::kInvalidSectionId) {
     const ImageLayout::SectionInfo& section_info =
         image_layout_.sections[section_index];
@@ -427,7 +538,7 @@ bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
     section_end = section_start + section_info.size;
   }
 
-  const FileRange& section_file_range = section_file_range_map_[section_index];
+  const FileRange& section_file_range = GetSectionFileRange(section_index);
 
   // The block should lie entirely within the section.
   if (addr < section_start || addr + block->size() > section_end) {
@@ -440,11 +551,6 @@ bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
   BlockGraph::Offset section_offs = addr - section_start;
   FileOffsetAddress file_offs = section_file_range.start() + section_offs;
 
-  // We shouldn't have written anything to the spot where the block belongs.
-  // This is only a DCHECK because the address space of the image layout and
-  // the consistency of the sections guarantees this for us.
-  DCHECK_LE(buffer->size(), file_offs.value());
-
   size_t inited_data_size = GetBlockInitializedDataSize(block);
 
   // If this block is entirely in the virtual portion of the section, skip it.
@@ -466,14 +572,11 @@ bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
     return false;
   }
 
-  // Add any necessary padding to get us to the block offset.
-  if (buffer->size() < file_offs.value())
-    buffer->resize(file_offs.value(), padding_byte);
-
-  // Copy the block data into the buffer.
-  buffer->insert(buffer->end(),
-                 block->data(),
-                 block->data() + block->data_size());
+  // Copy the block data into the buffer. The padding between blocks has
+  // already been written.
+  uint8_t* block_data = buffer->data() + file_offs.value();
+  if (block->data_size() > 0)
+    ::memcpy(block_data, block->data(), block->data_size());
 
   // We now want to append zeros for the implicit portion of the block data.
   size_t trailing_zeros = block->size() - block->data_size();
@@ -492,7 +595,7 @@ bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
     }
 
     // Write the implicit trailing zeros.
-    buffer->insert(buffer->end(), trailing_zeros, 0);
+    ::memset(block_data + block->data_size(), 0, trailing_zeros);
   }
 
   // Patch up all the references.
@@ -539,8 +642,7 @@ bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
         // Get the offset of the block in its section, as well as the range of
         // the section on disk. Validate that the referred location is
         // actually directly represented on disk (not in implicit virtual data).
-        const FileRange& file_range =
-            section_file_range_map_[dst_section_index];
+        const FileRange& file_range = GetSectionFileRange(dst_section_index);
         size_t section_offset = GetSectionOffset(image_layout_,
                                                  dst_addr,
                                                  dst_section_index);
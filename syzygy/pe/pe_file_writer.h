@@ -25,7 +25,9 @@
 namespace pe {
 
 // Given an address space and header information, writes a BlockGraph out
-// to a PE image file.
+// to a PE image file. The image is rendered into a buffer sized for the
+// whole file, with the sections being rendered concurrently. The checksum
+// is then computed on the buffer and the image is written in one go.
 class PEFileWriter {
  public:
   typedef block_graph::BlockGraph BlockGraph;
@@ -42,7 +44,21 @@ class PEFileWriter {
   // Updates the checksum for the image @p path.
   static bool UpdateFileChecksum(const base::FilePath& path);
 
+  // Updates the checksum of an image that is in memory, in its on-disk
+  // layout. This computes the same value as CheckSumMappedFile.
+  // @param image The image to update.
+  // @param image_size The size of @p image, in bytes.
+  // @returns true on success, false if @p image is not a valid PE image.
+  static bool UpdateImageChecksum(uint8_t* image, size_t image_size);
+
  protected:
+  // Renders the blocks of a single section into the image buffer. Used to
+  // render the sections concurrently.
+  class SectionWriter;
+
+  // A range of the image file.
+  typedef core::AddressRange<core::FileOffsetAddress, size_t> FileRange;
+
   // Validates the DOS header and the NT headers in the image.
   // On success, sets the nt_headers_ pointer.
   bool ValidateHeaders();
@@ -51,26 +67,29 @@ class PEFileWriter {
   // section_file_range_map_ and section_index_space_.
   bool CalculateSectionRanges();
 
-  // Writes the entire image to the given file. Delegates to FlushSection and
+  // Writes the entire image to the given file. Delegates to FillPadding and
   // WriteOneBlock.
   bool WriteBlocks(FILE* file);
 
-  // Closes off the writing of a section by adding any necessary padding to the
-  // output buffer.
-  void FlushSection(size_t section_index, std::vector<uint8_t>* buffer);
+  // Fills the file range of a section with its padding byte, the content of
+  // which depends on the section type.
+  void FillPadding(size_t section_index, std::vector<uint8_t>* buffer) const;
 
-  // Writes a single block to the buffer, first writing any necessary padding
-  // (the content of which depends on the section type), followed by the
-  // block data (containing finalized references).
+  // Writes a single block to its location in the buffer, which must already
+  // be sized to contain the whole image. This writes the block data
+  // (containing finalized references). This may be called concurrently for
+  // blocks in different sections.
   bool WriteOneBlock(AbsoluteAddress image_base,
                      size_t section_index,
                      const BlockGraph::Block* block,
-                     std::vector<uint8_t>* buffer);
+                     std::vector<uint8_t>* buffer) const;
+
+  // @returns the file range of the section with the given index.
+  const FileRange& GetSectionFileRange(size_t section_index) const;
 
   // The file ranges of each section. This is populated by
   // CalculateSectionRanges and is a map from section index (as ordered in
   // the image layout) to section ranges on disk.
-  typedef core::AddressRange<core::FileOffsetAddress, size_t> FileRange;
   typedef std::map<size_t, FileRange> SectionIndexFileRangeMap;
   SectionIndexFileRangeMap section_file_range_map_;
 
@@ -14,6 +14,8 @@
 
 #include "syzygy/pe/pe_file_writer.h"
 
+#include <imagehlp.h>  // NOLINT
+
 #include "base/path_service.h"
 #include "base/files/file_util.h"
 #include "gmock/gmock.h"
@@ -64,6 +66,16 @@ TEST_F(PEFileWriterTest, RewriteAndLoadImage) {
 
   ASSERT_TRUE(writer.WriteImage(temp_file));
   ASSERT_NO_FATAL_FAILURE(CheckTestDll(temp_file));
+
+  // The image should have been written with a valid checksum.
+  std::string contents;
+  ASSERT_TRUE(base::ReadFileToString(temp_file, &contents));
+  DWORD original_checksum = 0;
+  DWORD expected_checksum = 0;
+  ASSERT_TRUE(::CheckSumMappedFile(&contents[0], contents.size(),
+                                   &original_checksum,
+                                   &expected_checksum) != NULL);
+  EXPECT_EQ(expected_checksum, original_checksum);
 }
 
 TEST_F(PEFileWriterTest, UpdateFileChecksum) {
@@ -88,6 +100,37 @@ TEST_F(PEFileWriterTest, UpdateFileChecksum) {
   EXPECT_TRUE(PEFileWriter::UpdateFileChecksum(image_path));
 }
 
+TEST_F(PEFileWriterTest, UpdateImageChecksumMatchesCheckSumMappedFile) {
+  base::FilePath image_path(testing::GetExeRelativePath(testing::kTestDllName));
+  std::string contents;
+  ASSERT_TRUE(base::ReadFileToString(image_path, &contents));
+  std::vector<uint8_t> image(contents.begin(), contents.end());
+
+  // Try the full image, as well as images with a non-multiple of 4 size.
+  for (size_t trim = 0; trim < 4; ++trim) {
+    std::vector<uint8_t> trimmed(image.begin(), image.end() - trim);
+
+    DWORD original_checksum = 0;
+    DWORD expected_checksum = 0;
+    ASSERT_TRUE(::CheckSumMappedFile(trimmed.data(), trimmed.size(),
+                                     &original_checksum,
+                                     &expected_checksum) != NULL);
+
+    EXPECT_TRUE(PEFileWriter::UpdateImageChecksum(trimmed.data(),
+                                                  trimmed.size()));
+    const IMAGE_DOS_HEADER* dos_header =
+        reinterpret_cast<const IMAGE_DOS_HEADER*>(trimmed.data());
+    const IMAGE_NT_HEADERS* nt_headers =
+        reinterpret_cast<const IMAGE_NT_HEADERS*>(
+            trimmed.data() + dos_header->e_lfanew);
+    EXPECT_EQ(expected_checksum, nt_headers->OptionalHeader.CheckSum);
+  }
+
+  // Non-images should be rejected.
+  std::vector<uint8_t> zeros(16 * 1024);
+  EXPECT_FALSE(PEFileWriter::UpdateImageChecksum(zeros.data(), zeros.size()));
+}
+
 namespace {
 
 bool WriteImageLayout(const ImageLayout& image_layout,
@@ -107,7 +107,7 @@ PERelinker::PERelinker(const PETransformPolicy* pe_transform_policy)
     : PECoffRelinker(pe_transform_policy),
       pe_transform_policy_(pe_transform_policy),
       add_metadata_(true), augment_pdb_(true),
-      compress_pdb_(false), strip_strings_(false),
+      compress_pdb_(false), incremental_pdb_(false), strip_strings_(false),
       padding_(0), code_alignment_(1), output_guid_(GUID_NULL) {
   DCHECK(pe_transform_policy != NULL);
 }
@@ -231,7 +231,14 @@ bool PERelinker::Relink() {
   // Write the PDB file.
   LOG(INFO) << "Writing the PDB.";
   pdb::PdbWriter pdb_writer;
-  if (!pdb_writer.Write(output_pdb_path_, pdb_file)) {
+  bool written = false;
+  if (incremental_pdb_) {
+    written = pdb_writer.WriteIncremental(input_pdb_path_, output_pdb_path_,
+                                          pdb_file);
+  } else {
+    written = pdb_writer.Write(output_pdb_path_, pdb_file);
+  }
+  if (!written) {
     LOG(ERROR) << "Failed to write PDB file \"" << output_pdb_path_.value()
                << "\".";
     return false;
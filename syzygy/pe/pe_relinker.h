@@ -118,6 +118,7 @@ class PERelinker : public PECoffRelinker {
   bool add_metadata() const { return add_metadata_; }
   bool augment_pdb() const { return augment_pdb_; }
   bool compress_pdb() const { return compress_pdb_; }
+  bool incremental_pdb() const { return incremental_pdb_; }
   bool strip_strings() const { return strip_strings_; }
   size_t padding() const { return padding_; }
   size_t code_alignment() const { return code_alignment_; }
@@ -140,6 +141,9 @@ class PERelinker : public PECoffRelinker {
   void set_compress_pdb(bool compress_pdb) {
     compress_pdb_ = compress_pdb;
   }
+  void set_incremental_pdb(bool incremental_pdb) {
+    incremental_pdb_ = incremental_pdb;
+  }
   void set_strip_strings(bool strip_strings) {
     strip_strings_ = strip_strings;
   }
@@ -206,6 +210,9 @@ class PERelinker : public PECoffRelinker {
   // If true, then the augmented PDB stream will be compressed as it is written.
   // Defaults to false.
   bool compress_pdb_;
+  // If true, the output PDB is written by updating a copy of the input PDB,
+  // leaving the streams that weren't modified in place. Defaults to false.
+  bool incremental_pdb_;
   // If true, strings associated with a block-graph will not be serialized into
   // the PDB. Defaults to false.
   bool strip_strings_;
@@ -63,12 +63,10 @@ bool MinidumpProcessor::GenerateJsonOutput(FILE* file) {
   DCHECK_NE(static_cast<FILE*>(nullptr), file);
   DCHECK(processed_);
 
-  std::string out_str;
-  if (!crashdata::ToJson(true, &protobuf_value_, &out_str)) {
+  if (!crashdata::ToJson(true, &protobuf_value_, file)) {
     LOG(ERROR) << "Unable to convert the protobuf to JSON.";
     return false;
   }
-  ::fprintf(file, "%s", out_str.c_str());
   return true;
 }
 
@@ -43,6 +43,8 @@ const char kUsageFormatStr[] =
     "    --exclude-bb-padding  When randomly reordering basic blocks, exclude\n"
     "                          padding and unreachable code from the relinked\n"
     "                          output binary.\n"
+    "    --incremental-pdb     Write the output PDB by updating a copy of the\n"
+    "                          input PDB, only writing the modified streams.\n"
     "    --input-pdb=<path>    The PDB file associated with the input DLL.\n"
     "                          Default is inferred from input-image.\n"
     "    --no-augment-pdb      Indicates that the relinker should not augment\n"
@@ -124,6 +126,7 @@ bool RelinkApp::ParseCommandLine(const base::CommandLine* cmd_line) {
   order_file_path_ = AbsolutePath(cmd_line->GetSwitchValuePath("order-file"));
   no_augment_pdb_ = cmd_line->HasSwitch("no-augment-pdb");
   compress_pdb_ = cmd_line->HasSwitch("compress-pdb");
+  incremental_pdb_ = cmd_line->HasSwitch("incremental-pdb");
   no_strip_strings_ = cmd_line->HasSwitch("no-strip-strings");
   output_metadata_ = !cmd_line->HasSwitch("no-metadata");
   overwrite_ = cmd_line->HasSwitch("overwrite");
@@ -208,6 +211,7 @@ int RelinkApp::Run() {
   relinker.set_allow_overwrite(overwrite_);
   relinker.set_augment_pdb(!no_augment_pdb_);
   relinker.set_compress_pdb(compress_pdb_);
+  relinker.set_incremental_pdb(incremental_pdb_);
   relinker.set_strip_strings(!no_strip_strings_);
 
   // Initialize the relinker. This does the decomposition, etc.
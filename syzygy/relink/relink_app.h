@@ -35,6 +35,7 @@ class RelinkApp : public application::AppImplBase {
         code_alignment_(1),
         no_augment_pdb_(false),
         compress_pdb_(false),
+        incremental_pdb_(false),
         no_strip_strings_(false),
         output_metadata_(false),
         overwrite_(false),
@@ -69,6 +70,7 @@ class RelinkApp : public application::AppImplBase {
   size_t code_alignment_;
   bool no_augment_pdb_;
   bool compress_pdb_;
+  bool incremental_pdb_;
   bool no_strip_strings_;
   bool output_metadata_;
   bool overwrite_;
@@ -48,6 +48,7 @@ class TestRelinkApp : public RelinkApp {
   using RelinkApp::code_alignment_;
   using RelinkApp::no_augment_pdb_;
   using RelinkApp::compress_pdb_;
+  using RelinkApp::incremental_pdb_;
   using RelinkApp::no_strip_strings_;
   using RelinkApp::output_metadata_;
   using RelinkApp::overwrite_;
@@ -237,6 +238,7 @@ TEST_F(RelinkAppTest, ParseMinimalCommandLineWithOrderFile) {
   EXPECT_EQ(1, test_impl_.code_alignment_);
   EXPECT_FALSE(test_impl_.no_augment_pdb_);
   EXPECT_FALSE(test_impl_.compress_pdb_);
+  EXPECT_FALSE(test_impl_.incremental_pdb_);
   EXPECT_FALSE(test_impl_.no_strip_strings_);
   EXPECT_TRUE(test_impl_.output_metadata_);
   EXPECT_FALSE(test_impl_.overwrite_);
@@ -293,6 +295,7 @@ TEST_F(RelinkAppTest, ParseFullCommandLineWithInputSeedAndMetadata) {
                               base::StringPrintf("%d", code_alignment_));
   cmd_line_.AppendSwitch("no-augment-pdb");
   cmd_line_.AppendSwitch("compress-pdb");
+  cmd_line_.AppendSwitch("incremental-pdb");
   cmd_line_.AppendSwitch("no-strip-strings");
   cmd_line_.AppendSwitch("overwrite");
   cmd_line_.AppendSwitch("fuzz");
@@ -308,6 +311,7 @@ TEST_F(RelinkAppTest, ParseFullCommandLineWithInputSeedAndMetadata) {
   EXPECT_EQ(code_alignment_, test_impl_.code_alignment_);
   EXPECT_TRUE(test_impl_.no_augment_pdb_);
   EXPECT_TRUE(test_impl_.compress_pdb_);
+  EXPECT_TRUE(test_impl_.incremental_pdb_);
   EXPECT_TRUE(test_impl_.no_strip_strings_);
   EXPECT_TRUE(test_impl_.output_metadata_);
   EXPECT_TRUE(test_impl_.overwrite_);
@@ -86,6 +86,8 @@
         'laa.h',
         'metrics.cc',
         'metrics.h',
+        'thread_utils.cc',
+        'thread_utils.h',
         'toolchain.cc',
         'toolchain.h',
       ],
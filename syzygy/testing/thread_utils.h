@@ -0,0 +1,49 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Utilities for running concurrency and contention tests.
+
+#ifndef SYZYGY_TESTING_THREAD_UTILS_H_
+#define SYZYGY_TESTING_THREAD_UTILS_H_
+
+#include <memory>
+#include <vector>
+
+#include "base/threading/simple_thread.h"
+
+namespace testing {
+
+// Runs each of the given delegates on its own thread, and waits for all of
+// them to complete. The threads are all created before any of them is
+// started, so that the delegates run concurrently.
+// @param delegates The delegates to run.
+// @returns the number of timestamp counter cycles spent running them.
+uint64_t RunDelegatesConcurrently(
+    const std::vector<base::DelegateSimpleThread::Delegate*>& delegates);
+
+// Convenience overload for delegates that are owned by the caller.
+// @tparam DelegateType The type of the delegates, which must derive from
+//     base::DelegateSimpleThread::Delegate.
+template <typename DelegateType>
+uint64_t RunDelegatesConcurrently(
+    const std::vector<std::unique_ptr<DelegateType>>& delegates) {
+  std::vector<base::DelegateSimpleThread::Delegate*> raw_delegates;
+  for (const auto& delegate : delegates)
+    raw_delegates.push_back(delegate.get());
+  return RunDelegatesConcurrently(raw_delegates);
+}
+
+}  // namespace testing
+
+#endif  // SYZYGY_TESTING_THREAD_UTILS_H_
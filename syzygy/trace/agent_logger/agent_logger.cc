@@ -140,6 +140,10 @@ BOOL CALLBACK ReadProcessMemoryProc64(HANDLE process,
 AgentLogger::AgentLogger()
     : trace::common::Service(L"Logger"),
       destination_(NULL),
+      pending_writes_cv_(&pending_lock_),
+      pending_space_cv_(&pending_lock_),
+      writer_running_(false),
+      writer_stopping_(false),
       symbolize_stack_traces_(true) {
 }
 
@@ -148,16 +152,24 @@ AgentLogger::~AgentLogger() {
     ignore_result(Stop());
     ignore_result(Join());
   }
+  StopWriter();
 }
 
 bool AgentLogger::StartImpl() {
   LOG(INFO) << "Starting the logging service.";
 
-  if (!InitRpc())
+  if (!StartWriter())
     return false;
 
-  if (!StartRpc())
+  if (!InitRpc()) {
+    StopWriter();
     return false;
+  }
+
+  if (!StartRpc()) {
+    StopWriter();
+    return false;
+  }
 
   return true;
 }
@@ -173,10 +185,12 @@ bool AgentLogger::JoinImpl() {
   // this will simply ensure that all outstanding requests are handled. If
   // Stop has not been called, this will continue (i.e., block) handling events
   // until someone else calls Stop() in another thread.
-  if (!FinishRpc())
-    return false;
+  bool success = FinishRpc();
 
-  return true;
+  // No more messages can be received, write the pending ones.
+  StopWriter();
+
+  return success;
 }
 
 bool AgentLogger::AppendTrace(HANDLE process,
@@ -349,6 +363,91 @@ bool AgentLogger::CaptureRemoteTrace(HANDLE process,
 bool AgentLogger::Write(const base::StringPiece& message) {
   DCHECK(destination_ != NULL);
 
+  if (message.empty())
+    return true;
+
+  {
+    base::AutoLock auto_lock(pending_lock_);
+
+    // Wait for the writer thread to catch up when too many messages are
+    // pending, so that a client that outpaces it is throttled rather than
+    // growing the memory of the service. A message is always accepted when
+    // nothing is pending, however large it is.
+    while (writer_running_ && !pending_writes_.empty() &&
+           pending_writes_.size() + message.size() > kMaxPendingWritesSize) {
+      pending_space_cv_.Wait();
+    }
+
+    if (writer_running_) {
+      // Hand the message over to the writer thread. It only needs to be
+      // woken up if it's not already got some work to do.
+      bool was_empty = pending_writes_.empty();
+      message.AppendToString(&pending_writes_);
+      if (message[message.size() - 1] != '\n')
+        pending_writes_.push_back('\n');
+      if (was_empty)
+        pending_writes_cv_.Signal();
+      return true;
+    }
+  }
+
+  return WriteToDestination(message);
+}
+
+bool AgentLogger::StartWriter() {
+  DCHECK(!writer_running_);
+  writer_running_ = true;
+  writer_stopping_ = false;
+  if (!base::PlatformThread::Create(0, this, &writer_thread_)) {
+    LOG(ERROR) << "Failed to start the writer thread.";
+    writer_running_ = false;
+    return false;
+  }
+  return true;
+}
+
+void AgentLogger::StopWriter() {
+  {
+    base::AutoLock auto_lock(pending_lock_);
+    if (!writer_running_)
+      return;
+    writer_running_ = false;
+    writer_stopping_ = true;
+    pending_writes_cv_.Signal();
+    // The throttled RPC handlers write their messages themselves.
+    pending_space_cv_.Broadcast();
+  }
+
+  // The writer thread drains the pending messages before exiting.
+  base::PlatformThread::Join(writer_thread_);
+  DCHECK(pending_writes_.empty());
+}
+
+void AgentLogger::ThreadMain() {
+  base::PlatformThread::SetName("Syzygy Agent Logger Writer");
+
+  std::string data;
+  while (true) {
+    {
+      base::AutoLock auto_lock(pending_lock_);
+      while (pending_writes_.empty() && !writer_stopping_)
+        pending_writes_cv_.Wait();
+      if (pending_writes_.empty())
+        return;
+      data.swap(pending_writes_);
+      pending_space_cv_.Broadcast();
+    }
+
+    // Every message already ends with a newline, so this writes them as is.
+    if (!WriteToDestination(data))
+      LOG(ERROR) << "Failed to write " << data.size() << " bytes of messages.";
+    data.clear();
+  }
+}
+
+bool AgentLogger::WriteToDestination(const base::StringPiece& message) {
+  DCHECK(destination_ != NULL);
+
   if (message.empty())
     return true;
 
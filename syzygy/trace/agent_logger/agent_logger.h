@@ -23,6 +23,8 @@
 #include "base/message_loop/message_loop.h"
 #include "base/process/process.h"
 #include "base/strings/string_piece.h"
+#include "base/synchronization/condition_variable.h"
+#include "base/synchronization/lock.h"
 #include "base/threading/platform_thread.h"
 #include "syzygy/trace/common/service.h"
 #include "syzygy/trace/rpc/logger_rpc.h"
@@ -33,8 +35,18 @@ namespace agent_logger {
 // Implements the Logger interface (see "logger_rpc.idl").
 //
 // Note: The Logger expects to be the only RPC service running in the process.
-class AgentLogger : public trace::common::Service {
+//
+// While the service is running, messages are written to the destination file
+// by a dedicated thread, so that the RPC handlers don't block on file I/O. The
+// RPC handlers only block when the writer thread falls behind by more than
+// kMaxPendingWritesSize bytes, which throttles the clients.
+class AgentLogger : public trace::common::Service,
+                    public base::PlatformThread::Delegate {
  public:
+  // The number of bytes of messages that can be waiting for the writer
+  // thread before the RPC handlers wait for it to catch up.
+  static const size_t kMaxPendingWritesSize = 4 * 1024 * 1024;
+
   AgentLogger();
   virtual ~AgentLogger();
 
@@ -80,8 +92,10 @@ class AgentLogger : public trace::common::Service {
                           CONTEXT* context,
                           std::vector<uintptr_t>* trace_data);
 
-  // Write @p message to the log destination. Note that calls to this method
-  // are serialized using write_lock_.
+  // Write @p message to the log destination. While the service is running
+  // the message is queued, and written by the writer thread. Otherwise it is
+  // written immediately. Note that the writes are serialized using
+  // write_lock_.
   bool Write(const base::StringPiece& message);
 
   // Generate a minidump for the calling process.
@@ -135,6 +149,20 @@ class AgentLogger : public trace::common::Service {
   bool FinishRpc();  // This function is blocking.
   // @}
 
+  // @name Writer thread management functions.
+  // @{
+  bool StartWriter();
+  void StopWriter();  // Writes any pending message before returning.
+  // @}
+
+  // Implementation of base::PlatformThread::Delegate. This is the body of the
+  // writer thread.
+  void ThreadMain() override;
+
+  // Writes @p data to the log destination, appending a newline if it's
+  // missing. Calls to this method are serialized using write_lock_.
+  bool WriteToDestination(const base::StringPiece& data);
+
   // The file to which received log messages should be written. This must
   // remain valid for at least as long as the logger is valid. Writes to
   // the destination are serialized with lock_;
@@ -146,6 +174,29 @@ class AgentLogger : public trace::common::Service {
   // The lock used to serializes writes to destination_;
   base::Lock write_lock_;
 
+  // The lock under which the messages are handed over to the writer thread.
+  base::Lock pending_lock_;
+
+  // The messages waiting to be written by the writer thread. Under
+  // pending_lock_.
+  std::string pending_writes_;
+
+  // Signaled when messages are queued, or when the writer thread must stop.
+  // Under pending_lock_.
+  base::ConditionVariable pending_writes_cv_;
+
+  // Signaled when the writer thread takes the pending messages, or when it
+  // stops accepting messages. Under pending_lock_.
+  base::ConditionVariable pending_space_cv_;
+
+  // True while the writer thread is accepting messages, and when it has been
+  // asked to stop. Under pending_lock_.
+  bool writer_running_;
+  bool writer_stopping_;
+
+  // The handle to the writer thread.
+  base::PlatformThreadHandle writer_thread_;
+
   // The lock used to serialize access to the debug help library used to
   // symbolize traces.
   base::Lock symbol_lock_;
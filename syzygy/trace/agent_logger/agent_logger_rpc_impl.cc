@@ -235,6 +235,66 @@ boolean LoggerService_SaveMinidumpWithProtobufAndMemoryRanges(
   return true;
 }
 
+boolean LoggerService_WriteBatch(
+    /* [in] */ handle_t binding,
+    /* [in] */ unsigned long message_count,
+    /* [size_is][in] */ const byte text[],
+    /* [in] */ unsigned long text_length,
+    /* [size_is][in] */ const unsigned long trace_lengths[],
+    /* [size_is][in] */ const uintptr_t trace_data[],
+    /* [in] */ unsigned long trace_data_length) {
+  if (binding == NULL || text == NULL || trace_lengths == NULL ||
+      trace_data == NULL) {
+    LOG(ERROR) << "Invalid input parameter(s).";
+    return false;
+  }
+
+  // The caller's process is only needed to symbolize the stack traces.
+  ProcessId pid = 0;
+  ScopedHandle handle;
+  if (trace_data_length != 0 && !GetClientInfo(binding, &pid, &handle))
+    return false;
+
+  // Get the logger instance.
+  AgentLogger* instance = RpcLoggerInstanceManager::GetInstance();
+
+  // Build the log messages, and write them all at once.
+  const char* cursor = reinterpret_cast<const char*>(text);
+  const char* text_end = cursor + text_length;
+  const uintptr_t* trace = trace_data;
+  const uintptr_t* trace_end = trace_data + trace_data_length;
+  std::string messages;
+  for (unsigned long i = 0; i < message_count; ++i) {
+    const char* message_end =
+        static_cast<const char*>(::memchr(cursor, 0, text_end - cursor));
+    if (message_end == nullptr ||
+        trace_lengths[i] > static_cast<size_t>(trace_end - trace)) {
+      LOG(ERROR) << "Malformed batch of log messages.";
+      return false;
+    }
+
+    std::string message(cursor, message_end);
+    if (trace_lengths[i] != 0 &&
+        !instance->AppendTrace(handle.Get(), trace, trace_lengths[i],
+                               &message)) {
+      return false;
+    }
+    if (!message.empty() && message.back() != '\n')
+      message.push_back('\n');
+    messages.append(message);
+
+    cursor = message_end + 1;
+    trace += trace_lengths[i];
+  }
+
+  // Write the log messages.
+  if (!instance->Write(messages))
+    return false;
+
+  // And we're done.
+  return true;
+}
+
 // RPC endpoint.
 unsigned long LoggerService_GetProcessId(/* [in] */ handle_t binding) {
   return ::GetCurrentProcessId();
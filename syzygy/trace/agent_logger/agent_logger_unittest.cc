@@ -300,6 +300,33 @@ TEST_F(LoggerTest, Write) {
   EXPECT_EQ(expected_contents, contents);
 }
 
+TEST_F(LoggerTest, WriteMoreThanPendingLimit) {
+  // Write enough to exceed the pending limit several times over. The writes
+  // are throttled, rather than dropped.
+  const size_t kLineSize = 64 * 1024;
+  const size_t kLineCount =
+      3 * AgentLogger::kMaxPendingWritesSize / kLineSize + 1;
+  std::string expected_contents;
+  for (size_t i = 0; i < kLineCount; ++i) {
+    std::string line(kLineSize - 1, static_cast<char>('a' + i % 26));
+    line.push_back('\n');
+    ASSERT_TRUE(logger_.Write(line));
+    expected_contents += line;
+  }
+
+  // Stop the logger.
+  ASSERT_TRUE(logger_.Stop());
+  ASSERT_NO_FATAL_FAILURE(WaitForLoggerToFinish());
+
+  // Close the log file.
+  log_file_.reset(NULL);
+
+  // Every message should have been written, in order.
+  std::string contents;
+  ASSERT_TRUE(base::ReadFileToString(log_file_path_, &contents));
+  EXPECT_EQ(expected_contents, contents);
+}
+
 TEST_F(LoggerTest, RpcWrite) {
   // Connect to the logger over RPC.
   ScopedRpcBinding rpc_binding;
@@ -374,6 +401,70 @@ TEST_F(LoggerTest, RpcWriteWithStack) {
   ASSERT_TRUE(TextContainsKnownStack(text, line_1));
 }
 
+TEST_F(LoggerTest, RpcWriteBatch) {
+  // Connect to the logger over RPC.
+  ScopedRpcBinding rpc_binding;
+  std::wstring endpoint(
+      GetInstanceString(kLoggerRpcEndpointRoot, instance_id_));
+  ASSERT_TRUE(rpc_binding.Open(kLoggerRpcProtocol, endpoint));
+
+  HANDLE process = ::GetCurrentProcess();
+  std::vector<uintptr_t> trace_data;
+  ASSERT_NO_FATAL_FAILURE(ExecuteCallbackWithKnownStack(base::Bind(
+      &LoggerTest::DoCaptureRemoteTrace,
+      base::Unretained(this),
+      process,
+      &trace_data)));
+
+  // Build a batch with the stack trace attached to the second message.
+  std::string text(kLine1);
+  text.push_back('\0');
+  text.append(kLine2);
+  text.push_back('\0');
+  text.append(kLine3);
+  text.push_back('\0');
+  unsigned long trace_lengths[] = {
+      0, static_cast<unsigned long>(trace_data.size()), 0 };
+
+  // Write to and stop the logger via RPC.
+  ASSERT_TRUE(LoggerClient_WriteBatch(
+      rpc_binding.Get(), arraysize(trace_lengths),
+      reinterpret_cast<const byte*>(text.data()),
+      static_cast<unsigned long>(text.size()), trace_lengths,
+      trace_data.data(), static_cast<unsigned long>(trace_data.size())));
+
+  // A batch whose trace lengths don't add up is rejected.
+  trace_lengths[2] = 1;
+  ASSERT_FALSE(LoggerClient_WriteBatch(
+      rpc_binding.Get(), arraysize(trace_lengths),
+      reinterpret_cast<const byte*>(text.data()),
+      static_cast<unsigned long>(text.size()), trace_lengths,
+      trace_data.data(), static_cast<unsigned long>(trace_data.size())));
+
+  ASSERT_TRUE(LoggerClient_Stop(rpc_binding.Get()));
+  ASSERT_TRUE(rpc_binding.Close());
+
+  // Wait for the logger to finish shutting down.
+  EXPECT_NO_FATAL_FAILURE(WaitForLoggerToFinish());
+
+  // Close the log file.
+  log_file_.reset(NULL);
+
+  // Read in the log contents.
+  std::string contents;
+  ASSERT_TRUE(base::ReadFileToString(log_file_path_, &contents));
+
+  // The messages are in order, and only the second one has a stack trace.
+  EXPECT_EQ(0u, contents.find(kLine1));
+  size_t line_2 = contents.find(kLine2);
+  ASSERT_NE(std::string::npos, line_2);
+  EXPECT_TRUE(TextContainsKnownStack(contents, line_2));
+  size_t line_3 = contents.find(kLine3, line_2);
+  ASSERT_NE(std::string::npos, line_3);
+  EXPECT_EQ(contents.size(), line_3 + ::strlen(kLine3));
+  EXPECT_FALSE(TextContainsKnownStack(contents, line_3));
+}
+
 TEST_F(LoggerTest, RpcWriteWithContext) {
   // Connect to the logger over RPC.
   ScopedRpcBinding rpc_binding;
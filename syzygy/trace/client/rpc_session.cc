@@ -31,6 +31,9 @@ RpcSession::RpcSession()
     : rpc_binding_(NULL),
       session_handle_(NULL),
       flags_(0),
+      buffer_ring_(NULL),
+      buffer_ring_handle_(NULL),
+      buffer_ring_event_(NULL),
       is_disabled_(false) {
 }
 
@@ -38,6 +41,82 @@ RpcSession::~RpcSession() {
   FreeSharedMemory();
 }
 
+void RpcSession::SetUpBufferRing() {
+  DCHECK(IsTracing());
+  DCHECK(buffer_ring_ == NULL);
+
+  CallTraceBuffer ring_info = {};
+  unsigned long event = 0;
+  if (!::common::rpc::InvokeRpc(CallTraceClient_GetBufferRing, session_handle_,
+                                &ring_info, &event).succeeded()) {
+    LOG(WARNING) << "Failed to get the buffer ring, exchanging buffers "
+                 << "through RPC calls.";
+    return;
+  }
+
+  HANDLE ring_handle = reinterpret_cast<HANDLE>(ring_info.shared_memory_handle);
+  void* base_ptr = NULL;
+  if (ring_info.buffer_offset == 0 &&
+      ring_info.buffer_size >= sizeof(trace::rpc::BufferRing)) {
+    base_ptr = ::MapViewOfFile(ring_handle, FILE_MAP_WRITE, 0, 0,
+                               ring_info.buffer_size);
+    if (base_ptr == NULL) {
+      DWORD error = ::GetLastError();
+      LOG(WARNING) << "Failed to map the buffer ring: "
+                   << ::common::LogWe(error) << ".";
+    }
+  } else {
+    LOG(WARNING) << "Received an invalid buffer ring.";
+  }
+
+  if (base_ptr == NULL) {
+    ignore_result(::CloseHandle(ring_handle));
+    ignore_result(::CloseHandle(reinterpret_cast<HANDLE>(event)));
+    return;
+  }
+
+  base::AutoLock scoped_lock(buffer_ring_lock_);
+  buffer_ring_ = reinterpret_cast<trace::rpc::BufferRing*>(base_ptr);
+  buffer_ring_handle_ = ring_handle;
+  buffer_ring_event_ = reinterpret_cast<HANDLE>(event);
+}
+
+bool RpcSession::ExchangeBufferThroughRing(TraceFileSegment* segment) {
+  DCHECK(segment != NULL);
+
+  {
+    base::AutoLock scoped_lock(buffer_ring_lock_);
+    if (buffer_ring_ == NULL)
+      return false;
+
+    // Only commit the full buffer if a fresh one is available, and if there
+    // is room for it. Otherwise the RPC call will take care of both.
+    if (trace::rpc::GetQueueSize(buffer_ring_->free) == 0 ||
+        trace::rpc::GetQueueSize(buffer_ring_->full) >=
+            trace::rpc::BufferRing::kCapacity) {
+      return false;
+    }
+
+    CallTraceBuffer fresh_buffer = {};
+    if (!trace::rpc::PopBuffer(&buffer_ring_->free, &fresh_buffer))
+      return false;
+    bool pushed = trace::rpc::PushBuffer(segment->buffer_info,
+                                         &buffer_ring_->full);
+    DCHECK(pushed);
+    segment->buffer_info = fresh_buffer;
+  }
+
+  // Let the service know that there's a full buffer to pick up. This doesn't
+  // wait for the service.
+  if (!::SetEvent(buffer_ring_event_)) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to signal the buffer ring event: "
+               << ::common::LogWe(error) << ".";
+  }
+
+  return true;
+}
+
 bool RpcSession::MapSegmentBuffer(TraceFileSegment* segment) {
   DCHECK(segment != NULL);
 
@@ -126,6 +205,8 @@ bool RpcSession::CreateSession(TraceFileSegment* segment) {
     return false;
   }
 
+  SetUpBufferRing();
+
   return true;
 }
 
@@ -171,6 +252,10 @@ bool RpcSession::ExchangeBuffer(TraceFileSegment* segment) {
   DCHECK(IsTracing());
   DCHECK(segment != NULL);
 
+  // Avoid the round trip to the service whenever possible.
+  if (ExchangeBufferThroughRing(segment))
+    return MapSegmentBuffer(segment);
+
   bool succeeded =
       ::common::rpc::InvokeRpc(CallTraceClient_ExchangeBuffer, session_handle_,
                                &segment->buffer_info).succeeded();
@@ -199,6 +284,18 @@ bool RpcSession::CloseSession() {
 }
 
 void RpcSession::FreeSharedMemory() {
+  {
+    base::AutoLock scoped_lock(buffer_ring_lock_);
+    if (buffer_ring_ != NULL) {
+      ignore_result(::UnmapViewOfFile(buffer_ring_));
+      ignore_result(::CloseHandle(buffer_ring_handle_));
+      ignore_result(::CloseHandle(buffer_ring_event_));
+      buffer_ring_ = NULL;
+      buffer_ring_handle_ = NULL;
+      buffer_ring_event_ = NULL;
+    }
+  }
+
   base::AutoLock scoped_lock_(shared_memory_lock_);
 
   if (shared_memory_handles_.empty())
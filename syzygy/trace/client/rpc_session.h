@@ -23,6 +23,7 @@
 #include "base/synchronization/lock.h"
 #include "syzygy/trace/client/client_utils.h"
 #include "syzygy/trace/protocol/call_trace_defs.h"
+#include "syzygy/trace/rpc/buffer_ring.h"
 
 namespace trace {
 namespace client {
@@ -75,6 +76,16 @@ class RpcSession {
   // Map a tracefile segment buffer into local memory.
   bool MapSegmentBuffer(TraceFileSegment* segment);
 
+  // Gets and maps the buffer ring of the session. Failing to do so is not an
+  // error, as the buffers can still be exchanged through RPC calls.
+  void SetUpBufferRing();
+
+  // Exchanges a buffer through the buffer ring, without mapping the new one.
+  // @param segment the segment whose buffer is to be exchanged.
+  // @returns true on success, false if the buffer must be exchanged through
+  //     an RPC call instead.
+  bool ExchangeBufferThroughRing(TraceFileSegment* segment);
+
   // The call trace RPC binding.
   handle_t rpc_binding_;
 
@@ -95,6 +106,17 @@ class RpcSession {
   base::Lock shared_memory_lock_;
   SharedMemoryHandleMap shared_memory_handles_;
 
+  // The buffer ring shared with the service, its mapping handle and the event
+  // to signal after pushing full buffers to it. The ring is only used if
+  // the service provides one. The client threads exchanging buffers through
+  // the ring are serialized by buffer_ring_lock_, which makes the client the
+  // single producer of the full buffers and the single consumer of the free
+  // ones.
+  base::Lock buffer_ring_lock_;
+  trace::rpc::BufferRing* buffer_ring_;
+  HANDLE buffer_ring_handle_;
+  HANDLE buffer_ring_event_;
+
   // This becomes true if the client fails to attach to a call trace service.
   // This is used to allow the application to run even if no call trace
   // service is available.
@@ -0,0 +1,64 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/rpc/buffer_ring.h"
+
+#include "base/logging.h"
+
+namespace trace {
+namespace rpc {
+
+uint32_t GetQueueSize(const BufferRing::Queue& queue) {
+  // The indices wrap around, which the unsigned difference accounts for.
+  uint32_t head = base::subtle::Acquire_Load(&queue.head);
+  uint32_t tail = base::subtle::Acquire_Load(&queue.tail);
+  return tail - head;
+}
+
+bool PushBuffer(const ::CallTraceBuffer& buffer, BufferRing::Queue* queue) {
+  DCHECK_NE(static_cast<BufferRing::Queue*>(nullptr), queue);
+
+  // Only the producer writes the tail, so it can be read without a barrier.
+  uint32_t tail = base::subtle::NoBarrier_Load(&queue->tail);
+  uint32_t head = base::subtle::Acquire_Load(&queue->head);
+  if (tail - head >= BufferRing::kCapacity)
+    return false;
+
+  // Publish the entry before making it visible to the consumer.
+  queue->entries[tail % BufferRing::kCapacity] = buffer;
+  base::subtle::Release_Store(&queue->tail, tail + 1);
+
+  return true;
+}
+
+bool PopBuffer(BufferRing::Queue* queue, ::CallTraceBuffer* buffer) {
+  DCHECK_NE(static_cast<BufferRing::Queue*>(nullptr), queue);
+  DCHECK_NE(static_cast<::CallTraceBuffer*>(nullptr), buffer);
+
+  // Only the consumer writes the head, so it can be read without a barrier.
+  uint32_t head = base::subtle::NoBarrier_Load(&queue->head);
+  uint32_t tail = base::subtle::Acquire_Load(&queue->tail);
+  uint32_t size = tail - head;
+  if (size == 0 || size > BufferRing::kCapacity)
+    return false;
+
+  // Copy the entry out before making its slot available to the producer.
+  *buffer = queue->entries[head % BufferRing::kCapacity];
+  base::subtle::Release_Store(&queue->head, head + 1);
+
+  return true;
+}
+
+}  // namespace rpc
+}  // namespace trace
@@ -0,0 +1,83 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the BufferRing structure, which lives in memory shared between a
+// call trace client and the call trace service, and lets them exchange
+// buffers without an RPC round trip.
+
+#ifndef SYZYGY_TRACE_RPC_BUFFER_RING_H_
+#define SYZYGY_TRACE_RPC_BUFFER_RING_H_
+
+#include <stdint.h>
+
+#include "base/atomicops.h"
+#include "syzygy/trace/rpc/call_trace_rpc.h"
+
+namespace trace {
+namespace rpc {
+
+// A BufferRing holds two single-producer single-consumer queues of buffer
+// descriptors. Full buffers are pushed by the client and popped by the
+// service, and free buffers are pushed by the service and popped by the
+// client. A client with several threads must serialize its accesses to the
+// ring.
+//
+// The ring is only an accelerator: when a queue is empty or full, the buffers
+// are exchanged through the RPC interface as usual.
+struct BufferRing {
+  // The number of entries of each queue.
+  static const uint32_t kCapacity = 32;
+
+  struct Queue {
+    // The number of entries that have been popped. Only written by the
+    // consumer.
+    volatile base::subtle::Atomic32 head;
+    // The number of entries that have been pushed. Only written by the
+    // producer.
+    volatile base::subtle::Atomic32 tail;
+    // The entries, indexed modulo kCapacity.
+    ::CallTraceBuffer entries[kCapacity];
+  };
+
+  // The full buffers, produced by the client.
+  Queue full;
+  // The free buffers, produced by the service.
+  Queue free;
+};
+
+// Gets the number of entries in a queue of a buffer ring. This can be called
+// by the producer or the consumer of @p queue.
+// @param queue The queue to inspect.
+// @returns the number of entries in @p queue. This exceeds kCapacity if the
+//     other side of the ring is misbehaving.
+uint32_t GetQueueSize(const BufferRing::Queue& queue);
+
+// Pushes a buffer descriptor to a queue of a buffer ring. This must only be
+// called by the producer of @p queue.
+// @param buffer The buffer descriptor to push.
+// @param queue The queue to push to.
+// @returns true on success, false if the queue is full or corrupt.
+bool PushBuffer(const ::CallTraceBuffer& buffer, BufferRing::Queue* queue);
+
+// Pops a buffer descriptor from a queue of a buffer ring. This must only be
+// called by the consumer of @p queue.
+// @param queue The queue to pop from.
+// @param buffer Receives the buffer descriptor.
+// @returns true on success, false if the queue is empty or corrupt.
+bool PopBuffer(BufferRing::Queue* queue, ::CallTraceBuffer* buffer);
+
+}  // namespace rpc
+}  // namespace trace
+
+#endif  // SYZYGY_TRACE_RPC_BUFFER_RING_H_
@@ -34,8 +34,13 @@
         'prefix': 'CallTrace',
       },
       'includes': ['../../build/midl_rpc.gypi'],
-      'sources': ['call_trace_rpc.idl'],
+      'sources': [
+        'buffer_ring.cc',
+        'buffer_ring.h',
+        'call_trace_rpc.idl',
+      ],
       'dependencies': [
+        '<(src)/base/base.gyp:base',
         '<(src)/syzygy/common/rpc/rpc.gyp:common_rpc_lib',
         '<(src)/syzygy/trace/protocol/protocol.gyp:protocol_lib',
       ],
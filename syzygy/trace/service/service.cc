@@ -516,6 +516,10 @@ bool Service::CommitAndExchangeBuffer(SessionHandle session_handle,
     return false;
   DCHECK(session.get() != NULL);
 
+  // The buffers committed through the buffer ring, if any, were committed
+  // before this one.
+  session->DrainBufferRing();
+
   Buffer* buffer = NULL;
   if (!session->FindBuffer(call_trace_buffer, &buffer))
     return false;
@@ -553,6 +557,28 @@ bool Service::CommitAndExchangeBuffer(SessionHandle session_handle,
   return result;
 }
 
+// RPC entry point.
+bool Service::GetBufferRing(SessionHandle session_handle,
+                            CallTraceBuffer* buffer_ring,
+                            unsigned long* event) {
+  if (session_handle == NULL || buffer_ring == NULL || event == NULL) {
+    LOG(WARNING) << "Invalid RPC parameters.";
+    return false;
+  }
+
+  scoped_refptr<Session> session;
+  if (!GetExistingSession(session_handle, &session))
+    return false;
+  DCHECK(session.get() != NULL);
+
+  HANDLE client_event = NULL;
+  if (!session->GetBufferRing(buffer_ring, &client_event))
+    return false;
+
+  *event = reinterpret_cast<unsigned long>(client_event);
+  return true;
+}
+
 // RPC entry-point.
 bool Service::CloseSession(SessionHandle* session_handle) {
   if (session_handle == NULL || *session_handle == NULL) {
@@ -197,6 +197,12 @@ class Service {
   // See call_trace_rpc.idl for further info.
   bool CloseSession(SessionHandle* session_handle);
 
+  // RPC implementation of CallTraceService::GetBufferRing().
+  // See call_trace_rpc.idl for further info.
+  bool GetBufferRing(SessionHandle session_handle,
+                     CallTraceBuffer* buffer_ring,
+                     unsigned long* event);
+
   // Decrement the active session count.
   // @see num_active_sessions_
   void RemoveOneActiveSession();
@@ -84,6 +84,15 @@ boolean CallTraceService_CloseSession(
   return true;
 }
 
+// RPC entrypoint for CallTraceService::GetBufferRing().
+boolean CallTraceService_GetBufferRing(
+    /* [in] */ SessionHandle session_handle,
+    /* [out] */ CallTraceBuffer* buffer_ring,
+    /* [out] */ unsigned long* event) {
+  Service* instance = RpcServiceInstanceManager::GetInstance();
+  return instance->GetBufferRing(session_handle, buffer_ring, event);
+}
+
 // RPC entrypoint for CallTraceControl::Stop().
 boolean CallTraceService_Stop(/* [in] */ handle_t /* binding */) {
   Service* instance = RpcServiceInstanceManager::GetInstance();
@@ -24,6 +24,7 @@
 
 #include <time.h>
 #include <memory>
+#include <utility>
 
 #include "base/command_line.h"
 #include "base/logging.h"
@@ -44,6 +45,11 @@ namespace {
 
 using base::ProcessId;
 
+// The number of free buffers that are kept in a buffer ring. This is enough
+// for the client to swap buffers while the service picks up the full ones,
+// without taking too many buffers away from the RPC requests.
+const uint32_t kFreeBuffersInRing = 4;
+
 // Helper for logging Buffer::ID values.
 std::ostream& operator << (std::ostream& stream, const Buffer::ID& buffer_id) {
   return stream << "shared_memory_handle=0x" << std::hex << buffer_id.first
@@ -59,6 +65,8 @@ Session::Session(Service* call_trace_service)
       buffer_requests_waiting_for_recycle_(0),
       buffer_is_available_(&lock_),
       buffer_id_(0),
+      buffer_ring_(NULL),
+      buffer_ring_wait_(NULL),
       input_error_already_logged_(false) {
   DCHECK(call_trace_service != NULL);
   ::memset(buffer_state_counts_, 0, sizeof(buffer_state_counts_));
@@ -76,6 +84,13 @@ Session::~Session() {
   DCHECK_EQ(0u, buffer_state_counts_[Buffer::kInUse]);
   DCHECK_EQ(0u, buffer_state_counts_[Buffer::kPendingWrite]);
 
+  // The buffer ring is no longer picked up once the session is closed.
+  DCHECK(buffer_ring_wait_ == NULL);
+  if (buffer_ring_ != NULL) {
+    ::UnmapViewOfFile(buffer_ring_);
+    buffer_ring_ = NULL;
+  }
+
   // Not strictly necessary, but let's make sure nothing refers to the
   // client buffers before we delete the underlying memory.
   buffers_.clear();
@@ -110,6 +125,23 @@ bool Session::Init(ProcessId client_process_id) {
 }
 
 bool Session::Close() {
+  // Stop picking up the buffers pushed to the buffer ring, waiting for any
+  // pick up in progress to complete, then pick up the remaining ones so that
+  // they are written before the buffers flushed below. The free buffers left
+  // in the ring are still in use, so they are flushed as well.
+  HANDLE buffer_ring_wait = NULL;
+  {
+    base::AutoLock lock(lock_);
+    std::swap(buffer_ring_wait, buffer_ring_wait_);
+  }
+  if (buffer_ring_wait != NULL &&
+      !::UnregisterWaitEx(buffer_ring_wait, INVALID_HANDLE_VALUE)) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to unregister the buffer ring wait: "
+               << ::common::LogWe(error) << ".";
+  }
+  DrainBufferRing();
+
   std::vector<Buffer*> buffers;
   base::AutoLock lock(lock_);
 
@@ -270,6 +302,144 @@ bool Session::RecycleBuffer(Buffer* buffer) {
   return true;
 }
 
+bool Session::GetBufferRing(::CallTraceBuffer* buffer_ring,
+                            HANDLE* client_event) {
+  DCHECK(buffer_ring != NULL);
+  DCHECK(client_event != NULL);
+
+  base::AutoLock lock(lock_);
+
+  if (is_closing_) {
+    LOG(ERROR) << "Session is closing but someone is trying to get a buffer "
+               << "ring.";
+    return false;
+  }
+
+  if (buffer_ring_handle_.IsValid()) {
+    LOG(ERROR) << "The buffer ring of the session was already requested.";
+    return false;
+  }
+
+  // Create the shared memory holding the ring, and the event used by the
+  // client to signal the full buffers.
+  const size_t kBufferRingSize = sizeof(trace::rpc::BufferRing);
+  buffer_ring_handle_.Set(::CreateFileMapping(
+      NULL, NULL, PAGE_READWRITE, 0, kBufferRingSize, NULL));
+  if (!buffer_ring_handle_.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to allocate buffer ring: " << ::common::LogWe(error)
+               << ".";
+    return false;
+  }
+
+  buffer_ring_event_.Set(::CreateEvent(NULL, FALSE, FALSE, NULL));
+  if (!buffer_ring_event_.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to create buffer ring event: "
+               << ::common::LogWe(error) << ".";
+    return false;
+  }
+
+  buffer_ring_ = reinterpret_cast<trace::rpc::BufferRing*>(::MapViewOfFile(
+      buffer_ring_handle_.Get(), FILE_MAP_WRITE, 0, 0, kBufferRingSize));
+  if (buffer_ring_ == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to map buffer ring: " << ::common::LogWe(error)
+               << ".";
+    return false;
+  }
+
+  HANDLE client_ring_handle = NULL;
+  if (!CopyBufferHandleToClient(client_.process_handle.Get(),
+                                buffer_ring_handle_.Get(),
+                                &client_ring_handle) ||
+      !CopyBufferHandleToClient(client_.process_handle.Get(),
+                                buffer_ring_event_.Get(),
+                                client_event)) {
+    return false;
+  }
+
+  // Pick up the full buffers whenever the client signals them.
+  if (!::RegisterWaitForSingleObject(&buffer_ring_wait_,
+                                     buffer_ring_event_.Get(),
+                                     &Session::OnBufferRingSignaled,
+                                     this,
+                                     INFINITE,
+                                     WT_EXECUTEDEFAULT)) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to register the buffer ring wait: "
+               << ::common::LogWe(error) << ".";
+    buffer_ring_wait_ = NULL;
+    return false;
+  }
+
+  FillBufferRingUnlocked();
+
+  buffer_ring->shared_memory_handle =
+      reinterpret_cast<unsigned long>(client_ring_handle);
+  buffer_ring->mapping_size = kBufferRingSize;
+  buffer_ring->buffer_offset = 0;
+  buffer_ring->buffer_size = kBufferRingSize;
+
+  return true;
+}
+
+void CALLBACK Session::OnBufferRingSignaled(void* session,
+                                            BOOLEAN /* timed_out */) {
+  DCHECK(session != NULL);
+  Session* self = static_cast<Session*>(session);
+
+  self->DrainBufferRing();
+
+  base::AutoLock lock(self->lock_);
+  if (!self->is_closing_)
+    self->FillBufferRingUnlocked();
+}
+
+void Session::DrainBufferRing() {
+  base::AutoLock drain_lock(buffer_ring_drain_lock_);
+
+  // Pop the full buffers under the lock, which makes the service the single
+  // consumer of the ring.
+  std::vector<::CallTraceBuffer> full_buffers;
+  {
+    base::AutoLock lock(lock_);
+    if (is_closing_ || buffer_ring_ == NULL)
+      return;
+
+    ::CallTraceBuffer full_buffer = {};
+    while (trace::rpc::PopBuffer(&buffer_ring_->full, &full_buffer))
+      full_buffers.push_back(full_buffer);
+  }
+
+  // Return them exactly as if the client had called ReturnBuffer.
+  for (size_t i = 0; i < full_buffers.size(); ++i) {
+    Buffer* buffer = NULL;
+    if (!FindBuffer(&full_buffers[i], &buffer))
+      continue;
+    DCHECK(buffer != NULL);
+    if (!ReturnBuffer(buffer))
+      LOG(ERROR) << "Unable to return buffer from the buffer ring.";
+  }
+}
+
+void Session::FillBufferRingUnlocked() {
+  lock_.AssertAcquired();
+  DCHECK(buffer_ring_ != NULL);
+
+  // The clients waiting for a buffer to be recycled get the available buffers
+  // first.
+  while (!buffers_available_.empty() &&
+         buffer_requests_waiting_for_recycle_ == 0 &&
+         trace::rpc::GetQueueSize(buffer_ring_->free) < kFreeBuffersInRing) {
+    Buffer* buffer = buffers_available_.front();
+    if (!trace::rpc::PushBuffer(*buffer, &buffer_ring_->free))
+      break;
+    buffers_available_.pop_front();
+    ChangeBufferState(Buffer::kInUse, buffer);
+  }
+}
+
 void Session::ChangeBufferState(BufferState new_state, Buffer* buffer) {
   DCHECK(buffer != NULL);
   DCHECK(buffer->session == this);
@@ -27,6 +27,7 @@
 #include "base/synchronization/condition_variable.h"
 #include "base/synchronization/lock.h"
 #include "base/win/scoped_handle.h"
+#include "syzygy/trace/rpc/buffer_ring.h"
 #include "syzygy/trace/service/buffer_consumer.h"
 #include "syzygy/trace/service/buffer_pool.h"
 #include "syzygy/trace/service/process_info.h"
@@ -90,6 +91,22 @@ class Session : public base::RefCountedThreadSafe<Session> {
   // @returns true on success, false otherwise.
   bool RecycleBuffer(Buffer* buffer);
 
+  // Creates the buffer ring of this session, through which the client can
+  // exchange buffers without RPC calls, and fills it with free buffers. The
+  // full buffers pushed to the ring are picked up on a thread pool thread
+  // when the client signals the ring's event.
+  // @param buffer_ring will be populated with the description of the shared
+  //     memory holding the ring, valid in the client process.
+  // @param client_event will be set to the handle of the event to be signaled
+  //     by the client, valid in the client process.
+  // @returns true on success, false otherwise.
+  bool GetBufferRing(::CallTraceBuffer* buffer_ring, HANDLE* client_event);
+
+  // Returns the full buffers pushed to the buffer ring, if any, to the
+  // session. This must be called before returning a buffer committed through
+  // RPC, so that the buffers are written in the order they were committed.
+  void DrainBufferRing();
+
   // Locates the local record of the given call trace buffer.  The session
   // retains ownership of the buffer object, it MUST not be deleted by the
   // caller.
@@ -209,6 +226,18 @@ class Session : public base::RefCountedThreadSafe<Session> {
   // @pre Under lock_.
   bool CreateProcessEndedEvent(Buffer** buffer);
 
+  // Invoked on a thread pool thread when the client signals the buffer ring
+  // event.
+  // @param session the session owning the buffer ring.
+  // @param timed_out unused.
+  static void CALLBACK OnBufferRingSignaled(void* session, BOOLEAN timed_out);
+
+  // Hands over available buffers to the client through the buffer ring. This
+  // never allocates nor waits for buffers, so that back-pressure still applies
+  // to the clients falling back to RPC calls.
+  // @pre Under lock_.
+  void FillBufferRingUnlocked();
+
   // Returns true if the buffer book-keeping is self-consistent.
   // @pre Under lock_.
   bool BufferBookkeepingIsConsistent() const;
@@ -258,6 +287,21 @@ class Session : public base::RefCountedThreadSafe<Session> {
   // state.
   base::Lock lock_;
 
+  // The shared memory holding the buffer ring, and its local mapping. These
+  // are only set if the client requested the ring.
+  base::win::ScopedHandle buffer_ring_handle_;  // Under lock_.
+  trace::rpc::BufferRing* buffer_ring_;  // Under lock_.
+
+  // The event signaled by the client after pushing full buffers to the ring,
+  // and the registered wait on it. The wait is unregistered when the session
+  // closes.
+  base::win::ScopedHandle buffer_ring_event_;  // Under lock_.
+  HANDLE buffer_ring_wait_;  // Under lock_.
+
+  // This lock serializes the draining of the buffer ring, so that its buffers
+  // are returned in order. It must be acquired before lock_.
+  base::Lock buffer_ring_drain_lock_;
+
   // Tracks whether or not invalid input errors have already been logged.
   // When an error of this type occurs, there will typically be numerous
   // follow-on occurrences that we don't want to log.
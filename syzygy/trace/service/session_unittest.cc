@@ -576,5 +576,59 @@ TEST_F(SessionTest, LargeBufferRequestAvoidsBackPressure) {
   ASSERT_EQ(buffer3, session->last_singleton_buffer_destroyed_);
 }
 
+TEST_F(SessionTest, BufferRingExchangesBuffers) {
+  ASSERT_TRUE(call_trace_service_.Start(true));
+
+  TestSessionPtr session = call_trace_service_.CreateTestSession();
+  ASSERT_TRUE(session != NULL);
+
+  // Get a first buffer. This allocates a second one, which is left available.
+  Buffer* buffer1 = NULL;
+  ASSERT_TRUE(session->GetNextBuffer(&buffer1));
+  ASSERT_TRUE(buffer1 != NULL);
+
+  // The buffer ring can only be requested once.
+  ::CallTraceBuffer ring_info = {};
+  HANDLE event = NULL;
+  ASSERT_TRUE(session->GetBufferRing(&ring_info, &event));
+  EXPECT_TRUE(event != NULL);
+  EXPECT_EQ(0u, ring_info.buffer_offset);
+  EXPECT_LE(sizeof(rpc::BufferRing), ring_info.buffer_size);
+  ASSERT_FALSE(session->GetBufferRing(&ring_info, &event));
+
+  // Map the ring as the client would. The handles are not duplicated by the
+  // test session, so they must not be closed here.
+  rpc::BufferRing* ring = reinterpret_cast<rpc::BufferRing*>(::MapViewOfFile(
+      reinterpret_cast<HANDLE>(ring_info.shared_memory_handle), FILE_MAP_WRITE,
+      0, 0, ring_info.buffer_size));
+  ASSERT_TRUE(ring != NULL);
+
+  // The available buffer has been handed over through the ring.
+  ASSERT_EQ(1u, rpc::GetQueueSize(ring->free));
+  ::CallTraceBuffer free_buffer = {};
+  ASSERT_TRUE(rpc::PopBuffer(&ring->free, &free_buffer));
+  Buffer* buffer2 = NULL;
+  ASSERT_TRUE(session->FindBuffer(&free_buffer, &buffer2));
+  EXPECT_EQ(Buffer::kInUse, buffer2->state);
+
+  // Commit the first buffer through the ring. It's picked up by the session
+  // and scheduled for writing.
+  ASSERT_TRUE(rpc::PushBuffer(*buffer1, &ring->full));
+  session->DrainBufferRing();
+  EXPECT_EQ(0u, rpc::GetQueueSize(ring->full));
+  EXPECT_EQ(Buffer::kPendingWrite, buffer1->state);
+
+  // The ring is left empty, as no more buffers are available.
+  EXPECT_EQ(0u, rpc::GetQueueSize(ring->free));
+  ASSERT_TRUE(rpc::PushBuffer(free_buffer, &ring->full));
+  session->DrainBufferRing();
+  EXPECT_EQ(Buffer::kPendingWrite, buffer2->state);
+
+  EXPECT_TRUE(::UnmapViewOfFile(ring));
+
+  ASSERT_TRUE(session->Close());
+  session->AllowBuffersToBeRecycled(9999);
+}
+
 }  // namespace service
 }  // namespace trace
@@ -21,8 +21,10 @@
 // functionality would require some refactoring.
 //
 // Changes that are required to be made to the PE file are represented by an
-// address space, mapping replacement data to file offsets. This address-space
-// can then be simply 'stamped' on to the PE file to be modified.
+// address space, mapping replacement data to file offsets. The PE file is read
+// into memory once; the static parts of it are hashed straight from that
+// buffer, and the address-space is then simply 'stamped' on to it before
+// the checksum is updated and the image is written out in one go.
 //
 // The matching PDB file is completely rewritten to guarantee that it is
 // canonical (as long as the underlying PdbWriter doesn't change). We load all
@@ -286,15 +288,10 @@ bool Md5Consume(size_t bytes, FILE* file, base::MD5Context* context) {
   return true;
 }
 
-bool UpdateFileInPlace(const base::FilePath& path,
-                       const PatchAddressSpace& updates) {
-  LOG(INFO) << "Patching file: " << path.value();
-
-  base::ScopedFILE file(base::OpenFile(path, "rb+"));
-  if (file.get() == NULL) {
-    LOG(ERROR) << "Unable to open file for updating: " << path.value();
-    return false;
-  }
+// Applies the given updates to an in-memory copy of a file.
+bool PatchBuffer(const PatchAddressSpace& updates,
+                 std::vector<uint8_t>* buffer) {
+  DCHECK(buffer != NULL);
 
   PatchAddressSpace::const_iterator it = updates.begin();
   for (; it != updates.end(); ++it) {
@@ -303,29 +300,18 @@ bool UpdateFileInPlace(const base::FilePath& path,
     if (it->second.data == NULL)
       continue;
 
-    LOG(INFO) << "  Patching " << it->second.name << ", " << it->first.size()
-              << " bytes at " << it->first.start();
-
-    // Seek to the position to be updated.
-    if (::fseek(file.get(), it->first.start().value(), SEEK_SET) != 0) {
-      LOG(ERROR) << "Failed to seek to " << it->first.start()
-                 << " of file: " << path.value();
+    if (it->first.end().value() > buffer->size()) {
+      LOG(ERROR) << "Patch " << it->second.name << " at " << it->first.start()
+                 << " lies beyond the end of the file.";
       return false;
     }
 
-    // Write the updated data.
-    size_t bytes_written =
-        ::fwrite(it->second.data, 1, it->first.size(), file.get());
-    if (bytes_written != it->first.size()) {
-      LOG(ERROR) << "Failed to write " << it->first.size() << " bytes to "
-                 << "position " << it->first.start()
-                 << " of file: " << path.value();
-    }
+    LOG(INFO) << "  Patching " << it->second.name << ", " << it->first.size()
+              << " bytes at " << it->first.start();
+    ::memcpy(buffer->data() + it->first.start().value(), it->second.data,
+             it->first.size());
   }
 
-  LOG(INFO) << "Finished patching file: " << path.value();
-  file.reset();
-
   return true;
 }
 
@@ -520,6 +506,9 @@ bool ZapTimestamp::Init() {
   if (!MarkPeFileRanges())
     return false;
 
+  if (!ReadPeFile())
+    return false;
+
   if (!input_pdb_.empty()) {
     if (!CalculatePdbGuid())
       return false;
@@ -768,62 +757,66 @@ bool ZapTimestamp::MarkPeFileRanges() {
   return true;
 }
 
-bool ZapTimestamp::CalculatePdbGuid() {
-  DCHECK(!input_pdb_.empty());
-
-  LOG(INFO) << "Calculating PDB GUID from PE file contents.";
+bool ZapTimestamp::ReadPeFile() {
+  DCHECK(pe_image_data_.empty());
 
-  base::ScopedFILE pe_file(base::OpenFile(input_image_, "rb"));
-  if (pe_file.get() == NULL) {
-    LOG(ERROR) << "Failed to open PE file for reading: "
-               << input_image_.value();
+  int64_t file_size = 0;
+  if (!base::GetFileSize(input_image_, &file_size)) {
+    LOG(ERROR) << "Failed to get size of PE file: " << input_image_.value();
     return false;
   }
 
-  // Get the length of the entire file.
-  if (::fseek(pe_file.get(), 0, SEEK_END) != 0) {
-    LOG(ERROR) << "Failed to fseek to end of file.";
+  pe_image_data_.resize(static_cast<size_t>(file_size));
+  if (file_size > 0 &&
+      base::ReadFile(input_image_,
+                     reinterpret_cast<char*>(pe_image_data_.data()),
+                     pe_image_data_.size()) !=
+          static_cast<int>(pe_image_data_.size())) {
+    LOG(ERROR) << "Failed to read PE file: " << input_image_.value();
     return false;
   }
-  FileOffsetAddress end(::ftell(pe_file.get()));
 
-  // Seek back to the beginning.
-  if (::fseek(pe_file.get(), 0, SEEK_SET) != 0) {
-    LOG(ERROR) << "Failed to fseek to beginning of file.";
-    return false;
-  }
+  return true;
+}
+
+bool ZapTimestamp::CalculatePdbGuid() {
+  DCHECK(!input_pdb_.empty());
+
+  LOG(INFO) << "Calculating PDB GUID from PE file contents.";
+
+  const char* data = reinterpret_cast<const char*>(pe_image_data_.data());
+  FileOffsetAddress end(pe_image_data_.size());
 
   // Initialize the MD5 structure.
   base::MD5Context md5_context = {0};
   base::MD5Init(&md5_context);
 
-  // We seek through the bits of the file that will be changed, and skip those.
-  // The rest of the file (the static parts) are fed through an MD5 hash and
-  // used to generated a unique and stable GUID.
+  // We skip the bits of the file that will be changed. The rest of the file
+  // (the static parts) are fed through an MD5 hash in a single pass, and used
+  // to generate a unique and stable GUID.
   FileOffsetAddress cur(0);
   PatchAddressSpace::const_iterator range_it = pe_file_addr_space_.begin();
   for (; range_it != pe_file_addr_space_.end(); ++range_it) {
-    // Consume any data before this range.
-    if (cur < range_it->first.start()) {
-      size_t bytes_to_hash = range_it->first.start() - cur;
-      if (!Md5Consume(bytes_to_hash, pe_file.get(), &md5_context))
-        return false;  // This logs verbosely for us.
+    if (range_it->first.end() > end) {
+      LOG(ERROR) << "Marked range " << range_it->second.name
+                 << " lies beyond the end of the PE file.";
+      return false;
     }
 
-    if (::fseek(pe_file.get(), range_it->first.size(), SEEK_CUR)) {
-      LOG(ERROR) << "Failed to fseek past marked range.";
+    // Consume any data before this range.
+    if (cur < range_it->first.start()) {
+      base::MD5Update(&md5_context,
+                      base::StringPiece(data + cur.value(),
+                                        range_it->first.start() - cur));
     }
 
     cur = range_it->first.end();
   }
 
   // Consume any left-over data.
-  if (cur < end) {
-    if (!Md5Consume(end - cur, pe_file.get(), &md5_context))
-      return false;  // This logs verbosely for us.
-  }
-
-  DCHECK_EQ(end.value(), static_cast<uint32_t>(::ftell(pe_file.get())));
+  if (cur < end)
+    base::MD5Update(&md5_context, base::StringPiece(data + cur.value(),
+                                                    end - cur));
 
   static_assert(sizeof(base::MD5Digest) == sizeof(pdb_guid_data_),
                 "MD5Digest and GUID size mismatch.");
@@ -908,25 +901,31 @@ bool ZapTimestamp::LoadAndUpdatePdbFile() {
 }
 
 bool ZapTimestamp::WritePeFile() {
-  if (core::CompareFilePaths(input_image_, output_image_) !=
-      core::kEquivalentFilePaths) {
-    if (::CopyFileW(input_image_.value().c_str(), output_image_.value().c_str(),
-                    FALSE) == FALSE) {
-      LOG(ERROR) << "Failed to write output image: %s" << output_image_.value();
-      return false;
-    }
-  }
+  LOG(INFO) << "Patching PE file: " << output_image_.value();
 
-  if (!UpdateFileInPlace(output_image_, pe_file_addr_space_))
+  // Patch a copy of the image in memory, and update its checksum.
+  std::vector<uint8_t> output_data(pe_image_data_);
+  if (!PatchBuffer(pe_file_addr_space_, &output_data))
     return false;
 
   LOG(INFO) << "Updating checksum for PE file: " << output_image_.value();
-  if (!pe::PEFileWriter::UpdateFileChecksum(output_image_)) {
+  if (!pe::PEFileWriter::UpdateImageChecksum(output_data.data(),
+                                             output_data.size())) {
     LOG(ERROR) << "Failed to update checksum for PE file: "
                << output_image_.value();
     return false;
   }
 
+  // Write the whole image in one go. This works for both in place and out of
+  // place updates, as the input image has already been read in its entirety.
+  if (base::WriteFile(output_image_,
+                      reinterpret_cast<const char*>(output_data.data()),
+                      output_data.size()) !=
+          static_cast<int>(output_data.size())) {
+    LOG(ERROR) << "Failed to write output image: " << output_image_.value();
+    return false;
+  }
+
   return true;
 }
 
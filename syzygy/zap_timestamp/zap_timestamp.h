@@ -18,6 +18,8 @@
 #ifndef SYZYGY_ZAP_TIMESTAMP_ZAP_TIMESTAMP_H_
 #define SYZYGY_ZAP_TIMESTAMP_ZAP_TIMESTAMP_H_
 
+#include <vector>
+
 #include "base/files/file_path.h"
 #include "base/strings/string_piece.h"
 #include "syzygy/block_graph/block_graph.h"
@@ -112,6 +114,10 @@ class ZapTimestamp {
   // Paints the regions of the PE file that need to be modified.
   bool MarkPeFileRanges();
 
+  // Reads the contents of the PE file into memory. After this pe_image_data_
+  // has been initialized.
+  bool ReadPeFile();
+
   // Calculates a PDB GUID using the non-changing parts of the PE file.
   bool CalculatePdbGuid();
 
@@ -133,6 +139,10 @@ class ZapTimestamp {
   // Populated by MarkPeFileRanges.
   PatchAddressSpace pe_file_addr_space_;
 
+  // The contents of the PE file. Populated by ReadPeFile. This is used to
+  // calculate the PDB GUID and is patched in memory when writing the image.
+  std::vector<uint8_t> pe_image_data_;
+
   // Populated by LoadPdbFile and modified by UpdatePdbFile.
   std::unique_ptr<pdb::PdbFile> pdb_file_;
 